@@ -1,15 +1,33 @@
 #include <iostream>
-#include <unistd.h>
-#include <cerrno>
+#include <cstdlib>
 #include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <functional>
+#include <deque>
+
+#include "rcci_async_client.h"
 
-#include "rcci_client.h"
+// log callbacks come from run(), it returns at least this often
+static const int cRunTimeoutMs(100);
+
+// Log text waiting for output, or a lost range (from < to) to read again
+typedef struct log_part_s {
+    uint64_t    from, to;
+    std::string text;
+} log_part_t;
 
 int main(int argc, char *argv[])
 {
-    rcciClient client;
-    std::string logStr;
+    rcciAsyncClient client;
     int logEntryCounts = -1;
+    bool wasConnected = false, logSynced = false, failed = false;
+    uint64_t nextOffset = 0;
+    // live log received after a lost range waits until the range is read
+    std::deque<log_part_t> pending;
+    bool fetching = false;
+    std::function<void(uint64_t, uint64_t)> fetchLost;
+    std::function<void(void)> flushPending;
 
     if(argc < 3)
     {
@@ -18,45 +36,145 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    if(client.connect(std::string(argv[1]), atoi(argv[2])) < 0)
-    {
-        std::cerr << "Can not connect to server" << std::endl;
-        return -1;
-    }
-
     if(argc == 4)
     {
         logEntryCounts = atoi(argv[3]);
     }
 
-    if(client.logConnect(logStr) < 0)
+    // lost connection is not fatal - client reconnects and the log
+    // continues where it stopped
+    client.setStateCb([&](rcciAsyncClient::rcci_async_state_t state)
+        {
+            if(state == rcciAsyncClient::rcci_async_connected)
+            {
+                wasConnected = true;
+            }
+            else if((state == rcciAsyncClient::rcci_async_backoff) &&
+                    wasConnected)
+            {
+                std::cerr << "<=========== Connection lost, reconnecting "
+                    "===========>" << std::endl;
+                wasConnected = false;
+            }
+        });
+
+    // print what is pending up to the next lost range and start reading it
+    flushPending = [&](void)
+        {
+            while(!pending.empty() && !fetching)
+            {
+                log_part_t &part = pending.front();
+
+                if(part.from < part.to)
+                {
+                    fetching = true;
+                    fetchLost(part.from, part.to);
+                    break;
+                }
+
+                std::cout << part.text;
+                if(logEntryCounts > 0)
+                {
+                    logEntryCounts--;
+                }
+                pending.pop_front();
+            }
+        };
+
+    // lost range written or abandoned - continue with the live log after it
+    auto lostDone = [&](const char *note)
+        {
+            std::cerr << note << std::endl;
+            fetching = false;
+            pending.pop_front();
+            flushPending();
+        };
+
+    // read the lost part (datagrams lost in the network) again over TCP
+    fetchLost = [&](uint64_t from, uint64_t to)
+        {
+            int retVal = client.logFetch(from, to - from,
+                [&, to](int status, const std::string &text,
+                        uint64_t start, uint64_t)
+                {
+                    if((status < 0) || (start >= to))
+                    {
+                        lostDone("<=== end of lost log ===>");
+                        return;
+                    }
+                    // start is later than asked if the server did not keep it
+                    std::cout << text.substr(0, to - start);
+                    uint64_t next = start + std::min((uint64_t)text.length(),
+                                                     to - start);
+                    if(text.empty() || (next >= to))
+                    {
+                        lostDone("<=== end of lost log ===>");
+                        return;
+                    }
+                    fetchLost(next, to);
+                });
+            if(retVal < 0)
+            {
+                lostDone("<=== lost log not read, not connected ===>");
+            }
+        };
+
+    client.setLogCb([&](const std::string &text, uint64_t offset)
+        {
+            if(logSynced && (offset < nextOffset))
+            {
+                std::cerr << "<=========== Server restarted ============>"
+                          << std::endl;
+            }
+            else if(logSynced && (offset > nextOffset))
+            {
+                std::cerr << "<=== log lost: bytes " << nextOffset << " - "
+                          << offset << " ===>" << std::endl;
+                pending.push_back(log_part_t{nextOffset, offset, std::string()});
+            }
+            nextOffset = offset + text.length();
+            logSynced  = true;
+
+            pending.push_back(log_part_t{0, 0, text});
+            flushPending();
+        });
+
+    if(client.open(std::string(argv[1]), atoi(argv[2])) < 0)
     {
-        std::cerr << "logConnect() failed" << std::endl;
-        client.disconnect();
+        std::cerr << "Can not resolve " << argv[1] << std::endl;
         return -1;
     }
 
-    std::cerr << "<=========== Logging started ============>" << std::endl;
-    std::cerr << logStr;
+    // history first, done is called before it is received
+    client.logEnable(true, 0, [&](int status)
+        {
+            if(status == -EACCES)
+            {
+                std::cerr << "Log registration denied" << std::endl;
+                failed = true;
+                return;
+            }
+            if(status < 0)
+            {
+                std::cerr << "Log registration failed: " << strerror(-status)
+                          << ", retrying" << std::endl;
+                return;
+            }
+            std::cerr << "<=========== Logging started ============>"
+                      << std::endl;
+        });
 
-    while((logEntryCounts != 0))
+    while((logEntryCounts != 0) && !failed)
     {
-        ssize_t bytes = client.logReadData(logStr);
-        if(bytes < 0)
+        if(client.run(cRunTimeoutMs) < 0)
         {
-            std::cerr << "Error reading from log server: " <<
-                strerror(errno) << std::endl;
+            std::cerr << "Error reading from log server" << std::endl;
             break;
         }
-        if(logEntryCounts > 0)
-        {
-            logEntryCounts--;
-        }
-        std::cout << logStr;
     }
 
-    client.logDisconnect();
-    client.disconnect();
+    client.logDisable();
+    client.close();
 
-    return 0;
+    return failed ? -1 : 0;
 }
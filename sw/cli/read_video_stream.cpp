@@ -1,204 +1,153 @@
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <time.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <errno.h>
-#include <vector>
+#include <time.h>
 #include <iostream>
+#include <vector>
+#include <algorithm>
 
-#include "rcci_type.h"
+#include "rcci_video_rx.h"
+#include "rcci_client.h"
 
-const int cMaxFrameSize = (640*480*3);
+const size_t cLatencyReport(100); // frames per latency summary
 
-typedef struct rcc_rx_frame_s
+static int64_t monotonicUs(void)
 {
-    int size_frame; // full frame size (taken from header.size)
-    int cnt_frame; // frame count
-    int num_all_msgs; // how many all messages
-    int num_rx_msgs; // number of receiver messages
-    int frame[cMaxFrameSize];
-
-    rcc_rx_frame_s(void)
-        : cnt_frame(-1), num_all_msgs(-1), num_rx_msgs(-1)
-    {
-
-    };
-} rcc_rx_frame_t;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
 
-std::vector<rcc_rx_frame_t> rxFrames;
+// Glass-to-glass latency is capture (V4L2 timestamp on the car) to frame
+// complete here, both on the car clock - needs offset from syncClock()
+static void printLatency(std::vector<int64_t> &lat)
+{
+    std::sort(lat.begin(), lat.end());
+    std::cout << "latency [ms] p50=" << lat[lat.size() / 2] / 1000.0
+              << " p99=" << lat[(lat.size() * 99) / 100] / 1000.0
+              << " max=" << lat.back() / 1000.0 << std::endl;
+    lat.clear();
+}
 
 int main(int argc, char *argv[])
 {
-    struct sockaddr_in addr;
-    int fd, nbytes,addrlen;
-    struct ip_mreq mreq;
-    rcci_msg_vframe_t videoFrame;
-
+    rcciVideoRx videoRx;
+    rcciClient client;
+    rcciVideoRx::rcci_video_rx_stats_t stats, lastStats;
+    std::vector<int64_t> latency;
+    bool clockSynced = false;
+    int frameCnt = 0;
     int port;
-    u_int yes=1;            /*** MODIFICATION TO ORIGINAL */
 
-    if(argc != 3)
+    if((argc != 3) && (argc != 4))
     {
-        fprintf(stderr, "Usage: %s <hostname> <port>\n", argv[0]);
-        return -1;
-    }
-    /* create what looks like an ordinary UDP socket */
-    if ((fd=socket(AF_INET,SOCK_DGRAM,0)) < 0) {
-        perror("socket");
+        fprintf(stderr, "Usage: %s <hostname> <port> [unicast|<daemon_port>]\n"
+                "  multicast stream port or rcc_daemon port with 'unicast',\n"
+                "  rcc_daemon port for multicast stream latency measurement\n",
+                argv[0]);
         return -1;
     }
 
     port = (int)strtod(argv[2], NULL);
 
-    /* allow multiple sockets to use the same PORT number */
-    if (setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&yes,sizeof(yes)) < 0) {
-        perror("Reusing ADDR failed");
-        return -1;;
+    if((argc == 4) && (std::string(argv[3]) == "unicast"))
+    {
+        // register to video service of rcc_daemon
+        if((client.connect(argv[1], port) < 0) ||
+           (videoRx.attachSocket(client.videoConnect()) < 0))
+        {
+            fprintf(stderr, "Can not connect to video service of %s:%d\n",
+                    argv[1], port);
+            return -1;
+        }
     }
-
-    /* set up destination address */
-    memset(&addr,0,sizeof(addr));
-    addr.sin_family=PF_INET;
-    addr.sin_addr.s_addr=htonl(INADDR_ANY); /* N.B.: differs from sender */
-    addr.sin_port=htons(port);
-
-    /* bind to receive address */
-    if (bind(fd,(struct sockaddr *) &addr,sizeof(addr)) < 0) {
-        perror("bind");
-        return -1;;
+    else if(videoRx.openSocket(port) < 0)
+    {
+        return -1;
     }
-
-    /* use setsockopt() to request that the kernel join a multicast group */
-    mreq.imr_multiaddr.s_addr=inet_addr("226.0.0.1");
-    mreq.imr_interface.s_addr=htonl(INADDR_ANY);
-    if (setsockopt(fd,IPPROTO_IP,IP_ADD_MEMBERSHIP,&mreq,sizeof(mreq)) < 0) {
-        perror("setsockopt");
-        return -1;;
+    else if((argc == 4) &&
+            (client.connect(argv[1], (int)strtod(argv[3], NULL)) < 0))
+    {
+        fprintf(stderr, "Can not connect to %s:%s\n", argv[1], argv[3]);
+        return -1;
     }
 
-    /* now just enter a read-print loop */
-    const int maxBufLen = rcci_msg_vframe_max_packet_size;
-    int frameCnt = 0;
-    printf("maxBufLen=%d\n", maxBufLen);
-    rxFrames.resize(0);
-
-    while (1) {
-        while(true)
+    if(client.isConnected())
+    {
+        int rtt = client.syncClock();
+        if(rtt >= 0)
         {
-            addrlen=sizeof(addr);
+            clockSynced = true;
+            std::cout << "Clock offset " << client.serverClockOffset()
+                      << " us (RTT " << rtt << " us)" << std::endl;
+        }
+    }
 
-            if((nbytes=recvfrom(fd,&videoFrame, maxBufLen, 0,
-                                (struct sockaddr *) &addr,
-                                (socklen_t *)&addrlen)) < 0) {
-                perror("recvfrom");
-                return -1;;
-            }
+    videoRx.setFrameCb(
+        [&](const uint8_t *data, size_t size,
+            const rcciVideoRx::rcci_video_frame_t &info)
+        {
+            char fout_str[64];
+            sprintf((char *)&fout_str[0], "/tmp/image%03d.jpg", frameCnt++);
 
-            if((videoFrame.header.magic == rcci_msg_init_magic))
+            if(clockSynced && (info.flags & rcci_vframe_flag_capture))
             {
-                // search if we have frame in the structure already
-                std::vector<rcc_rx_frame_t>::iterator it;
-                /* Valid frame check if we have already thig count */
-                std::cout << "Reciving frame number " << (int)videoFrame.cnt_frame
-                          << " ( " << (int)(videoFrame.cur_msg+1) << " / "
-                          << (int)videoFrame.all_msgs << " )"
-                          << " frame_size=" << videoFrame.header.size
-                          << " cur_ptr=" << videoFrame.idx_frame
-                          << " cur_size=" << videoFrame.size_frame << std::endl;
-
-                for(it = rxFrames.begin(); it != rxFrames.end(); it++)
-                {
-                    if(it->cnt_frame == (int)videoFrame.cnt_frame)
-                    {
-                        if(it->size_frame == (int)videoFrame.header.size)
-                        {
-                            break;
-                        }
-                        else
-                        {
-                            // somethings wrong - cnt matches but not size
-                            std::cerr
-                                << "Counter matches but not size"
-                                << ", deleting old frame!" << std::endl;
-                            rxFrames.erase(it);
-                            it = rxFrames.end();
-                            break;
-                        }
-                    }
-                }
-
-                // not found so create new one
-                if(it == rxFrames.end())
+                int64_t lat = monotonicUs() + client.serverClockOffset() -
+                    (int64_t)info.captureUs;
+                latency.push_back(lat);
+                printf("Dumping frame=%u v2 (size=%zu, latency=%.1f ms), "
+                       "dumping to %s\n", info.seq, size, lat / 1000.0,
+                       fout_str);
+                if(latency.size() >= cLatencyReport)
                 {
-                    rcc_rx_frame_t rxFrame;
-                    rxFrame.size_frame = videoFrame.header.size;
-                    rxFrame.cnt_frame = videoFrame.cnt_frame;
-                    rxFrame.num_all_msgs = videoFrame.all_msgs;
-                    rxFrame.num_rx_msgs = 0;
-                    rxFrames.push_back(rxFrame);
-                    it = --rxFrames.end();
-                    std::cout << "New frame (cnt=" << rxFrame.cnt_frame
-                              << " num_msgs=" << rxFrame.num_all_msgs
-                              << " size=" << rxFrame.size_frame
-                              << " )" << std::endl;
+                    printLatency(latency);
                 }
+            }
+            else
+            {
+                printf("Dumping frame=%u v%d (size=%zu), dumping to %s\n",
+                       info.seq, (info.version == rcci_msg_video_v2) ? 2 : 1,
+                       size, fout_str);
+            }
 
-                it->num_rx_msgs += 1;
-//                std::cout << "Copying to=" << (int)videoFrame.idx_frame
-//                          << " size=" << (int)videoFrame.size_frame
-//                          << std::endl;
-
-                memcpy((void *)&it->frame[videoFrame.idx_frame],
-                       (void *)&videoFrame.frame[0],
-                       videoFrame.size_frame);
-
-                if(it->num_rx_msgs == it->num_all_msgs)
-                {
-                    char fout_str[64];
-                    sprintf((char *)&fout_str[0], "/tmp/image%03d.jpg", frameCnt++);
-
-                    printf("Dumping frame=%d (size=%d), dumping to %s\n",
-                           it->cnt_frame,it->size_frame, fout_str);
-
-
-                    int fout = open(fout_str, O_RDWR | O_CREAT);
-                    if(fout < 0)
-                    {
-                        fprintf(stderr, "Failed to open %s for writing: %s\n",
-                                fout_str, strerror(errno));
-                    }
-                    else
-                    {
-                        write(fout, it->frame, it->size_frame);
-                        close(fout);
-                    }
+            int fout = open(fout_str, O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if(fout < 0)
+            {
+                fprintf(stderr, "Failed to open %s for writing: %s\n",
+                        fout_str, strerror(errno));
+                return;
+            }
+            if(write(fout, data, size) < 0)
+            {
+                perror("write");
+            }
+            close(fout);
+        });
 
-                    videoFrame.header.size = videoFrame.header.magic = 0;
+    videoRx.getStats(lastStats);
+    while(true)
+    {
+        if(videoRx.receive(1000) < 0)
+        {
+            return -1;
+        }
 
-                    // erase also all frames with older frame counters
-                    int cur_frame_cnt = it->cnt_frame;
-                    for(it = rxFrames.begin(); it != rxFrames.end(); it++)
-                    {
-                        if(it->cnt_frame <= cur_frame_cnt)
-                        {
-                            std::cout << "Removing frame " << it->cnt_frame
-                                      << " from vector" << std::endl;
-                            it = rxFrames.erase(it);
-                            if(it == rxFrames.end())
-                            {
-                                break;
-                            }
-                        }
-                    }
-                }
-            }
+        videoRx.getStats(stats);
+        if((stats.recovered != lastStats.recovered) ||
+           (stats.dropped != lastStats.dropped) ||
+           (stats.invalid != lastStats.invalid))
+        {
+            std::cout << "frames=" << stats.frames
+                      << " recovered=" << stats.recovered
+                      << " dropped=" << stats.dropped
+                      << " late=" << stats.late
+                      << " invalid=" << stats.invalid << std::endl;
         }
+        lastStats = stats;
     }
+
     return 0;
 }
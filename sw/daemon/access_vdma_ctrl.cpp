@@ -17,7 +17,7 @@ void usage(const char *name)
 {
     std::cerr << "Usage: " << name << std::endl <<
         " [<regAddr> [regValue]]" << std::endl<<
-        " [-a <width> <height> <phy_addr1> [<phy_addr2> ...]]" <<
+        " [-u <uio_dev>] -a <width> <height> <phy_addr1> [<phy_addr2> ...]" <<
         std::endl << std::endl <<
         "If no arguments is provided full register dump is performed" <<
         ", if only register address then read is performed if address and" <<
@@ -26,13 +26,26 @@ void usage(const char *name)
         " and waits for acquisition of data and dumps it when arrives." <<
         " Physical addresses needs to be provided as arguments (and number" <<
         " of addresses also provides number of frames that application will" <<
-        " wait for." << std::endl;
+        " wait for. With -u frames are waited for on the VDMA frame" <<
+        " counter interrupt of the given UIO device (e.g. /dev/uio0)" <<
+        " instead of polling." << std::endl;
 }
 
 int main(int argc, char *argv[])
 {
     rccVdmaCtrl *mVdmaCtrl = new rccVdmaCtrl();
 
+    if((argc > 3) && (strncmp(argv[1], "-u", 2) == 0))
+    {
+        if(!mVdmaCtrl->setIrqSource(argv[2]))
+        {
+            return -1;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
     if(argc == 1)
     {
         mVdmaCtrl->dumpRegs();
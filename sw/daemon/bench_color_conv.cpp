@@ -0,0 +1,147 @@
+#include <stdlib.h>
+
+#include <iostream>
+#include <chrono>
+#include <functional>
+
+#include <opencv2/opencv.hpp>
+
+#include "rcc_color_conv.h"
+
+// Compares rcc_color_conv kernels (NEON on target, scalar otherwise) with
+// OpenCV cvtColor() on synthetic YUYV frames at the OV5642 resolutions.
+// Also checks that dispatched kernels are bit-exact with the scalar ones and
+// how far the BGR output is from cvtColor().
+
+static double timeIt(int iterations, std::function<void(void)> fn)
+{
+    auto tp1 = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; i++)
+    {
+        fn();
+    }
+    auto tp2 = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::micro>(tp2 - tp1).count() /
+        iterations;
+}
+
+static void printResult(const char *name, double kernelUs, double scalarUs,
+                        double cvUs)
+{
+    std::cout << "  " << name << ": kernel " << kernelUs << " us, scalar "
+              << scalarUs << " us, cvtColor " << cvUs << " us (x"
+              << cvUs / kernelUs << ")" << std::endl;
+}
+
+static bool benchResolution(int width, int height, int iterations)
+{
+    cv::Mat yuyv(height, width, CV_8UC2);
+    cv::Mat bgr(height, width, CV_8UC3), bgrRef(height, width, CV_8UC3);
+    cv::Mat bgrCv, greyCv, i420Cv;
+    cv::Mat grey(height, width, CV_8UC1), greyRef(height, width, CV_8UC1);
+    cv::Mat i420(height * 3 / 2, width, CV_8UC1);
+    cv::Mat i420Ref(height * 3 / 2, width, CV_8UC1);
+    bool ok = true;
+
+    cv::randu(yuyv, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    uint8_t *i420Y = i420.data;
+    uint8_t *i420U = i420Y + width * height;
+    uint8_t *i420V = i420U + (width / 2) * (height / 2);
+    uint8_t *refY  = i420Ref.data;
+    uint8_t *refU  = refY + width * height;
+    uint8_t *refV  = refU + (width / 2) * (height / 2);
+
+    std::cout << width << "x" << height << " ("
+              << (rccColorConvHasNeon() ? "NEON" : "scalar") << " kernels, "
+              << iterations << " iterations)" << std::endl;
+
+    // YUYV -> grey
+    {
+        double k = timeIt(iterations, [&]{
+                rccYuyvToGrey(yuyv.data, yuyv.step, grey.data, grey.step,
+                              width, height); });
+        double s = timeIt(iterations, [&]{
+                rccYuyvToGreyScalar(yuyv.data, yuyv.step, greyRef.data,
+                                    greyRef.step, width, height); });
+        double c = timeIt(iterations, [&]{
+                cv::cvtColor(yuyv, greyCv, CV_YUV2GRAY_YUYV); });
+        printResult("grey", k, s, c);
+
+        if((cv::norm(grey, greyRef, cv::NORM_INF) != 0) ||
+           (cv::norm(grey, greyCv, cv::NORM_INF) != 0))
+        {
+            std::cerr << "  grey output mismatch" << std::endl;
+            ok = false;
+        }
+    }
+
+    // YUYV -> I420 (OpenCV has no direct conversion, goes through BGR)
+    {
+        double k = timeIt(iterations, [&]{
+                rccYuyvToI420(yuyv.data, yuyv.step, i420Y, width,
+                              i420U, width / 2, i420V, width / 2,
+                              width, height); });
+        double s = timeIt(iterations, [&]{
+                rccYuyvToI420Scalar(yuyv.data, yuyv.step, refY, width,
+                                    refU, width / 2, refV, width / 2,
+                                    width, height); });
+        double c = timeIt(iterations, [&]{
+                cv::cvtColor(yuyv, bgrCv, CV_YUV2BGR_YUYV);
+                cv::cvtColor(bgrCv, i420Cv, CV_BGR2YUV_I420); });
+        printResult("i420", k, s, c);
+
+        if(cv::norm(i420, i420Ref, cv::NORM_INF) != 0)
+        {
+            std::cerr << "  i420 output mismatch" << std::endl;
+            ok = false;
+        }
+    }
+
+    // YUYV -> BGR
+    {
+        double k = timeIt(iterations, [&]{
+                rccYuyvToBgr(yuyv.data, yuyv.step, bgr.data, bgr.step,
+                             width, height); });
+        double s = timeIt(iterations, [&]{
+                rccYuyvToBgrScalar(yuyv.data, yuyv.step, bgrRef.data,
+                                   bgrRef.step, width, height); });
+        double c = timeIt(iterations, [&]{
+                cv::cvtColor(yuyv, bgrCv, CV_YUV2BGR_YUYV); });
+        printResult("bgr", k, s, c);
+
+        double maxDiff = cv::norm(bgr, bgrCv, cv::NORM_INF);
+        std::cout << "  bgr max difference to cvtColor: " << maxDiff
+                  << std::endl;
+        if((cv::norm(bgr, bgrRef, cv::NORM_INF) != 0) || (maxDiff > 2))
+        {
+            std::cerr << "  bgr output mismatch" << std::endl;
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = 100;
+    bool ok = true;
+
+    if(argc > 1)
+    {
+        iterations = atoi(argv[1]);
+    }
+    if(iterations <= 0)
+    {
+        std::cerr << "Usage: " << argv[0] << " [iterations]" << std::endl;
+        return -1;
+    }
+
+    // resolutions supported by OV5642 init tables
+    ok &= benchResolution(640, 480, iterations);
+    ok &= benchResolution(1280, 720, iterations);
+
+    return ok ? 0 : -1;
+}
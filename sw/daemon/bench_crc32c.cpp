@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "rcci_type.h"
+#include "rcci_crc.h"
+
+// CRC-32C cost of RCCI messages: full video fragment
+// (rcci_msg_vframe_max_packet_size), control and drive message, for the
+// table (slicing-by-8) implementation and CRC instructions when built for
+// them. Reference is JPEG encoding of a VGA frame - CRC of all its fragments
+// has to stay far below it. Implementations are checked against a bitwise
+// CRC-32C first.
+
+const uint32_t cCheckValue = 0xE3069283; // CRC-32C of "123456789"
+
+static uint32_t crc32cBitwise(uint32_t crc, const uint8_t *p, size_t len)
+{
+    crc = ~crc;
+    while(len--)
+    {
+        crc ^= *p++;
+        for(int i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+        }
+    }
+    return ~crc;
+}
+
+static bool selfCheck(void)
+{
+    std::vector<uint8_t> buf(4096 + 16);
+    bool ok = true;
+
+    for(size_t i = 0; i < buf.size(); i++)
+    {
+        buf[i] = rand();
+    }
+
+    if((rcciCrc32cSw(0, "123456789", 9) != cCheckValue) ||
+       (rcciCrc32c(0, "123456789", 9) != cCheckValue))
+    {
+        std::cerr << "CRC-32C check value mismatch" << std::endl;
+        return false;
+    }
+
+    // all alignments and tail lengths, chaining over two buffers
+    for(int i = 0; (i < 2000) && ok; i++)
+    {
+        size_t off = rand() % 16;
+        size_t len = rand() % 4096;
+        size_t split = len ? (rand() % len) : 0;
+        const uint8_t *p = &buf[off];
+        uint32_t ref = crc32cBitwise(0, p, len);
+
+        ok = (rcciCrc32cSw(0, p, len) == ref) &&
+            (rcciCrc32c(0, p, len) == ref) &&
+            (rcciCrc32c(rcciCrc32c(0, p, split), p + split, len - split) == ref);
+    }
+    if(!ok)
+    {
+        std::cerr << "CRC-32C differs from bitwise reference" << std::endl;
+        return false;
+    }
+
+    // message helpers - split header/payload equals contiguous message
+    rcci_msg_vframe_hdr_t &hdr = *(rcci_msg_vframe_hdr_t *)&buf[0];
+    rcciMsgSetCrc(&buf[0], 1024);
+    ok = rcciMsgCheckCrc(&hdr, rcci_msg_vframe_payload_offset,
+                         &buf[rcci_msg_vframe_payload_offset],
+                         1024 - rcci_msg_vframe_payload_offset);
+    buf[100] ^= 0x10;
+    ok &= !rcciMsgCheckCrc(&buf[0], 1024);
+    if(!ok)
+    {
+        std::cerr << "rcciMsgCheckCrc() failed" << std::endl;
+    }
+
+    return ok;
+}
+
+static double timeIt(int iterations, std::function<void(void)> fn)
+{
+    auto tp1 = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; i++)
+    {
+        fn();
+    }
+    auto tp2 = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::micro>(tp2 - tp1).count() /
+        iterations;
+}
+
+static void benchCrc(const char *name, int iterations,
+                     uint32_t (*crcFn)(uint32_t, const void *, size_t),
+                     double encodeUs, int numFrags)
+{
+    std::vector<uint8_t> frag(rcci_msg_vframe_max_packet_size);
+    rcci_msg_drv_ctrl_t drv;
+    rcci_msg_reg_service_t ctrl;
+    volatile uint32_t sink = 0;
+
+    for(size_t i = 0; i < frag.size(); i++)
+    {
+        frag[i] = i * 7;
+    }
+    memset(&drv, 0, sizeof(drv));
+    memset(&ctrl, 0, sizeof(ctrl));
+
+    double fragUs = timeIt(iterations, [&]() {
+            sink = crcFn(0, frag.data(), frag.size());
+        });
+    double ctrlUs = timeIt(iterations * 100, [&]() {
+            sink = crcFn(0, &ctrl, sizeof(ctrl));
+        });
+    double drvUs = timeIt(iterations * 100, [&]() {
+            sink = crcFn(0, &drv, offsetof(rcci_msg_drv_ctrl_t, crc));
+        });
+    (void)sink;
+
+    std::cout << "  " << name << ": fragment (" << frag.size() << " B) "
+              << fragUs << " us (" << frag.size() / fragUs << " MB/s), "
+              << "control " << ctrlUs * 1000 << " ns, drive " << drvUs * 1000
+              << " ns" << std::endl;
+    std::cout << "    frame of " << numFrags << " fragment(s): "
+              << fragUs * numFrags << " us = " << 100.0 * fragUs * numFrags /
+        encodeUs << " % of JPEG encode" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = 200;
+
+    if(argc > 1)
+        iterations = atoi(argv[1]);
+
+    if(iterations <= 0)
+    {
+        std::cerr << "Usage: " << argv[0] << " [iterations]" << std::endl;
+        return -1;
+    }
+
+    if(!selfCheck())
+    {
+        return -1;
+    }
+
+    // same settings as rccVideoStreamer::encodeFrame(), noise is the worst
+    // case for frame size
+    cv::Mat frame(480, 640, CV_8UC3);
+    std::vector<uchar> encoded;
+    std::vector<int> params = { CV_IMWRITE_JPEG_QUALITY, 70 };
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(frame, frame, cv::Size(5, 5), 0);
+
+    double encodeUs = timeIt(iterations / 10 + 1, [&]() {
+            cv::imencode(".jpg", frame, encoded, params);
+        });
+    int numFrags = (encoded.size() + rcci_msg_vframe_max_frame_size - 1) /
+        rcci_msg_vframe_max_frame_size;
+
+    std::cout << "JPEG encode 640x480: " << encodeUs << " us, "
+              << encoded.size() << " B" << std::endl;
+    std::cout << "CRC-32C (" << iterations << " iterations):" << std::endl;
+    benchCrc("slicing-by-8", iterations, &rcciCrc32cSw, encodeUs, numFrags);
+    if(rcciCrc32cHw())
+    {
+        benchCrc(rcciCrc32cHw(), iterations, &rcciCrc32c, encodeUs, numFrags);
+    }
+    else
+    {
+        std::cout << "  no CRC instructions in this build" << std::endl;
+    }
+
+    return 0;
+}
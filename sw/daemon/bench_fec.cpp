@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <memory>
+
+#include "rcci_type.h"
+#include "rcci_fec.h"
+
+// FEC encode/decode cost of rcci_fec for a JPEG sized frame split to data
+// fragments of given size and several parity ratios. Decoding rebuilds as
+// many random data fragments as there are parity fragments (worst case).
+// Cost is reported per frame and as share of the frame period at 30 fps.
+
+const int cFps = 30;
+
+typedef std::chrono::steady_clock benchClock;
+
+static bool benchRatio(size_t frameSize, size_t fragSize, int parityPercent,
+                       int iterations)
+{
+    fragSize = std::min(fragSize, frameSize);
+    int numData = (frameSize + fragSize - 1) / fragSize;
+    int numParity = rcciFecNumParity(numData, parityPercent);
+    std::vector<uint8_t> frame(frameSize), rx(frameSize);
+    std::vector<std::vector<uint8_t> > parityBuf(numParity,
+                                                 std::vector<uint8_t>(fragSize));
+    std::vector<const uint8_t *> src(numData);
+    std::vector<uint8_t *> dst(numData), parity(numParity);
+    std::vector<size_t> len(numData);
+    std::unique_ptr<bool[]> dataPresent(new bool[numData]);
+    std::unique_ptr<bool[]> parityPresent(new bool[numParity + 1]);
+    std::vector<int> order(numData);
+    double encUs = 0, decUs = 0;
+    bool ok = true;
+
+    if((numData + numParity) > rcciFecMaxShards)
+    {
+        std::cout << "  " << parityPercent << " %: too many fragments" << std::endl;
+        return true;
+    }
+
+    for(size_t i = 0; i < frameSize; i++)
+    {
+        frame[i] = rand();
+    }
+    for(int i = 0; i < numData; i++)
+    {
+        src[i] = &frame[i * fragSize];
+        dst[i] = &rx[i * fragSize];
+        len[i] = std::min(fragSize, frameSize - i * fragSize);
+        order[i] = i;
+    }
+    for(int j = 0; j < numParity; j++)
+    {
+        parity[j] = parityBuf[j].data();
+        parityPresent[j] = true;
+    }
+
+    for(int it = 0; (it < iterations) && ok; it++)
+    {
+        benchClock::time_point tp1 = benchClock::now();
+        rcciFecEncode(src.data(), len.data(), numData, parity.data(),
+                      numParity, fragSize);
+        benchClock::time_point tp2 = benchClock::now();
+
+        // lose numParity random data fragments
+        std::random_shuffle(order.begin(), order.end());
+        memcpy(rx.data(), frame.data(), frameSize);
+        for(int i = 0; i < numData; i++)
+        {
+            dataPresent[i] = true;
+        }
+        for(int i = 0; i < std::min(numParity, numData); i++)
+        {
+            dataPresent[order[i]] = false;
+            memset(dst[order[i]], 0xa5, len[order[i]]);
+        }
+
+        benchClock::time_point tp3 = benchClock::now();
+        int rebuilt = rcciFecDecode(dst.data(), len.data(), dataPresent.get(),
+                                    numData, parity.data(), parityPresent.get(),
+                                    numParity, fragSize);
+        benchClock::time_point tp4 = benchClock::now();
+
+        encUs += std::chrono::duration<double, std::micro>(tp2 - tp1).count();
+        decUs += std::chrono::duration<double, std::micro>(tp4 - tp3).count();
+
+        if((numParity > 0) &&
+           ((rebuilt != std::min(numParity, numData)) ||
+            (memcmp(rx.data(), frame.data(), frameSize) != 0)))
+        {
+            std::cerr << "  decode failed (rebuilt " << rebuilt << ")"
+                      << std::endl;
+            ok = false;
+        }
+    }
+
+    encUs /= iterations;
+    decUs /= iterations;
+    std::cout << "  " << parityPercent << " %: " << numData << " + "
+              << numParity << " fragments, encode " << encUs << " us ("
+              << 100.0 * encUs * cFps / 1e6 << " % @" << cFps << "fps), decode "
+              << std::min(numParity, numData) << " lost " << decUs << " us ("
+              << 100.0 * decUs * cFps / 1e6 << " %)" << std::endl;
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t frameSize = 40000;
+    int iterations = 100;
+    bool ok = true;
+
+    if(argc > 1)
+        frameSize = atoi(argv[1]);
+    if(argc > 2)
+        iterations = atoi(argv[2]);
+
+    if((frameSize == 0) || (frameSize > (size_t)rcci_msg_vframe_max_frame) ||
+       (iterations <= 0))
+    {
+        std::cerr << "Usage: " << argv[0] << " [frame_size] [iterations]"
+                  << std::endl;
+        return -1;
+    }
+
+    std::cout << "FEC for " << frameSize << " B frame ("
+              << (rcciFecHasNeon() ? "NEON" : "scalar") << ", " << iterations
+              << " iterations)" << std::endl;
+
+    // WiFi MTU sized, mid-size and the largest fragments
+    const size_t fragSizes[] = { 1400, 8192, rcci_msg_vframe_max_frame_size };
+    const int ratios[] = { 10, 20, 50 };
+    for(size_t f = 0; f < sizeof(fragSizes) / sizeof(fragSizes[0]); f++)
+    {
+        std::cout << "fragment size " << fragSizes[f] << " B:" << std::endl;
+        for(size_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); r++)
+        {
+            ok &= benchRatio(frameSize, fragSizes[f], ratios[r], iterations);
+        }
+    }
+
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,228 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "rcci_server.h"
+#include "rcci_client.h"
+#include "rcc_logger.h"
+#include "rcc_mmio.h"
+#include "rcc_sys_ctrl.h"
+#include "rcc_vdma_ctrl.h"
+
+// Off-target latency benchmarks on simulated register blocks (rccMmioSim):
+//  - drive: rcciClient drvSendData() -> UDP -> rcciServer drive thread ->
+//    rccSysCtrl::pushDriveData() -> PWM ACTIVE0 register write,
+//  - vdma: startAcquisition() (reset, start, configuration) and
+//    stopAcquisition() duration and time to the first frame for given
+//    simulated reset/halt response times.
+
+const uint32_t cRegPwmActive0 = 0x10;
+const int      cBenchPort     = 21025;
+const int      cDriveSendUs   = 20000; // above rcciServer coalescing period
+
+const int      cWidth         = 640;
+const int      cHeight        = 480;
+const int      cFrameStores   = 3;
+
+typedef std::chrono::steady_clock benchClock;
+
+static rccSysCtrl *benchSysCtrl = NULL;
+
+static int pushDataToDrvCtrl(rcci_msg_drv_ctrl_t drvCtrlData)
+{
+    benchSysCtrl->pushDriveData(drvCtrlData);
+    return 0;
+}
+
+static double usSince(benchClock::time_point tp1, benchClock::time_point tp2)
+{
+    return std::chrono::duration<double, std::micro>(tp2 - tp1).count();
+}
+
+static void printPercentiles(const char *name, std::vector<double> &vals)
+{
+    if(vals.empty())
+    {
+        std::cout << "  " << name << ": no samples" << std::endl;
+        return;
+    }
+
+    std::sort(vals.begin(), vals.end());
+    std::cout << "  " << name << ": min " << vals.front()
+              << " p50 " << vals[vals.size() / 2]
+              << " p99 " << vals[(vals.size() * 99) / 100]
+              << " max " << vals.back() << " [us]" << std::endl;
+}
+
+static bool benchDrive(int numCmds)
+{
+    rccMmioSim regs(rccSysCtrl::regsSize());
+    std::atomic<int64_t> writeNs(0);
+    std::vector<double> lat;
+    rcciServer server;
+    rcciClient client;
+    bool ok = true;
+
+    rccSysCtrl::configureSim(regs);
+    regs.setWriteCb([&writeNs](uint32_t offset, uint32_t) {
+            if(offset == cRegPwmActive0)
+            {
+                writeNs = benchClock::now().time_since_epoch().count();
+            }
+        });
+
+    rccSysCtrl sysCtrl(&regs);
+    benchSysCtrl = &sysCtrl;
+    sysCtrl.pwmEnable(true);
+
+    server.setDriveDataCb((rccSysCtrl::driveFuncCb)&pushDataToDrvCtrl);
+    if(server.openServer(cBenchPort) < 0)
+    {
+        return false;
+    }
+
+    if((client.connect("127.0.0.1", cBenchPort) < 0) ||
+       (client.drvConnect() < 0))
+    {
+        std::cerr << "drive: can not connect to the server" << std::endl;
+        server.closeServer();
+        return false;
+    }
+
+    for(int i = 0; i < numCmds; i++)
+    {
+        int64_t before = writeNs;
+        benchClock::time_point sent = benchClock::now();
+
+        client.drvSendData((i & 1) ? 500 : -500, 0);
+        while((writeNs == before) && (usSince(sent, benchClock::now()) < 100000))
+        {
+            std::this_thread::yield();
+        }
+        if(writeNs == before)
+        {
+            std::cerr << "drive: command " << i << " not applied" << std::endl;
+            ok = false;
+            break;
+        }
+
+        lat.push_back(usSince(sent, benchClock::time_point(
+                                  benchClock::duration(writeNs.load()))));
+        std::this_thread::sleep_until(sent +
+                                      std::chrono::microseconds(cDriveSendUs));
+    }
+
+    client.drvDisconnect();
+    client.disconnect();
+    server.closeServer();
+    benchSysCtrl = NULL;
+
+    std::cout << "drive command -> PWM register (" << lat.size()
+              << " commands):" << std::endl;
+    printPercentiles("latency", lat);
+
+    return ok;
+}
+
+static bool benchVdma(int iterations, int resetUs, int haltUs)
+{
+    rccMmioSim regs(rccVdmaCtrl::regsSize());
+    std::vector<std::vector<uint8_t> > buffers(cFrameStores,
+        std::vector<uint8_t>(cWidth * cHeight * 2));
+    std::vector<double> startLat, firstFrameLat, stopLat;
+    uint8_t *virtAddr[cFrameStores];
+    uint32_t phyAddr[cFrameStores];
+    bool ok = true;
+
+    for(int i = 0; i < cFrameStores; i++)
+    {
+        virtAddr[i] = buffers[i].data();
+        phyAddr[i]  = 0x10000000 + i * buffers[i].size();
+    }
+
+    // 1 kHz frames so first frame latency is dominated by configuration
+    rccVdmaCtrl::configureSim(regs, 1000, cFrameStores, -1, nullptr,
+                              resetUs, haltUs);
+    rccVdmaCtrl vdma(&regs);
+    regs.start();
+
+    uint64_t reads = regs.getReads(), writes = regs.getWrites();
+    for(int i = 0; (i < iterations) && ok; i++)
+    {
+        rccVdmaCtrl::rcc_vdma_frame_t frame;
+        benchClock::time_point tp1 = benchClock::now();
+
+        if(vdma.startAcquisition(cWidth, cHeight, cFrameStores, phyAddr,
+                                 virtAddr) < 0)
+        {
+            std::cerr << "vdma: startAcquisition() failed" << std::endl;
+            ok = false;
+            break;
+        }
+        benchClock::time_point tp2 = benchClock::now();
+
+        if(vdma.waitFrame(frame, 1000) <= 0)
+        {
+            std::cerr << "vdma: no frame after start" << std::endl;
+            ok = false;
+        }
+        benchClock::time_point tp3 = benchClock::now();
+
+        vdma.stopAcquisition();
+        benchClock::time_point tp4 = benchClock::now();
+
+        startLat.push_back(usSince(tp1, tp2));
+        firstFrameLat.push_back(usSince(tp1, tp3));
+        stopLat.push_back(usSince(tp3, tp4));
+    }
+    regs.stop();
+
+    std::cout << "vdma configuration (reset " << resetUs << " us, halt "
+              << haltUs << " us, " << startLat.size() << " cycles, "
+              << (startLat.empty() ? 0 :
+                  (regs.getReads() - reads) / startLat.size())
+              << " reads / "
+              << (startLat.empty() ? 0 :
+                  (regs.getWrites() - writes) / startLat.size())
+              << " writes per cycle):" << std::endl;
+    printPercentiles("startAcquisition", startLat);
+    printPercentiles("first frame", firstFrameLat);
+    printPercentiles("stopAcquisition", stopLat);
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int numCmds = 200, iterations = 50;
+    bool ok = true;
+
+    if(argc > 1)
+        numCmds = atoi(argv[1]);
+    if(argc > 2)
+        iterations = atoi(argv[2]);
+
+    if((numCmds <= 0) || (iterations <= 0))
+    {
+        std::cerr << "Usage: " << argv[0] << " [drive_cmds] [vdma_iterations]"
+                  << std::endl;
+        return -1;
+    }
+
+    // keep server/driver chatter out of the results
+    getLogger().setLogging(rccLogger::rccLoggerError, rccLogger::rccLoggerErr);
+
+    ok &= benchDrive(numCmds);
+    // ideal device, typical soft reset and slow responding device
+    ok &= benchVdma(iterations, 0, 0);
+    ok &= benchVdma(iterations, 10, 2);
+    ok &= benchVdma(iterations, 500, 100);
+
+    return ok ? 0 : -1;
+}
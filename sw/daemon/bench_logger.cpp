@@ -0,0 +1,135 @@
+#include <stdlib.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "rcc_logger.h"
+
+// Measures latency of a single log call from several threads at once.
+// rccLogger (lock-free ring + drain thread) is compared with a synchronous
+// logger doing what rccLogger::print() used to do: write + flush to the log
+// file and append to an unbounded in-RAM string, here under a mutex.
+
+const char *cLogFile = "/tmp/bench_logger.log";
+
+class syncLogger {
+public:
+    syncLogger(const char *fileName) : mFile(fileName, std::ios::trunc) {};
+    void print(const std::string &str)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFile << str << std::flush;
+        mLog.append(str);
+    };
+private:
+    std::mutex    mMutex;
+    std::ofstream mFile;
+    std::string   mLog;
+};
+
+typedef std::chrono::steady_clock benchClock;
+
+template <typename F>
+static void logThread(int id, int numMsgs, std::vector<double> *latencies,
+                      F logFn)
+{
+    std::ostringstream strStream;
+    strStream << "bench thread " << id << " drive: steer=1500 speed=1500 "
+              << "some more text to have realistic line length" << std::endl;
+    std::string msg = strStream.str();
+
+    latencies->reserve(numMsgs);
+    for(int i = 0; i < numMsgs; i++)
+    {
+        benchClock::time_point tp1 = benchClock::now();
+        logFn(msg);
+        benchClock::time_point tp2 = benchClock::now();
+        latencies->push_back(
+            std::chrono::duration<double, std::micro>(tp2 - tp1).count());
+
+        // roughly like real callers - not a tight loop
+        if((i % 16) == 15)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+
+template <typename F>
+static void runBench(const char *name, int numThreads, int numMsgs, F logFn)
+{
+    std::vector<std::vector<double> > latencies(numThreads);
+    std::vector<std::thread *> threads;
+
+    for(int i = 0; i < numThreads; i++)
+    {
+        threads.push_back(new std::thread(logThread<F>, i, numMsgs,
+                                          &latencies[i], logFn));
+    }
+    for(int i = 0; i < numThreads; i++)
+    {
+        threads[i]->join();
+        delete threads[i];
+    }
+
+    std::vector<double> all;
+    for(int i = 0; i < numThreads; i++)
+    {
+        all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+    }
+    std::sort(all.begin(), all.end());
+
+    std::cout << name << " threads=" << numThreads << ": p50="
+              << all[all.size() / 2] << " us p99="
+              << all[(all.size() * 99) / 100] << " us max="
+              << all.back() << " us" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int maxThreads = 8, numMsgs = 2000;
+
+    if(argc > 1)
+        maxThreads = atoi(argv[1]);
+    if(argc > 2)
+        numMsgs = atoi(argv[2]);
+
+    if((maxThreads <= 0) || (numMsgs <= 0))
+    {
+        std::cerr << "Usage: " << argv[0] << " [max_threads] [msgs_per_thread]"
+                  << std::endl;
+        return -1;
+    }
+
+    // file & RAM only, stdout would dominate the numbers
+    getLogger().setLogging(rccLogger::rccLoggerDebug|rccLogger::rccLoggerError,
+                           rccLogger::rccLoggerRam|rccLogger::rccLoggerFile);
+    if(getLogger().setFilename(cLogFile) < 0)
+    {
+        return -1;
+    }
+
+    for(int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        syncLogger sync(cLogFile);
+
+        runBench("sync   ", threads, numMsgs,
+                 [&sync](const std::string &str) { sync.print(str); });
+        runBench("ring   ", threads, numMsgs,
+                 [](const std::string &str) { getLogger().debug(str); });
+        getLogger().flush();
+    }
+
+    std::string log;
+    getLogger().getLog(log, 1024);
+    std::cout << "dropped=" << getLogger().getDropped() << " last 1 KB of log "
+              << "has " << log.length() << " bytes" << std::endl;
+
+    return 0;
+}
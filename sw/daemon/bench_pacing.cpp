@@ -0,0 +1,270 @@
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "rcc_video_streamer.h"
+
+// Latency of small drive packets while a video stream is running, with
+// pacing off, timer and txtime. Loopback has no bottleneck, so the receiver
+// models the WiFi link as a FIFO draining at given rate: a packet leaves the
+// link when all bytes queued in front of it are gone. Drive latency is send
+// time to link departure, i.e. how long the packet sat behind video.
+
+const char *cMcastGroup = "226.0.0.1";
+const char *cMcastIf    = "127.0.0.1";
+const int cFps(30);
+const int cDrivePeriodMs(5);
+const int cFragSize(1400);     // WiFi MTU sized fragments
+const uint32_t cDriveMagic(0x44525645);
+
+typedef struct bench_drive_pkt_s {
+    uint32_t magic;
+    uint32_t seq;
+    uint64_t sendNs;
+} bench_drive_pkt_t;
+
+static std::atomic<bool> rxRunning(false);
+static std::mutex        rxMutex;
+static std::vector<double> driveLat; // [us], protected by rxMutex
+static double            linkRate;   // [B/s]
+
+static uint64_t monotonicNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void receiverThread(int fd)
+{
+    static uint8_t buf[rcci_msg_vframe_max_packet_size];
+    double linkFreeNs = 0; // when the modelled link finishes current queue
+
+    while(rxRunning)
+    {
+        ssize_t bytes = recv(fd, buf, sizeof(buf), 0);
+        if(bytes <= 0)
+        {
+            continue;
+        }
+
+        double nowNs = monotonicNs();
+        linkFreeNs = std::max(linkFreeNs, nowNs) + bytes * 1e9 / linkRate;
+
+        bench_drive_pkt_t pkt;
+        memcpy(&pkt, buf, std::min(sizeof(pkt), (size_t)bytes));
+        if((bytes == sizeof(pkt)) && (pkt.magic == cDriveMagic))
+        {
+            std::lock_guard<std::mutex> lock(rxMutex);
+            driveLat.push_back((linkFreeNs - pkt.sendNs) / 1000);
+        }
+    }
+}
+
+static int openReceiver(int port)
+{
+    struct sockaddr_in addr;
+    struct ip_mreq mreq;
+    int yes = 1;
+    int rcvBuf = 8 * 1024 * 1024;
+    struct timeval tv = { 0, 100000 };
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(port);
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        std::cerr << "bind() failed: " << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    mreq.imr_multiaddr.s_addr = inet_addr(cMcastGroup);
+    mreq.imr_interface.s_addr = inet_addr(cMcastIf);
+    if(setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+    {
+        std::cerr << "IP_ADD_MEMBERSHIP failed: " << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Drive commands go unicast to the same port, so they share the link model
+static void driveThread(int port, std::atomic<bool> *running)
+{
+    struct sockaddr_in addr;
+    bench_drive_pkt_t pkt;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(cMcastIf);
+    addr.sin_port        = htons(port);
+    pkt.magic = cDriveMagic;
+    pkt.seq   = 0;
+
+    auto tp = std::chrono::steady_clock::now();
+    while(*running)
+    {
+        tp += std::chrono::milliseconds(cDrivePeriodMs);
+        std::this_thread::sleep_until(tp);
+
+        pkt.seq++;
+        pkt.sendNs = monotonicNs();
+        sendto(sock, &pkt, sizeof(pkt), 0, (struct sockaddr *)&addr,
+               sizeof(addr));
+    }
+    close(sock);
+}
+
+static void printPercentiles(const char *name, std::vector<double> &vals)
+{
+    if(vals.empty())
+    {
+        std::cout << "  " << name << ": no samples" << std::endl;
+        return;
+    }
+
+    std::sort(vals.begin(), vals.end());
+    std::cout << "  " << name << ": min " << vals.front()
+              << " p50 " << vals[vals.size() / 2]
+              << " p99 " << vals[(vals.size() * 99) / 100]
+              << " max " << vals.back() << " [us]" << std::endl;
+}
+
+static bool benchMode(const char *name, rccVideoStreamer::rcc_pacing_mode_t mode,
+                      int port, int frameSize, int seconds)
+{
+    rccVideoStreamer streamer;
+    rccVideoStreamer::rcc_stream_id_t id;
+    rccVideoStreamer::rcc_stream_stats_t stats;
+    std::vector<uint8_t> frame(frameSize);
+    std::atomic<bool> driveRunning(true);
+
+    for(int i = 0; i < frameSize; i++)
+    {
+        frame[i] = (uint8_t)i;
+    }
+
+    id = streamer.addStream("bench", cFps, port, cMcastIf);
+    if((id < 0) || !streamer.setStreamFec(id, 0, cFragSize) ||
+       !streamer.setStreamPacing(id, mode))
+    {
+        std::cerr << "Can not set up stream" << std::endl;
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(rxMutex);
+        driveLat.clear();
+    }
+    std::thread drive(driveThread, port, &driveRunning);
+
+    auto tp = std::chrono::steady_clock::now();
+    for(int i = 0; i < (seconds * cFps); i++)
+    {
+        tp += std::chrono::microseconds(1000000 / cFps);
+        if(streamer.sendEncodedFrame(id, frame.data(), frame.size()) < 0)
+        {
+            break;
+        }
+        std::this_thread::sleep_until(tp);
+    }
+
+    driveRunning = false;
+    drive.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    streamer.getStreamStats(id, stats);
+    std::cout << name << ": " << stats.frames << " frames, "
+              << stats.fragments << " fragments (" << stats.paced
+              << " paced), queue delay avg "
+              << (stats.fragments ? stats.queueDelaySumUs / stats.fragments : 0)
+              << " max " << stats.queueDelayMaxUs << " us, pacer late max "
+              << stats.paceLateMaxUs << " us" << std::endl;
+
+    std::lock_guard<std::mutex> lock(rxMutex);
+    printPercentiles("drive latency", driveLat);
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int port      = 18901;
+    int frameSize = 40000;
+    int linkKBps  = 2000;
+    int seconds   = 5;
+    bool ok = true;
+
+    if(argc > 1)
+        port = atoi(argv[1]);
+    if(argc > 2)
+        frameSize = atoi(argv[2]);
+    if(argc > 3)
+        linkKBps = atoi(argv[3]);
+    if(argc > 4)
+        seconds = atoi(argv[4]);
+
+    if((frameSize <= 0) || (frameSize > rcci_msg_vframe_max_frame) ||
+       (linkKBps <= 0) || (seconds <= 0))
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " [port] [frame_size <= " << rcci_msg_vframe_max_frame
+                  << "] [link_kB/s] [seconds]" << std::endl;
+        return -1;
+    }
+    linkRate = linkKBps * 1000.0;
+
+    std::cout << frameSize << " B frames @" << cFps << "fps ("
+              << frameSize * cFps / 1000 << " kB/s) over " << linkKBps
+              << " kB/s link, drive packet every " << cDrivePeriodMs << " ms"
+              << std::endl;
+
+    int rxFd = openReceiver(port);
+    if(rxFd < 0)
+    {
+        return -1;
+    }
+    rxRunning = true;
+    std::thread rxThread(receiverThread, rxFd);
+
+    ok &= benchMode("no pacing", rccVideoStreamer::rcc_pacing_off, port,
+                    frameSize, seconds);
+    ok &= benchMode("timer pacing", rccVideoStreamer::rcc_pacing_timer, port,
+                    frameSize, seconds);
+    // without fq qdisc on the interface departure times are ignored
+    ok &= benchMode("txtime pacing", rccVideoStreamer::rcc_pacing_txtime, port,
+                    frameSize, seconds);
+
+    rxRunning = false;
+    rxThread.join();
+    close(rxFd);
+
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,165 @@
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+
+#include "rcc_sys_ctrl.h"
+
+// Runs rccSysCtrl drive link failsafe against a simulated register block
+// (rccMmioSim). Drive commands are pushed at the PWM rate, then the link is
+// "lost" and the benchmark measures when the failsafe started to ramp drive
+// and when PWM ACTIVE0 reached the nominal pulse. Wake-up lateness of the
+// watchdog timer loop is reported as histogram.
+
+const uint32_t cRegPwmActive0 = 0x10;
+
+const int cSysClockMHz   = 50;
+const int cPulseNomUs    = 1400;
+const int cCmdPeriodUs   = 16600;
+
+typedef std::chrono::steady_clock benchClock;
+
+static bool runCycle(rccSysCtrl &sysCtrl, rccMmioSim &regs,
+                     int timeoutMs, int rampMs, int cycle)
+{
+    rcci_msg_drv_ctrl_t cmd;
+    uint32_t nomCnt = cPulseNomUs * cSysClockMHz;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.drive = (cycle & 1) ? -800 : 800;
+    cmd.steer = 200;
+
+    // half a second of healthy link
+    for(int i = 0; i < (500000 / cCmdPeriodUs); i++)
+    {
+        sysCtrl.pushDriveData(cmd);
+        std::this_thread::sleep_for(std::chrono::microseconds(cCmdPeriodUs));
+        if(sysCtrl.watchdogActive())
+        {
+            std::cerr << "failsafe fired while commands were arriving"
+                      << std::endl;
+            return false;
+        }
+    }
+
+    sysCtrl.pushDriveData(cmd);
+    benchClock::time_point lastCmd = benchClock::now();
+    benchClock::time_point rampStart, nominal;
+    bool started = false;
+
+    // wait for ramp to finish, poll the "hardware" register
+    while(true)
+    {
+        uint32_t active0 = regs.peek(cRegPwmActive0);
+        benchClock::time_point now = benchClock::now();
+
+        if(!started && (active0 != (uint32_t)((cPulseNomUs + cmd.drive * 400 / 1000) *
+                                               cSysClockMHz)))
+        {
+            started   = true;
+            rampStart = now;
+        }
+        if(active0 == nomCnt)
+        {
+            nominal = now;
+            if(!started)
+                rampStart = now;
+            break;
+        }
+        if(now - lastCmd > std::chrono::milliseconds(timeoutMs + rampMs + 500))
+        {
+            std::cerr << "drive did not reach nominal pulse" << std::endl;
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    double startMs = std::chrono::duration<double, std::milli>(
+        rampStart - lastCmd).count();
+    double nomMs = std::chrono::duration<double, std::milli>(
+        nominal - lastCmd).count();
+    std::cout << "  cycle " << cycle << ": ramp started after " << startMs
+              << " ms, nominal after " << nomMs << " ms (deadline "
+              << timeoutMs + rampMs << " ms)" << std::endl;
+
+    return (nomMs <= (timeoutMs + rampMs + 2 * rccSysCtrl::cWdogTickUs / 1000.0));
+}
+
+int main(int argc, char *argv[])
+{
+    int timeoutMs = 250, rampMs = 100, cycles = 5;
+    bool ok = true;
+
+    if(argc > 1)
+        timeoutMs = atoi(argv[1]);
+    if(argc > 2)
+        rampMs = atoi(argv[2]);
+    if(argc > 3)
+        cycles = atoi(argv[3]);
+
+    if((timeoutMs <= 0) || (rampMs < 0) || (cycles <= 0))
+    {
+        std::cerr << "Usage: " << argv[0] << " [timeout_ms] [ramp_ms] [cycles]"
+                  << std::endl;
+        return -1;
+    }
+
+    rccMmioSim regs(rccSysCtrl::regsSize());
+    rccSysCtrl::configureSim(regs);
+    rccSysCtrl sysCtrl(&regs);
+
+    sysCtrl.pwmEnable(true);
+    if(!sysCtrl.startWatchdog(timeoutMs, rampMs))
+    {
+        std::cerr << "startWatchdog() failed" << std::endl;
+        return -1;
+    }
+
+    std::cout << "Failsafe timeout " << timeoutMs << " ms, ramp " << rampMs
+              << " ms, tick " << rccSysCtrl::cWdogTickUs << " us" << std::endl;
+    for(int i = 0; i < cycles; i++)
+    {
+        ok &= runCycle(sysCtrl, regs, timeoutMs, rampMs, i);
+    }
+
+    sysCtrl.stopWatchdog();
+
+    rccSysCtrl::rcc_wdog_stats_t stats;
+    sysCtrl.getWatchdogStats(stats);
+    if(stats.ticks == 0)
+    {
+        std::cerr << "watchdog never ticked" << std::endl;
+        return -1;
+    }
+
+    std::cout << "Watchdog: " << stats.ticks << " ticks, " << stats.overruns
+              << " overruns, wake-up late avg "
+              << stats.wakeLateSumUs / stats.ticks << " us max "
+              << stats.wakeLateMaxUs << " us" << std::endl;
+    for(int i = 0; i < rccSysCtrl::cWdogLatBuckets; i++)
+    {
+        if(stats.wakeHist[i])
+        {
+            if(i < (rccSysCtrl::cWdogLatBuckets - 1))
+                std::cout << "  <" << (rccSysCtrl::cWdogLatBucketUs << i);
+            else
+                std::cout << "  >=" << (rccSysCtrl::cWdogLatBucketUs << (i - 1));
+            std::cout << " us: " << stats.wakeHist[i] << std::endl;
+        }
+    }
+    std::cout << "Failsafe: fired " << stats.fired << " times, after deadline avg "
+              << (stats.fired ? stats.fireLateSumUs / stats.fired : 0)
+              << " us max " << stats.fireLateMaxUs << " us" << std::endl;
+
+    if(stats.fired != (uint64_t)cycles)
+    {
+        std::cerr << "failsafe fired " << stats.fired << " times, expected "
+                  << cycles << std::endl;
+        ok = false;
+    }
+
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,157 @@
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "rcc_vdma_ctrl.h"
+
+// Runs rccVdmaCtrl hardware paced acquisition against simulated VDMA
+// (rccMmioSim programmed by rccVdmaCtrl::configureSim() - reset, run/halt,
+// frame store pointer, frame counter interrupt via eventfd) and compares
+// interrupt driven waiting with polling of the frame store pointer: CPU time
+// used by the acquiring thread and latency from frame end to waitFrame()
+// return.
+
+const int cNumFrameStores = 3;
+const int cWidth          = 640;
+const int cHeight         = 480;
+const int cMaxSeq         = 4096;
+
+typedef std::chrono::steady_clock simClock;
+
+static simClock::time_point frameEnd[cMaxSeq];
+
+static double threadCpuUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static bool runMode(const char *name, bool useIrq, int fps, int numFrames)
+{
+    rccMmioSim regs(rccVdmaCtrl::regsSize());
+    std::vector<std::vector<uint8_t> > buffers(cNumFrameStores,
+        std::vector<uint8_t>(cWidth * cHeight * 2));
+    uint8_t *virtAddr[cNumFrameStores];
+    uint32_t phyAddr[cNumFrameStores];
+    int irqFd = -1;
+    bool ok = true;
+
+    for(int i = 0; i < cNumFrameStores; i++)
+    {
+        virtAddr[i] = buffers[i].data();
+        phyAddr[i]  = 0x10000000 + i * buffers[i].size();
+    }
+
+    if(useIrq)
+    {
+        irqFd = eventfd(0, EFD_CLOEXEC);
+        if(irqFd < 0)
+        {
+            std::cerr << "eventfd() failed" << std::endl;
+            return false;
+        }
+    }
+
+    // "DMA" some data into frame store before frame store pointer moves on
+    rccVdmaCtrl::configureSim(regs, 1000000 / fps, cNumFrameStores, irqFd,
+        [&virtAddr](uint32_t seq, uint32_t frameStore) {
+            memset(virtAddr[frameStore], (seq - 1) & 0xff, 64);
+            frameEnd[seq % cMaxSeq] = simClock::now();
+        });
+
+    rccVdmaCtrl vdma(&regs);
+    vdma.setIrqSource(irqFd, useIrq ? rccVdmaCtrl::rcc_vdma_irq_eventfd :
+                      rccVdmaCtrl::rcc_vdma_irq_none);
+
+    regs.start();
+
+    if(vdma.startAcquisition(cWidth, cHeight, cNumFrameStores, phyAddr,
+                             virtAddr) < 0)
+    {
+        std::cerr << name << ": startAcquisition() failed" << std::endl;
+        ok = false;
+    }
+
+    double cpu1 = threadCpuUs(), latSum = 0, latMax = 0;
+    uint32_t missed = 0;
+    int frames = 0;
+
+    while(ok && (frames < numFrames))
+    {
+        rccVdmaCtrl::rcc_vdma_frame_t frame;
+        int retVal = vdma.waitFrame(frame, 1000);
+        simClock::time_point now = simClock::now();
+
+        if(retVal <= 0)
+        {
+            std::cerr << name << ": waitFrame() "
+                      << ((retVal < 0) ? "error" : "timeout") << std::endl;
+            ok = false;
+            break;
+        }
+
+        // data of the frame must be the one simulator wrote last
+        if(frame.data[0] != (uint8_t)((frame.sequence - 1) & 0xff))
+        {
+            std::cerr << name << ": wrong frame buffer returned" << std::endl;
+            ok = false;
+        }
+
+        double lat = std::chrono::duration<double, std::micro>(
+            now - frameEnd[frame.sequence % cMaxSeq]).count();
+        latSum += lat;
+        if(lat > latMax)
+            latMax = lat;
+        missed += frame.missed;
+        frames++;
+    }
+    double cpu2 = threadCpuUs();
+
+    vdma.stopAcquisition();
+    regs.stop();
+    if(irqFd >= 0)
+    {
+        close(irqFd);
+    }
+
+    if(frames > 0)
+    {
+        std::cout << name << ": " << frames << " frames, " << missed
+                  << " missed, CPU " << (cpu2 - cpu1) / frames
+                  << " us/frame, latency avg " << latSum / frames
+                  << " us max " << latMax << " us" << std::endl;
+    }
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int fps = 30, numFrames = 90;
+    bool ok = true;
+
+    if(argc > 1)
+        fps = atoi(argv[1]);
+    if(argc > 2)
+        numFrames = atoi(argv[2]);
+
+    if((fps <= 0) || (fps > 1000) || (numFrames <= 0))
+    {
+        std::cerr << "Usage: " << argv[0] << " [fps] [num_frames]" << std::endl;
+        return -1;
+    }
+
+    ok &= runMode("frame irq (eventfd)", true, fps, numFrames);
+    ok &= runMode("frame store polling", false, fps, numFrames);
+
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,244 @@
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "rcci_crc.h"
+#include "rcc_video_streamer.h"
+
+// Compares the original copy + sendto() per fragment path with the
+// sendmmsg()/iovec path of rccVideoStreamer. Fragments are sent to the
+// multicast group over loopback and counted by a local receiver.
+
+const char *cMcastGroup = "226.0.0.1";
+const char *cMcastIf    = "127.0.0.1";
+
+static std::atomic<bool>     rxRunning(false);
+static std::atomic<uint64_t> rxBytes(0);
+static std::atomic<uint64_t> rxMsgs(0);
+
+static void receiverThread(int fd)
+{
+    static uint8_t buf[rcci_msg_vframe_max_packet_size];
+
+    while(rxRunning)
+    {
+        ssize_t bytes = recv(fd, buf, sizeof(buf), 0);
+        if(bytes > 0)
+        {
+            rxBytes += bytes;
+            rxMsgs++;
+        }
+    }
+}
+
+static int openReceiver(int port)
+{
+    struct sockaddr_in addr;
+    struct ip_mreq mreq;
+    int yes = 1;
+    int rcvBuf = 8 * 1024 * 1024;
+    struct timeval tv = { 0, 100000 };
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(port);
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        std::cerr << "bind() failed: " << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    mreq.imr_multiaddr.s_addr = inet_addr(cMcastGroup);
+    mreq.imr_interface.s_addr = inet_addr(cMcastIf);
+    if(setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+    {
+        std::cerr << "IP_ADD_MEMBERSHIP failed: " << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Original implementation: memcpy() into rcci_msg_vframe_t + sendto()
+static int sendCopyPath(int sock, struct sockaddr_in &addr, uint8_t cntFrame,
+                        const uint8_t *data, size_t size, uint64_t &syscalls)
+{
+    static rcci_msg_vframe_t videoFrame;
+    const int maxFrameLength = rcci_msg_vframe_max_frame_size;
+    uint32_t msgCounter = 0;
+    uint8_t  cntMsg = 0;
+
+    videoFrame.header.magic = rcci_msg_init_magic;
+    videoFrame.header.size  = size;
+    videoFrame.cnt_frame    = cntFrame;
+    videoFrame.all_msgs     = (size + maxFrameLength - 1) / maxFrameLength;
+
+    while(msgCounter < size)
+    {
+        uint32_t fragSize = size - msgCounter;
+        if(fragSize > (uint32_t)maxFrameLength)
+        {
+            fragSize = maxFrameLength;
+        }
+        videoFrame.size_frame = fragSize;
+        videoFrame.idx_frame  = msgCounter;
+        videoFrame.cur_msg    = cntMsg++;
+        memcpy(&videoFrame.frame[0], &data[msgCounter], fragSize);
+        rcciMsgSetCrc(&videoFrame, rcci_msg_vframe_payload_offset + fragSize);
+
+        ssize_t retVal = sendto(sock, &videoFrame,
+                                rcci_msg_vframe_payload_offset + fragSize, 0,
+                                (struct sockaddr *)&addr, sizeof(addr));
+        syscalls++;
+        if(retVal < 0)
+        {
+            std::cerr << "sendto() failed: " << strerror(errno) << std::endl;
+            return -1;
+        }
+        msgCounter += fragSize;
+    }
+
+    return msgCounter;
+}
+
+static void printResult(const char *name, int numFrames, uint64_t bytes,
+                        uint64_t syscalls, double seconds)
+{
+    std::cout << name << ": " << numFrames << " frames, "
+              << (bytes / seconds) / 1e6 << " MB/s, "
+              << (double)syscalls / numFrames << " syscalls/frame, "
+              << (seconds * 1e6) / numFrames << " us/frame, received "
+              << rxMsgs << " fragments / " << rxBytes << " bytes" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int port      = 18900;
+    int frameSize = 200000;
+    int numFrames = 1000;
+
+    if(argc > 1)
+        port = atoi(argv[1]);
+    if(argc > 2)
+        frameSize = atoi(argv[2]);
+    if(argc > 3)
+        numFrames = atoi(argv[3]);
+
+    if((frameSize <= 0) || (frameSize > rcci_msg_vframe_max_frame) ||
+       (numFrames <= 0))
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " [port] [frame_size <= " << rcci_msg_vframe_max_frame
+                  << "] [num_frames]" << std::endl;
+        return -1;
+    }
+
+    std::vector<uint8_t> frame(frameSize);
+    for(int i = 0; i < frameSize; i++)
+    {
+        frame[i] = (uint8_t)i;
+    }
+
+    int rxFd = openReceiver(port);
+    if(rxFd < 0)
+    {
+        return -1;
+    }
+    rxRunning = true;
+    std::thread rxThread(receiverThread, rxFd);
+
+    // 1) original copy + sendto() path
+    {
+        struct sockaddr_in addr;
+        struct in_addr iaddr;
+        uint64_t syscalls = 0;
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+        iaddr.s_addr = inet_addr(cMcastIf);
+        setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &iaddr, sizeof(iaddr));
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = inet_addr(cMcastGroup);
+        addr.sin_port        = htons(port);
+
+        uint64_t bytes = 0;
+        auto tp1 = std::chrono::steady_clock::now();
+        for(int i = 0; i < numFrames; i++)
+        {
+            int retVal = sendCopyPath(sock, addr, i, frame.data(), frame.size(),
+                                      syscalls);
+            if(retVal < 0)
+                break;
+            bytes += retVal;
+        }
+        auto tp2 = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        printResult("copy+sendto", numFrames, bytes, syscalls,
+                    std::chrono::duration<double>(tp2 - tp1).count());
+        close(sock);
+    }
+
+    rxMsgs  = 0;
+    rxBytes = 0;
+
+    // 2) rccVideoStreamer iovec + sendmmsg() path
+    {
+        rccVideoStreamer streamer;
+        rccVideoStreamer::rcc_stream_id_t id;
+        rccVideoStreamer::rcc_stream_stats_t stats;
+
+        id = streamer.addStream("bench", 30, port, cMcastIf);
+        if(id < 0)
+        {
+            std::cerr << "addStream() failed" << std::endl;
+            rxRunning = false;
+            rxThread.join();
+            return -1;
+        }
+
+        uint64_t bytes = 0;
+        auto tp1 = std::chrono::steady_clock::now();
+        for(int i = 0; i < numFrames; i++)
+        {
+            int retVal = streamer.sendEncodedFrame(id, frame.data(), frame.size());
+            if(retVal < 0)
+                break;
+            bytes += retVal;
+        }
+        auto tp2 = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        streamer.getStreamStats(id, stats);
+        printResult("iovec+sendmmsg", numFrames, bytes, stats.syscalls,
+                    std::chrono::duration<double>(tp2 - tp1).count());
+    }
+
+    rxRunning = false;
+    rxThread.join();
+    close(rxFd);
+
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <cstdlib>
 #include <thread>
 #include <string.h>
 #include <errno.h>
@@ -23,6 +24,7 @@
 #include "rcc_img_proc.h"
 
 #include "rcc_video_streamer.h"
+#include "rcc_capture_pipeline.h"
 
 #define TRACK_TIME
 //#define USE_OV5642
@@ -59,7 +61,13 @@ int main(int argc, char *argv[])
     std::chrono::duration <int, std::micro> interval(1000000/15);
 
     rccVideoStreamer *videoStreamer = NULL;
-    rccVideoStreamer::rcc_stream_id_t origStreamId, greyStreamId;
+    rccVideoStreamer::rcc_stream_id_t origStreamId = -1, greyStreamId = -1;
+    bool streamGrey = false;
+    int fecPercent = 0, fecFragSize = 0;
+    int adaptMaxFrags = 0;
+    rccVideoStreamer::rcc_pacing_mode_t paceMode = rccVideoStreamer::rcc_pacing_off;
+    int paceRate = 0;
+    rccCapturePipeline *pipeline = NULL;
 
 #ifdef USE_OV5642
     rccOv5642Ctrl::ov5642_mode_t mode = rccOv5642Ctrl::ov5642_vga_yuv;
@@ -84,8 +92,45 @@ int main(int argc, char *argv[])
     {
         inputFile = std::string(argv[2]);
     }
+    if(argc > 3)
+    {
+        // stream luma only - no colour conversion, ~1/3 smaller JPEGs
+        streamGrey = (std::string(argv[3]) == "grey");
+    }
+    if(argc > 4)
+    {
+        // FEC parity in % of data fragments, optional data fragment size
+        fecPercent = atoi(argv[4]);
+    }
+    if(argc > 5)
+    {
+        fecFragSize = atoi(argv[5]);
+    }
+    if(argc > 6)
+    {
+        // adapt encoding to receiver reports, max data fragments per frame
+        adaptMaxFrags = atoi(argv[6]);
+    }
+    if(argc > 7)
+    {
+        // spread fragments over frame interval: off, timer or txtime
+        if(std::string(argv[7]) == "timer")
+            paceMode = rccVideoStreamer::rcc_pacing_timer;
+        else if(std::string(argv[7]) == "txtime")
+            paceMode = rccVideoStreamer::rcc_pacing_txtime;
+    }
+    if(argc > 8)
+    {
+        // minimum pacing rate in kB/s (0 - just fit frame into interval)
+        paceRate = atoi(argv[8]);
+    }
 
     imgProc = new rccImgProc();
+    if(startServer)
+    {
+        // capture pipeline keeps V4L2 buffers until frames are converted
+        imgProc->setNumBuffers(rccCapturePipeline::maxHeldFrames() + 1);
+    }
     if(imgProc->open(inputFile.c_str()))
     {
         std::cout << "Opened input file " << inputFile << std::endl;
@@ -128,24 +173,52 @@ int main(int argc, char *argv[])
                 goto end;
             }
 
-            origStreamId = videoStreamer->addStream(origName, fps, serverPort);
-            if(origStreamId < 0)
+            if(streamGrey)
+            {
+                greyStreamId = videoStreamer->addStream(greyName, fps, serverPort);
+                if(greyStreamId < 0)
+                {
+                    std::cerr << "Could not add stream " << greyName << std::endl;
+                    goto end;
+                }
+            }
+            else
+            {
+                origStreamId = videoStreamer->addStream(origName, fps, serverPort);
+                if(origStreamId < 0)
+                {
+                    std::cerr << "Could not add stream " << origName << std::endl;
+                    goto end;
+                }
+            }
+
+            if(!videoStreamer->setStreamFec(streamGrey ? greyStreamId : origStreamId,
+                                            fecPercent, fecFragSize))
+            {
+                std::cerr << "Invalid FEC settings " << fecPercent << " % / "
+                          << fecFragSize << " B" << std::endl;
+                goto end;
+            }
+
+            if(!videoStreamer->setStreamAdaptive(streamGrey ? greyStreamId :
+                                                 origStreamId, adaptMaxFrags))
             {
-                std::cerr << "Could not add stream " << origName << std::endl;
+                std::cerr << "Invalid number of fragments per frame "
+                          << adaptMaxFrags << std::endl;
                 goto end;
             }
 
-#if 0
-            greyStreamId = videoStreamer->addStream(greyName, fps, serverPort+1);
-            if(greyStreamId < 0)
+            if(!videoStreamer->setStreamPacing(streamGrey ? greyStreamId :
+                                               origStreamId, paceMode,
+                                               paceRate * 1000))
             {
-                std::cerr << "Could not add stream " << greyName << std::endl;
+                std::cerr << "Can not set pacing" << std::endl;
                 goto end;
             }
-#endif
 
             std::cout << "Added streams for original (" << origStreamId <<
-                ") and grey (" << greyStreamId << ")" << std::endl;
+                ") and grey (" << greyStreamId << "), FEC " << fecPercent <<
+                " %" << std::endl;
         }
         else
         {
@@ -164,6 +237,70 @@ int main(int argc, char *argv[])
         }
     }
 
+    if(startServer)
+    {
+        // capture, encode & send run in separate threads
+        const char *stageNames[rccCapturePipeline::rcc_pipe_stage_nonexisting] =
+            { "capture", "encode", "send" };
+
+        if(streamGrey)
+        {
+            pipeline = new rccCapturePipeline(imgProc, videoStreamer,
+                                              greyStreamId, 2, 2,
+                                              rccVideoStreamer::rcc_frame_grey);
+        }
+        else
+        {
+            pipeline = new rccCapturePipeline(imgProc, videoStreamer,
+                                              origStreamId);
+        }
+        if(!pipeline->start(fps))
+        {
+            std::cerr << "Can not start capture pipeline" << std::endl;
+            goto end;
+        }
+
+        while(pipeline->isRunning())
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+
+            for(int i = 0; i < rccCapturePipeline::rcc_pipe_stage_nonexisting; i++)
+            {
+                rccCapturePipeline::rcc_pipe_stats_t stats;
+                pipeline->getStats((rccCapturePipeline::rcc_pipe_stage_t)i, stats);
+                std::cout << " " << stageNames[i] << ": processed=" << stats.processed
+                          << " dropped=" << stats.dropped
+                          << " depth=" << stats.depth;
+                if(stats.latMaxUs)
+                {
+                    // capture (V4L2 timestamp) -> stage done
+                    std::cout << " latency avg=" << stats.latAvgUs
+                              << "us max=" << stats.latMaxUs << "us";
+                }
+            }
+
+            rccVideoStreamer::rcc_stream_enc_t enc;
+            videoStreamer->getStreamEncoding(streamGrey ? greyStreamId :
+                                             origStreamId, enc);
+            std::cout << " quality=" << enc.quality << " scale=" << enc.scale
+                      << "% fps=" << enc.fps;
+
+            rccVideoStreamer::rcc_stream_stats_t streamStats;
+            videoStreamer->getStreamStats(streamGrey ? greyStreamId :
+                                          origStreamId, streamStats);
+            if(streamStats.fragments)
+            {
+                std::cout << " queue delay avg="
+                          << streamStats.queueDelaySumUs / streamStats.fragments
+                          << "us max=" << streamStats.queueDelayMaxUs << "us";
+            }
+            std::cout << std::endl;
+        }
+
+        retVal = 0;
+        goto end;
+    }
+
     tp = std::chrono::steady_clock::now();
     while(true)
     {
@@ -193,25 +330,7 @@ int main(int argc, char *argv[])
             continue;
         }
 
-        if(startServer)
-        {
-            // Stream also greyscale just to show multiple streams
-//            cv::Mat grey;
-//            cv::Mat grey2;
-
-            // TODO: need double-conversion because encodeAndStream
-            // can currently work only with 3-dimensional matrices
-//            cv::cvtColor(frame, grey, CV_BGR2GRAY);
-//            cv::cvtColor(grey, grey2, CV_GRAY2BGR);
-
-//            videoStreamer->encodeAndStream(greyStreamId, grey2);
-
-            videoStreamer->encodeAndStream(origStreamId, frame);
-        }
-        else
-        {
-            outputVideo << frame;
-        }
+        outputVideo << frame;
 #ifdef TRACK_TIME
         std::chrono::steady_clock::time_point tp3 = std::chrono::steady_clock::now();
 #endif
@@ -242,6 +361,12 @@ int main(int argc, char *argv[])
     retVal = 0;
 
 end:
+    if(pipeline)
+    {
+        delete pipeline;
+        pipeline = NULL;
+    }
+
     if(videoStreamer)
     {
         delete videoStreamer;
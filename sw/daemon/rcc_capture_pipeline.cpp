@@ -0,0 +1,451 @@
+#include <time.h>
+
+#include <iostream>
+#include <chrono>
+
+#include "rcc_capture_pipeline.h"
+
+const int cMaxCaptureRetries = 100;
+
+rccCapturePipeline::rccCapturePipeline(rccImgProc *imgProc,
+                                       rccVideoStreamer *streamer,
+                                       rccVideoStreamer::rcc_stream_id_t streamId,
+                                       int numWorkers, int queueDepth,
+                                       rccVideoStreamer::rcc_frame_type_t frameType)
+    : mImgProc(imgProc), mStreamer(streamer), mStreamId(streamId),
+      mNumWorkers(numWorkers), mFrameType(frameType),
+      mRunning(false), mNumFrames(0),
+      mCaptureThread(NULL), mSendThread(NULL)
+{
+    if(mNumWorkers < 1)
+        mNumWorkers = 1;
+    if(queueDepth < 1)
+        queueDepth = 1;
+
+    // enough frames that every ring and latest slot can be full while
+    // each stage still holds one frame
+    mNumFrames = mNumWorkers * (2 * queueDepth + 2) + 2;
+    mFrames.reset(new rcc_pipe_frame_t[mNumFrames]);
+    for(int i = 0; i < mNumFrames; i++)
+    {
+        mFrames[i].seq = 0;
+        mFrames[i].captureUs = 0;
+        mFrames[i].inUse = false;
+    }
+
+    mEncodeNotify.reset(new rccNotifier[mNumWorkers]);
+    mEncodeLatest.reset(new std::atomic<int>[mNumWorkers]);
+    for(int i = 0; i < mNumWorkers; i++)
+    {
+        mEncodeLatest[i] = -1;
+        mEncodeRings.push_back(std::unique_ptr<rccSpscRing<int> >(
+                                   new rccSpscRing<int>(queueDepth)));
+        mSendRings.push_back(std::unique_ptr<rccSpscRing<int> >(
+                                 new rccSpscRing<int>(queueDepth)));
+    }
+
+    for(int i = 0; i < rcc_pipe_stage_nonexisting; i++)
+    {
+        mCounters[i].processed = 0;
+        mCounters[i].dropped = 0;
+        mCounters[i].latSumUs = 0;
+        mCounters[i].latCount = 0;
+        mCounters[i].latMaxUs = 0;
+    }
+}
+
+rccCapturePipeline::~rccCapturePipeline(void)
+{
+    stop();
+}
+
+bool rccCapturePipeline::start(int fps)
+{
+    if(mRunning || !mImgProc || !mStreamer || (fps <= 0))
+    {
+        return false;
+    }
+
+    for(int i = 0; i < mNumFrames; i++)
+    {
+        mFrames[i].inUse = false;
+    }
+
+    mRunning = true;
+    mSendThread = new std::thread(&rccCapturePipeline::sendThread, this);
+    for(int i = 0; i < mNumWorkers; i++)
+    {
+        mEncodeThreads.push_back(
+            new std::thread(&rccCapturePipeline::encodeThread, this, i));
+    }
+    mCaptureThread = new std::thread(&rccCapturePipeline::captureThread,
+                                     this, fps);
+
+    return true;
+}
+
+void rccCapturePipeline::stop(void)
+{
+    mRunning = false;
+
+    if(mCaptureThread)
+    {
+        mCaptureThread->join();
+        delete mCaptureThread;
+        mCaptureThread = NULL;
+    }
+
+    for(int i = 0; i < (int)mEncodeThreads.size(); i++)
+    {
+        mEncodeNotify[i].notify();
+        mEncodeThreads[i]->join();
+        delete mEncodeThreads[i];
+    }
+    mEncodeThreads.clear();
+
+    if(mSendThread)
+    {
+        mSendNotify.notify();
+        mSendThread->join();
+        delete mSendThread;
+        mSendThread = NULL;
+    }
+
+    // drop whatever is left in the rings
+    int idx;
+    for(int i = 0; i < mNumWorkers; i++)
+    {
+        while(mEncodeRings[i]->pop(idx)) { releaseFrame(idx); }
+        while(mSendRings[i]->pop(idx))   { releaseFrame(idx); }
+        releaseFrame(mEncodeLatest[i].exchange(-1));
+    }
+}
+
+bool rccCapturePipeline::getStats(rcc_pipe_stage_t stage,
+                                  rcc_pipe_stats_t &stats)
+{
+    if((stage < 0) || (stage >= rcc_pipe_stage_nonexisting))
+    {
+        return false;
+    }
+
+    stats.processed = mCounters[stage].processed;
+    stats.dropped   = mCounters[stage].dropped;
+    stats.depth     = 0;
+    stats.latMaxUs  = mCounters[stage].latMaxUs;
+    uint64_t latCount = mCounters[stage].latCount;
+    stats.latAvgUs  = latCount ? (mCounters[stage].latSumUs / latCount) : 0;
+
+    switch(stage)
+    {
+    case rcc_pipe_stage_capture:
+        // frames currently in flight
+        for(int i = 0; i < mNumFrames; i++)
+        {
+            if(mFrames[i].inUse)
+                stats.depth++;
+        }
+        break;
+    case rcc_pipe_stage_encode:
+        for(int i = 0; i < mNumWorkers; i++)
+        {
+            stats.depth += mEncodeRings[i]->depth();
+            if(mEncodeLatest[i] >= 0)
+                stats.depth++;
+        }
+        break;
+    case rcc_pipe_stage_send:
+        for(int i = 0; i < mNumWorkers; i++)
+            stats.depth += mSendRings[i]->depth();
+        break;
+    default:
+        break;
+    }
+
+    return true;
+}
+
+// Capture timestamps are CLOCK_MONOTONIC (see rccFrameView::captureUs())
+void rccCapturePipeline::addLatency(rcc_pipe_counters_t &counters,
+                                    uint64_t captureUs)
+{
+    struct timespec ts;
+
+    if(captureUs == 0)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t nowUs = (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    uint64_t latUs = (nowUs > captureUs) ? (nowUs - captureUs) : 0;
+
+    counters.latSumUs += latUs;
+    counters.latCount++;
+    // encode workers share their counters
+    uint64_t maxUs = counters.latMaxUs;
+    while((latUs > maxUs) &&
+          !counters.latMaxUs.compare_exchange_weak(maxUs, latUs))
+    {
+    }
+}
+
+// Only capture thread acquires, any stage can release
+int rccCapturePipeline::acquireFrame(void)
+{
+    for(int i = 0; i < mNumFrames; i++)
+    {
+        if(!mFrames[i].inUse)
+        {
+            mFrames[i].inUse = true;
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void rccCapturePipeline::releaseFrame(int idx)
+{
+    if((idx >= 0) && (idx < mNumFrames))
+    {
+        // re-queues V4L2 buffer if still held
+        mFrames[idx].view.release();
+        mFrames[idx].inUse = false;
+    }
+}
+
+void rccCapturePipeline::captureThread(int fps)
+{
+    rcc_pipe_counters_t &counters = mCounters[rcc_pipe_stage_capture];
+    std::chrono::steady_clock::time_point tp = std::chrono::steady_clock::now();
+    std::chrono::duration<int, std::micro> interval(1000000 / fps);
+    int retries = cMaxCaptureRetries;
+    int nextWorker = 0;
+
+    while(mRunning)
+    {
+        int idx = acquireFrame();
+        rccFrameView &view = (idx >= 0) ? mFrames[idx].view : mScratch;
+
+        if(!mImgProc->readFrame(view))
+        {
+            std::cerr << "Problem getting the frame" << std::endl;
+            releaseFrame(idx);
+
+            if(--retries == 0)
+            {
+                std::cerr << "Too many retries, quitting" << std::endl;
+                break;
+            }
+            continue;
+        }
+
+        if(!view.isValid())
+        {
+            releaseFrame(idx);
+            mImgProc->reset();
+            continue;
+        }
+
+        if(idx < 0)
+        {
+            // all frames still in use by later stages
+            mScratch.release();
+            counters.dropped++;
+        }
+        else if(!mStreamer->acceptFrame(mStreamId))
+        {
+            // stream frame rate lowered - skip before any conversion
+            releaseFrame(idx);
+        }
+        else
+        {
+            bool queued = false;
+
+            mFrames[idx].seq = view.sequence();
+            mFrames[idx].captureUs = view.captureUs();
+            for(int i = 0; (i < mNumWorkers) && !queued; i++)
+            {
+                int worker = (nextWorker + i) % mNumWorkers;
+                if(mEncodeRings[worker]->push(idx))
+                {
+                    mEncodeNotify[worker].notify();
+                    nextWorker = (worker + 1) % mNumWorkers;
+                    queued = true;
+                }
+            }
+
+            if(!queued)
+            {
+                // every ring full - the new frame replaces the one parked
+                // before, the worker picks it up next to its ring contents
+                int old = mEncodeLatest[nextWorker].exchange(idx);
+                if(old >= 0)
+                {
+                    releaseFrame(old);
+                    counters.dropped++;
+                }
+                mEncodeNotify[nextWorker].notify();
+                nextWorker = (nextWorker + 1) % mNumWorkers;
+            }
+            counters.processed++;
+            addLatency(counters, mFrames[idx].captureUs);
+        }
+
+        // V4L2 reads block until next frame anyway, this paces file inputs
+        tp = tp + interval;
+        if(tp < std::chrono::steady_clock::now())
+        {
+            tp = std::chrono::steady_clock::now();
+        }
+        else
+        {
+            std::this_thread::sleep_until(tp);
+        }
+    }
+
+    // capture ended (stop() or error) - wake up other stages to quit
+    mRunning = false;
+    for(int i = 0; i < mNumWorkers; i++)
+    {
+        mEncodeNotify[i].notify();
+    }
+    mSendNotify.notify();
+}
+
+void rccCapturePipeline::encodeThread(int worker)
+{
+    rcc_pipe_counters_t &counters = mCounters[rcc_pipe_stage_encode];
+
+    while(true)
+    {
+        int idx, newest = -1;
+
+        mEncodeNotify[worker].wait();
+        if(!mRunning)
+        {
+            break;
+        }
+
+        // latest frame wins, the parked frame may be older than frames
+        // pushed after the ring got space again
+        newest = mEncodeLatest[worker].exchange(-1);
+        while(mEncodeRings[worker]->pop(idx))
+        {
+            if((newest < 0) ||
+               ((int32_t)(mFrames[idx].seq - mFrames[newest].seq) > 0))
+            {
+                std::swap(idx, newest);
+            }
+            if(idx >= 0)
+            {
+                releaseFrame(idx);
+                counters.dropped++;
+            }
+        }
+        if(newest < 0)
+        {
+            continue;
+        }
+
+        // convert and give V4L2 buffer back to the driver before encoding
+        rcc_pipe_frame_t &pFrame = mFrames[newest];
+        rccVideoStreamer::rcc_stream_enc_t enc;
+        bool converted;
+        switch(mFrameType)
+        {
+        case rccVideoStreamer::rcc_frame_grey:
+            converted = pFrame.view.getGrey(pFrame.frame);
+            break;
+        case rccVideoStreamer::rcc_frame_i420:
+            converted = pFrame.view.getI420(pFrame.frame);
+            break;
+        default:
+            converted = pFrame.view.getBgr(pFrame.frame);
+            break;
+        }
+        pFrame.view.release();
+
+        if(!converted || !mStreamer->getStreamEncoding(mStreamId, enc) ||
+           !mStreamer->encodeFrame(pFrame.frame, pFrame.encoded, mFrameType,
+                                   enc.quality, enc.scale) ||
+           !mSendRings[worker]->push(newest))
+        {
+            releaseFrame(newest);
+            counters.dropped++;
+            continue;
+        }
+
+        counters.processed++;
+        addLatency(counters, pFrame.captureUs);
+        mSendNotify.notify();
+    }
+}
+
+void rccCapturePipeline::sendThread(void)
+{
+    rcc_pipe_counters_t &counters = mCounters[rcc_pipe_stage_send];
+    uint32_t lastSeq = 0;
+    bool     sentAny = false;
+
+    while(true)
+    {
+        int idx, newest = -1;
+
+        mSendNotify.wait();
+        if(!mRunning)
+        {
+            break;
+        }
+
+        // pick newest encoded frame from all workers, release the rest
+        for(int i = 0; i < mNumWorkers; i++)
+        {
+            while(mSendRings[i]->pop(idx))
+            {
+                if((newest < 0) ||
+                   ((int32_t)(mFrames[idx].seq - mFrames[newest].seq) > 0))
+                {
+                    std::swap(idx, newest);
+                }
+                if(idx >= 0)
+                {
+                    releaseFrame(idx);
+                    counters.dropped++;
+                }
+            }
+        }
+        if(newest < 0)
+        {
+            continue;
+        }
+
+        // worker finishing late with older frame than already sent
+        rcc_pipe_frame_t &pFrame = mFrames[newest];
+        if(sentAny && ((int32_t)(pFrame.seq - lastSeq) <= 0))
+        {
+            releaseFrame(newest);
+            counters.dropped++;
+            continue;
+        }
+
+        rccVideoStreamer::rcc_frame_info_t info;
+        info.captureUs = pFrame.captureUs;
+        info.seq       = pFrame.seq;
+        if(mStreamer->sendEncodedFrame(mStreamId, pFrame.encoded.data(),
+                                       pFrame.encoded.size(), &info) < 0)
+        {
+            counters.dropped++;
+        }
+        else
+        {
+            counters.processed++;
+            addLatency(counters, pFrame.captureUs);
+        }
+
+        lastSeq = pFrame.seq;
+        sentAny = true;
+        releaseFrame(newest);
+    }
+}
@@ -0,0 +1,141 @@
+#ifndef __RCC_CAPTURE_PIPELINE_H
+#define __RCC_CAPTURE_PIPELINE_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "rcc_spsc_ring.h"
+#include "rcc_img_proc.h"
+#include "rcc_video_streamer.h"
+
+// Staged capture -> encode -> send pipeline:
+//  - capture thread dequeues frame views from rccImgProc into a fixed pool
+//  - pool of encode workers converts to BGR/grey/I420 (releasing the V4L2
+//    buffer) and JPEG encodes
+//  - send thread fragments and sends to rccVideoStreamer stream
+// Stages are linked with SPSC rings carrying frame pool indexes. Consumers
+// always skip to the newest frame available (latest-frame-wins) and release
+// the older ones, so latency stays bounded when some stage is too slow.
+// When all encode rings are full the capture thread parks the new frame in
+// the worker's latest slot, replacing (and releasing) the frame parked there.
+class rccCapturePipeline {
+public:
+    typedef enum rcc_pipe_stage_e {
+        rcc_pipe_stage_capture = 0,
+        rcc_pipe_stage_encode,
+        rcc_pipe_stage_send,
+        rcc_pipe_stage_nonexisting // must be last
+    } rcc_pipe_stage_t;
+
+    typedef struct rcc_pipe_stats_s {
+        uint64_t processed; // frames passed to next stage
+        uint64_t dropped;   // frames dropped in front of/inside the stage
+        size_t   depth;     // frames waiting in input queue(s) of the stage
+        uint64_t latAvgUs;  // capture time -> stage done, processed frames
+        uint64_t latMaxUs;  //  (0 - capture time not known)
+    } rcc_pipe_stats_t;
+
+    rccCapturePipeline(rccImgProc *imgProc, rccVideoStreamer *streamer,
+                       rccVideoStreamer::rcc_stream_id_t streamId,
+                       int numWorkers = 2, int queueDepth = 2,
+                       rccVideoStreamer::rcc_frame_type_t frameType =
+                       rccVideoStreamer::rcc_frame_bgr);
+    ~rccCapturePipeline(void);
+
+    // Frame views the pipeline can hold at once - rccImgProc needs at least
+    // one more buffer than this
+    static int maxHeldFrames(int numWorkers = 2, int queueDepth = 2)
+    {
+        return numWorkers * (queueDepth + 1) + 1;
+    };
+
+    bool start(int fps);
+    void stop(void);
+    bool isRunning(void) { return mRunning; };
+
+    bool getStats(rcc_pipe_stage_t stage, rcc_pipe_stats_t &stats);
+
+private:
+    // Frame pool entry, handles passed between stages are indexes to mFrames
+    typedef struct rcc_pipe_frame_s {
+        rccFrameView       view;    // captured frame (V4L2 buffer)
+        cv::Mat            frame;   // converted frame (mFrameType)
+        std::vector<uchar> encoded; // JPEG encoded frame
+        uint32_t           seq;     // capture sequence number
+        uint64_t           captureUs; // CLOCK_MONOTONIC, 0 - not known
+        std::atomic<bool>  inUse;
+    } rcc_pipe_frame_t;
+
+    // Wakeup of sleeping stage, data itself goes through lock-free rings
+    class rccNotifier {
+    public:
+        rccNotifier(void) : mFlag(false) {};
+        void notify(void)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mFlag = true;
+            }
+            mCond.notify_one();
+        };
+        void wait(void)
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCond.wait(lock, [this]{ return mFlag; });
+            mFlag = false;
+        };
+    private:
+        std::mutex              mMutex;
+        std::condition_variable mCond;
+        bool                    mFlag;
+    };
+
+    typedef struct rcc_pipe_counters_s {
+        std::atomic<uint64_t> processed;
+        std::atomic<uint64_t> dropped;
+        std::atomic<uint64_t> latSumUs; // of frames with known capture time
+        std::atomic<uint64_t> latCount;
+        std::atomic<uint64_t> latMaxUs;
+    } rcc_pipe_counters_t;
+
+    void captureThread(int fps);
+    void encodeThread(int worker);
+    void sendThread(void);
+
+    void addLatency(rcc_pipe_counters_t &counters, uint64_t captureUs);
+    int  acquireFrame(void);
+    void releaseFrame(int idx);
+
+    rccImgProc                         *mImgProc;
+    rccVideoStreamer                   *mStreamer;
+    rccVideoStreamer::rcc_stream_id_t   mStreamId;
+    int                                 mNumWorkers;
+    rccVideoStreamer::rcc_frame_type_t  mFrameType;
+
+    std::atomic<bool>                   mRunning;
+    std::unique_ptr<rcc_pipe_frame_t[]> mFrames;
+    int                                 mNumFrames;
+    rccFrameView                        mScratch; // used when pool is empty
+
+    // one input & output ring per encode worker to keep them SPSC
+    std::vector<std::unique_ptr<rccSpscRing<int> > > mEncodeRings;
+    std::vector<std::unique_ptr<rccSpscRing<int> > > mSendRings;
+    std::unique_ptr<rccNotifier[]>                   mEncodeNotify;
+    // frame index parked by capture thread when the ring is full, -1 if none
+    std::unique_ptr<std::atomic<int>[]>              mEncodeLatest;
+    rccNotifier                                      mSendNotify;
+
+    rcc_pipe_counters_t                 mCounters[rcc_pipe_stage_nonexisting];
+
+    std::thread                        *mCaptureThread;
+    std::vector<std::thread *>          mEncodeThreads;
+    std::thread                        *mSendThread;
+};
+
+#endif // __RCC_CAPTURE_PIPELINE_H
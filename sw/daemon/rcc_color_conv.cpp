@@ -0,0 +1,244 @@
+#include "rcc_color_conv.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RCC_COLOR_CONV_NEON
+#include <arm_neon.h>
+#endif
+
+// BT.601 limited range YUV -> RGB coefficients scaled by 64
+const int cCoefY  = 74;  // 1.164
+const int cCoefRV = 102; // 1.596
+const int cCoefGV = 52;  // 0.813
+const int cCoefGU = 25;  // 0.391
+const int cCoefBU = 129; // 2.018
+
+static inline uint8_t clampShift6(int val)
+{
+    // same as NEON vqrshrun_n_s16(val, 6)
+    val = (val + 32) >> 6;
+    return (val < 0) ? 0 : ((val > 255) ? 255 : val);
+}
+
+static inline int lumaScaled(uint8_t y)
+{
+    return ((y > 16) ? (y - 16) : 0) * cCoefY;
+}
+
+// Row helpers process pixels [x, width) - NEON versions use them for tails
+static void yuyvToGreyRow(const uint8_t *src, uint8_t *dst, int x, int width)
+{
+    for(; x < width; x++)
+    {
+        dst[x] = src[2 * x];
+    }
+}
+
+static void yuyvToI420Rows(const uint8_t *src0, const uint8_t *src1,
+                           uint8_t *dstY0, uint8_t *dstY1,
+                           uint8_t *dstU, uint8_t *dstV, int x, int width)
+{
+    for(; x < width; x += 2)
+    {
+        const uint8_t *p0 = src0 + 2 * x;
+        const uint8_t *p1 = src1 + 2 * x;
+
+        dstY0[x]     = p0[0];
+        dstY0[x + 1] = p0[2];
+        dstY1[x]     = p1[0];
+        dstY1[x + 1] = p1[2];
+        dstU[x / 2]  = (p0[1] + p1[1] + 1) >> 1;
+        dstV[x / 2]  = (p0[3] + p1[3] + 1) >> 1;
+    }
+}
+
+static void yuyvToBgrRow(const uint8_t *src, uint8_t *dst, int x, int width)
+{
+    for(; x < width; x += 2)
+    {
+        const uint8_t *p = src + 2 * x;
+        uint8_t *d = dst + 3 * x;
+        int u = p[1] - 128;
+        int v = p[3] - 128;
+        int rOff = cCoefRV * v;
+        int gOff = -cCoefGV * v - cCoefGU * u;
+        int bOff = cCoefBU * u;
+        int y0 = lumaScaled(p[0]);
+        int y1 = lumaScaled(p[2]);
+
+        d[0] = clampShift6(y0 + bOff);
+        d[1] = clampShift6(y0 + gOff);
+        d[2] = clampShift6(y0 + rOff);
+        d[3] = clampShift6(y1 + bOff);
+        d[4] = clampShift6(y1 + gOff);
+        d[5] = clampShift6(y1 + rOff);
+    }
+}
+
+void rccYuyvToGreyScalar(const uint8_t *src, int srcStride,
+                         uint8_t *dst, int dstStride, int width, int height)
+{
+    for(int y = 0; y < height; y++)
+    {
+        yuyvToGreyRow(src + y * srcStride, dst + y * dstStride, 0, width);
+    }
+}
+
+void rccYuyvToI420Scalar(const uint8_t *src, int srcStride,
+                         uint8_t *dstY, int dstYStride,
+                         uint8_t *dstU, int dstUStride,
+                         uint8_t *dstV, int dstVStride, int width, int height)
+{
+    for(int y = 0; y < height; y += 2)
+    {
+        yuyvToI420Rows(src + y * srcStride, src + (y + 1) * srcStride,
+                       dstY + y * dstYStride, dstY + (y + 1) * dstYStride,
+                       dstU + (y / 2) * dstUStride, dstV + (y / 2) * dstVStride,
+                       0, width);
+    }
+}
+
+void rccYuyvToBgrScalar(const uint8_t *src, int srcStride,
+                        uint8_t *dst, int dstStride, int width, int height)
+{
+    for(int y = 0; y < height; y++)
+    {
+        yuyvToBgrRow(src + y * srcStride, dst + y * dstStride, 0, width);
+    }
+}
+
+#ifdef RCC_COLOR_CONV_NEON
+// All NEON kernels process 16 pixels (32 bytes of YUYV) per iteration
+
+static void yuyvToGreyRowNeon(const uint8_t *src, uint8_t *dst, int width)
+{
+    int x = 0;
+
+    for(; x <= (width - 16); x += 16)
+    {
+        uint8x16x2_t yuyv = vld2q_u8(src + 2 * x);
+        vst1q_u8(dst + x, yuyv.val[0]);
+    }
+    yuyvToGreyRow(src, dst, x, width);
+}
+
+static void yuyvToI420RowsNeon(const uint8_t *src0, const uint8_t *src1,
+                               uint8_t *dstY0, uint8_t *dstY1,
+                               uint8_t *dstU, uint8_t *dstV, int width)
+{
+    int x = 0;
+
+    for(; x <= (width - 16); x += 16)
+    {
+        // val[0] - Y, val[1] - interleaved U/V
+        uint8x16x2_t yuyv0 = vld2q_u8(src0 + 2 * x);
+        uint8x16x2_t yuyv1 = vld2q_u8(src1 + 2 * x);
+
+        vst1q_u8(dstY0 + x, yuyv0.val[0]);
+        vst1q_u8(dstY1 + x, yuyv1.val[0]);
+
+        uint8x16_t uv = vrhaddq_u8(yuyv0.val[1], yuyv1.val[1]);
+        uint8x8x2_t uvSplit = vuzp_u8(vget_low_u8(uv), vget_high_u8(uv));
+        vst1_u8(dstU + x / 2, uvSplit.val[0]);
+        vst1_u8(dstV + x / 2, uvSplit.val[1]);
+    }
+    yuyvToI420Rows(src0, src1, dstY0, dstY1, dstU, dstV, x, width);
+}
+
+static void yuyvToBgrRowNeon(const uint8_t *src, uint8_t *dst, int width)
+{
+    const uint8x8_t c16  = vdup_n_u8(16);
+    const uint8x8_t c128 = vdup_n_u8(128);
+    const uint8x8_t cY   = vdup_n_u8(cCoefY);
+    int x = 0;
+
+    for(; x <= (width - 16); x += 16)
+    {
+        // val[0] - Y of even pixels, val[1] - U, val[2] - Y odd, val[3] - V
+        uint8x8x4_t yuyv = vld4_u8(src + 2 * x);
+
+        int16x8_t y0 = vreinterpretq_s16_u16(
+            vmull_u8(vqsub_u8(yuyv.val[0], c16), cY));
+        int16x8_t y1 = vreinterpretq_s16_u16(
+            vmull_u8(vqsub_u8(yuyv.val[2], c16), cY));
+        int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(yuyv.val[1], c128));
+        int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(yuyv.val[3], c128));
+
+        int16x8_t rOff = vmulq_n_s16(v, cCoefRV);
+        int16x8_t gOff = vmlaq_n_s16(vmulq_n_s16(v, -cCoefGV), u, -cCoefGU);
+        int16x8_t bOff = vmulq_n_s16(u, cCoefBU);
+
+        // saturation at 16 bits only happens above 255 << 6
+        uint8x8x2_t b = vzip_u8(vqrshrun_n_s16(vqaddq_s16(y0, bOff), 6),
+                                vqrshrun_n_s16(vqaddq_s16(y1, bOff), 6));
+        uint8x8x2_t g = vzip_u8(vqrshrun_n_s16(vqaddq_s16(y0, gOff), 6),
+                                vqrshrun_n_s16(vqaddq_s16(y1, gOff), 6));
+        uint8x8x2_t r = vzip_u8(vqrshrun_n_s16(vqaddq_s16(y0, rOff), 6),
+                                vqrshrun_n_s16(vqaddq_s16(y1, rOff), 6));
+
+        uint8x8x3_t bgr;
+        bgr.val[0] = b.val[0];
+        bgr.val[1] = g.val[0];
+        bgr.val[2] = r.val[0];
+        vst3_u8(dst + 3 * x, bgr);
+        bgr.val[0] = b.val[1];
+        bgr.val[1] = g.val[1];
+        bgr.val[2] = r.val[1];
+        vst3_u8(dst + 3 * x + 24, bgr);
+    }
+    yuyvToBgrRow(src, dst, x, width);
+}
+#endif // RCC_COLOR_CONV_NEON
+
+void rccYuyvToGrey(const uint8_t *src, int srcStride,
+                   uint8_t *dst, int dstStride, int width, int height)
+{
+#ifdef RCC_COLOR_CONV_NEON
+    for(int y = 0; y < height; y++)
+    {
+        yuyvToGreyRowNeon(src + y * srcStride, dst + y * dstStride, width);
+    }
+#else
+    rccYuyvToGreyScalar(src, srcStride, dst, dstStride, width, height);
+#endif
+}
+
+void rccYuyvToI420(const uint8_t *src, int srcStride,
+                   uint8_t *dstY, int dstYStride,
+                   uint8_t *dstU, int dstUStride,
+                   uint8_t *dstV, int dstVStride, int width, int height)
+{
+#ifdef RCC_COLOR_CONV_NEON
+    for(int y = 0; y < height; y += 2)
+    {
+        yuyvToI420RowsNeon(src + y * srcStride, src + (y + 1) * srcStride,
+                           dstY + y * dstYStride, dstY + (y + 1) * dstYStride,
+                           dstU + (y / 2) * dstUStride,
+                           dstV + (y / 2) * dstVStride, width);
+    }
+#else
+    rccYuyvToI420Scalar(src, srcStride, dstY, dstYStride, dstU, dstUStride,
+                        dstV, dstVStride, width, height);
+#endif
+}
+
+void rccYuyvToBgr(const uint8_t *src, int srcStride,
+                  uint8_t *dst, int dstStride, int width, int height)
+{
+#ifdef RCC_COLOR_CONV_NEON
+    for(int y = 0; y < height; y++)
+    {
+        yuyvToBgrRowNeon(src + y * srcStride, dst + y * dstStride, width);
+    }
+#else
+    rccYuyvToBgrScalar(src, srcStride, dst, dstStride, width, height);
+#endif
+}
+
+bool rccColorConvHasNeon(void)
+{
+#ifdef RCC_COLOR_CONV_NEON
+    return true;
+#else
+    return false;
+#endif
+}
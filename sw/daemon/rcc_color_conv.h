@@ -0,0 +1,42 @@
+#ifndef __RCC_COLOR_CONV_H
+#define __RCC_COLOR_CONV_H
+
+#include <stdint.h>
+
+// Colour conversion kernels for packed YUYV (YUV 4:2:2) camera frames.
+// rccYuyvTo*() use NEON when compiled for ARM with NEON enabled (i.e.
+// -mfpu=neon on Zynq) and fall back to the scalar versions otherwise. Scalar
+// and NEON versions use the same fixed point arithmetic and give bit-exact
+// results, scalar ones are exported so they can be checked on any host.
+//
+// All strides are in bytes, width must be even (and height even for I420).
+// YUV->BGR uses BT.601 limited range with 6-bit coefficients, the same
+// formula as OpenCV's YUV2BGR_YUYV up to rounding (+-2).
+
+// Y (luma) plane only - grey image
+void rccYuyvToGrey(const uint8_t *src, int srcStride,
+                   uint8_t *dst, int dstStride, int width, int height);
+
+// Planar I420 - chroma of two lines is averaged
+void rccYuyvToI420(const uint8_t *src, int srcStride,
+                   uint8_t *dstY, int dstYStride,
+                   uint8_t *dstU, int dstUStride,
+                   uint8_t *dstV, int dstVStride, int width, int height);
+
+// Packed BGR 8:8:8
+void rccYuyvToBgr(const uint8_t *src, int srcStride,
+                  uint8_t *dst, int dstStride, int width, int height);
+
+void rccYuyvToGreyScalar(const uint8_t *src, int srcStride,
+                         uint8_t *dst, int dstStride, int width, int height);
+void rccYuyvToI420Scalar(const uint8_t *src, int srcStride,
+                         uint8_t *dstY, int dstYStride,
+                         uint8_t *dstU, int dstUStride,
+                         uint8_t *dstV, int dstVStride, int width, int height);
+void rccYuyvToBgrScalar(const uint8_t *src, int srcStride,
+                        uint8_t *dst, int dstStride, int width, int height);
+
+// True when rccYuyvTo*() run NEON code
+bool rccColorConvHasNeon(void);
+
+#endif // __RCC_COLOR_CONV_H
@@ -1,16 +1,30 @@
+#include <unistd.h>
+
+#include <sstream>
+
 #include <rcci_server.h>
 #include <rcc_logger.h>
 #include <rcc_sys_ctrl.h>
+#include <rcc_img_proc.h>
+#include <rcc_video_streamer.h>
+#include <rcc_capture_pipeline.h>
+
+const unsigned int cDriveStatsPeriodS = 10;
+const int cDriveWdogTimeoutMs = 250; // ~15 lost PWM periods
+const int cDriveWdogRampMs    = 100;
 
 static rcciServer *myServer = NULL;
 static rccSysCtrl *mySysCtrl = NULL;
+static rccImgProc *myImgProc = NULL;
+static rccVideoStreamer *myStreamer = NULL;
+static rccCapturePipeline *myPipeline = NULL;
 
 // TODO: Try to add call-backs a little bit nicer
-static void pushLogToClients(std::string &str)
+static void pushLogToClients(std::string &str, uint64_t offset)
 {
     if(myServer)
     {
-        myServer->writeServiceLog(str);
+        myServer->writeServiceLog(str, offset);
     }
 }
 
@@ -22,17 +36,83 @@ static void pushDataToDrvCtrl(rcci_msg_drv_ctrl_t drvCtrlData)
     }
 }
 
+static void pushVideoToClients(rccVideoStreamer::rcc_stream_id_t,
+                               const uint8_t *data, size_t size,
+                               const rccVideoStreamer::rcc_frame_info_t &info)
+{
+    if(myServer)
+    {
+        // capture time & sequence go to v2 clients for latency measurement
+        myServer->writeServiceVideo(data, size, info.captureUs, info.seq);
+    }
+}
+
+// Camera frames are encoded by the capture pipeline and go to unicast
+// video clients of the server only (stream without multicast)
+static bool startVideo(const char *device)
+{
+    std::ostringstream strStream;
+
+    myImgProc = new rccImgProc();
+    myImgProc->setNumBuffers(rccCapturePipeline::maxHeldFrames() + 1);
+    if(!myImgProc->open(device))
+    {
+        strStream << "Can not open video device " << device << std::endl;
+        getLogger().error(strStream.str());
+        return false;
+    }
+
+    int fps = (int)myImgProc->getFps();
+    myStreamer = new rccVideoStreamer();
+    rccVideoStreamer::rcc_stream_id_t streamId =
+        myStreamer->addStream("video", fps, 0);
+    if(streamId < 0)
+    {
+        return false;
+    }
+    myStreamer->setFrameCb(&pushVideoToClients);
+
+    myPipeline = new rccCapturePipeline(myImgProc, myStreamer, streamId);
+    if(!myPipeline->start(fps))
+    {
+        strStream << "Can not start capture pipeline" << std::endl;
+        getLogger().error(strStream.str());
+        return false;
+    }
+
+    strStream << "Video service streaming " << device << " at " << fps
+              << " fps" << std::endl;
+    getLogger().debug(strStream.str());
+    return true;
+}
+
+static void stopVideo(void)
+{
+    delete myPipeline;
+    myPipeline = NULL;
+    delete myStreamer;
+    myStreamer = NULL;
+    delete myImgProc;
+    myImgProc = NULL;
+}
+
 int main(int argc, char *argv[])
 {
     int port = 1025;
+    const char *videoDevice = NULL;
 
     myServer = new rcciServer();
     mySysCtrl = new rccSysCtrl();
 
-    if(argc == 2)
+    if(argc > 1)
     {
         port = atoi(argv[1]);
     }
+    if(argc > 2)
+    {
+        // camera for the unicast video service (none - no video)
+        videoDevice = argv[2];
+    }
 
     if(!mySysCtrl->isInitialized())
     {
@@ -61,17 +141,82 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    if(videoDevice && !startVideo(videoDevice))
+    {
+        stopVideo();
+        return -1;
+    }
+
 
     // TODO: Check comment above - rccSysCtrl should be passed directly
     // to rcciServer and instead of callbacks just control directly
     mySysCtrl->pwmEnable(true);
+    if(!mySysCtrl->startWatchdog(cDriveWdogTimeoutMs, cDriveWdogRampMs))
+    {
+        std::cerr << "Can not start drive watchdog!" << std::endl;
+        return -1;
+    }
 
-
+    // everything is served from the server event loop & drive threads,
+    // just report drive statistics from time to time
+    uint64_t lastApplied = 0, lastFired = 0, lastVideoFrames = 0;
     while(true)
     {
-
+        rcciServer::rcci_drive_stats_t stats;
+        rccSysCtrl::rcc_wdog_stats_t wdogStats;
+        rcciServer::rcci_video_stats_t videoStats;
+
+        sleep(cDriveStatsPeriodS);
+        if(myServer->getDriveStats(stats) && (stats.applied != lastApplied))
+        {
+            std::ostringstream strStream;
+            strStream << "Drive: received=" << stats.received << " applied="
+                      << stats.applied << " stale=" << stats.stale
+                      << " coalesced=" << stats.coalesced << " invalid="
+                      << stats.invalid << " max latency=" << stats.latMaxUs
+                      << " [us] histogram:";
+            for(int i = 0; i < rcciServer::cDriveLatBuckets; i++)
+            {
+                if(stats.latHist[i])
+                {
+                    strStream << " <" << (rcciServer::cDriveLatBucketUs << i)
+                              << "us:" << stats.latHist[i];
+                }
+            }
+            strStream << std::endl;
+            getLogger().debug(strStream.str());
+            lastApplied = stats.applied;
+        }
+
+        mySysCtrl->getWatchdogStats(wdogStats);
+        if(wdogStats.fired != lastFired)
+        {
+            std::ostringstream strStream;
+            strStream << "Drive watchdog: fired=" << wdogStats.fired
+                      << " avg late=" << wdogStats.fireLateSumUs / wdogStats.fired
+                      << " max late=" << wdogStats.fireLateMaxUs
+                      << " [us] tick max late=" << wdogStats.wakeLateMaxUs
+                      << " [us] overruns=" << wdogStats.overruns << std::endl;
+            getLogger().debug(strStream.str());
+            lastFired = wdogStats.fired;
+        }
+
+        if(myServer->getVideoStats(videoStats) &&
+           (videoStats.frames != lastVideoFrames) && videoStats.clients)
+        {
+            std::ostringstream strStream;
+            strStream << "Video: clients=" << videoStats.clients
+                      << " frames=" << videoStats.frames
+                      << " sent=" << videoStats.sent
+                      << " dropped=" << videoStats.dropped
+                      << " fragments=" << videoStats.fragments
+                      << " reports=" << videoStats.reports << std::endl;
+            getLogger().debug(strStream.str());
+        }
+        lastVideoFrames = videoStats.frames;
     }
 
+    stopVideo();
     myServer->closeServer();
 
     delete mySysCtrl;
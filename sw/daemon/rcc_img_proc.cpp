@@ -5,11 +5,13 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include <iostream>
 #include <sstream>
 
 #include "rcc_img_proc.h"
+#include "rcc_color_conv.h"
 
 #ifdef V4L2_DIRECT_CTRL
 #include <sys/ioctl.h>
@@ -17,15 +19,98 @@
 #include <linux/videodev2.h>
 #endif
 
+const int cDefaultNumBuffers = 3;
+
+static void monotonicTimeval(struct timeval &tv)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    tv.tv_sec  = ts.tv_sec;
+    tv.tv_usec = ts.tv_nsec / 1000;
+}
+
+rccFrameView::rccFrameView(void)
+    : m_format(rcc_frame_fmt_none), m_sequence(0)
+{
+    memset(&m_timestamp, 0, sizeof(m_timestamp));
+}
+
+void rccFrameView::release(void)
+{
+    m_holder.reset();
+    m_mat = cv::Mat();
+    m_format = rcc_frame_fmt_none;
+}
+
+bool rccFrameView::getBgr(cv::Mat &a_frame) const
+{
+    switch(m_format)
+    {
+    case rcc_frame_fmt_yuyv:
+        a_frame.create(m_mat.rows, m_mat.cols, CV_8UC3);
+        rccYuyvToBgr(m_mat.data, m_mat.step, a_frame.data, a_frame.step,
+                     m_mat.cols, m_mat.rows);
+        return true;
+    case rcc_frame_fmt_bgr:
+        a_frame = m_mat;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool rccFrameView::getGrey(cv::Mat &a_frame) const
+{
+    switch(m_format)
+    {
+    case rcc_frame_fmt_yuyv:
+        a_frame.create(m_mat.rows, m_mat.cols, CV_8UC1);
+        rccYuyvToGrey(m_mat.data, m_mat.step, a_frame.data, a_frame.step,
+                      m_mat.cols, m_mat.rows);
+        return true;
+    case rcc_frame_fmt_bgr:
+        cv::cvtColor(m_mat, a_frame, CV_BGR2GRAY);
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool rccFrameView::getI420(cv::Mat &a_frame) const
+{
+    switch(m_format)
+    {
+    case rcc_frame_fmt_yuyv:
+    {
+        int width = m_mat.cols, height = m_mat.rows;
+        uint8_t *dstY, *dstU, *dstV;
+
+        a_frame.create(height * 3 / 2, width, CV_8UC1);
+        dstY = a_frame.data;
+        dstU = dstY + width * height;
+        dstV = dstU + (width / 2) * (height / 2);
+        rccYuyvToI420(m_mat.data, m_mat.step, dstY, width, dstU, width / 2,
+                      dstV, width / 2, width, height);
+        return true;
+    }
+    case rcc_frame_fmt_bgr:
+        cv::cvtColor(m_mat, a_frame, CV_BGR2YUV_I420);
+        return true;
+    default:
+        return false;
+    }
+}
 
 rccImgProc::rccImgProc(void)
     : m_devName(std::string("/dev/video0")), m_isOpened(false),
-      m_fps(-1), m_width(-1), m_height(-1), m_fourcc(-1)
+      m_fps(-1), m_width(-1), m_height(-1), m_fourcc(-1),
+      m_numBuffers(cDefaultNumBuffers), m_sequence(0)
 {
 #ifdef V4L2_DIRECT_CTRL
     m_devFd    = -1;
     m_v4l2Open = false;
     m_buffers.resize(0);
+    m_bufLengths.resize(0);
 #endif
 }
 
@@ -76,8 +161,32 @@ bool rccImgProc::close(void)
     return true;
 }
 
-bool rccImgProc::readFrame(cv::Mat &frame)
+bool rccImgProc::readFrame(cv::Mat &frame, uint64_t *captureUs,
+                           uint32_t *sequence)
 {
+    rccFrameView view;
+
+    if(!readFrame(view))
+    {
+        return false;
+    }
+    if(captureUs)
+    {
+        *captureUs = view.captureUs();
+    }
+    if(sequence)
+    {
+        *sequence = view.sequence();
+    }
+
+    // buffer is re-queued when view goes out of scope
+    return view.getBgr(frame);
+}
+
+bool rccImgProc::readFrame(rccFrameView &a_view)
+{
+    a_view.release();
+
     if(!isOpened())
     {
         return false;
@@ -86,13 +195,20 @@ bool rccImgProc::readFrame(cv::Mat &frame)
 #ifdef V4L2_DIRECT_CTRL
     if(m_v4l2Open)
     {
-        struct timeval timestamp;
-        return readV4L2Frame(frame, timestamp);
+        return readV4L2Frame(a_view);
     }
 #endif
 
+    cv::Mat frame;
     m_videoCap >> frame;
 
+    // cv::Mat already keeps reference count for decoded frame
+    a_view.m_mat = frame;
+    a_view.m_format = frame.empty() ? rccFrameView::rcc_frame_fmt_none :
+        rccFrameView::rcc_frame_fmt_bgr;
+    a_view.m_holder = std::shared_ptr<void>(a_view.m_mat.data, [](void *){});
+    a_view.m_sequence = m_sequence++;
+    monotonicTimeval(a_view.m_timestamp);
 
     return true;
 }
@@ -204,7 +320,7 @@ bool rccImgProc::initV4L2Device(void)
     if(!m_v4l2Open)
         return false;
 
-    req.count = 3;
+    req.count = m_numBuffers;
     req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     req.memory = V4L2_MEMORY_MMAP;
 
@@ -215,7 +331,9 @@ bool rccImgProc::initV4L2Device(void)
         return false;
     }
 
+    // driver might change the number of buffers
     int numBuffers = req.count;
+    m_numBuffers = numBuffers;
 
     for(int i = 0; i < numBuffers; i++)
     {
@@ -234,7 +352,14 @@ bool rccImgProc::initV4L2Device(void)
         buffer = (uint8_t *)mmap (NULL, buf.length,
                                  PROT_READ | PROT_WRITE, MAP_SHARED,
                                  m_devFd, buf.m.offset);
+        if(buffer == MAP_FAILED)
+        {
+            std::cerr << "initV4L2Device() mmap failed: "
+                      << strerror(errno) << std::endl;
+            return false;
+        }
         m_buffers.push_back(buffer);
+        m_bufLengths.push_back(buf.length);
     }
 
     for(int i = 0; i < numBuffers; i++)
@@ -268,6 +393,19 @@ bool rccImgProc::initV4L2Device(void)
 
 void rccImgProc::closeV4L2Device(void)
 {
+    if(m_devFd > 0)
+    {
+        v4l2_buf_type buf_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(m_devFd, VIDIOC_STREAMOFF, &buf_type);
+    }
+
+    for(size_t i = 0; i < m_buffers.size(); i++)
+    {
+        munmap(m_buffers[i], m_bufLengths[i]);
+    }
+    m_buffers.clear();
+    m_bufLengths.clear();
+
     if(m_devFd > 0)
     {
         ::close(m_devFd);
@@ -276,8 +414,7 @@ void rccImgProc::closeV4L2Device(void)
     m_v4l2Open = false;
 }
 
-bool rccImgProc::readV4L2Frame(cv::Mat &a_frame,
-                               struct timeval &a_timestamp)
+bool rccImgProc::readV4L2Frame(rccFrameView &a_view)
 {
     fd_set fds;
     FD_ZERO(&fds);
@@ -317,23 +454,49 @@ bool rccImgProc::readV4L2Frame(cv::Mat &a_frame,
         return false;
     }
 
-    // Here copy received buffer
-    cv::Mat yuvFrame(cv::Mat(m_height, m_width, CV_8UC2, m_buffers[buf.index]));
+    // No copy - view points directly to the mmap'd buffer and re-queues it
+    // when last reference is released
+    uint32_t index = buf.index;
+    a_view.m_mat = cv::Mat(m_height, m_width, CV_8UC2, m_buffers[index]);
+    a_view.m_format = rccFrameView::rcc_frame_fmt_yuyv;
+    a_view.m_holder = std::shared_ptr<void>(m_buffers[index],
+                                            [this, index](void *)
+                                            {
+                                                requeueV4L2Buffer(index);
+                                            });
+    a_view.m_sequence = buf.sequence;
+    // end of frame on CLOCK_MONOTONIC for most drivers, other clocks can not
+    // be compared with the rest of the system
+    if((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+       V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+    {
+        memcpy(&a_view.m_timestamp, &buf.timestamp, sizeof(struct timeval));
+    }
+    else
+    {
+        monotonicTimeval(a_view.m_timestamp);
+    }
+
+    return true;
+}
+
+// Can be called from any thread holding the last view of the buffer
+void rccImgProc::requeueV4L2Buffer(uint32_t a_index)
+{
+    v4l2_buffer buf = v4l2_buffer();
 
-    // TODO: convert to RGB - should move anyway ASAP to camera to acquire directly RGB
-    cv::cvtColor(yuvFrame, a_frame, CV_YUV2BGR_YUYV);
+    if(!m_v4l2Open || (a_index >= m_buffers.size()))
+        return;
 
-    memcpy(&a_timestamp, &buf.timestamp, sizeof(struct timeval));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = a_index;
 
-    // buf.index points to correct buffer
     if(xioctl(m_devFd, VIDIOC_QBUF, &buf) == -1)
     {
-        std::cerr << "readV4L2Frame() VIDIOC_QBUF failed: "
+        std::cerr << "requeueV4L2Buffer() VIDIOC_QBUF failed: "
                   << strerror(errno) << std::endl;
-        return false;
     }
-
-    return true;
 }
 
 #endif // V4L2_DIRECT_CTRL
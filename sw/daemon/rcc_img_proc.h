@@ -3,6 +3,8 @@
 
 #include <string>
 #include <ctime>
+#include <memory>
+#include <sys/time.h>
 
 #include "opencv2/opencv.hpp"
 
@@ -10,6 +12,57 @@
 // slow OpenCV VideoCapture overhead - recommended for RCC ;-)
 #define V4L2_DIRECT_CTRL
 
+// Reference counted view of a captured frame. For V4L2 devices it points
+// directly to the dequeued (YUYV) mmap buffer which is re-queued to the driver
+// when the last copy of the view is released, for other inputs it holds the
+// decoded BGR frame. Consumers convert to the format they need on demand.
+// All views must be released before rccImgProc::close().
+class rccFrameView {
+public:
+    typedef enum rcc_frame_fmt_e {
+        rcc_frame_fmt_none = 0,
+        rcc_frame_fmt_yuyv,     // packed YUV 4:2:2 (V4L2 buffer)
+        rcc_frame_fmt_bgr       // packed BGR 8:8:8
+    } rcc_frame_fmt_t;
+
+    rccFrameView(void);
+
+    bool isValid(void) const { return (bool)m_holder; };
+    void release(void);
+
+    rcc_frame_fmt_t format(void) const { return m_format; };
+    int width(void) const  { return m_mat.cols; };
+    int height(void) const { return m_mat.rows; };
+    const uint8_t *data(void) const { return m_mat.data; };
+    // Capture time on CLOCK_MONOTONIC (V4L2 buffer timestamp when the driver
+    // uses that clock, dequeue time otherwise)
+    const struct timeval &timestamp(void) const { return m_timestamp; };
+    uint64_t captureUs(void) const
+    {
+        return (uint64_t)m_timestamp.tv_sec * 1000000 + m_timestamp.tv_usec;
+    };
+    uint32_t sequence(void) const { return m_sequence; };
+
+    // Zero-copy access to the underlying buffer (CV_8UC2 or CV_8UC3)
+    const cv::Mat &mat(void) const { return m_mat; };
+
+    // Conversions, a_frame is reused if it already has the right size. YUYV
+    // input is converted with rcc_color_conv kernels (NEON on target).
+    bool getBgr(cv::Mat &a_frame) const;
+    bool getGrey(cv::Mat &a_frame) const;
+    // Planar I420 in single CV_8UC1 matrix of (height * 3 / 2) x width
+    bool getI420(cv::Mat &a_frame) const;
+
+private:
+    friend class rccImgProc;
+
+    std::shared_ptr<void> m_holder; // re-queues V4L2 buffer when last ref is gone
+    cv::Mat               m_mat;
+    rcc_frame_fmt_t       m_format;
+    struct timeval        m_timestamp;
+    uint32_t              m_sequence;
+};
+
 class rccImgProc {
 public:
     rccImgProc(void);
@@ -19,9 +72,17 @@ public:
     bool isOpened(void) { return m_isOpened; };
     bool close(void);
 
-    bool readFrame(cv::Mat &frame);
+    // captureUs & sequence (if given) describe the frame as rccFrameView does
+    bool readFrame(cv::Mat &frame, uint64_t *captureUs = NULL,
+                   uint32_t *sequence = NULL);
+    bool readFrame(rccFrameView &a_view);
     void reset(void);
 
+    // Number of V4L2 buffers - must be set before open(), each frame view
+    // held by consumers keeps one of them
+    void setNumBuffers(int a_numBuffers) { m_numBuffers = a_numBuffers; };
+    int  getNumBuffers(void) { return m_numBuffers; };
+
     int getFps(void)    { return m_fps; };
     int getWidth(void)  { return m_width; };
     int getHeight(void) { return m_height; };
@@ -33,13 +94,16 @@ private:
     bool openV4L2Device(std::string a_devName);
     bool initV4L2Device(void);
     void closeV4L2Device(void);
-    bool readV4L2Frame(cv::Mat &a_frame, struct timeval &a_timestamp);
+    bool readV4L2Frame(rccFrameView &a_view);
+    void requeueV4L2Buffer(uint32_t a_index);
 #endif
 
 private:
     std::string      m_devName;
     bool             m_isOpened;
     int              m_fps, m_width, m_height, m_fourcc;
+    int              m_numBuffers;
+    uint32_t         m_sequence; // used when input is not V4L2
 
     cv::VideoCapture m_videoCap;
 
@@ -47,6 +111,7 @@ private:
     bool                   m_v4l2Open; // if True then m_videoCap is not valid
     int                    m_devFd;
     std::vector<uint8_t *> m_buffers; // frame buffers
+    std::vector<size_t>    m_bufLengths;
 #endif
 };
 
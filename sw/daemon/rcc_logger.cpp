@@ -3,24 +3,62 @@
 #include <iostream>
 #include <sstream>
 #include <cstring>
+#include <cstdio>
+#include <algorithm>
 #include <cerrno>
 #include <vector>
+#include <chrono>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 
 #include "rcc_logger.h"
 
+const size_t rccLogger::cRingSize;
+const size_t rccLogger::cRecordTextSize;
+const size_t rccLogger::cHistorySize;
+
+// Producers wake up drain thread only when it sleeps, a missed wake-up
+// (race between check and wait) is covered by this timeout
+const int cDrainSleepMs = 10;
+
+static const char cTruncated[] = "...\n";
+
 rccLogger::rccLogger(void)
-    : mLogStream(nullptr), mCbFunc(NULL)
+    : mRing(new rcc_log_record_t[cRingSize]), mHead(0), mTail(0),
+      mDrained(0), mDropped(0), mDroppedReported(0),
+      mDrainThread(NULL), mDrainRunning(true), mDrainWaiting(false),
+      mHistory(new char[cHistorySize]), mHistoryPos(0), mHistoryLen(0),
+      mLogStream(nullptr), mCbFunc(NULL), mOffset(0)
 {
-    mLog.clear();
+    static_assert((cRingSize & (cRingSize - 1)) == 0,
+                  "cRingSize must be power of 2");
+
+    for(size_t i = 0; i < cRingSize; i++)
+    {
+        mRing[i].seq = i;
+    }
+
+    // reserve callback string so drain thread does not allocate per record
+    mCbStr.reserve(cRecordTextSize);
+
     mLevel = rccLoggerError;
-    mOutputs = rccLoggerErr;
+    mOutputs = rccLoggerRam | rccLoggerOut | rccLoggerErr;
+
+    mDrainThread = new std::thread(&rccLogger::drainThread, this);
 }
 
 rccLogger::~rccLogger(void)
 {
+    mDrainRunning = false;
+    if(mDrainThread)
+    {
+        mDrainCv.notify_one();
+        mDrainThread->join();
+        delete mDrainThread;
+        mDrainThread = NULL;
+    }
+
     if(mLogBuf.is_open())
     {
         mLogBuf.close();
@@ -30,6 +68,13 @@ rccLogger::~rccLogger(void)
 
 int rccLogger::setFilename(std::string fName)
 {
+    std::lock_guard<std::mutex> lock(mSinkMutex);
+
+    if(mLogBuf.is_open())
+    {
+        mLogBuf.close();
+    }
+
     mLogName = fName;
     mLogBuf.open(mLogName.c_str(), std::ios::out|std::ios::trunc);
 
@@ -45,6 +90,8 @@ int rccLogger::setFilename(std::string fName)
 
 int rccLogger::setCallback(logFuncCb cbFunc)
 {
+    std::lock_guard<std::mutex> lock(mSinkMutex);
+
     mCbFunc = cbFunc;
     return 0;
 }
@@ -57,39 +104,246 @@ int rccLogger::setLogging(int level, int outputs)
     return 0;
 }
 
-int rccLogger::print(int level, std::string &str)
+// Bounded MPSC ring: slot is free for producer of position 'pos' when its
+// seq == pos, producer publishes it with seq = pos + 1 and drain thread
+// returns it with seq = pos + cRingSize.
+int rccLogger::print(int level, const char *str, size_t len)
 {
-    // implement level checks
-    if(level == rccLoggerErr)
+    size_t pos = mHead.load(std::memory_order_relaxed);
+    rcc_log_record_t *rec;
+
+    while(true)
+    {
+        rec = &mRing[pos & (cRingSize - 1)];
+        size_t seq = rec->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if(diff == 0)
+        {
+            if(mHead.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if(diff < 0)
+        {
+            // ring full - never block the caller
+            mDropped++;
+            return -1;
+        }
+        else
+        {
+            pos = mHead.load(std::memory_order_relaxed);
+        }
+    }
+
+    rec->level = level;
+    if(len > cRecordTextSize)
+    {
+        size_t keep = cRecordTextSize - (sizeof(cTruncated) - 1);
+        memcpy(rec->text, str, keep);
+        memcpy(rec->text + keep, cTruncated, sizeof(cTruncated) - 1);
+        rec->len = cRecordTextSize;
+    }
+    else
+    {
+        memcpy(rec->text, str, len);
+        rec->len = len;
+    }
+    rec->seq.store(pos + 1, std::memory_order_release);
+
+    if(mDrainWaiting.load(std::memory_order_relaxed))
+    {
+        mDrainCv.notify_one();
+    }
+
+    return 0;
+}
+
+void rccLogger::flush(void)
+{
+    size_t target = mHead.load();
+    std::unique_lock<std::mutex> lock(mDrainMutex);
+
+    mDrainCv.notify_one();
+    mFlushCv.wait_for(lock, std::chrono::seconds(1),
+                      [this, target]{ return (mDrained >= target) ||
+                                      !mDrainRunning; });
+}
+
+void rccLogger::clearLog(void)
+{
+    std::lock_guard<std::mutex> lock(mSinkMutex);
+
+    mHistoryPos = 0;
+    mHistoryLen = 0;
+}
+
+void rccLogger::getLog(std::string &log, size_t maxBytes)
+{
+    std::lock_guard<std::mutex> lock(mSinkMutex);
+    size_t len = std::min(maxBytes, mHistoryLen);
+    size_t start = (mHistoryPos + cHistorySize - len) % cHistorySize;
+
+    log.clear();
+    if(start + len <= cHistorySize)
     {
-        std::cerr << str;
+        log.append(&mHistory[start], len);
     }
     else
     {
-        std::cout << str;
+        log.append(&mHistory[start], cHistorySize - start);
+        log.append(&mHistory[0], len - (cHistorySize - start));
+    }
+}
+
+uint64_t rccLogger::readLog(uint64_t offset, char *buf, size_t maxBytes,
+                            size_t &len, uint64_t &end)
+{
+    std::lock_guard<std::mutex> lock(mSinkMutex);
+
+    // mOffset only changes with mSinkMutex held
+    end = mOffset;
+    offset = std::max(offset, end - mHistoryLen);
+    offset = std::min(offset, end);
+    len = std::min(maxBytes, (size_t)(end - offset));
+
+    size_t start = (mHistoryPos + cHistorySize - (size_t)(end - offset)) %
+        cHistorySize;
+    size_t first = std::min(len, cHistorySize - start);
+    memcpy(buf, &mHistory[start], first);
+    memcpy(buf + first, &mHistory[0], len - first);
+
+    return offset;
+}
+
+void rccLogger::appendHistory(const char *str, size_t len)
+{
+    if(len >= cHistorySize)
+    {
+        str += len - cHistorySize;
+        len = cHistorySize;
+    }
+
+    size_t first = std::min(len, cHistorySize - mHistoryPos);
+    memcpy(&mHistory[mHistoryPos], str, first);
+    memcpy(&mHistory[0], str + first, len - first);
+
+    mHistoryPos = (mHistoryPos + len) % cHistorySize;
+    mHistoryLen = std::min(mHistoryLen + len, cHistorySize);
+}
+
+// Called with mSinkMutex held
+void rccLogger::writeSinks(int level, const char *str, size_t len)
+{
+    int outputs = mOutputs;
+
+    if(level == rccLoggerErr)
+    {
+        if(outputs & rccLoggerErr)
+        {
+            std::cerr.write(str, len);
+        }
+    }
+    else if(outputs & rccLoggerOut)
+    {
+        std::cout.write(str, len);
     }
 
     if(mLogBuf.is_open())
     {
-        mLogStream << str << std::flush;
+        mLogStream.write(str, len);
     }
 
-    if((mOutputs & rccLoggerCB) && mCbFunc)
+    if((outputs & rccLoggerCB) && mCbFunc)
     {
-        mCbFunc(str);
+        mCbStr.assign(str, len);
+        mCbFunc(mCbStr, mOffset);
     }
 
-    mLog.append(str);
+    if(outputs & rccLoggerRam)
+    {
+        appendHistory(str, len);
+    }
+    else
+    {
+        // history must stay the tail of the stream
+        mHistoryPos = 0;
+        mHistoryLen = 0;
+    }
 
-    return 0;
+    mOffset += len;
 }
 
-void rccLogger::clearLog(void)
+bool rccLogger::drainRecords(void)
 {
-    mLog.clear();
+    std::lock_guard<std::mutex> lock(mSinkMutex);
+    bool any = false;
+
+    // bounded batch so getLog()/setters are not starved
+    for(size_t i = 0; i < cRingSize; i++)
+    {
+        rcc_log_record_t *rec = &mRing[mTail & (cRingSize - 1)];
+        if(rec->seq.load(std::memory_order_acquire) != (mTail + 1))
+        {
+            break;
+        }
+
+        writeSinks(rec->level, rec->text, rec->len);
+
+        rec->seq.store(mTail + cRingSize, std::memory_order_release);
+        mTail++;
+        any = true;
+    }
+
+    uint64_t dropped = mDropped;
+    if(dropped != mDroppedReported)
+    {
+        char buf[64];
+        int len = snprintf(buf, sizeof(buf), "rccLogger: %llu messages dropped\n",
+                           (unsigned long long)(dropped - mDroppedReported));
+        writeSinks(rccLoggerErr, buf, len);
+        mDroppedReported = dropped;
+    }
+
+    if(any)
+    {
+        // one flush per batch instead of one per message
+        if(mLogBuf.is_open())
+        {
+            mLogStream.flush();
+        }
+        std::cout.flush();
+    }
+
+    return any;
 }
 
-void rccLogger::getLog(std::string &log)
+void rccLogger::drainThread(void)
 {
-    log = mLog;
+    while(true)
+    {
+        bool any = drainRecords();
+
+        {
+            std::unique_lock<std::mutex> lock(mDrainMutex);
+            mDrained = mTail;
+            mFlushCv.notify_all();
+
+            if(!mDrainRunning)
+            {
+                break;
+            }
+            if(!any)
+            {
+                mDrainWaiting = true;
+                mDrainCv.wait_for(lock, std::chrono::milliseconds(cDrainSleepMs));
+                mDrainWaiting = false;
+            }
+        }
+    }
+
+    // whatever was logged while stopping
+    drainRecords();
 }
@@ -4,9 +4,22 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
 
 
 // Singleton class
+//
+// print() only copies the message into a fixed-size lock-free ring (many
+// producers, one consumer) and returns - it never blocks, allocates or does
+// I/O. Background drain thread writes records to stdout/stderr, log file and
+// callback (UDP log service) and keeps the last cHistorySize bytes in RAM for
+// getLog()/readLog(). If ring is full the message is dropped and counted.
+// Everything passed to sinks forms the log stream addressed by byte offsets
+// (getOffset()), RAM history is its tail.
 
 class rccLogger {
 public:
@@ -22,7 +35,12 @@ public:
         rccLoggerCB   = 16 // callback
     };
 
-    typedef void (*logFuncCb)(std::string &);
+    static const size_t cRingSize        = 1024; // records, power of 2
+    static const size_t cRecordTextSize  = 240;  // longer messages truncated
+    static const size_t cHistorySize     = 64 * 1024;
+
+    // log text and its offset in the log stream (see getOffset())
+    typedef void (*logFuncCb)(std::string &, uint64_t);
 
     static rccLogger& getInstance()
     {
@@ -34,14 +52,39 @@ public:
     int setCallback(logFuncCb cbFunc);
 
     int setLogging(int level, int outputs);
-    int print(int level, std::string &str);
-    int error(std::string str) { return print(rccLoggerErr, str); };
-    int debug(std::string str) { return print(rccLoggerOut, str); };
+    int print(int level, const char *str, size_t len);
+    int print(int level, const std::string &str)
+    {
+        return print(level, str.c_str(), str.length());
+    };
+    int error(const std::string &str) { return print(rccLoggerErr, str); };
+    int debug(const std::string &str) { return print(rccLoggerOut, str); };
+
+    // Blocks until everything logged so far went through the sinks
+    void flush(void);
 
     void clearLog(void);
-    void getLog(std::string &log);
+    // Snapshot of the RAM log, maxBytes limits it to the newest bytes
+    void getLog(std::string &log, size_t maxBytes = cHistorySize);
+    // Copies up to maxBytes of the RAM log from 'offset' (from the oldest
+    // byte kept if it is gone already) to buf, returns offset of the first
+    // copied byte, len - bytes copied, end - offset behind the newest byte
+    uint64_t readLog(uint64_t offset, char *buf, size_t maxBytes,
+                     size_t &len, uint64_t &end);
+
+    uint64_t getDropped(void) { return mDropped; };
+    // Bytes of all records passed to sinks so far - offsets given to the
+    // callback address this stream
+    uint64_t getOffset(void) { return mOffset; };
 
 private:
+    typedef struct rcc_log_record_s {
+        std::atomic<size_t> seq;   // ring slot sequence (see print())
+        int                 level;
+        uint32_t            len;
+        char                text[cRecordTextSize];
+    } rcc_log_record_t;
+
     rccLogger(void);
 
     rccLogger(rccLogger const &) = delete;
@@ -49,13 +92,38 @@ private:
 
     ~rccLogger(void);
 
-    // TODO: log rotation or at least protection we don't grow too much
-    std::string   mLog;
+    void drainThread(void);
+    bool drainRecords(void);
+    void writeSinks(int level, const char *str, size_t len);
+    void appendHistory(const char *str, size_t len);
+
+    std::unique_ptr<rcc_log_record_t[]> mRing;
+    char                 mPad0[64];
+    std::atomic<size_t>  mHead;       // next slot for producers
+    char                 mPad1[64];
+    size_t               mTail;       // next slot for drain thread
+    std::atomic<size_t>  mDrained;    // mTail visible to flush()
+    std::atomic<uint64_t> mDropped;
+    uint64_t             mDroppedReported;
+
+    std::thread         *mDrainThread;
+    std::atomic<bool>    mDrainRunning;
+    std::atomic<bool>    mDrainWaiting;
+    std::mutex           mDrainMutex;
+    std::condition_variable mDrainCv;
+    std::condition_variable mFlushCv;
+
+    // sinks - only touched by drain thread & setters
+    std::mutex    mSinkMutex;
+    std::unique_ptr<char[]> mHistory; // circular buffer of last log bytes
+    size_t        mHistoryPos, mHistoryLen;
+    std::string   mCbStr;
     std::string   mLogName;
     std::filebuf  mLogBuf;
     std::ostream  mLogStream;
-    int           mLevel, mOutputs;
+    std::atomic<int> mLevel, mOutputs;
     logFuncCb     mCbFunc;
+    std::atomic<uint64_t> mOffset;
 };
 
 #define getLogger() rccLogger::getInstance()
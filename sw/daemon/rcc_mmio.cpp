@@ -0,0 +1,412 @@
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+
+#include "rcc_mmio.h"
+#include "rcc_logger.h"
+
+static int64_t monotonicNs(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+rccMmio::rccMmio(uint32_t phyAddr, size_t size) :
+    mRegs(NULL), mSize(size), mMemFd(-1), mMapBase(NULL), mMapLen(0)
+{
+    void *pagePtr;
+    long pageAddr, pageOff, pageSize = sysconf(_SC_PAGESIZE);
+
+    std::ostringstream strStream;
+    mMemFd = open("/dev/mem", O_RDWR | O_SYNC);
+    if(mMemFd < 0)
+    {
+        strStream.str(std::string());
+        strStream << "open() of /dev/mem failed: " << strerror(errno) << std::endl;
+        getLogger().error(strStream.str());
+        return;
+    }
+
+    pageAddr   = phyAddr & (~(pageSize-1));
+    pageOff    = phyAddr - pageAddr;
+    mMapLen    = pageOff + size;
+    pagePtr    = mmap(NULL, mMapLen,
+                      PROT_READ | PROT_WRITE, MAP_SHARED,
+                      mMemFd, pageAddr);
+    if((void*)pagePtr == MAP_FAILED)
+    {
+        strStream.str(std::string());
+        strStream << "mmap() of /dev/mem failed: " << strerror(errno) << std::endl;
+        getLogger().error(strStream.str());
+        mMapLen = 0;
+        return;
+    }
+
+    mMapBase = pagePtr;
+    mRegs = (volatile uint32_t *)((uint8_t *)pagePtr + pageOff);
+}
+
+rccMmio::rccMmio(size_t size) :
+    mRegs(NULL), mSize(size), mMemFd(-1), mMapBase(NULL), mMapLen(0)
+{
+}
+
+rccMmio::~rccMmio(void)
+{
+    std::ostringstream strStream;
+
+    if(mMapBase)
+    {
+        if(munmap(mMapBase, mMapLen) < 0)
+        {
+            strStream.str(std::string());
+            strStream << "munmap() failed: " << strerror(errno) << std::endl;
+            getLogger().error(strStream.str());
+        }
+        mMapBase = NULL;
+    }
+    mRegs = NULL;
+
+    if(mMemFd >= 0)
+    {
+        close(mMemFd);
+        mMemFd = -1;
+    }
+}
+
+rccMmioSim::rccMmioSim(size_t size) :
+    rccMmio(size),
+    mMem((size + 3) >> 2, 0), mResetVal((size + 3) >> 2, 0),
+    mRoMask((size + 3) >> 2, 0), mW1cMask((size + 3) >> 2, 0),
+    mFrameEnabled(false), mFrameThread(NULL), mFrameRunning(false),
+    mReads(0), mWrites(0), mFrames(0)
+{
+    mRegs = mMem.data();
+}
+
+rccMmioSim::~rccMmioSim(void)
+{
+    stop();
+    mRegs = NULL;
+}
+
+void rccMmioSim::setResetValue(uint32_t offset, uint32_t value)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    uint32_t idx = offset >> 2;
+
+    mResetVal[idx] = (mResetVal[idx] & mRoMask[idx]) | (value & ~mRoMask[idx]);
+    mMem[idx]      = mResetVal[idx];
+}
+
+void rccMmioSim::setReadOnly(uint32_t offset, uint32_t mask, uint32_t value)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    uint32_t idx = offset >> 2;
+
+    mRoMask[idx]  |= mask;
+    mMem[idx]      = (mMem[idx] & ~mask) | (value & mask);
+    mResetVal[idx] = (mResetVal[idx] & ~mask) | (value & mask);
+}
+
+void rccMmioSim::setW1C(uint32_t offset, uint32_t mask)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mW1cMask[offset >> 2] |= mask;
+}
+
+void rccMmioSim::setSelfClear(uint32_t offset, uint32_t mask, int delayUs,
+                              bool resetsDevice)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    rcc_sim_self_clear_t sc;
+
+    sc.offset       = offset;
+    sc.mask         = mask;
+    sc.delayNs      = (int64_t)delayUs * 1000;
+    sc.resetsDevice = resetsDevice;
+    sc.dueNs        = -1;
+    mSelfClear.push_back(sc);
+}
+
+void rccMmioSim::setHalt(uint32_t ctrlOffset, uint32_t runMask,
+                         uint32_t statOffset, uint32_t haltMask, int delayUs)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    rcc_sim_halt_t h;
+
+    h.ctrlOffset = ctrlOffset;
+    h.runMask    = runMask;
+    h.statOffset = statOffset;
+    h.haltMask   = haltMask;
+    h.delayNs    = (int64_t)delayUs * 1000;
+    h.dueNs      = -1;
+    h.halted     = !(mMem[ctrlOffset >> 2] & runMask);
+    if(h.halted)
+    {
+        mMem[statOffset >> 2]      |= haltMask;
+        mResetVal[statOffset >> 2] |= haltMask;
+    }
+    mHalt.push_back(h);
+}
+
+void rccMmioSim::setFrameCounter(const rcc_mmio_sim_frame_t &cfg)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mFrameCfg     = cfg;
+    mFrameEnabled = (cfg.periodUs > 0);
+}
+
+void rccMmioSim::setWriteCb(writeFuncCb cbFunc)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mWriteCb = cbFunc;
+}
+
+bool rccMmioSim::start(void)
+{
+    stop();
+
+    if(mFrameEnabled)
+    {
+        mFrameRunning = true;
+        mFrameThread = new std::thread(&rccMmioSim::frameThread, this);
+    }
+
+    return true;
+}
+
+void rccMmioSim::stop(void)
+{
+    if(mFrameThread)
+    {
+        mFrameRunning = false;
+        mFrameThread->join();
+        delete mFrameThread;
+        mFrameThread = NULL;
+    }
+}
+
+uint32_t rccMmioSim::read(uint32_t offset)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    update(monotonicNs());
+    mReads++;
+
+    return mMem[offset >> 2];
+}
+
+void rccMmioSim::write(uint32_t offset, uint32_t value)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    int64_t nowNs = monotonicNs();
+    uint32_t idx = offset >> 2;
+    uint32_t ro = mRoMask[idx], w1c = mW1cMask[idx];
+
+    update(nowNs);
+
+    mMem[idx] = (mMem[idx] & ro) | (value & ~ro & ~w1c) |
+        (mMem[idx] & w1c & ~value);
+
+    for(size_t i = 0; i < mSelfClear.size(); i++)
+    {
+        rcc_sim_self_clear_t &sc = mSelfClear[i];
+        if((sc.offset == offset) && (value & sc.mask) && (sc.dueNs < 0))
+        {
+            sc.dueNs = nowNs + sc.delayNs;
+        }
+    }
+    ctrlWritten(offset, nowNs);
+    // zero delays take effect before the next access
+    update(nowNs);
+
+    mWrites++;
+    if(mWriteCb)
+    {
+        mWriteCb(offset, value);
+    }
+}
+
+uint32_t rccMmioSim::peek(uint32_t offset)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return mMem[offset >> 2];
+}
+
+void rccMmioSim::poke(uint32_t offset, uint32_t value)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mMem[offset >> 2] = value;
+}
+
+// RUN bit changed - HALT follows after delay (unless already there)
+void rccMmioSim::ctrlWritten(uint32_t offset, int64_t nowNs)
+{
+    for(size_t i = 0; i < mHalt.size(); i++)
+    {
+        rcc_sim_halt_t &h = mHalt[i];
+        if(h.ctrlOffset != offset)
+        {
+            continue;
+        }
+
+        bool halt = !(mMem[h.ctrlOffset >> 2] & h.runMask);
+        bool current = (h.dueNs >= 0) ? h.halted :
+            ((mMem[h.statOffset >> 2] & h.haltMask) != 0);
+        if(halt != current)
+        {
+            h.halted = halt;
+            h.dueNs  = nowNs + h.delayNs;
+        }
+    }
+}
+
+void rccMmioSim::resetDevice(void)
+{
+    for(size_t i = 0; i < mMem.size(); i++)
+    {
+        mMem[i] = mResetVal[i];
+    }
+
+    // in reset everything stops immediately
+    for(size_t i = 0; i < mHalt.size(); i++)
+    {
+        rcc_sim_halt_t &h = mHalt[i];
+        h.halted = true;
+        h.dueNs  = -1;
+        mMem[h.statOffset >> 2] |= h.haltMask;
+    }
+    for(size_t i = 0; i < mSelfClear.size(); i++)
+    {
+        mSelfClear[i].dueNs = -1;
+    }
+}
+
+void rccMmioSim::update(int64_t nowNs)
+{
+    for(size_t i = 0; i < mSelfClear.size(); i++)
+    {
+        rcc_sim_self_clear_t &sc = mSelfClear[i];
+        if((sc.dueNs >= 0) && (nowNs >= sc.dueNs))
+        {
+            sc.dueNs = -1;
+            if(sc.resetsDevice)
+            {
+                // reset values have the bit cleared
+                resetDevice();
+            }
+            else
+            {
+                mMem[sc.offset >> 2] &= ~sc.mask;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < mHalt.size(); i++)
+    {
+        rcc_sim_halt_t &h = mHalt[i];
+        if((h.dueNs >= 0) && (nowNs >= h.dueNs))
+        {
+            h.dueNs = -1;
+            if(h.halted)
+                mMem[h.statOffset >> 2] |= h.haltMask;
+            else
+                mMem[h.statOffset >> 2] &= ~h.haltMask;
+        }
+    }
+}
+
+bool rccMmioSim::frameRunning(void)
+{
+    const rcc_mmio_sim_frame_t &c = mFrameCfg;
+
+    if((mMem[c.runOffset >> 2] & c.runMask) != c.runMask)
+        return false;
+    if(c.haltMask && (mMem[c.haltOffset >> 2] & c.haltMask))
+        return false;
+    if((c.armOffset >= 0) && (mMem[c.armOffset >> 2] == 0))
+        return false;
+
+    return true;
+}
+
+void rccMmioSim::frameThread(void)
+{
+    std::chrono::microseconds period(mFrameCfg.periodUs);
+    std::chrono::steady_clock::time_point next =
+        std::chrono::steady_clock::now() + period;
+    const rcc_mmio_sim_frame_t &c = mFrameCfg;
+    uint32_t seq = 0;
+    bool running = false;
+
+    while(mFrameRunning)
+    {
+        std::this_thread::sleep_until(next);
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        update(monotonicNs());
+        if(!frameRunning())
+        {
+            // frame timing starts when transfer is started
+            running = false;
+            next = std::chrono::steady_clock::now() +
+                std::chrono::microseconds(100);
+            continue;
+        }
+        if(!running)
+        {
+            running = true;
+            next = std::chrono::steady_clock::now() + period;
+            continue;
+        }
+
+        uint32_t cnt = (mMem[c.cntOffset >> 2] & c.cntMask) >> c.cntShift;
+        lock.unlock();
+
+        seq++;
+        if(c.frameCb)
+        {
+            c.frameCb(seq, cnt);
+        }
+
+        lock.lock();
+        // full 32-bit field wraps by itself (maxCnt == 0)
+        uint32_t maxCnt = (c.cntModulo > 0) ? (uint32_t)c.cntModulo :
+            ((c.cntMask >> c.cntShift) + 1);
+        cnt = maxCnt ? ((cnt + 1) % maxCnt) : (cnt + 1);
+        mMem[c.cntOffset >> 2] = (mMem[c.cntOffset >> 2] & ~c.cntMask) |
+            ((cnt << c.cntShift) & c.cntMask);
+        if(c.irqOffset >= 0)
+        {
+            mMem[c.irqOffset >> 2] |= c.irqMask;
+        }
+        mFrames++;
+        lock.unlock();
+
+        if(c.eventFd >= 0)
+        {
+            uint64_t one = 1;
+            if(::write(c.eventFd, &one, sizeof(one)) != sizeof(one))
+            {
+                getLogger().error("rccMmioSim: eventfd write failed\n");
+            }
+        }
+
+        next += period;
+    }
+}
@@ -0,0 +1,159 @@
+#ifndef __RCC_MMIO_H
+#define __RCC_MMIO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+
+// Register block of an AXI-Lite peripheral. rccMmio maps the physical address
+// through /dev/mem, rccMmioSim keeps the registers in ordinary memory and
+// models device behaviour so drivers (rccSysCtrl, rccVdmaCtrl, rccVideoCtrl)
+// can be run and profiled on a host. Offsets are in bytes like in the
+// register maps, accesses are always 32-bit.
+class rccMmio {
+public:
+    rccMmio(uint32_t phyAddr, size_t size);
+    virtual ~rccMmio(void);
+
+    bool   isMapped(void) { return (mRegs != NULL); };
+    size_t size(void) { return mSize; };
+    // /dev/mem descriptor for mapping other memory (frame buffers), -1 if
+    // registers are not in physical memory
+    int    memFd(void) { return mMemFd; };
+
+    virtual uint32_t read(uint32_t offset) { return mRegs[offset >> 2]; };
+    virtual void     write(uint32_t offset, uint32_t value)
+    {
+        mRegs[offset >> 2] = value;
+    };
+
+    void setBits(uint32_t offset, uint32_t mask)
+    {
+        write(offset, read(offset) | mask);
+    };
+    void clearBits(uint32_t offset, uint32_t mask)
+    {
+        write(offset, read(offset) & ~mask);
+    };
+
+protected:
+    rccMmio(size_t size); // for backends not using /dev/mem
+
+    volatile uint32_t *mRegs;
+    size_t             mSize;
+    int                mMemFd;
+    void              *mMapBase;
+    size_t             mMapLen;
+
+private:
+    rccMmio(rccMmio const &) = delete;
+    void operator=(rccMmio const &) = delete;
+};
+
+// Simulated register block. Behaviour is programmed before start():
+//  - read-only bits keep their value on writes (version registers),
+//  - write-1-to-clear bits (interrupt status),
+//  - self-clearing bits after a delay, optionally resetting the whole block
+//    to reset values (VDMA soft reset),
+//  - HALT status bit following a RUN control bit after a delay,
+//  - frame counter advancing a register field every frame period while
+//    running, setting interrupt status bits and signalling an eventfd.
+// All timed behaviour is evaluated on every access so results do not
+// depend on the frame thread scheduling.
+class rccMmioSim : public rccMmio {
+public:
+    typedef struct rcc_mmio_sim_frame_s {
+        int      periodUs;
+        // frames are produced while (run & runMask) == runMask, HALT bit is
+        // clear (haltMask != 0) and arm register is non-zero (armOffset >= 0)
+        uint32_t runOffset, runMask;
+        uint32_t haltOffset, haltMask;
+        int      armOffset;
+        // counter field (cntModulo == 0 wraps with the field)
+        uint32_t cntOffset, cntMask;
+        int      cntShift, cntModulo;
+        // status bits set on every frame (-1 none)
+        int      irqOffset;
+        uint32_t irqMask;
+        int      eventFd; // -1 none, not closed
+        // called before counter moves on (sequence from 1, counter value of
+        // the finished frame) - the "DMA" of the frame, must not access mmio
+        std::function<void(uint32_t, uint32_t)> frameCb;
+    } rcc_mmio_sim_frame_t;
+
+    typedef std::function<void(uint32_t, uint32_t)> writeFuncCb;
+
+    rccMmioSim(size_t size);
+    ~rccMmioSim(void);
+
+    void setResetValue(uint32_t offset, uint32_t value);
+    void setReadOnly(uint32_t offset, uint32_t mask, uint32_t value);
+    void setW1C(uint32_t offset, uint32_t mask);
+    void setSelfClear(uint32_t offset, uint32_t mask, int delayUs,
+                      bool resetsDevice = false);
+    void setHalt(uint32_t ctrlOffset, uint32_t runMask,
+                 uint32_t statOffset, uint32_t haltMask, int delayUs);
+    void setFrameCounter(const rcc_mmio_sim_frame_t &cfg);
+    // Called on every write (offset, written value) with device lock held
+    void setWriteCb(writeFuncCb cbFunc);
+
+    bool start(void);
+    void stop(void);
+
+    uint32_t read(uint32_t offset);
+    void     write(uint32_t offset, uint32_t value);
+
+    // Direct access without modelled behaviour
+    uint32_t peek(uint32_t offset);
+    void     poke(uint32_t offset, uint32_t value);
+
+    uint64_t getReads(void)  { return mReads; };
+    uint64_t getWrites(void) { return mWrites; };
+    uint64_t getFrames(void) { return mFrames; };
+
+private:
+    typedef struct rcc_sim_self_clear_s {
+        uint32_t offset, mask;
+        int64_t  delayNs;
+        bool     resetsDevice;
+        int64_t  dueNs;  // < 0 - not pending
+    } rcc_sim_self_clear_t;
+
+    typedef struct rcc_sim_halt_s {
+        uint32_t ctrlOffset, runMask;
+        uint32_t statOffset, haltMask;
+        int64_t  delayNs;
+        int64_t  dueNs;  // < 0 - not pending
+        bool     halted; // state reached at dueNs
+    } rcc_sim_halt_t;
+
+    void update(int64_t nowNs);       // mMutex held
+    void resetDevice(void);           // mMutex held
+    void ctrlWritten(uint32_t offset, int64_t nowNs);
+    bool frameRunning(void);
+    void frameThread(void);
+
+    std::mutex                         mMutex;
+    std::vector<uint32_t>              mMem;
+    std::vector<uint32_t>              mResetVal;
+    std::vector<uint32_t>              mRoMask;
+    std::vector<uint32_t>              mW1cMask;
+    std::vector<rcc_sim_self_clear_t>  mSelfClear;
+    std::vector<rcc_sim_halt_t>        mHalt;
+    writeFuncCb                        mWriteCb;
+
+    bool                               mFrameEnabled;
+    rcc_mmio_sim_frame_t               mFrameCfg;
+    std::thread                       *mFrameThread;
+    std::atomic<bool>                  mFrameRunning;
+
+    std::atomic<uint64_t>              mReads, mWrites, mFrames;
+};
+
+#endif // __RCC_MMIO_H
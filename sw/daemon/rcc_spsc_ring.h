@@ -0,0 +1,78 @@
+#ifndef __RCC_SPSC_RING_H
+#define __RCC_SPSC_RING_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+// Bounded lock-free ring buffer for exactly one producer and one consumer
+// thread. Used to pass small handles (indexes, pointers) between pipeline
+// stages - items are copied in and out.
+template <typename T>
+class rccSpscRing {
+public:
+    rccSpscRing(size_t size)
+        : mBuf(size + 1), mHead(0), mTail(0)
+    {
+    }
+
+    // Producer side, returns false if ring is full
+    bool push(const T &item)
+    {
+        size_t head = mHead.load(std::memory_order_relaxed);
+        size_t next = increment(head);
+
+        if(next == mTail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        mBuf[head] = item;
+        mHead.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, returns false if ring is empty
+    bool pop(T &item)
+    {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+
+        if(tail == mHead.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        item = mBuf[tail];
+        mTail.store(increment(tail), std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called from a third thread
+    size_t depth(void) const
+    {
+        size_t head = mHead.load(std::memory_order_acquire);
+        size_t tail = mTail.load(std::memory_order_acquire);
+
+        return (head >= tail) ? (head - tail) : (head + mBuf.size() - tail);
+    }
+
+    size_t capacity(void) const { return mBuf.size() - 1; };
+
+private:
+    size_t increment(size_t idx) const
+    {
+        return ((idx + 1) == mBuf.size()) ? 0 : (idx + 1);
+    }
+
+    rccSpscRing(rccSpscRing const &) = delete;
+    void operator=(rccSpscRing const &) = delete;
+
+    std::vector<T>      mBuf;
+    // keep producer & consumer indexes on separate cache lines
+    char                mPad0[64];
+    std::atomic<size_t> mHead; // written by producer only
+    char                mPad1[64];
+    std::atomic<size_t> mTail; // written by consumer only
+};
+
+#endif // __RCC_SPSC_RING_H
@@ -1,10 +1,12 @@
 #include <string.h>
 #include <errno.h>
-#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
 
 #include <iostream>
 #include <sstream>
@@ -19,115 +21,117 @@
 
 // PWM_CTRLSTAT = 0x08
 #define PWMCTRLSTAT_ENABLE        0x01     // bit0         - R/W - PWM Enable
-#define PWMCTRLSTAT_CNT_WIDTH     0xFF000  // bits [23:16] - RO  - Counter width (limit also for counter input)
+#define PWMCTRLSTAT_CNT_WIDTH     0xFF0000 // bits [23:16] - RO  - Counter width (limit also for counter input)
 
-rccSysCtrl::rccSysCtrl(void) :
-    mMemFd(-1), mRegs(NULL)
-{
-    void *pagePtr;
-    long pageAddr, pageOff, pageSize = sysconf(_SC_PAGESIZE);
+#define SYS_REG(reg) offsetof(axiSysCtrlRegs_t, reg)
 
-    std::ostringstream strStream;
-    mMemFd = open("/dev/mem", O_RDWR | O_SYNC);
-    if(mMemFd < 0)
-    {
-        strStream.str(std::string());
-        strStream << "open() of /dev/mem failed: " << strerror(errno) << std::endl;
-        getLogger().error(strStream.str());
-        return;
-    }
+// values presented by simulated device
+const uint32_t cSimVersion(0x100);
+const uint32_t cSimPwmCntWidth(24);
+
+const int cWdogThreadPrio(60);     // SCHED_FIFO priority if allowed, above drive
 
-    pageAddr   = cSysCtrlAddr & (~(pageSize-1));
-    pageOff    = cSysCtrlAddr - pageAddr;
-    pagePtr    = mmap(NULL, sizeof(axiSysCtrlRegs_t),
-                      PROT_READ | PROT_WRITE, MAP_SHARED,
-                      mMemFd, pageAddr);
-    if((void*)pagePtr == MAP_FAILED)
+const int rccSysCtrl::cWdogTickUs;
+const int rccSysCtrl::cWdogLatBuckets;
+const int rccSysCtrl::cWdogLatBucketUs;
+
+static int64_t monotonicNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+rccSysCtrl::rccSysCtrl(void) :
+    mMmio(new rccMmio(cSysCtrlAddr, sizeof(axiSysCtrlRegs_t))), mMmioOwned(true),
+    mDrivePeriod(0), mSteerPeriod(0),
+    mDriveActive(cPwmPulseNom), mSteerActive(cPwmPulseNom), mLastDriveNs(0),
+    mWdogThread(NULL), mWdogRunning(false), mWdogFailsafe(false),
+    mWdogTimeoutUs(0), mWdogRampUs(0)
+{
+    if(!isInitialized())
     {
-        strStream.str(std::string());
-        strStream << "mmap() of /dev/mem failed: " << strerror(errno) << std::endl;
-        getLogger().error(strStream.str());
+        cleanup();
         return;
     }
 
-    mRegs = (axiSysCtrlRegs_t *)pagePtr + pageOff;
+    pwmSetPeriod(cDefaultPwmPeriod);
+}
 
+rccSysCtrl::rccSysCtrl(rccMmio *mmio) :
+    mMmio(mmio), mMmioOwned(false),
+    mDrivePeriod(0), mSteerPeriod(0),
+    mDriveActive(cPwmPulseNom), mSteerActive(cPwmPulseNom), mLastDriveNs(0),
+    mWdogThread(NULL), mWdogRunning(false), mWdogFailsafe(false),
+    mWdogTimeoutUs(0), mWdogRampUs(0)
+{
     pwmSetPeriod(cDefaultPwmPeriod);
 }
 
 rccSysCtrl::~rccSysCtrl(void)
 {
+    stopWatchdog();
     cleanup();
 }
 
 int rccSysCtrl::cleanup(void)
 {
-    std::ostringstream strStream;
-
-    if(mRegs)
+    if(mMmioOwned)
     {
-        if(munmap((void *)mRegs, cSysCtrlAddr) < 0)
-        {
-            strStream.str(std::string());
-            strStream << "munmap() failed: " << strerror(errno) << std::endl;
-            getLogger().error(strStream.str());
-            return -1;
-        }
-        mRegs = NULL;
-    }
-
-    if(mMemFd)
-    {
-        close(mMemFd);
-        mMemFd = -1;
+        delete mMmio;
     }
+    mMmio = NULL;
+    mMmioOwned = false;
 
     return 0;
 }
 
+void rccSysCtrl::configureSim(rccMmioSim &sim)
+{
+    sim.setReadOnly(SYS_REG(version), 0xffffffff, cSimVersion);
+    sim.setReadOnly(SYS_REG(pwmCtrlStat), PWMCTRLSTAT_CNT_WIDTH,
+                    cSimPwmCntWidth << 16);
+    sim.setReadOnly(SYS_REG(vidFrmStat), 0xffffffff, 0);
+}
+
 int rccSysCtrl::version(void)
 {
     if(isInitialized())
     {
-        return mRegs->version;
+        return mMmio->read(SYS_REG(version));
     }
     return -1;
 }
 
 int rccSysCtrl::writeReg(uint8_t regOffset, uint32_t regValue)
 {
-    uint32_t *addr = (uint32_t *)mRegs;
-
     if(!isInitialized())
     {
         return -1;
     }
 
-    *(addr+(regOffset>>2)) = regValue;
+    mMmio->write(regOffset & ~3, regValue);
     return 0;
 }
 
 uint32_t rccSysCtrl::readReg(uint8_t regOffset)
 {
     uint32_t val = 0xdeadbeef;
-    uint32_t *addr = (uint32_t *)mRegs;
 
     if(!isInitialized())
     {
         return val;
     }
 
-    return *(addr+(regOffset>>2));
+    return mMmio->read(regOffset & ~3);
 }
 
 void rccSysCtrl::dumpRegs(void)
 {
-    uint32_t *addr = (uint32_t *)mRegs;
-
     for(int i = 0; i < (int)(sizeof(axiSysCtrlRegs_t)>>2); i++)
     {
         std::cout << "Offset=0x" << std::hex << (i*4)
-                  << " Value=0x" << *(addr+i) << std::endl;
+                  << " Value=0x" << mMmio->read(i*4) << std::endl;
     }
 
     return;
@@ -137,7 +141,7 @@ int rccSysCtrl::pwmMuxSel(void)
 {
     if(isInitialized())
     {
-        return mRegs->ioCtrl & IOCTRL_PWM_MUX_SEL;
+        return mMmio->read(SYS_REG(ioCtrl)) & IOCTRL_PWM_MUX_SEL;
     }
 
     return -1;
@@ -152,11 +156,11 @@ int rccSysCtrl::setPwmMuxSel(int muxSel)
 
     if(muxSel)
     {
-        mRegs->ioCtrl |= IOCTRL_PWM_MUX_SEL;
+        mMmio->setBits(SYS_REG(ioCtrl), IOCTRL_PWM_MUX_SEL);
     }
     else
     {
-        mRegs->ioCtrl &= ~IOCTRL_PWM_MUX_SEL;
+        mMmio->clearBits(SYS_REG(ioCtrl), IOCTRL_PWM_MUX_SEL);
     }
 
     return 0;
@@ -167,7 +171,7 @@ bool rccSysCtrl::pwmRunning(void)
     if(!isInitialized())
         return false;
 
-    return mRegs->pwmCtrlStat & PWMCTRLSTAT_ENABLE;
+    return mMmio->read(SYS_REG(pwmCtrlStat)) & PWMCTRLSTAT_ENABLE;
 }
 
 
@@ -179,11 +183,11 @@ int rccSysCtrl::pwmEnable(bool enable)
 
     if(enable)
     {
-        mRegs->pwmCtrlStat |= PWMCTRLSTAT_ENABLE;
+        mMmio->setBits(SYS_REG(pwmCtrlStat), PWMCTRLSTAT_ENABLE);
     }
     else
     {
-        mRegs->pwmCtrlStat &= ~PWMCTRLSTAT_ENABLE;
+        mMmio->clearBits(SYS_REG(pwmCtrlStat), PWMCTRLSTAT_ENABLE);
     }
 
     return 0;
@@ -198,12 +202,19 @@ int rccSysCtrl::pwmSetPeriod(int period)
         return -1;
 
     // TODO: Add checsk
-    mRegs->pwmPeriod = periodCnts;
+    mMmio->write(SYS_REG(pwmPeriod), periodCnts);
 
     return 0;
 }
 
 int rccSysCtrl::pwmSetActive(int active0, int active1)
+{
+    std::lock_guard<std::mutex> lock(mPwmMutex);
+
+    return writeActive(active0, active1);
+}
+
+int rccSysCtrl::writeActive(int active0, int active1)
 {
     uint32_t active0Cnts = convertUsToCnt(active0);
     uint32_t active1Cnts = convertUsToCnt(active1);
@@ -212,8 +223,10 @@ int rccSysCtrl::pwmSetActive(int active0, int active1)
         return -1;
 
     // TODO: Add checks
-    mRegs->pwmActive0 = active0Cnts;
-    mRegs->pwmActive1 = active1Cnts;
+    mMmio->write(SYS_REG(pwmActive0), active0Cnts);
+    mMmio->write(SYS_REG(pwmActive1), active1Cnts);
+    mDriveActive = active0;
+    mSteerActive = active1;
 
     return 0;
 }
@@ -223,15 +236,18 @@ void rccSysCtrl::pwmDumpRegs(void)
     std::ostringstream strStream;
     strStream.str(std::string());
     strStream << "PWM registers: " << std::endl;
-    strStream << "   CTRLSTAT=0x"  << std::hex << mRegs->pwmCtrlStat << std::endl;
-    strStream << "   PERIOD=0x"    << std::hex << mRegs->pwmPeriod << std::endl;
-    strStream << "   ACTIVE0=0x"   << std::hex << mRegs->pwmActive0 << std::endl;
-    strStream << "   ACTIVE1=0x"   << std::hex << mRegs->pwmActive1 << std::endl;
+    strStream << "   CTRLSTAT=0x"  << std::hex << mMmio->read(SYS_REG(pwmCtrlStat)) << std::endl;
+    strStream << "   PERIOD=0x"    << std::hex << mMmio->read(SYS_REG(pwmPeriod)) << std::endl;
+    strStream << "   ACTIVE0=0x"   << std::hex << mMmio->read(SYS_REG(pwmActive0)) << std::endl;
+    strStream << "   ACTIVE1=0x"   << std::hex << mMmio->read(SYS_REG(pwmActive1)) << std::endl;
     getLogger().debug(strStream.str());
 }
 
 void rccSysCtrl::pushDriveData(rcci_msg_drv_ctrl_t aData)
 {
+    // link is alive even when PWM is not enabled
+    mLastDriveNs = monotonicNs();
+
     if(!pwmRunning()) {
         return;
     }
@@ -255,7 +271,194 @@ void rccSysCtrl::pushDriveData(rcci_msg_drv_ctrl_t aData)
     driveTime = cPwmPulseNom + (driveTime * cPwmPulseRange) / cPwmPulseLimit;
     steerTime = cPwmPulseNom + (steerTime * cPwmPulseRange) / cPwmPulseLimit;
 
-    pwmSetActive(driveTime, steerTime);
+    std::lock_guard<std::mutex> lock(mPwmMutex);
+    mWdogFailsafe = false;
+    writeActive(driveTime, steerTime);
+}
+
+bool rccSysCtrl::startWatchdog(int timeoutMs, int rampMs)
+{
+    std::ostringstream strStream;
+
+    if(!isInitialized() || (timeoutMs <= 0) || (rampMs < 0))
+    {
+        return false;
+    }
+
+    stopWatchdog();
+
+    mWdogTimeoutUs = timeoutMs * 1000;
+    mWdogRampUs    = rampMs * 1000;
+    mWdogFailsafe  = false;
+    {
+        std::lock_guard<std::mutex> lock(mWdogStatsMutex);
+        memset(&mWdogStats, 0, sizeof(mWdogStats));
+    }
+    mWdogRunning = true;
+    mWdogThread = new std::thread(&rccSysCtrl::watchdogThread, this);
+
+    strStream << "Drive watchdog started, timeout " << timeoutMs
+              << " ms, ramp " << rampMs << " ms" << std::endl;
+    getLogger().debug(strStream.str());
+
+    return true;
+}
+
+void rccSysCtrl::stopWatchdog(void)
+{
+    if(mWdogThread)
+    {
+        mWdogRunning = false;
+        mWdogThread->join();
+        delete mWdogThread;
+        mWdogThread = NULL;
+    }
+}
+
+void rccSysCtrl::getWatchdogStats(rcc_wdog_stats_t &stats)
+{
+    std::lock_guard<std::mutex> lock(mWdogStatsMutex);
+
+    stats = mWdogStats;
+}
+
+// Periodic absolute timerfd tick (no drift from processing time). On every
+// wake-up it records how late it was and, when no drive command came for
+// mWdogTimeoutUs, linearly moves drive pulse from the value it had at the
+// deadline to cPwmPulseNom so it is reached mWdogRampUs after the deadline.
+void rccSysCtrl::watchdogThread(void)
+{
+    std::ostringstream strStream;
+    struct sched_param param;
+    struct itimerspec its;
+    int64_t baseNs, tickNs = (int64_t)cWdogTickUs * 1000, expTotal = 0;
+    int64_t deadlineNs = 0;
+    int rampFrom = cPwmPulseNom;
+    int timerFd;
+
+    param.sched_priority = cWdogThreadPrio;
+    if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+    {
+        strStream << "Drive watchdog running without real-time priority"
+                  << std::endl;
+        getLogger().debug(strStream.str());
+    }
+
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if(timerFd < 0)
+    {
+        strStream.str(std::string());
+        strStream << "timerfd_create() failed: " << strerror(errno) << std::endl;
+        getLogger().error(strStream.str());
+        return;
+    }
+
+    baseNs = monotonicNs();
+    its.it_interval.tv_sec  = 0;
+    its.it_interval.tv_nsec = tickNs;
+    its.it_value.tv_sec     = (baseNs + tickNs) / 1000000000;
+    its.it_value.tv_nsec    = (baseNs + tickNs) % 1000000000;
+    if(timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+    {
+        strStream.str(std::string());
+        strStream << "timerfd_settime() failed: " << strerror(errno) << std::endl;
+        getLogger().error(strStream.str());
+        close(timerFd);
+        return;
+    }
+
+    while(mWdogRunning)
+    {
+        uint64_t expirations;
+
+        if(read(timerFd, &expirations, sizeof(expirations)) !=
+           sizeof(expirations))
+        {
+            if(errno == EINTR)
+                continue;
+            strStream.str(std::string());
+            strStream << "Watchdog timer read() failed: " << strerror(errno)
+                      << std::endl;
+            getLogger().error(strStream.str());
+            break;
+        }
+
+        int64_t nowNs = monotonicNs();
+        expTotal += expirations;
+        int64_t lateUs = (nowNs - (baseNs + expTotal * tickNs)) / 1000;
+        int64_t lateFireUs = -1;
+
+        {
+            std::lock_guard<std::mutex> lock(mPwmMutex);
+            int64_t lastNs = mLastDriveNs;
+
+            // armed by the first drive command, idle link is not a loss
+            if((lastNs != 0) &&
+               ((nowNs - lastNs) > (int64_t)mWdogTimeoutUs * 1000))
+            {
+                int driveUs;
+
+                if(!mWdogFailsafe)
+                {
+                    mWdogFailsafe = true;
+                    deadlineNs = lastNs + (int64_t)mWdogTimeoutUs * 1000;
+                    rampFrom   = mDriveActive;
+                    lateFireUs = (nowNs - deadlineNs) / 1000;
+                }
+
+                int64_t rampNs = nowNs - deadlineNs;
+                if((mWdogRampUs == 0) || (rampNs >= (int64_t)mWdogRampUs * 1000))
+                {
+                    driveUs = cPwmPulseNom;
+                }
+                else
+                {
+                    driveUs = rampFrom - (int)((rampFrom - cPwmPulseNom) *
+                                               rampNs / ((int64_t)mWdogRampUs * 1000));
+                }
+
+                if((driveUs != mDriveActive) && pwmRunning())
+                {
+                    writeActive(driveUs, mSteerActive);
+                }
+            }
+        }
+
+        if(lateFireUs >= 0)
+        {
+            strStream.str(std::string());
+            strStream << "Drive link lost, failsafe active (" << lateFireUs
+                      << " us after deadline)" << std::endl;
+            getLogger().error(strStream.str());
+        }
+
+        std::lock_guard<std::mutex> lock(mWdogStatsMutex);
+        mWdogStats.ticks++;
+        mWdogStats.overruns += expirations - 1;
+        if(lateUs < 0)
+            lateUs = 0;
+        if((uint32_t)lateUs > mWdogStats.wakeLateMaxUs)
+            mWdogStats.wakeLateMaxUs = lateUs;
+        mWdogStats.wakeLateSumUs += lateUs;
+
+        int bucket = 0;
+        while((bucket < (cWdogLatBuckets - 1)) &&
+              (lateUs >= ((int64_t)cWdogLatBucketUs << bucket)))
+        {
+            bucket++;
+        }
+        mWdogStats.wakeHist[bucket]++;
+
+        if(lateFireUs >= 0)
+        {
+            mWdogStats.fired++;
+            mWdogStats.fireLateSumUs += lateFireUs;
+            if((uint32_t)lateFireUs > mWdogStats.fireLateMaxUs)
+                mWdogStats.fireLateMaxUs = lateFireUs;
+        }
+    }
+
+    close(timerFd);
 }
 
 uint32_t rccSysCtrl::convertUsToCnt(int timeUs)
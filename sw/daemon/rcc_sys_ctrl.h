@@ -1,6 +1,12 @@
 #ifndef __RCC_SYS_CTRL_H
 #define __RCC_SYS_CTRL_H
 
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include "rcc_mmio.h"
+
 extern "C" {
 #include "rcci_type.h"
 }
@@ -49,13 +55,38 @@ private:
     } axiSysCtrlRegs_t;
 
 public:
+    // Failsafe watchdog statistics. Watchdog thread wakes up every
+    // cWdogTickUs, wake-up lateness histogram bucket i counts latencies below
+    // (cWdogLatBucketUs << i) [us], last one everything above.
+    static const int cWdogTickUs      = 5000;
+    static const int cWdogLatBuckets  = 12;
+    static const int cWdogLatBucketUs = 8;
+
+    typedef struct rcc_wdog_stats_s {
+        uint64_t ticks;       // timer wake-ups
+        uint64_t overruns;    // timer expirations missed by late wake-ups
+        uint32_t wakeLateMaxUs;
+        uint64_t wakeLateSumUs;
+        uint64_t wakeHist[cWdogLatBuckets];
+        uint64_t fired;       // failsafe activations
+        uint32_t fireLateMaxUs; // activation after the deadline
+        uint64_t fireLateSumUs;
+    } rcc_wdog_stats_t;
+
     rccSysCtrl(void);
+    // Use given register block (not deleted), e.g. rccMmioSim of at least
+    // regsSize() bytes prepared with configureSim()
+    rccSysCtrl(rccMmio *mmio);
     ~rccSysCtrl(void);
 
+    static size_t regsSize(void) { return sizeof(axiSysCtrlRegs_t); };
+    // Program simulated device to behave like the system control block
+    static void configureSim(rccMmioSim &sim);
+
     typedef int (*driveFuncCb)(rcci_msg_drv_ctrl_t);
 
 
-    bool isInitialized(void) { return (mRegs != NULL); };
+    bool isInitialized(void) { return (mMmio != NULL) && mMmio->isMapped(); };
 
     int version(void);
 
@@ -75,14 +106,36 @@ public:
     void pwmDumpRegs(void);
 
     void pushDriveData(rcci_msg_drv_ctrl_t aData); // driveFuncCb() really
+
+    // Drive link failsafe - if pushDriveData() is not called for timeoutMs
+    // drive output is ramped to cPwmPulseNom within rampMs (steer is kept).
+    // The deadline is armed by the first drive command.
+    bool startWatchdog(int timeoutMs = 250, int rampMs = 100);
+    void stopWatchdog(void);
+    bool watchdogActive(void) { return mWdogFailsafe; };
+    void getWatchdogStats(rcc_wdog_stats_t &stats);
+
 private:
     int      cleanup(void);
     uint32_t convertUsToCnt(int timeUs);
+    int      writeActive(int driveUs, int steerUs); // mPwmMutex held
+    void     watchdogThread(void);
 
-    int                        mMemFd;
-    volatile axiSysCtrlRegs_t *mRegs;
+    rccMmio                   *mMmio;
+    bool                       mMmioOwned;
     int                        mDrivePeriod, mSteerPeriod;
 
+    // last written pulses & time of last drive command (CLOCK_MONOTONIC)
+    std::mutex                 mPwmMutex;
+    int                        mDriveActive, mSteerActive;
+    std::atomic<int64_t>       mLastDriveNs;
+
+    std::thread               *mWdogThread;
+    std::atomic<bool>          mWdogRunning;
+    std::atomic<bool>          mWdogFailsafe;
+    int                        mWdogTimeoutUs, mWdogRampUs;
+    std::mutex                 mWdogStatsMutex;
+    rcc_wdog_stats_t           mWdogStats;
 };
 
 #endif // __RCC_SYS_CTRL_H
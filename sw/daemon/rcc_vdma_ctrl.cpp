@@ -5,6 +5,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #include <iostream>
 #include <sstream>
@@ -20,6 +21,9 @@
 #define VDMA_S2MM_DMACR_CIRCULAR  0x02
 #define VDMA_S2MM_DMACR_RESET     0x04
 #define VDMA_S2MM_DMACR_GL_EN     0x08  // GenLock Enable
+#define VDMA_S2MM_DMACR_FRM_CNT_IRQ_EN 0x00001000 // Frame Count IRQ Enable
+#define VDMA_S2MM_DMACR_ERR_IRQ_EN     0x00004000 // Error IRQ Enable
+#define VDMA_S2MM_DMACR_IRQ_FRM_CNT    0x00FF0000 // IRQ Frame Count
 
 #define VDMA_S2MM_DMASR_HALT           0x00000001
 #define VDMA_S2MM_DMASR_INT_ERR        0x00000010 // Internal Error
@@ -36,37 +40,39 @@
 #define VDMA_S2MM_DMASR_DLY_CNT        0xFF000000 // Delay Count
 
 #define VDMA_S2MM_DMASR_ERR_MASK       0x0000CFF0
+#define VDMA_S2MM_DMASR_W1C_MASK       0x0000FFF0 // errors & interrupts
 
-rccVdmaCtrl::rccVdmaCtrl(void) :
-    mMemFd(-1), mRegs(NULL)
-{
-    void *pagePtr;
-    long pageAddr, pageOff, pageSize = sysconf(_SC_PAGESIZE);
+#define VDMA_PARK_PTR_WR_FRM_STORE     0x1F000000 // S2MM frame being written
 
-    std::ostringstream strStream;
-    mMemFd = open("/dev/mem", O_RDWR | O_SYNC);
-    if(mMemFd < 0)
-    {
-        strStream.str(std::string());
-        strStream << "open() of /dev/mem failed: " << strerror(errno) << std::endl;
-        getLogger().error(strStream.str());
-        return;
-    }
+#define VDMA_REG(reg) offsetof(axiVdmaCtrlRegs_t, reg)
 
-    pageAddr   = cVdmaCtrlAddr & (~(pageSize-1));
-    pageOff    = cVdmaCtrlAddr - pageAddr;
-    pagePtr    = mmap(NULL, sizeof(axiVdmaCtrlRegs_t),
-                      PROT_READ | PROT_WRITE, MAP_SHARED,
-                      mMemFd, pageAddr);
-    if((void*)pagePtr == MAP_FAILED)
+const uint32_t cSimVersion(0x62000000); // v6.2 presented by simulated device
+
+const int cRegTimeoutMs  = 100; // reset/start/stop response time
+const int cRegPollUs     = 10;
+const int cFramePollMs   = 1;   // used when no interrupt source is set
+
+rccVdmaCtrl::rccVdmaCtrl(void) :
+    mMmio(new rccMmio(cVdmaCtrlAddr, sizeof(axiVdmaCtrlRegs_t))),
+    mMmioOwned(true),
+    mIrqFd(-1), mIrqType(rcc_vdma_irq_none), mIrqFdOwned(false),
+    mIrqCountValid(false), mIrqCount(0),
+    mAcqRunning(false), mFrameBufsMapped(false), mFrameSize(0),
+    mSequence(0), mLastFrameStore(0)
+{
+    if(!isInitialized())
     {
-        strStream.str(std::string());
-        strStream << "mmap() of /dev/mem failed: " << strerror(errno) << std::endl;
-        getLogger().error(strStream.str());
-        return;
+        cleanup();
     }
+}
 
-    mRegs = (axiVdmaCtrlRegs_t *)pagePtr + pageOff;
+rccVdmaCtrl::rccVdmaCtrl(rccMmio *mmio) :
+    mMmio(mmio), mMmioOwned(false),
+    mIrqFd(-1), mIrqType(rcc_vdma_irq_none), mIrqFdOwned(false),
+    mIrqCountValid(false), mIrqCount(0),
+    mAcqRunning(false), mFrameBufsMapped(false), mFrameSize(0),
+    mSequence(0), mLastFrameStore(0)
+{
 }
 
 rccVdmaCtrl::~rccVdmaCtrl(void)
@@ -76,247 +82,561 @@ rccVdmaCtrl::~rccVdmaCtrl(void)
 
 int rccVdmaCtrl::cleanup(void)
 {
-    std::ostringstream strStream;
-
-    if(mRegs)
+    if(mMmio)
     {
-        if(munmap((void *)mRegs, cVdmaCtrlAddr) < 0)
-        {
-            strStream.str(std::string());
-            strStream << "munmap() failed: " << strerror(errno) << std::endl;
-            getLogger().error(strStream.str());
-            return -1;
-        }
-        mRegs = NULL;
+        stopAcquisition();
     }
+    closeIrqSource();
 
-    if(mMemFd)
+    if(mMmioOwned)
     {
-        close(mMemFd);
-        mMemFd = -1;
+        delete mMmio;
     }
+    mMmio = NULL;
+    mMmioOwned = false;
 
     return 0;
 }
 
+void rccVdmaCtrl::configureSim(rccMmioSim &sim, int framePeriodUs,
+                               int numFrameStores, int eventFd,
+                               std::function<void(uint32_t, uint32_t)> frameCb,
+                               int resetUs, int haltUs)
+{
+    rccMmioSim::rcc_mmio_sim_frame_t frm;
+
+    sim.setReadOnly(VDMA_REG(vdmaVersion), 0xffffffff, cSimVersion);
+    sim.setReadOnly(VDMA_REG(parkPtr), VDMA_PARK_PTR_WR_FRM_STORE, 0);
+    sim.setReadOnly(VDMA_REG(s2mmVdmaStat), ~VDMA_S2MM_DMASR_W1C_MASK, 0);
+    sim.setW1C(VDMA_REG(s2mmVdmaStat), VDMA_S2MM_DMASR_W1C_MASK);
+    sim.setSelfClear(VDMA_REG(s2mmVdmaCtrl), VDMA_S2MM_DMACR_RESET, resetUs,
+                     true);
+    sim.setHalt(VDMA_REG(s2mmVdmaCtrl), VDMA_S2MM_DMACR_START,
+                VDMA_REG(s2mmVdmaStat), VDMA_S2MM_DMASR_HALT, haltUs);
+
+    frm.periodUs   = framePeriodUs;
+    frm.runOffset  = VDMA_REG(s2mmVdmaCtrl);
+    frm.runMask    = VDMA_S2MM_DMACR_START;
+    frm.haltOffset = VDMA_REG(s2mmVdmaStat);
+    frm.haltMask   = VDMA_S2MM_DMASR_HALT;
+    frm.armOffset  = VDMA_REG(s2mmVSize);
+    frm.cntOffset  = VDMA_REG(parkPtr);
+    frm.cntMask    = VDMA_PARK_PTR_WR_FRM_STORE;
+    frm.cntShift   = 24;
+    frm.cntModulo  = numFrameStores;
+    frm.irqOffset  = VDMA_REG(s2mmVdmaStat);
+    frm.irqMask    = VDMA_S2MM_DMASR_FRM_CNT_INT;
+    frm.eventFd    = eventFd;
+    frm.frameCb    = frameCb;
+    sim.setFrameCounter(frm);
+}
+
 int rccVdmaCtrl::version(void)
 {
     if(isInitialized())
     {
-        return mRegs->vdmaVersion;
+        return mMmio->read(VDMA_REG(vdmaVersion));
     }
     return -1;
 }
 
 int rccVdmaCtrl::writeReg(uint8_t regOffset, uint32_t regValue)
 {
-    uint32_t *addr = (uint32_t *)mRegs;
-
     if(!isInitialized())
     {
         return -1;
     }
 
-    *(addr+(regOffset>>2)) = regValue;
+    mMmio->write(regOffset & ~3, regValue);
     return 0;
 }
 
 uint32_t rccVdmaCtrl::readReg(uint8_t regOffset)
 {
     uint32_t val = 0xdeadbeef;
-    uint32_t *addr = (uint32_t *)mRegs;
 
     if(!isInitialized())
     {
         return val;
     }
 
-    return *(addr+(regOffset>>2));
+    return mMmio->read(regOffset & ~3);
 }
 
 void rccVdmaCtrl::dumpRegs(void)
 {
-    uint32_t *addr = (uint32_t *)mRegs;
-
     for(int i = 0; i < (int)(sizeof(axiVdmaCtrlRegs_t)>>2); i++)
     {
         std::cout << "Offset=0x" << std::hex << (i*4)
-                  << " Value=0x" << *(addr+i) << std::endl;
+                  << " Value=0x" << mMmio->read(i*4) << std::endl;
     }
 
     return;
 }
 
-void rccVdmaCtrl::vdmaReset(void)
+// Sleeps between register reads to not burn the core, hardware normally
+// responds in a few AXI clocks so this is only reached when it is stuck
+bool rccVdmaCtrl::waitRegBits(uint32_t offset, uint32_t mask,
+                              uint32_t value)
 {
-    if(isInitialized())
-    {
-        mRegs->s2mmVdmaCtrl |= VDMA_S2MM_DMACR_RESET;
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(cRegTimeoutMs);
 
-        // Wait until RESET bit is cleared
-        while(mRegs->s2mmVdmaCtrl & VDMA_S2MM_DMACR_RESET)
+    while((mMmio->read(offset) & mask) != value)
+    {
+        if(std::chrono::steady_clock::now() > deadline)
         {
-            /* Empty body */
+            std::ostringstream strStream;
+            strStream << "VDMA register timeout, mask=0x" << std::hex << mask
+                      << " value=0x" << mMmio->read(offset) << std::endl;
+            getLogger().error(strStream.str());
+            return false;
         }
+        std::this_thread::sleep_for(std::chrono::microseconds(cRegPollUs));
     }
+
+    return true;
 }
 
-void rccVdmaCtrl::vdmaStop(void)
+bool rccVdmaCtrl::vdmaReset(void)
 {
-    if(isInitialized())
+    if(!isInitialized())
     {
-        mRegs->s2mmVdmaCtrl &= ~VDMA_S2MM_DMACR_START;
-
-        // Wait until HALT bit is set
-        while(vdmaRunning()) { /* Empty body */ }
+        return false;
     }
+
+    mMmio->setBits(VDMA_REG(s2mmVdmaCtrl), VDMA_S2MM_DMACR_RESET);
+
+    // Wait until RESET bit is cleared
+    return waitRegBits(VDMA_REG(s2mmVdmaCtrl), VDMA_S2MM_DMACR_RESET, 0);
 }
 
-void rccVdmaCtrl::vdmaStart(void)
+bool rccVdmaCtrl::vdmaStop(void)
 {
-    if(isInitialized())
+    if(!isInitialized())
     {
-        mRegs->s2mmVdmaCtrl |= VDMA_S2MM_DMACR_START;
+        return false;
+    }
+
+    mMmio->clearBits(VDMA_REG(s2mmVdmaCtrl), VDMA_S2MM_DMACR_START);
+
+    // Wait until HALT bit is set
+    return waitRegBits(VDMA_REG(s2mmVdmaStat), VDMA_S2MM_DMASR_HALT,
+                       VDMA_S2MM_DMASR_HALT);
+}
 
-        // Wait until not running
-        while(!vdmaRunning()) { /* Empty body */ }
+bool rccVdmaCtrl::vdmaStart(void)
+{
+    if(!isInitialized())
+    {
+        return false;
     }
+
+    mMmio->setBits(VDMA_REG(s2mmVdmaCtrl), VDMA_S2MM_DMACR_START);
+
+    // Wait until running
+    return waitRegBits(VDMA_REG(s2mmVdmaStat), VDMA_S2MM_DMASR_HALT, 0);
 }
 
 bool rccVdmaCtrl::vdmaRunning(void)
 {
-    return(!(mRegs->s2mmVdmaStat & VDMA_S2MM_DMASR_HALT));
+    if(!isInitialized())
+    {
+        return false;
+    }
+
+    return(!(mMmio->read(VDMA_REG(s2mmVdmaStat)) & VDMA_S2MM_DMASR_HALT));
 }
 
 int rccVdmaCtrl::acqNumFrames(int width, int height, int num_frames,
                               uint32_t *phy_addr)
 {
     int retVal = 0;
-    int buf_size = width * height * 2;
-    uint8_t  **virt_addr;
-    int cur_frm_cnt;
+    rcc_vdma_frame_t frame;
 
-    if(!isInitialized() || (mMemFd == -1))
+    if(startAcquisition(width, height, num_frames, phy_addr) < 0)
     {
-        std::cerr << "acqNumFrames() system not initialized" << std::endl;
+        std::cerr << "acqNumFrames() can not start acquisition" << std::endl;
         return -1;
     }
 
-    /* Allocate memory */
-    virt_addr = (uint8_t **)malloc(num_frames * sizeof(uint8_t *));
-    if(!virt_addr)
+    std::cout << "VDMA S2MM configured, registers:" << std::endl;
+    dumpRegs();
+
+    std::cout << "Waiting for " << std::dec << num_frames << " frames."
+              << std::endl;
+
+    for(int frm_idx = 0; frm_idx < num_frames; frm_idx++)
+    {
+        int ret = waitFrame(frame, 1000);
+        if(ret <= 0)
+        {
+            std::cerr << "acqNumFrames() " << ((ret < 0) ? "error" : "timeout")
+                      << " waiting for frame " << frm_idx << std::endl;
+            retVal = -1;
+            break;
+        }
+
+        std::cout << "FRAME" << frm_idx << " index=" << frame.index
+                  << " seq=" << frame.sequence << " missed=" << frame.missed
+                  << " time=" << frame.timestamp.tv_sec << "."
+                  << frame.timestamp.tv_usec << std::endl;
+    }
+
+    stopAcquisition();
+
+    return retVal;
+}
+
+bool rccVdmaCtrl::setIrqSource(const char *uioDevName)
+{
+    std::ostringstream strStream;
+    int fd = open(uioDevName, O_RDWR | O_CLOEXEC);
+
+    if(fd < 0)
+    {
+        strStream << "open() of " << uioDevName << " failed: "
+                  << strerror(errno) << std::endl;
+        getLogger().error(strStream.str());
+        return false;
+    }
+
+    if(!setIrqSource(fd, rcc_vdma_irq_uio))
+    {
+        close(fd);
+        return false;
+    }
+    mIrqFdOwned = true;
+
+    return true;
+}
+
+bool rccVdmaCtrl::setIrqSource(int fd, rcc_vdma_irq_t type)
+{
+    if(mAcqRunning)
+    {
+        return false;
+    }
+
+    closeIrqSource();
+    mIrqFd = fd;
+    mIrqType = (fd < 0) ? rcc_vdma_irq_none : type;
+    mIrqFdOwned = false;
+
+    return true;
+}
+
+void rccVdmaCtrl::closeIrqSource(void)
+{
+    if(mIrqFdOwned && (mIrqFd >= 0))
+    {
+        close(mIrqFd);
+    }
+    mIrqFd = -1;
+    mIrqType = rcc_vdma_irq_none;
+    mIrqFdOwned = false;
+}
+
+int rccVdmaCtrl::curFrameStore(void)
+{
+    return (mMmio->read(VDMA_REG(parkPtr)) & VDMA_PARK_PTR_WR_FRM_STORE) >> 24;
+}
+
+void rccVdmaCtrl::unmapFrameBuffers(void)
+{
+    if(mFrameBufsMapped)
     {
-        std::cerr << "acqNumFrames() can not allocate memory for buffers"
+        for(size_t i = 0; i < mFrameBufs.size(); i++)
+        {
+            if(mFrameBufs[i])
+            {
+                munmap(mFrameBufs[i], mFrameSize);
+            }
+        }
+    }
+    mFrameBufs.clear();
+    mFramePhyAddr.clear();
+    mFrameBufsMapped = false;
+}
+
+uint8_t *rccVdmaCtrl::getFrameBuffer(int idx)
+{
+    if((idx < 0) || (idx >= (int)mFrameBufs.size()))
+    {
+        return NULL;
+    }
+
+    return mFrameBufs[idx];
+}
+
+int rccVdmaCtrl::startAcquisition(int width, int height, int numFrames,
+                                  const uint32_t *phyAddr, uint8_t **virtAddr)
+{
+    std::ostringstream strStream;
+
+    if(!isInitialized() || mAcqRunning || (numFrames <= 0) ||
+       (numFrames > 16) || (width <= 0) || (height <= 0))
+    {
+        std::cerr << "startAcquisition() invalid state or arguments"
                   << std::endl;
         return -1;
     }
-    for(int i = 0; i < num_frames; i++)
+
+    /* x2 because currently we are providing YCbCr directly (1 pixel 2 bytes) */
+    mFrameSize = width * height * 2;
+    mFrameBufs.assign(numFrames, (uint8_t *)NULL);
+    mFramePhyAddr.assign(phyAddr, phyAddr + numFrames);
+
+    if(virtAddr)
     {
-        virt_addr[i] = NULL;
+        for(int i = 0; i < numFrames; i++)
+        {
+            mFrameBufs[i] = virtAddr[i];
+        }
     }
+    else
+    {
+        if(mMmio->memFd() < 0)
+        {
+            std::cerr << "startAcquisition() no buffers and no /dev/mem"
+                      << std::endl;
+            return -1;
+        }
 
-    /* Map all physical addresses */
-//    for(int i = 0; i < num_frames; i++)
-//    {
-//        virt_addr[i] = (uint8_t *)mmap(NULL, buf_size, PROT_READ | PROT_WRITE,
-//                                       MAP_SHARED, mMemFd, (off_t)phy_addr[i]);
-//        if(virt_addr[i] == MAP_FAILED)
-//        {
-//            std::cerr << "acqNumFrames() mapping of phy_addr (0x" << std::hex
-//                      << phy_addr[i] << ") failed: "  << strerror(errno) << std::endl;
-//            retVal = -1;
-//            goto free_and_exit;
-//        }
-//        std::cout << "Mapped buffer address 0x" << std::hex << phy_addr[i]
-//                  << " to virtual address" << std::endl;
-//        memset(virt_addr[i], 0, buf_size);
-//    }
+        mFrameBufsMapped = true;
+        for(int i = 0; i < numFrames; i++)
+        {
+            void *ptr = mmap(NULL, mFrameSize, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, mMmio->memFd(), (off_t)phyAddr[i]);
+            if(ptr == MAP_FAILED)
+            {
+                strStream << "mmap() of frame buffer 0x" << std::hex
+                          << phyAddr[i] << " failed: " << strerror(errno)
+                          << std::endl;
+                getLogger().error(strStream.str());
+                unmapFrameBuffers();
+                return -1;
+            }
+            mFrameBufs[i] = (uint8_t *)ptr;
+        }
+    }
 
     /* Reset */
-    vdmaReset();
+    if(!vdmaReset())
+    {
+        unmapFrameBuffers();
+        return -1;
+    }
 
     /* Clear status */
-    mRegs->s2mmVdmaStat = 0xffffffff;
+    mMmio->write(VDMA_REG(s2mmVdmaStat), 0xffffffff);
 
     /* Mask out all interrupts */
-    mRegs->s2mmVdmaIrqMsk = 0xF;
+    mMmio->write(VDMA_REG(s2mmVdmaIrqMsk), 0xF);
 
-    mRegs->s2mmVdmaCtrl = (num_frames << 16) | VDMA_S2MM_DMACR_CIRCULAR;
+    /* Interrupt after every frame */
+    mMmio->write(VDMA_REG(s2mmVdmaCtrl), (1 << 16) | VDMA_S2MM_DMACR_CIRCULAR |
+                 VDMA_S2MM_DMACR_FRM_CNT_IRQ_EN | VDMA_S2MM_DMACR_ERR_IRQ_EN);
 
     /* Enable also start bit and wait */
-    vdmaStart();
+    if(!vdmaStart())
+    {
+        unmapFrameBuffers();
+        return -1;
+    }
 
-    mRegs->s2mmRegIndex = 0;
+    mMmio->write(VDMA_REG(s2mmRegIndex), 0);
 
     /* Set addresses */
-    for(int i = 0; i < num_frames; i++)
+    for(int i = 0; i < numFrames; i++)
     {
-        mRegs->s2mmStAddr[i] = phy_addr[i];
+        mMmio->write(VDMA_REG(s2mmStAddr) + i * 4, phyAddr[i]);
     }
 
-    mRegs->parkPtr = 0;
+    mMmio->write(VDMA_REG(parkPtr), 0);
 
-    /* x2 because currently we are providing YCbCr directly (1 pixel 2 bytes) */
-    mRegs->s2mmFrmDlyStrd = (width * 2);
-    mRegs->s2mmHSize = (width * 2);
+    mMmio->write(VDMA_REG(s2mmFrmDlyStrd), (width * 2));
+    mMmio->write(VDMA_REG(s2mmHSize), (width * 2));
+
+    mSequence = 0;
+    mIrqCountValid = false;
+    mLastFrameStore = curFrameStore();
+
+    /* (Re-)enable UIO interrupt */
+    if(enableIrq() < 0)
+    {
+        strStream << "Enabling UIO interrupt failed: " << strerror(errno)
+                  << std::endl;
+        getLogger().error(strStream.str());
+    }
 
-    /* Read original frame counter before starting the engine */
-    cur_frm_cnt = (mRegs->s2mmVdmaStat & VDMA_S2MM_DMASR_FRM_CNT) >> 16;
     /* Vertical Size must be last - this actually starts the transfer */
-    mRegs->s2mmVSize = height;
+    mMmio->write(VDMA_REG(s2mmVSize), height);
+    mAcqRunning = true;
 
-    std::cout << "VDMA S2MM configured, registers:" << std::endl;
-    dumpRegs();
+    return 0;
+}
+
+void rccVdmaCtrl::stopAcquisition(void)
+{
+    if(!mAcqRunning)
+    {
+        return;
+    }
+
+    vdmaStop();
+    mAcqRunning = false;
+    unmapFrameBuffers();
+}
+
+int rccVdmaCtrl::waitIrq(int timeoutMs, uint32_t &events)
+{
+    struct pollfd pfd;
+    int retVal;
+
+    pfd.fd      = mIrqFd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
 
-    std::cout << "Waiting for " << cur_frm_cnt << " frames." << std::endl;
-    // Waiting for frames...
+    do {
+        retVal = poll(&pfd, 1, timeoutMs);
+    } while((retVal < 0) && (errno == EINTR));
 
-    int frm_idx = 0;
-    while(cur_frm_cnt > 0)
+    if(retVal <= 0)
     {
-        int frm_cnt = (mRegs->s2mmVdmaStat & VDMA_S2MM_DMASR_FRM_CNT) >> 16;
+        return retVal;
+    }
 
-        if(mRegs->s2mmVdmaStat & VDMA_S2MM_DMASR_ERR_MASK)
+    if(mIrqType == rcc_vdma_irq_uio)
+    {
+        // UIO returns total number of interrupts and masks it until
+        // re-enabled - waitFrame() does it after the status is acknowledged
+        uint32_t count;
+        if(read(mIrqFd, &count, sizeof(count)) != sizeof(count))
         {
-            std::cerr << "VDMA S2MM Status: 0x" << std::hex
-                      << mRegs->s2mmVdmaStat << std::endl;
-            retVal = -1;
-            break;
+            return -1;
         }
+        events = mIrqCountValid ? (count - mIrqCount) : 1;
+        mIrqCount = count;
+        mIrqCountValid = true;
+    }
+    else
+    {
+        // eventfd returns number of signals since previous read
+        uint64_t count;
+        if(read(mIrqFd, &count, sizeof(count)) != sizeof(count))
+        {
+            return -1;
+        }
+        events = (uint32_t)count;
+    }
+
+    return 1;
+}
+
+int rccVdmaCtrl::enableIrq(void)
+{
+    uint32_t irqOn = 1;
+
+    if(mIrqType != rcc_vdma_irq_uio)
+    {
+        return 0;
+    }
+    if(write(mIrqFd, &irqOn, sizeof(irqOn)) != sizeof(irqOn))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+int rccVdmaCtrl::pollFrameStore(int timeoutMs, uint32_t &events)
+{
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(timeoutMs);
+    int numFrames = mFrameBufs.size();
 
-        if(frm_cnt != cur_frm_cnt)
+    while(true)
+    {
+        int frameStore = curFrameStore();
+        if(frameStore != mLastFrameStore)
+        {
+            events = (frameStore - mLastFrameStore + numFrames) % numFrames;
+            return 1;
+        }
+        if(mMmio->read(VDMA_REG(s2mmVdmaStat)) & VDMA_S2MM_DMASR_ERR_MASK)
         {
-            std::cout << "FRAME" << frm_idx << " data=";
-//            for(int i = 0; i < buf_size; i++)
-//            {
-//                std::cout << " 0x" << (uint8_t)virt_addr[frm_idx][i];
-//            }
-            std::cout << std::endl;
-
-            /* Frame counter decreased - we have new frame! */
-            std::cout << "cur_frm_cnt=" << cur_frm_cnt << " frm_cnt=" << frm_cnt << " num_frames=" << num_frames << " frm_idx=" << frm_idx << std::endl;
-            cur_frm_cnt = frm_cnt;
-            frm_idx++;
-            if(frm_idx == num_frames)
-                break;
+            return 1; // reported by waitFrame()
         }
+        if(std::chrono::steady_clock::now() > deadline)
+        {
+            return 0;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(cFramePollMs));
+    }
+}
+
+int rccVdmaCtrl::waitFrame(rcc_vdma_frame_t &frame, int timeoutMs)
+{
+    uint32_t events = 0;
+    uint32_t stat;
+    int retVal, numFrames = mFrameBufs.size();
 
-        // sleep a little bit
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if(!mAcqRunning)
+    {
+        return -1;
     }
 
-free_and_exit:
-//    if(virt_addr)
-//    {
-//        for(int i = 0; i < num_frames; i++)
-//        {
-//            if(virt_addr[i] != MAP_FAILED)
-//            {
-//                munmap(virt_addr[i], buf_size);
-//            }
-//        }
-//        delete virt_addr;
-//    }
+    if(mIrqType == rcc_vdma_irq_none)
+    {
+        retVal = pollFrameStore(timeoutMs, events);
+    }
+    else
+    {
+        retVal = waitIrq(timeoutMs, events);
+    }
+    if(retVal <= 0)
+    {
+        return retVal;
+    }
 
-    return retVal;
+    stat = mMmio->read(VDMA_REG(s2mmVdmaStat));
+    if(stat & VDMA_S2MM_DMASR_ERR_MASK)
+    {
+        std::ostringstream strStream;
+        strStream << "VDMA S2MM Status: 0x" << std::hex << stat << std::endl;
+        getLogger().error(strStream.str());
+
+        /* Clear error bits (W1C), they would keep the interrupt asserted */
+        mMmio->write(VDMA_REG(s2mmVdmaStat), stat & (VDMA_S2MM_DMASR_ERR_MASK |
+                                                     VDMA_S2MM_DMASR_FRM_CNT_INT));
+        enableIrq();
+        return -1;
+    }
+
+    /* Acknowledge frame counter interrupt (W1C), only then re-enable level
+       interrupt - it would fire again for the same frame */
+    mMmio->write(VDMA_REG(s2mmVdmaStat), VDMA_S2MM_DMASR_FRM_CNT_INT);
+    if(enableIrq() < 0)
+    {
+        return -1;
+    }
+
+    /* VDMA already moved to the next frame store, finished one is before */
+    mLastFrameStore = curFrameStore();
+    frame.index = (mLastFrameStore + numFrames - 1) % numFrames;
+    frame.data = mFrameBufs[frame.index];
+    frame.phyAddr = mFramePhyAddr[frame.index];
+    if(events == 0)
+    {
+        events = 1;
+    }
+    frame.missed = events - 1;
+    mSequence += events;
+    frame.sequence = mSequence;
+    gettimeofday(&frame.timestamp, NULL);
+
+    return 1;
 }
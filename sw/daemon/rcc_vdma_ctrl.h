@@ -1,6 +1,12 @@
 #ifndef __RCC_VDMA_CTRL_H
 #define __RCC_VDMA_CTRL_H
 
+#include <sys/time.h>
+#include <vector>
+#include <functional>
+
+#include "rcc_mmio.h"
+
 extern "C" {
 #include "rcci_type.h"
 }
@@ -47,10 +53,43 @@ private:
     } axiVdmaCtrlRegs_t;
 
 public:
+    // Frame returned by waitFrame(). Buffer stays mapped until
+    // stopAcquisition() but in circular mode VDMA overwrites it again after
+    // (numFrames - 1) further frames, so consume it before that.
+    typedef struct rcc_vdma_frame_s {
+        uint8_t        *data;      // mapped frame buffer
+        uint32_t        phyAddr;
+        int             index;     // frame store index
+        uint32_t        sequence;  // frames captured since startAcquisition()
+        uint32_t        missed;    // frames lost since previous waitFrame()
+        struct timeval  timestamp; // when frame interrupt was handled
+    } rcc_vdma_frame_t;
+
+    typedef enum rcc_vdma_irq_e {
+        rcc_vdma_irq_none = 0, // poll frame store pointer (1 ms sleeps)
+        rcc_vdma_irq_uio,      // /dev/uioX of the VDMA S2MM interrupt
+        rcc_vdma_irq_eventfd   // eventfd signalled by someone else (simulation)
+    } rcc_vdma_irq_t;
+
     rccVdmaCtrl(void);
+    // Use given register block (not deleted), e.g. rccMmioSim of at least
+    // regsSize() bytes prepared with configureSim()
+    rccVdmaCtrl(rccMmio *mmio);
     ~rccVdmaCtrl(void);
 
-    bool isInitialized(void) { return (mRegs != NULL); };
+    bool isInitialized(void) { return (mMmio != NULL) && mMmio->isMapped(); };
+    // Size of the register block (for simulated registers)
+    static size_t regsSize(void) { return sizeof(axiVdmaCtrlRegs_t); };
+    // Program simulated device to behave like S2MM channel of AXI VDMA with
+    // numFrameStores frame stores: soft reset self-clearing after resetUs,
+    // HALT following RUN after haltUs, frame every framePeriodUs once VSIZE
+    // is written (frameCb gets sequence & finished frame store, eventFd is
+    // signalled like the frame counter interrupt)
+    static void configureSim(rccMmioSim &sim, int framePeriodUs,
+                             int numFrameStores, int eventFd = -1,
+                             std::function<void(uint32_t, uint32_t)> frameCb =
+                             nullptr,
+                             int resetUs = 10, int haltUs = 2);
 
     int version(void);
 
@@ -59,17 +98,57 @@ public:
     void     dumpRegs(void);
 
     bool     vdmaRunning(void);
-    void     vdmaReset(void);
-    void     vdmaStop(void);
-    void     vdmaStart(void);
+    // Return false if hardware did not respond in cRegTimeoutMs
+    bool     vdmaReset(void);
+    bool     vdmaStop(void);
+    bool     vdmaStart(void);
     int      acqNumFrames(int width, int height, int num_frames,
                           uint32_t *phy_addr);
 
+    // Hardware paced acquisition - frame counter interrupt fires for every
+    // captured frame and waitFrame() sleeps on it instead of polling.
+    bool     setIrqSource(const char *uioDevName);
+    bool     setIrqSource(int fd, rcc_vdma_irq_t type); // fd is not closed
+    // virtAddr can provide already mapped buffers (simulation or buffers
+    // mapped elsewhere), otherwise phyAddr are mapped through /dev/mem
+    int      startAcquisition(int width, int height, int numFrames,
+                              const uint32_t *phyAddr,
+                              uint8_t **virtAddr = NULL);
+    // Returns 1 when frame is available, 0 on timeout and -1 on error
+    int      waitFrame(rcc_vdma_frame_t &frame, int timeoutMs);
+    void     stopAcquisition(void);
+
+    int      getNumFrameBuffers(void) { return mFrameBufs.size(); };
+    uint8_t *getFrameBuffer(int idx);
+
 private:
     int      cleanup(void);
+    bool     waitRegBits(uint32_t offset, uint32_t mask, uint32_t value);
+    int      waitIrq(int timeoutMs, uint32_t &events);
+    int      enableIrq(void);
+    int      pollFrameStore(int timeoutMs, uint32_t &events);
+    int      curFrameStore(void);
+    void     unmapFrameBuffers(void);
+    void     closeIrqSource(void);
+
+    rccMmio                    *mMmio;
+    bool                        mMmioOwned;
+
+    // interrupt source
+    int                         mIrqFd;
+    rcc_vdma_irq_t              mIrqType;
+    bool                        mIrqFdOwned;
+    bool                        mIrqCountValid;
+    uint32_t                    mIrqCount; // last UIO interrupt count
 
-    int                         mMemFd;
-    volatile axiVdmaCtrlRegs_t *mRegs;
+    // acquisition state
+    bool                        mAcqRunning;
+    std::vector<uint8_t *>      mFrameBufs;
+    std::vector<uint32_t>       mFramePhyAddr;
+    bool                        mFrameBufsMapped; // mapped by us
+    size_t                      mFrameSize;
+    uint32_t                    mSequence;
+    int                         mLastFrameStore;
 };
 
 #endif // __RCC_VDMA_CTRL_H
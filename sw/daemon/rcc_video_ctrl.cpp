@@ -1,6 +1,5 @@
 #include <string.h>
 #include <errno.h>
-#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -12,36 +11,27 @@
 #include "rcc_video_ctrl.h"
 #include "rcc_logger.h"
 
-rccVideoCtrl::rccVideoCtrl(void) :
-    mMemFd(-1), mRegs(NULL)
-{
-    void *pagePtr;
-    long pageAddr, pageOff, pageSize = sysconf(_SC_PAGESIZE);
+#define VIDEO_REG(reg) offsetof(axiVideoCtrlRegs_t, reg)
 
-    std::ostringstream strStream;
-    mMemFd = open("/dev/mem", O_RDWR | O_SYNC);
-    if(mMemFd < 0)
-    {
-        strStream.str(std::string());
-        strStream << "open() of /dev/mem failed: " << strerror(errno) << std::endl;
-        getLogger().error(strStream.str());
-        return;
-    }
+#define RXCTRL_RX_ENABLE   0x01    // bit0 - R/W - Image receiver enable
+
+// values presented by simulated device
+const uint32_t cSimVersion(0xdead0100);
+const uint32_t cSimAxiClockMHz(50);
 
-    pageAddr   = cVideoCtrlAddr & (~(pageSize-1));
-    pageOff    = cVideoCtrlAddr - pageAddr;
-    pagePtr    = mmap(NULL, sizeof(axiVideoCtrlRegs_t),
-                      PROT_READ | PROT_WRITE, MAP_SHARED,
-                      mMemFd, pageAddr);
-    if((void*)pagePtr == MAP_FAILED)
+rccVideoCtrl::rccVideoCtrl(void) :
+    mMmio(new rccMmio(cVideoCtrlAddr, sizeof(axiVideoCtrlRegs_t))),
+    mMmioOwned(true)
+{
+    if(!isInitialized())
     {
-        strStream.str(std::string());
-        strStream << "mmap() of /dev/mem failed: " << strerror(errno) << std::endl;
-        getLogger().error(strStream.str());
-        return;
+        cleanup();
     }
+}
 
-    mRegs = (axiVideoCtrlRegs_t *)pagePtr + pageOff;
+rccVideoCtrl::rccVideoCtrl(rccMmio *mmio) :
+    mMmio(mmio), mMmioOwned(false)
+{
 }
 
 rccVideoCtrl::~rccVideoCtrl(void)
@@ -51,72 +41,83 @@ rccVideoCtrl::~rccVideoCtrl(void)
 
 int rccVideoCtrl::cleanup(void)
 {
-    std::ostringstream strStream;
-
-    if(mRegs)
+    if(mMmioOwned)
     {
-        if(munmap((void *)mRegs, cVideoCtrlAddr) < 0)
-        {
-            strStream.str(std::string());
-            strStream << "munmap() failed: " << strerror(errno) << std::endl;
-            getLogger().error(strStream.str());
-            return -1;
-        }
-        mRegs = NULL;
-    }
-
-    if(mMemFd)
-    {
-        close(mMemFd);
-        mMemFd = -1;
+        delete mMmio;
     }
+    mMmio = NULL;
+    mMmioOwned = false;
 
     return 0;
 }
 
+void rccVideoCtrl::configureSim(rccMmioSim &sim, int framePeriodUs)
+{
+    rccMmioSim::rcc_mmio_sim_frame_t frm;
+
+    sim.setReadOnly(VIDEO_REG(version), 0xffffffff, cSimVersion);
+    sim.setReadOnly(VIDEO_REG(rxSizeStat), 0xffffffff, 0);
+    sim.setReadOnly(VIDEO_REG(rxFrameCnts), 0xffffffff, 0);
+    // frame length in AXI clocks
+    sim.setReadOnly(VIDEO_REG(rxFrameLen), 0xffffffff,
+                    (uint32_t)framePeriodUs * cSimAxiClockMHz);
+    sim.setReadOnly(VIDEO_REG(rxFifoStatus), 0xffffffff, 0);
+
+    frm.periodUs   = framePeriodUs;
+    frm.runOffset  = VIDEO_REG(rxCtrl);
+    frm.runMask    = RXCTRL_RX_ENABLE;
+    frm.haltOffset = 0;
+    frm.haltMask   = 0;
+    frm.armOffset  = -1;
+    frm.cntOffset  = VIDEO_REG(rxFrameCnts);
+    frm.cntMask    = 0xffffffff;
+    frm.cntShift   = 0;
+    frm.cntModulo  = 0;
+    frm.irqOffset  = -1;
+    frm.irqMask    = 0;
+    frm.eventFd    = -1;
+    frm.frameCb    = nullptr;
+    sim.setFrameCounter(frm);
+}
+
 int rccVideoCtrl::version(void)
 {
     if(isInitialized())
     {
-        return mRegs->version;
+        return mMmio->read(VIDEO_REG(version));
     }
     return -1;
 }
 
 int rccVideoCtrl::writeReg(uint8_t regOffset, uint32_t regValue)
 {
-    uint32_t *addr = (uint32_t *)mRegs;
-
     if(!isInitialized())
     {
         return -1;
     }
 
-    *(addr+(regOffset>>2)) = regValue;
+    mMmio->write(regOffset & ~3, regValue);
     return 0;
 }
 
 uint32_t rccVideoCtrl::readReg(uint8_t regOffset)
 {
     uint32_t val = 0xdeadbeef;
-    uint32_t *addr = (uint32_t *)mRegs;
 
     if(!isInitialized())
     {
         return val;
     }
 
-    return *(addr+(regOffset>>2));
+    return mMmio->read(regOffset & ~3);
 }
 
 void rccVideoCtrl::dumpRegs(void)
 {
-    uint32_t *addr = (uint32_t *)mRegs;
-
     for(int i = 0; i < (int)(sizeof(axiVideoCtrlRegs_t)>>2); i++)
     {
         std::cout << "Offset=0x" << std::hex << (i*4)
-                  << " Value=0x" << *(addr+i) << std::endl;
+                  << " Value=0x" << mMmio->read(i*4) << std::endl;
     }
 
     return;
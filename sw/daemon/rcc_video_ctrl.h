@@ -1,6 +1,8 @@
 #ifndef __RCC_VIDEO_CTRL_H
 #define __RCC_VIDEO_CTRL_H
 
+#include "rcc_mmio.h"
+
 extern "C" {
 #include "rcci_type.h"
 }
@@ -26,9 +28,16 @@ private:
 
 public:
     rccVideoCtrl(void);
+    // Use given register block (not deleted), e.g. rccMmioSim of at least
+    // regsSize() bytes prepared with configureSim()
+    rccVideoCtrl(rccMmio *mmio);
     ~rccVideoCtrl(void);
 
-    bool isInitialized(void) { return (mRegs != NULL); };
+    bool isInitialized(void) { return (mMmio != NULL) && mMmio->isMapped(); };
+    static size_t regsSize(void) { return sizeof(axiVideoCtrlRegs_t); };
+    // Program simulated device: RX frame counter runs every framePeriodUs
+    // while receiver is enabled
+    static void configureSim(rccMmioSim &sim, int framePeriodUs);
 
     int version(void);
 
@@ -39,8 +48,8 @@ public:
 private:
     int      cleanup(void);
 
-    int                         mMemFd;
-    volatile axiVideoCtrlRegs_t *mRegs;
+    rccMmio                    *mMmio;
+    bool                        mMmioOwned;
 };
 
 #endif // __RCC_VIDEO_CTRL_H
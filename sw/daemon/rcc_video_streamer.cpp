@@ -1,8 +1,47 @@
 #include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#ifdef SO_TXTIME
+#include <linux/net_tstamp.h>
+#endif
 
 #include "rcci_type.h"
+#include "rcci_crc.h"
+#include "rcci_fec.h"
 #include "rcc_video_streamer.h"
 
+const int rccVideoStreamer::cDefaultQuality;
+
+// Adaptation to receiver reports
+const int cQualityMin(30);
+const int cQualityMax(90);
+const int cQualityStep(10);
+const int cScaleMin(25);
+const int cScaleStep(25);
+const int cFpsMin(5);
+const int cLossHigh(30);      // lost fragments in 1/1000 - step down
+const int cLossLow(5);        // link is clear below this
+const int cClearReports(5);   // clear reports in a row before stepping up
+const int cHoldReports(2);    // reports after step down still show old state
+// v1 viewer keeps stream at v1 this long after its last report
+const std::chrono::seconds cVersionHold(2);
+
+// Pacing
+const double cPaceSpread(0.8);  // share of frame interval one frame may use
+const uint32_t cPaceBurst(8192); // bytes sent back to back by default
+
+// FEC
+const int cFecMaxPercent(100);  // parity fragments per data fragment [%]
+
+static uint64_t monotonicNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 rccVideoStreamer::rccVideoStreamer(void)
 #ifdef USE_LIVE555
     : mServerStarted(0), mServerThread(NULL),
@@ -57,6 +96,12 @@ bool rccVideoStreamer::stopServer(void)
             Medium::close(it->devSource);
         closeMulticastSocket(it->sock);
 #endif // USE_LIVE555
+#ifdef USE_UDP_MULTICAST
+        if(it->timerFd >= 0)
+        {
+            ::close(it->timerFd);
+        }
+#endif // USE_UDP_MULTICAST
     }
     mRccStreams.resize(0);
 
@@ -107,14 +152,22 @@ bool rccVideoStreamer::isServerStarted(void)
 
 
 rccVideoStreamer::rcc_stream_id_t rccVideoStreamer::addStream(const char *streamName,
-                                                              int fps, int port)
+                                                              int fps, int port,
+                                                              const char *mcastIf)
 {
     rcc_streams_info_t new_stream;
 
     new_stream.name = std::string(streamName);
     new_stream.fps = fps;
+    new_stream.enc.quality = cDefaultQuality;
+    new_stream.enc.scale   = 100;
+    new_stream.enc.fps     = fps;
+    new_stream.fpsDiv = 1;
+    new_stream.fpsCnt = 0;
+    memset(&new_stream.stats, 0, sizeof(new_stream.stats));
 
 #ifdef USE_LIVE555
+    (void)mcastIf;
     const unsigned char ttl = 255;
     Port rtpPort(18888);
     Port rtcpPort(18888+1);
@@ -185,6 +238,21 @@ rccVideoStreamer::rcc_stream_id_t rccVideoStreamer::addStream(const char *stream
 
 #ifdef USE_UDP_MULTICAST
     new_stream.port = port;
+    new_stream.frameSeq = 0;
+    new_stream.version = rcci_msg_video_v1;
+    new_stream.maxVersion = rcci_msg_video_v2;
+    new_stream.negotiate = true;
+    new_stream.v2Report = false;
+    new_stream.fecPercent = 0;
+    new_stream.fragSize = rcci_msg_vframe_max_frame_size;
+    new_stream.adaptMaxFrags = 0;
+    new_stream.adaptClear = 0;
+    new_stream.adaptHold = 0;
+    new_stream.lastFrags = 0;
+    new_stream.paceMode = rcc_pacing_off;
+    new_stream.paceRate = 0;
+    new_stream.paceBurst = cPaceBurst;
+    new_stream.timerFd = -1;
     new_stream.sock = openMulticastSocket();
     if(new_stream.sock < 0)
     {
@@ -206,8 +274,12 @@ rccVideoStreamer::rcc_stream_id_t rccVideoStreamer::addStream(const char *stream
 
     struct in_addr iaddr;
     iaddr.s_addr = INADDR_ANY; // use DEFAULT interface
+    if(mcastIf)
+    {
+        iaddr.s_addr = inet_addr(mcastIf);
+    }
 
-    // Set the outgoing interface to DEFAULT
+    // Set the outgoing interface (DEFAULT unless requested otherwise)
     setsockopt(new_stream.sock, IPPROTO_IP, IP_MULTICAST_IF, &iaddr,
                sizeof(struct in_addr));
 
@@ -231,22 +303,117 @@ rccVideoStreamer::rcc_stream_id_t rccVideoStreamer::addStream(const char *stream
 }
 
 bool rccVideoStreamer::encodeAndStream(rccVideoStreamer::rcc_stream_id_t stream_id,
-                                       cv::Mat &frame)
+                                       cv::Mat &frame, rcc_frame_type_t type,
+                                       const rcc_frame_info_t *info)
 {
     if(isServerStarted() && ((size_t)stream_id < mRccStreams.size()))
     {
 #ifdef USE_LIVE555
         LiveCamDeviceSource *camDevice = mRccStreams[stream_id].devSource;
+        if(type == rcc_frame_i420)
+        {
+            cv::Mat bgrFrame;
+            cv::cvtColor(frame, bgrFrame, cv::COLOR_YUV2BGR_I420);
+            return camDevice->encodeAndStream(camDevice, bgrFrame);
+        }
         return camDevice->encodeAndStream(camDevice, frame);
 #endif // USE_LIVE555
 #ifdef USE_UDP_MULTICAST
-        return (sendMulticastData(stream_id, frame) > 0) ? true : false;
+        return (sendMulticastData(stream_id, frame, type, info) >= 0) ? true : false;
 #endif // USE_UDP_MULTICAST
     }
 
     return false;
 }
 
+// Does not touch any streamer state, can be called from several threads
+bool rccVideoStreamer::encodeFrame(const cv::Mat &frame,
+                                   std::vector<uchar> &encodedBuffer,
+                                   rcc_frame_type_t type, int quality,
+                                   int scale)
+{
+    std::vector<int> encodingVar;
+    cv::Mat bgrFrame, scaledFrame;
+    const cv::Mat *src = &frame;
+
+    encodingVar.push_back(CV_IMWRITE_JPEG_QUALITY);
+    encodingVar.push_back(quality);
+
+    switch(type)
+    {
+    case rcc_frame_grey:
+        // libjpeg encodes single channel images directly
+        if(frame.channels() != 1)
+        {
+            return false;
+        }
+        break;
+    case rcc_frame_i420:
+        // JPEG encoder only takes interleaved input
+        if((frame.channels() != 1) || ((frame.rows % 3) != 0))
+        {
+            return false;
+        }
+        cv::cvtColor(frame, bgrFrame, cv::COLOR_YUV2BGR_I420);
+        src = &bgrFrame;
+        break;
+    default:
+        break;
+    }
+
+    if((scale > 0) && (scale < 100))
+    {
+        cv::resize(*src, scaledFrame, cv::Size(), scale / 100.0, scale / 100.0,
+                   cv::INTER_AREA);
+        src = &scaledFrame;
+    }
+
+    return cv::imencode(".jpg", *src, encodedBuffer, encodingVar);
+}
+
+bool rccVideoStreamer::getStreamStats(rccVideoStreamer::rcc_stream_id_t stream_id,
+                                      rcc_stream_stats_t &stats)
+{
+    if((stream_id < 0) || ((size_t)stream_id >= mRccStreams.size()))
+    {
+        return false;
+    }
+
+    stats = mRccStreams[stream_id].stats;
+    return true;
+}
+
+bool rccVideoStreamer::getStreamEncoding(rccVideoStreamer::rcc_stream_id_t stream_id,
+                                         rcc_stream_enc_t &enc)
+{
+    if((stream_id < 0) || ((size_t)stream_id >= mRccStreams.size()))
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mEncProt);
+    enc = mRccStreams[stream_id].enc;
+    return true;
+}
+
+bool rccVideoStreamer::acceptFrame(rccVideoStreamer::rcc_stream_id_t stream_id)
+{
+    if((stream_id < 0) || ((size_t)stream_id >= mRccStreams.size()))
+    {
+        return false;
+    }
+
+    rcc_streams_info_t &stream = mRccStreams[stream_id];
+    std::lock_guard<std::mutex> lock(mEncProt);
+    if(++stream.fpsCnt < stream.fpsDiv)
+    {
+        stream.stats.skipped++;
+        return false;
+    }
+    stream.fpsCnt = 0;
+    return true;
+}
+
 #ifdef USE_LIVE555
 void rccVideoStreamer::serverThread(int port)
 {
@@ -305,97 +472,691 @@ int rccVideoStreamer::closeMulticastSocket(int sock)
 }
 
 int rccVideoStreamer::sendMulticastData(rccVideoStreamer::rcc_stream_id_t stream_id,
-                                        cv::Mat &frame)
+                                        cv::Mat &frame, rcc_frame_type_t type,
+                                        const rcc_frame_info_t *info)
 {
-    rcci_msg_vframe_t videoFrame;
-
     std::vector<uchar> encodedBuffer;
-    static std::vector<int> encodingVar;
-    const u_int8_t cQFactor = 70;
-    int retVal;
+    rcc_stream_enc_t enc;
+
+    if(!getStreamEncoding(stream_id, enc))
+    {
+        return -1;
+    }
 
-    // TODO: Change this horrible instantiation to class member :)
-    static uint8_t frameCnt = 0;
+    if(!acceptFrame(stream_id))
+    {
+        return 0;
+    }
 
-    if((size_t)stream_id >= mRccStreams.size())
+    if(!encodeFrame(frame, encodedBuffer, type, enc.quality, enc.scale))
     {
         return -1;
     }
 
-    if(encodingVar.size() > 0)
+    int retVal = sendEncodedFrame(stream_id, encodedBuffer.data(),
+                                  encodedBuffer.size(), info);
+
+    std::cout << "Sending new frame stream_id=" << stream_id << " numStreams="
+              << mRccStreams.size()  << " frame size=" << encodedBuffer.size()
+              << " ret val=" << retVal << std::endl;
+
+    return retVal;
+}
+
+// Every fragment is sent as two iovecs - its own small header and pointer
+// into encoded frame - and the whole frame goes out with one sendmmsg(),
+// or spread over the frame interval when pacing is on.
+// FEC parity fragments (if enabled) follow the data fragments.
+int rccVideoStreamer::sendEncodedFrame(rccVideoStreamer::rcc_stream_id_t stream_id,
+                                       const uint8_t *data, size_t size,
+                                       const rcc_frame_info_t *info)
+{
+    if((stream_id < 0) || ((size_t)stream_id >= mRccStreams.size()))
     {
-        encodingVar.resize(0);
-        encodingVar.push_back(CV_IMWRITE_JPEG_QUALITY);
-        encodingVar.push_back(cQFactor);
+        return -1;
     }
 
-    cv::imencode(".jpg", frame, encodedBuffer, encodingVar);
+    rcc_streams_info_t &stream = mRccStreams[stream_id];
 
-    videoFrame.header.magic = rcci_msg_init_magic;
+    readReports(stream);
 
-    if(encodedBuffer.size() > rcci_msg_vframe_max_frame)
+    const bool v2 = (stream.version >= rcci_msg_video_v2);
+    const size_t maxFrame = v2 ? rcci_msg_vframe2_max_frame :
+        rcci_msg_vframe_max_frame;
+    if((size == 0) || (size > maxFrame))
     {
-        std::cerr << "Buffer not large enough!" << std::endl;
+        std::cerr << "Frame size not supported: " << size << std::endl;
         return -1;
     }
 
+    rcc_frame_info_t frameInfo;
+    frameInfo.captureUs = info ? info->captureUs : 0;
+    frameInfo.seq       = info ? info->seq : stream.frameSeq++;
+    const uint64_t captureUs = frameInfo.captureUs;
+    const uint32_t seq = frameInfo.seq;
+
+    if(mFrameCb)
+    {
+        mFrameCb(stream_id, data, size, frameInfo);
+    }
+    if(stream.port == 0)
+    {
+        stream.stats.frames++;
+        return (int)size;
+    }
+
+    // v1 indexes fragments with uint8_t, FEC is limited the same way
+    const size_t hdrSize = v2 ? rcci_msg_vframe2_payload_offset :
+        rcci_msg_vframe_payload_offset;
+    const size_t maxFragSize = v2 ? rcci_msg_vframe2_max_frag_size :
+        rcci_msg_vframe_max_frame_size;
+    const int maxShards = (v2 && (stream.fecPercent == 0)) ?
+        rcci_msg_vframe2_max_msgs : rcciFecMaxShards;
+
+    size_t maxFrameLength = std::min(std::min(stream.fragSize, maxFragSize), size);
+    int numMsgs = (size + maxFrameLength - 1) / maxFrameLength;
+    int numParity = rcciFecNumParity(numMsgs, stream.fecPercent);
+    if((numMsgs + numParity) > maxShards)
+    {
+        // too many small fragments - make them bigger to fit
+        int maxData = std::max((maxShards * 100) / (100 + stream.fecPercent),
+                               1);
+        maxFrameLength = (size + maxData - 1) / maxData;
+        if(maxFrameLength > maxFragSize)
+        {
+            maxFrameLength = maxFragSize;
+        }
+        numMsgs   = (size + maxFrameLength - 1) / maxFrameLength;
+        numParity = rcciFecNumParity(numMsgs, stream.fecPercent);
+    }
+    if((numMsgs + numParity) > rcciFecMaxShards)
+    {
+        // even largest fragments do not fit - this frame goes without parity
+        numParity = 0;
+    }
+
+    if(numParity > 0)
+    {
+        stream.fecData.resize(numParity);
+        stream.fecSrc.resize(numMsgs);
+        stream.fecSrcLen.resize(numMsgs);
+        stream.fecDst.resize(numParity);
+        for(int i = 0; i < numMsgs; i++)
+        {
+            size_t offset = i * maxFrameLength;
+            stream.fecSrc[i]    = &data[offset];
+            stream.fecSrcLen[i] = std::min(maxFrameLength, size - offset);
+        }
+        for(int j = 0; j < numParity; j++)
+        {
+            stream.fecData[j].resize(maxFrameLength);
+            stream.fecDst[j] = stream.fecData[j].data();
+        }
+        if(!rcciFecEncode(stream.fecSrc.data(), stream.fecSrcLen.data(),
+                          numMsgs, stream.fecDst.data(), numParity,
+                          maxFrameLength))
+        {
+            std::cerr << "FEC encoding failed (" << numMsgs << " + "
+                      << numParity << " shards)" << std::endl;
+            numParity = 0;
+        }
+    }
+    const int numAll = numMsgs + numParity;
+
+    stream.fragIov.resize(numAll * 2);
+    stream.fragMsgs.resize(numAll);
+
+    uint16_t flags = captureUs ? rcci_vframe_flag_capture : rcci_vframe_flag_none;
+    {
+        std::lock_guard<std::mutex> lock(mEncProt);
+        if(stream.enc.scale < 100)
+        {
+            flags |= rcci_vframe_flag_scaled;
+        }
+    }
+
     uint32_t msgCounter = 0;
-    const int maxMsgLength = rcci_msg_vframe_max_packet_size; // max one for UDP
-    const int maxFrameLength = maxMsgLength - rcci_msg_vframe_header_size;
-    uint8_t *frameBuffer = encodedBuffer.data();
-    uint8_t  cnt_msg = 0;
-    //memcpy(&videoFrame.frame[0], encodedBuffer.data(), encodedBuffer.size());
-    videoFrame.header.size = encodedBuffer.size();
-    videoFrame.cnt_frame = frameCnt++;
-    videoFrame.all_msgs = ((videoFrame.header.size+maxMsgLength) / maxMsgLength);
+    if(v2)
+    {
+        stream.fragHdrs2.resize(numAll);
+    }
+    else
+    {
+        stream.fragHdrs.resize(numMsgs);
+    }
+    for(int i = 0; i < numMsgs; i++)
+    {
+        uint32_t fragSize = size - msgCounter;
+        if(fragSize > maxFrameLength)
+        {
+            fragSize = maxFrameLength;
+        }
 
-    while(msgCounter < videoFrame.header.size)
+        if(v2)
+        {
+            rcci_msg_vframe2_hdr_t &hdr = stream.fragHdrs2[i];
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.header.magic = rcci_msg_init_magic;
+            hdr.header.ver   = rcci_msg_video_v2;
+            hdr.header.type  = rcci_msg_video;
+            hdr.header.size  = hdrSize + fragSize;
+            hdr.seq          = seq;
+            hdr.frame_size   = size;
+            hdr.idx_frame    = msgCounter;
+            hdr.all_msgs     = numMsgs;
+            hdr.cur_msg      = i;
+            hdr.num_parity   = numParity;
+            hdr.flags        = flags;
+            hdr.size_shard   = maxFrameLength;
+            hdr.capture_us   = captureUs;
+            rcciMsgSetCrc(&hdr, hdrSize, &data[msgCounter], fragSize);
+            stream.fragIov[2*i].iov_base = &hdr;
+        }
+        else
+        {
+            rcci_msg_vframe_hdr_t &hdr = stream.fragHdrs[i];
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.header.magic = rcci_msg_init_magic;
+            hdr.header.type  = rcci_msg_video;
+            hdr.header.size  = size;
+            hdr.size_frame   = fragSize;
+            hdr.idx_frame    = msgCounter;
+            hdr.cnt_frame    = seq;
+            hdr.all_msgs     = numMsgs;
+            hdr.cur_msg      = i;
+            rcciMsgSetCrc(&hdr, hdrSize, &data[msgCounter], fragSize);
+            stream.fragIov[2*i].iov_base = &hdr;
+        }
+        stream.fragIov[2*i].iov_len    = hdrSize;
+        stream.fragIov[2*i+1].iov_base = (void *)&data[msgCounter];
+        stream.fragIov[2*i+1].iov_len  = fragSize;
+
+        msgCounter += fragSize;
+    }
+
+    if(numParity > 0)
     {
-        int sendBytes =
-            (videoFrame.header.size - msgCounter) + rcci_msg_vframe_header_size;
-        if(sendBytes > maxMsgLength)
+        if(!v2)
+        {
+            stream.fecHdrs.resize(numParity);
+        }
+        for(int j = 0; j < numParity; j++)
         {
-            sendBytes = maxMsgLength;
+            int m = numMsgs + j;
+
+            if(v2)
+            {
+                rcci_msg_vframe2_hdr_t &hdr = stream.fragHdrs2[m];
+                memset(&hdr, 0, sizeof(hdr));
+                hdr.header.magic = rcci_msg_init_magic;
+                hdr.header.ver   = rcci_msg_video_v2;
+                hdr.header.type  = rcci_msg_video_fec;
+                hdr.header.size  = hdrSize + maxFrameLength;
+                hdr.seq          = seq;
+                hdr.frame_size   = size;
+                hdr.all_msgs     = numMsgs;
+                hdr.cur_msg      = j;
+                hdr.num_parity   = numParity;
+                hdr.flags        = flags;
+                hdr.size_shard   = maxFrameLength;
+                hdr.capture_us   = captureUs;
+                rcciMsgSetCrc(&hdr, hdrSize, stream.fecDst[j], maxFrameLength);
+                stream.fragIov[2*m].iov_base = &hdr;
+            }
+            else
+            {
+                rcci_msg_vfec_hdr_t &hdr = stream.fecHdrs[j];
+                memset(&hdr, 0, sizeof(hdr));
+                hdr.header.magic = rcci_msg_init_magic;
+                hdr.header.type  = rcci_msg_video_fec;
+                hdr.header.size  = size;
+                hdr.size_shard   = maxFrameLength;
+                hdr.idx_parity   = j;
+                hdr.cnt_frame    = seq;
+                hdr.all_msgs     = numMsgs;
+                hdr.num_parity   = numParity;
+                rcciMsgSetCrc(&hdr, hdrSize, stream.fecDst[j], maxFrameLength);
+                stream.fragIov[2*m].iov_base = &hdr;
+            }
+            stream.fragIov[2*m].iov_len    = hdrSize;
+            stream.fragIov[2*m+1].iov_base = stream.fecDst[j];
+            stream.fragIov[2*m+1].iov_len  = maxFrameLength;
         }
+    }
 
-        videoFrame.size_frame = sendBytes - rcci_msg_vframe_header_size;
-        videoFrame.idx_frame = msgCounter;
-        videoFrame.cur_msg = cnt_msg++;
+    for(int i = 0; i < numAll; i++)
+    {
+        struct msghdr &msg = stream.fragMsgs[i].msg_hdr;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name    = &stream.addr;
+        msg.msg_namelen = sizeof(stream.addr);
+        msg.msg_iov     = &stream.fragIov[2*i];
+        msg.msg_iovlen  = 2;
+    }
 
-//        std::cout << "Copying from " << msgCounter << " bytes " <<
-//            sendBytes-rcci_msg_vframe_header_size << std::endl;
-//        std::cout << "Sending out " << (int)sendBytes << " bytes" <<
-//            " cur_msg=" << (int)videoFrame.cur_msg << std::endl;
+    if(stream.paceMode != rcc_pacing_off)
+    {
+        if(sendPaced(stream, numAll) < 0)
+        {
+            return -1;
+        }
+    }
+    else if(sendFragments(stream, 0, numAll, monotonicNs()) < 0)
+    {
+        return -1;
+    }
 
-        memcpy(&videoFrame.frame[0], (void *)&frameBuffer[msgCounter],
-               videoFrame.size_frame);
+    stream.stats.frames++;
+    stream.stats.fragments += numAll;
+    stream.stats.parity    += numParity;
 
-        retVal = ::sendto(mRccStreams[stream_id].sock,
-//                          (void *)&videoFrame, videoFrame.header.size, 0,
-                          (void *)&videoFrame, sendBytes, 0,
-                          (struct sockaddr *)&mRccStreams[stream_id].addr,
-                          sizeof(mRccStreams[stream_id].addr));
+    // frame too big for the link - lower quality/scale for the next one
+    stream.lastFrags = numMsgs;
+    if(stream.adaptMaxFrags && (numMsgs > stream.adaptMaxFrags))
+    {
+        stepEncoding(stream, false, false);
+        stream.adaptClear = 0;
+    }
 
-        msgCounter += sendBytes - rcci_msg_vframe_header_size;
+    return (int)msgCounter;
+}
 
+// sendmmsg() of fragments [first, first + num), startNs != 0 - account
+// queue delay of every fragment since startNs
+int rccVideoStreamer::sendFragments(rcc_streams_info_t &stream, int first,
+                                    int num, uint64_t startNs)
+{
+    // sendmmsg() can return before all messages are sent
+    int msgsSent = first;
+    while(msgsSent < (first + num))
+    {
+        int retVal = ::sendmmsg(stream.sock, &stream.fragMsgs[msgsSent],
+                                first + num - msgsSent, 0);
+        stream.stats.syscalls++;
         if(retVal < 0)
         {
-            std::cerr << "sendto() failed: " << strerror(errno) << std::endl;
-            msgCounter = retVal;
-            break;
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "sendmmsg() failed: " << strerror(errno) << std::endl;
+            return -1;
+        }
+
+        uint32_t delayUs = startNs ? (monotonicNs() - startNs) / 1000 : 0;
+        for(int i = msgsSent; i < (msgsSent + retVal); i++)
+        {
+            stream.stats.bytes += stream.fragMsgs[i].msg_len;
         }
-        if(retVal != sendBytes)
+        if(startNs)
         {
-            std::cerr << "sendto() wrong return: " << sendBytes << " != " <<
-                retVal << std::endl;
+            stream.stats.queueDelaySumUs += (uint64_t)delayUs * retVal;
+            stream.stats.queueDelayMaxUs =
+                std::max(stream.stats.queueDelayMaxUs, delayUs);
         }
+        msgsSent += retVal;
     }
 
-    std::cout << "Sending new frame stream_id=" << stream_id << " numStreams="
-              << mRccStreams.size()  << " frame size=" << videoFrame.header.size
-              << " ret val=" << msgCounter << std::endl;
+    return num;
+}
 
-    return (int)msgCounter;
+// Fragment i may leave once the bytes in front of it minus the burst have
+// drained at the pacing rate. The rate is raised to fit the frame into
+// cPaceSpread of the frame interval, so pacing never lowers the frame rate.
+int rccVideoStreamer::sendPaced(rcc_streams_info_t &stream, int numAll)
+{
+    const uint64_t startNs = monotonicNs();
+    double frameBytes = 0;
+    int fps;
+
+    for(int i = 0; i < numAll; i++)
+    {
+        frameBytes += stream.fragIov[2*i].iov_len + stream.fragIov[2*i+1].iov_len;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mEncProt);
+        fps = (stream.enc.fps > 0) ? stream.enc.fps : 1;
+    }
+    double rate = std::max(stream.paceRate, frameBytes * fps / cPaceSpread);
+    double burst = stream.paceBurst;
+
+#ifdef SO_TXTIME
+    if(stream.paceMode == rcc_pacing_txtime)
+    {
+        const size_t ctrlSize = CMSG_SPACE(sizeof(uint64_t));
+        double bytesBefore = 0;
+
+        stream.txtimeCtrl.resize(numAll * ctrlSize);
+        for(int i = 0; i < numAll; i++)
+        {
+            struct msghdr &msg = stream.fragMsgs[i].msg_hdr;
+            double fragBytes = stream.fragIov[2*i].iov_len +
+                stream.fragIov[2*i+1].iov_len;
+            double ahead = std::max(0.0, bytesBefore + fragBytes - burst);
+            uint64_t offsetNs = (uint64_t)(ahead * 1e9 / rate);
+            uint64_t txtime = startNs + offsetNs;
+
+            msg.msg_control    = &stream.txtimeCtrl[i * ctrlSize];
+            msg.msg_controllen = ctrlSize;
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type  = SCM_TXTIME;
+            cmsg->cmsg_len   = CMSG_LEN(sizeof(uint64_t));
+            memcpy(CMSG_DATA(cmsg), &txtime, sizeof(txtime));
+
+            // departure is up to the qdisc, account the scheduled delay
+            uint32_t delayUs = offsetNs / 1000;
+            stream.stats.queueDelaySumUs += delayUs;
+            stream.stats.queueDelayMaxUs =
+                std::max(stream.stats.queueDelayMaxUs, delayUs);
+            bytesBefore += fragBytes;
+        }
+        stream.stats.paced += numAll;
+
+        return sendFragments(stream, 0, numAll, 0);
+    }
+#endif // SO_TXTIME
+
+    int sent = 0;
+    double bytesSent = 0;
+    while(sent < numAll)
+    {
+        double fragBytes = stream.fragIov[2*sent].iov_len +
+            stream.fragIov[2*sent+1].iov_len;
+        double ahead = std::max(0.0, bytesSent + fragBytes - burst);
+        uint64_t dueNs = startNs + (uint64_t)(ahead * 1e9 / rate);
+        uint64_t nowNs = monotonicNs();
+
+        if(dueNs > nowNs)
+        {
+            struct itimerspec its;
+            uint64_t expirations;
+
+            memset(&its, 0, sizeof(its));
+            its.it_value.tv_sec  = dueNs / 1000000000ULL;
+            its.it_value.tv_nsec = dueNs % 1000000000ULL;
+            if(timerfd_settime(stream.timerFd, TFD_TIMER_ABSTIME, &its,
+                               NULL) < 0)
+            {
+                std::cerr << "timerfd_settime() failed: " << strerror(errno)
+                          << std::endl;
+                return -1;
+            }
+            while((::read(stream.timerFd, &expirations,
+                          sizeof(expirations)) < 0) && (errno == EINTR))
+            {
+            }
+
+            nowNs = monotonicNs();
+            stream.stats.paceLateMaxUs =
+                std::max(stream.stats.paceLateMaxUs,
+                         (uint32_t)((nowNs - dueNs) / 1000));
+        }
+
+        // everything that is due by now goes out with one syscall
+        double allowed = (nowNs - startNs) * rate / 1e9 + burst;
+        int num = 0;
+        do
+        {
+            bytesSent += stream.fragIov[2*(sent+num)].iov_len +
+                stream.fragIov[2*(sent+num)+1].iov_len;
+            num++;
+        } while(((sent + num) < numAll) &&
+                ((bytesSent + stream.fragIov[2*(sent+num)].iov_len +
+                  stream.fragIov[2*(sent+num)+1].iov_len) <= allowed));
+
+        if(sendFragments(stream, sent, num, startNs) < 0)
+        {
+            return -1;
+        }
+        sent += num;
+    }
+    stream.stats.paced += numAll;
+
+    return numAll;
+}
+
+bool rccVideoStreamer::setStreamFec(rccVideoStreamer::rcc_stream_id_t stream_id,
+                                    int parityPercent, int fragSize)
+{
+    if((stream_id < 0) || ((size_t)stream_id >= mRccStreams.size()) ||
+       (parityPercent < 0) || (parityPercent > cFecMaxPercent) ||
+       (fragSize < 0) ||
+       (fragSize > rcci_msg_vframe_max_frame_size))
+    {
+        return false;
+    }
+
+    rcc_streams_info_t &stream = mRccStreams[stream_id];
+    stream.fecPercent = parityPercent;
+    stream.fragSize   = fragSize ? fragSize : rcci_msg_vframe_max_frame_size;
+
+    return true;
+}
+
+bool rccVideoStreamer::setStreamAdaptive(rccVideoStreamer::rcc_stream_id_t stream_id,
+                                         int maxFrags)
+{
+    if((stream_id < 0) || ((size_t)stream_id >= mRccStreams.size()) ||
+       (maxFrags < 0) || (maxFrags > rcci_msg_vframe2_max_msgs))
+    {
+        return false;
+    }
+
+    rcc_streams_info_t &stream = mRccStreams[stream_id];
+    stream.adaptMaxFrags = maxFrags;
+    stream.adaptClear    = 0;
+    stream.adaptHold     = 0;
+
+    return true;
+}
+
+bool rccVideoStreamer::setStreamPacing(rccVideoStreamer::rcc_stream_id_t stream_id,
+                                       rcc_pacing_mode_t mode,
+                                       uint32_t rateBps, uint32_t burst)
+{
+    if((stream_id < 0) || ((size_t)stream_id >= mRccStreams.size()))
+    {
+        return false;
+    }
+
+    rcc_streams_info_t &stream = mRccStreams[stream_id];
+
+    if(mode == rcc_pacing_txtime)
+    {
+#ifdef SO_TXTIME
+        // fq qdisc takes CLOCK_MONOTONIC departure times, without it
+        // (or etf) they are ignored and the burst goes out as before
+        struct sock_txtime txtime;
+        txtime.clockid = CLOCK_MONOTONIC;
+        txtime.flags   = 0;
+        if(setsockopt(stream.sock, SOL_SOCKET, SO_TXTIME, &txtime,
+                      sizeof(txtime)) < 0)
+        {
+            std::cerr << "SO_TXTIME not supported (" << strerror(errno)
+                      << "), pacing with timer" << std::endl;
+            mode = rcc_pacing_timer;
+        }
+#else
+        std::cerr << "SO_TXTIME not available, pacing with timer" << std::endl;
+        mode = rcc_pacing_timer;
+#endif // SO_TXTIME
+    }
+
+    if((mode == rcc_pacing_timer) && (stream.timerFd < 0))
+    {
+        stream.timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if(stream.timerFd < 0)
+        {
+            std::cerr << "timerfd_create() failed: " << strerror(errno)
+                      << std::endl;
+            return false;
+        }
+    }
+
+    stream.paceMode  = mode;
+    stream.paceRate  = rateBps;
+    stream.paceBurst = burst ? burst : cPaceBurst;
+
+    return true;
+}
+
+bool rccVideoStreamer::setStreamVersion(rccVideoStreamer::rcc_stream_id_t stream_id,
+                                        uint16_t version, bool negotiate)
+{
+    if((stream_id < 0) || ((size_t)stream_id >= mRccStreams.size()) ||
+       ((version != rcci_msg_video_v1) && (version != rcci_msg_video_v2)))
+    {
+        return false;
+    }
+
+    rcc_streams_info_t &stream = mRccStreams[stream_id];
+    stream.maxVersion = version;
+    stream.negotiate  = negotiate;
+    selectVersion(stream);
+
+    return true;
+}
+
+void rccVideoStreamer::selectVersion(rcc_streams_info_t &stream)
+{
+    uint16_t version = stream.maxVersion;
+
+    if(stream.negotiate && (version >= rcci_msg_video_v2) &&
+       (!stream.v2Report ||
+        ((std::chrono::steady_clock::now() - stream.v1Report) < cVersionHold)))
+    {
+        version = rcci_msg_video_v1;
+    }
+
+    if(version != stream.version)
+    {
+        std::cout << "Stream '" << stream.name << "' video fragments v"
+                  << ((version >= rcci_msg_video_v2) ? 2 : 1) << std::endl;
+        stream.version = version;
+    }
+}
+
+// Receiver reports arrive as unicast to the stream socket, applied from the
+// sending thread before each frame. Any viewer reporting loss or jitter
+// steps the stream down, stepping up needs clear reports from all of them.
+void rccVideoStreamer::readReports(rcc_streams_info_t &stream)
+{
+    rcci_msg_vreport_t report;
+    rcc_stream_enc_t enc;
+    ssize_t len;
+
+    while((len = ::recv(stream.sock, &report, sizeof(report),
+                        MSG_DONTWAIT | MSG_TRUNC)) >= 0)
+    {
+        if((len != sizeof(report)) ||
+           (report.header.magic != rcci_msg_init_magic) ||
+           (report.header.type != rcci_msg_video_report) ||
+           (report.header.size != sizeof(report)) ||
+           !rcciMsgCheckCrc(&report, sizeof(report)))
+        {
+            continue;
+        }
+        stream.stats.reports++;
+
+        if(report.header.ver >= rcci_msg_video_v2)
+        {
+            stream.v2Report = true;
+        }
+        else
+        {
+            stream.v1Report = std::chrono::steady_clock::now();
+        }
+
+        if(stream.adaptMaxFrags == 0)
+        {
+            continue;
+        }
+        if(stream.adaptHold > 0)
+        {
+            stream.adaptHold--;
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mEncProt);
+            enc = stream.enc;
+        }
+        uint32_t intervalUs = (enc.fps > 0) ? (1000000 / enc.fps) : 1000000;
+
+        if((report.loss_permille > cLossHigh) ||
+           ((report.jitter_us * 2) > intervalUs))
+        {
+            stepEncoding(stream, false, true);
+            stream.adaptClear = 0;
+            stream.adaptHold  = cHoldReports;
+        }
+        else if((report.loss_permille <= cLossLow) &&
+                ((report.jitter_us * 4) < intervalUs))
+        {
+            if(++stream.adaptClear >= cClearReports)
+            {
+                stepEncoding(stream, true, true);
+                stream.adaptClear = 0;
+            }
+        }
+        else
+        {
+            stream.adaptClear = 0;
+        }
+    }
+
+    selectVersion(stream);
+}
+
+// Down: quality first (cheapest to recover), then resolution, frame rate
+// last. Up goes in reverse order.
+void rccVideoStreamer::stepEncoding(rcc_streams_info_t &stream, bool up,
+                                    bool allowFps)
+{
+    std::lock_guard<std::mutex> lock(mEncProt);
+    rcc_stream_enc_t &enc = stream.enc;
+    rcc_stream_enc_t old = enc;
+
+    if(up)
+    {
+        if(stream.fpsDiv > 1)
+        {
+            stream.fpsDiv--;
+        }
+        else if(enc.scale < 100)
+        {
+            enc.scale = std::min(100, enc.scale + cScaleStep);
+        }
+        else if((enc.quality < cQualityMax) &&
+                ((stream.lastFrags * 4) <= (stream.adaptMaxFrags * 3)))
+        {
+            enc.quality = std::min(cQualityMax, enc.quality + cQualityStep);
+        }
+    }
+    else
+    {
+        if(enc.quality > cQualityMin)
+        {
+            enc.quality = std::max(cQualityMin, enc.quality - cQualityStep);
+        }
+        else if(enc.scale > cScaleMin)
+        {
+            enc.scale = std::max(cScaleMin, enc.scale - cScaleStep);
+        }
+        else if(allowFps && ((stream.fps / (stream.fpsDiv + 1)) >= cFpsMin))
+        {
+            stream.fpsDiv++;
+        }
+    }
+    enc.fps = stream.fps / stream.fpsDiv;
+
+    if(memcmp(&old, &enc, sizeof(enc)) != 0)
+    {
+        std::cout << "Stream '" << stream.name << "' encoding: quality="
+                  << enc.quality << " scale=" << enc.scale << "% fps="
+                  << enc.fps << std::endl;
+    }
 }
 
 #endif // USE_UDP_MULTICAST
@@ -2,6 +2,9 @@
 #define __RCC_VIDEO_STREAMER_H
 
 #include <thread>
+#include <mutex>
+#include <chrono>
+#include <functional>
 #include <condition_variable>
 
 #define USE_UDP_MULTICAST
@@ -16,8 +19,13 @@
 #ifdef USE_UDP_MULTICAST
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+
+extern "C" {
+#include "rcci_type.h"
+}
 #endif // USE_UDP_MULTICAST
 
 // OpenCV
@@ -27,6 +35,45 @@
 #include "live_cam_device_source.h"
 
 class rccVideoStreamer {
+public:
+    // Per stream send statistics
+    typedef struct rcc_stream_stats_s {
+        uint64_t frames;    // frames sent
+        uint64_t fragments; // UDP fragments sent
+        uint64_t bytes;     // bytes sent (including fragment headers)
+        uint64_t syscalls;  // send syscalls issued
+        uint64_t parity;    // FEC parity fragments (included in fragments)
+        uint64_t skipped;   // frames skipped to lower the frame rate
+        uint64_t reports;   // valid receiver reports received
+        uint64_t paced;     // fragments sent through the pacer
+        uint64_t queueDelaySumUs; // frame submit -> fragment departure
+        uint32_t queueDelayMaxUs;
+        uint32_t paceLateMaxUs;   // timer pacer wakeup after departure time
+    } rcc_stream_stats_t;
+
+    // How fragments of a frame are spread over the frame interval
+    typedef enum rcc_pacing_mode_e {
+        rcc_pacing_off = 0, // whole frame back to back
+        rcc_pacing_timer,   // sending thread sleeps on timerfd between bursts
+        rcc_pacing_txtime   // departure time per fragment (SO_TXTIME), the
+                            // qdisc (fq/etf) holds them - falls back to timer
+    } rcc_pacing_mode_t;
+
+    // Current encoding of a stream (adapted to receiver reports)
+    typedef struct rcc_stream_enc_s {
+        int quality; // JPEG quality
+        int scale;   // resolution in % of the captured frame
+        int fps;     // frames per second sent
+    } rcc_stream_enc_t;
+
+    static const int cDefaultQuality = 70;
+
+    // Capture of a frame, carried to receivers in v2 fragment headers
+    typedef struct rcc_frame_info_s {
+        uint64_t captureUs; // CLOCK_MONOTONIC [us], 0 - not known
+        uint32_t seq;       // capture sequence number
+    } rcc_frame_info_t;
+
 private:
     // internal structure holding info on available streams
     // Outside world uses 'rcc_stream_id_t' when addressing specific stream and
@@ -34,6 +81,9 @@ private:
     typedef struct rcc_streams_info_s {
         std::string          name;
         int                  fps;
+        rcc_stream_enc_t     enc;       // protected by mEncProt
+        int                  fpsDiv;    // every fpsDiv-th frame is sent
+        int                  fpsCnt;
 #ifdef USE_LIVE555
         std::string          url;
         LiveCamDeviceSource *devSource;
@@ -42,22 +92,120 @@ private:
         int                  sock;
         int                  port;
         struct sockaddr_in   addr;
+        uint32_t             frameSeq;
+        // fragment header version, v2 once all reporting viewers know it
+        uint16_t                              version;
+        uint16_t                              maxVersion;
+        bool                                  negotiate;
+        bool                                  v2Report;  // any v2 report seen
+        std::chrono::steady_clock::time_point v1Report;  // last v1 report
+        // fragment headers & scatter/gather lists, reused between frames
+        std::vector<rcci_msg_vframe_hdr_t>  fragHdrs;
+        std::vector<rcci_msg_vframe2_hdr_t> fragHdrs2; // data & parity
+        std::vector<struct iovec>          fragIov;
+        std::vector<struct mmsghdr>        fragMsgs;
+        // FEC parity fragments (fecPercent == 0 - disabled)
+        int                                fecPercent;
+        size_t                             fragSize;
+        std::vector<rcci_msg_vfec_hdr_t>   fecHdrs;
+        std::vector<std::vector<uint8_t> > fecData;
+        std::vector<const uint8_t *>       fecSrc;
+        std::vector<size_t>                fecSrcLen;
+        std::vector<uint8_t *>             fecDst;
+        // adaptation to receiver reports (adaptMaxFrags == 0 - disabled)
+        int                                adaptMaxFrags;
+        int                                adaptClear; // clear reports in a row
+        int                                adaptHold;  // reports to ignore
+        int                                lastFrags;  // data fragments of last frame
+        // pacing of fragments (paceMode == rcc_pacing_off - disabled)
+        rcc_pacing_mode_t                  paceMode;
+        double                             paceRate;   // [B/s], minimum
+        size_t                             paceBurst;  // [B] sent ahead of time
+        int                                timerFd;
+        std::vector<uint8_t>               txtimeCtrl; // SCM_TXTIME per fragment
 #endif // USE_UDP_MULTICAST
+        rcc_stream_stats_t   stats;
     } rcc_streams_info_t;
 
 public:
     typedef int rcc_stream_id_t;
 
+    // Every encoded frame sent (also on unicast only stream), called from
+    // the sending thread - data is valid only during the call. info holds
+    // the sequence number the frame was sent with.
+    typedef std::function<void(rcc_stream_id_t, const uint8_t *, size_t,
+                               const rcc_frame_info_t &)> frameFuncCb;
+
+    // Layout of frames given to encodeAndStream()/encodeFrame()
+    typedef enum rcc_frame_type_e {
+        rcc_frame_bgr = 0, // CV_8UC3 packed BGR
+        rcc_frame_grey,    // CV_8UC1 luma only, encoded as grey JPEG
+        rcc_frame_i420     // CV_8UC1 (height * 3 / 2) x width planar I420
+    } rcc_frame_type_t;
+
     rccVideoStreamer(void);
     ~rccVideoStreamer(void);
 
     bool            startServer(int port);
     bool            stopServer(void);
     bool            isServerStarted(void);
-    rcc_stream_id_t addStream(const char *streamName, int fps, int port = 0);
+    // mcastIf selects outgoing interface address (NULL - default one),
+    // port 0 - no multicast, frames only go to the frame callback
+    rcc_stream_id_t addStream(const char *streamName, int fps, int port = 0,
+                              const char *mcastIf = NULL);
 
     bool encodeAndStream(rccVideoStreamer::rcc_stream_id_t stream_id,
-                         cv::Mat &frame);
+                         cv::Mat &frame, rcc_frame_type_t type = rcc_frame_bgr,
+                         const rcc_frame_info_t *info = NULL);
+    // JPEG encoding only (thread safe), scale in % of frame resolution
+    bool encodeFrame(const cv::Mat &frame, std::vector<uchar> &encodedBuffer,
+                     rcc_frame_type_t type = rcc_frame_bgr,
+                     int quality = cDefaultQuality, int scale = 100);
+    bool getStreamStats(rccVideoStreamer::rcc_stream_id_t stream_id,
+                        rcc_stream_stats_t &stats);
+    void setFrameCb(frameFuncCb cbFunc) { mFrameCb = cbFunc; };
+    // Encoding to use for the next frame of the stream (thread safe)
+    bool getStreamEncoding(rccVideoStreamer::rcc_stream_id_t stream_id,
+                           rcc_stream_enc_t &enc);
+    // Call once per captured frame, false when the frame should be skipped
+    // because stream frame rate is lowered
+    bool acceptFrame(rccVideoStreamer::rcc_stream_id_t stream_id);
+
+#ifdef USE_UDP_MULTICAST
+    // Fragments and sends already encoded frame without copying it. With
+    // info the frame keeps its capture sequence number and time, otherwise
+    // frames of the stream are numbered here.
+    int  sendEncodedFrame(rccVideoStreamer::rcc_stream_id_t stream_id,
+                          const uint8_t *data, size_t size,
+                          const rcc_frame_info_t *info = NULL);
+    // Highest fragment header version of the stream (rcci_msg_video_v1/v2).
+    // With negotiate the stream starts with v1 and goes to v2 when receiver
+    // reports announce it and no viewer reported v1 for a while, otherwise
+    // the version is used right away. Default - v2 negotiated.
+    bool setStreamVersion(rccVideoStreamer::rcc_stream_id_t stream_id,
+                          uint16_t version, bool negotiate = true);
+    // Adds parityPercent % (0 - off, up to 100) of FEC parity fragments to
+    // every frame that fits into rcciFecMaxShards with them.
+    // fragSize limits data fragment payload (0 - largest possible), smaller
+    // fragments spread one frame over more of them so FEC has something to
+    // work with.
+    bool setStreamFec(rccVideoStreamer::rcc_stream_id_t stream_id,
+                      int parityPercent, int fragSize = 0);
+    // Adapts JPEG quality, scale and frame rate of the stream to receiver
+    // reports (rcci_msg_vreport_t) and keeps frames within maxFrags data
+    // fragments. 0 - off, encoding stays as it is.
+    bool setStreamAdaptive(rccVideoStreamer::rcc_stream_id_t stream_id,
+                           int maxFrags);
+    // Spreads fragments of every frame over the frame interval at rateBps
+    // (raised when the frame would not fit into the interval), so video does
+    // not fill the link queue in front of drive packets. burst - bytes sent
+    // back to back (0 - default). Needs small fragments (setStreamFec()) to
+    // have something to spread. txtime falls back to timer when the socket
+    // does not support it.
+    bool setStreamPacing(rccVideoStreamer::rcc_stream_id_t stream_id,
+                         rcc_pacing_mode_t mode, uint32_t rateBps = 0,
+                         uint32_t burst = 0);
+#endif // USE_UDP_MULTICAST
 private:
 #ifdef USE_LIVE555
     void serverThread(int port);
@@ -67,7 +215,14 @@ private:
     int openMulticastSocket(void);
     int closeMulticastSocket(int fd);
     int sendMulticastData(rccVideoStreamer::rcc_stream_id_t stream_id,
-                          cv::Mat &frame);
+                          cv::Mat &frame, rcc_frame_type_t type,
+                          const rcc_frame_info_t *info);
+    void readReports(rcc_streams_info_t &stream);
+    void selectVersion(rcc_streams_info_t &stream);
+    void stepEncoding(rcc_streams_info_t &stream, bool up, bool allowFps);
+    int  sendFragments(rcc_streams_info_t &stream, int first, int num,
+                       uint64_t startNs);
+    int  sendPaced(rcc_streams_info_t &stream, int numAll);
 #endif // USE_UDP_MULTICAST
     // Server stuff
 
@@ -85,5 +240,7 @@ private:
 #endif // USE_LIVE555
 
     std::vector<rcc_streams_info_t> mRccStreams;
+    std::mutex                      mEncProt; // enc of all streams
+    frameFuncCb                     mFrameCb;
 };
 #endif // __RCC_VIDEO_STREAMER_H
@@ -1,28 +1,97 @@
 #include <unistd.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #include <iostream>
 #include <sstream>
 #include <cstring>
 #include <cerrno>
 #include <chrono>
+#include <algorithm>
 
 #include "rcci_server.h"
+#include "rcci_crc.h"
 #include "rcc_logger.h"
 
 const int cCommMagic(0xa5a5);
 const int cCommVer(0x100);
 const int cNumberOfConn(5);
-const int cSelTimeoutMs(100);
+const int cMaxEpollEvents(16);
+const size_t cMaxMsgSize(4096);        // control channel message limit
+const size_t cRxBufSize(2 * cMaxMsgSize);
+const int cMaxReplyIov(64);            // replies per sendmsg()
+const size_t cMaxTxQueueSize(256 * 1024); // client not reading is dropped
+const uint32_t cClientEvents(EPOLLIN | EPOLLRDHUP | EPOLLET);
 
 const uint16_t cServMagic(0xbaba);
 const uint16_t cServVer(0x100);
 
+const int cDrivePeriodUs(16600);   // PWM period, see rccSysCtrl
+const int cDriveIdleTimeoutMs(100); // checks mDriveThreadRunning
+const int cDriveBatch(16);          // recvmmsg() messages per call
+const int cDriveSeqResync(32);      // stale commands in row - client restarted
+const int cDriveThreadPrio(50);     // SCHED_FIFO priority if allowed
+
+const size_t cVideoFragSize(1400);    // fits WiFi MTU, no IP fragmentation
+const size_t cVideoQueueDepth(2);     // frames per client, oldest dropped
+const int cVideoBatch(16);            // sendmmsg() fragments per call
+const int cVideoIdleMs(100);          // checks mVideoThreadRunning
+const double cVideoRateStart(1.5e6);  // client pacing [B/s]
+const double cVideoRateMin(250e3);
+const double cVideoRateMax(4e6);
+const double cVideoRateStep(100e3);   // increase per clear receiver report
+const double cVideoBurst(16384);      // token bucket depth [B]
+const int cVideoLossHigh(30);         // reported loss [1/1000] - back off
+const int cVideoLossLow(5);
+
+const int cLogCoalesceMs(20);         // wait for more lines before sending
+const size_t cLogQueueMax(64 * 1024); // queued text, dropped when full
+const int cLogBatch(64);              // sendmmsg() datagrams per call
+
+const int rcciServer::cDriveLatBuckets;
+const int rcciServer::cDriveLatBucketUs;
+
+static int64_t timespecDiffUs(const struct timespec &a, const struct timespec &b)
+{
+    return (int64_t)(a.tv_sec - b.tv_sec) * 1000000 +
+        (a.tv_nsec - b.tv_nsec) / 1000;
+}
+
+static bool sameAddr(const struct sockaddr_in &a, const struct sockaddr_in &b)
+{
+    return (a.sin_addr.s_addr == b.sin_addr.s_addr) &&
+        (a.sin_port == b.sin_port);
+}
+
+static int setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if(flags < 0)
+    {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
 rcciServer::rcciServer(void)
-    : mListenFd(-1), mPort(-1), mListenThread(NULL), mListenThreadRunning(false),
-      mSelectThread(NULL), mSelectThreadRunning(NULL), mSelectThreadUpdate(false),
-      mDriveCbFunc(NULL), mDriveReadThread(NULL), mDriveReadThreadRunning(false)
+    : mListenFd(-1), mPort(-1), mEpollFd(-1), mEventFd(-1),
+      mLoopThread(NULL), mLoopThreadRunning(false), mDriveCbFunc(NULL),
+      mDriveThread(NULL), mDriveThreadRunning(false), mDriveSeqReset(false),
+      mDriveSeqValid(false), mDriveLastSeq(0), mDriveStaleRun(0),
+      mVideoThread(NULL), mVideoThreadRunning(false), mVideoSeq(0),
+      mLogThread(NULL), mLogThreadRunning(false), mLogOffset(0)
 {
     mConnClients.clear();
+    memset(&mDriveStats, 0, sizeof(mDriveStats));
+    memset(&mVideoStats, 0, sizeof(mVideoStats));
+    memset(&mLogStats, 0, sizeof(mLogStats));
 
     for(int i = 0; i < rcci_service_nonexisting; i++)
     {
@@ -52,6 +121,11 @@ int rcciServer::openServer(int port)
         return -1;
     }
 
+    // restarted daemon binds even with connections of the previous one in
+    // TIME_WAIT, clients reconnect
+    int yes = 1;
+    setsockopt(mListenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
     memset(&sockAddr, 0, sizeof(sockAddr));
     sockAddr.sin_family = AF_INET;
     sockAddr.sin_addr.s_addr = INADDR_ANY;
@@ -68,6 +142,7 @@ int rcciServer::openServer(int port)
     mPort = ntohs(port);
 
     listen(mListenFd, cNumberOfConn);
+    setNonBlocking(mListenFd);
 
     strStream << "Server open on port: " << htons(mPort) << std::endl;
     getLogger().debug(strStream.str());
@@ -75,41 +150,91 @@ int rcciServer::openServer(int port)
     for(auto it = mServices.begin(); it != mServices.end(); ++it)
         startServiceServer(*it);
 
-    // TODO: Move this to DRV service register
-    startDriveThread(); // start listening for DRV service
-
     return listenServer();
 }
 
 int rcciServer::listenServer(void)
 {
     std::ostringstream strStream;
-    mListenThread = new std::thread(&rcciServer::acceptThread, this);
 
-    if(!mListenThread)
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(mEpollFd < 0)
     {
-        strStream << "Can not start accepting thread" << std::endl;
+        strStream << "epoll_create1() failed: " << strerror(errno) << std::endl;
         getLogger().error(strStream.str());
         return -1;
     }
 
-    strStream << "Started accepting thread" << std::endl;
-    getLogger().debug(strStream.str());
+    mEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(mEventFd < 0)
+    {
+        strStream << "eventfd() failed: " << strerror(errno) << std::endl;
+        getLogger().error(strStream.str());
+        return -1;
+    }
+
+    if((epollAdd(mEventFd, EPOLLIN) < 0) ||
+       (epollAdd(mListenFd, EPOLLIN | EPOLLET) < 0))
+    {
+        return -1;
+    }
+
+    // UDP service sockets are served from the same loop, except drive
+    // one which has its own thread
+    for(auto it = mServices.begin(); it != mServices.end(); ++it)
+    {
+        if(it->fd > 0)
+        {
+            setNonBlocking(it->fd);
+            if(it->serviceId != rcci_service_drive)
+            {
+                epollAdd(it->fd, EPOLLIN | EPOLLET);
+            }
+        }
+    }
+
+    if(mServices[rcci_service_drive].fd > 0)
+    {
+        int on = 1;
+        // kernel receive timestamps for latency statistics
+        setsockopt(mServices[rcci_service_drive].fd, SOL_SOCKET,
+                   SO_TIMESTAMPNS, &on, sizeof(on));
+
+        mDriveThreadRunning = true;
+        mDriveThread = new std::thread(&rcciServer::driveThread, this);
+    }
+
+    if(mServices[rcci_service_video].fd > 0)
+    {
+        mVideoThreadRunning = true;
+        mVideoThread = new std::thread(&rcciServer::videoThread, this);
+    }
+
+    if(mServices[rcci_service_logging].fd > 0)
+    {
+        mLogThreadRunning = true;
+        mLogThread = new std::thread(&rcciServer::logThread, this);
+    }
 
-    mSelectThread = new std::thread(&rcciServer::selectThread, this);
-    if(!mSelectThread)
+    mLoopThreadRunning = true;
+    mLoopThread = new std::thread(&rcciServer::eventLoopThread, this);
+    if(!mLoopThread)
     {
-        strStream << "Can not start select thread" << std::endl;
+        mLoopThreadRunning = false;
+        strStream << "Can not start event loop thread" << std::endl;
         getLogger().error(strStream.str());
         return -1;
     }
 
+    strStream << "Started event loop thread" << std::endl;
+    getLogger().debug(strStream.str());
+
     return 0;
 }
 
 bool rcciServer::isServerRunning()
 {
-    if(mListenThread && (mPort > 0) && (mListenFd > 0))
+    if(mLoopThread && (mPort > 0) && (mListenFd > 0))
     {
         return true;
     }
@@ -119,35 +244,52 @@ bool rcciServer::isServerRunning()
     }
 }
 
-void rcciServer::writeServiceLog(std::string &str)
+// Called from the logger drain thread, only queues the text
+void rcciServer::writeServiceLog(std::string &str, uint64_t offset)
 {
-    ssize_t bytes;
-    for(auto it = mServices[rcci_service_logging].clients.begin();
-        it != mServices[rcci_service_logging].clients.end(); ++it)
-    {
-        sockaddr_in *sockAddr = (sockaddr_in *)&(*it);
-        socklen_t adrlen = sizeof(*sockAddr);
+    bool wakeup;
 
-        bytes = sendto(mServices[rcci_service_logging].fd, str.c_str(), str.length(), 0,
-                       (sockaddr *)sockAddr, adrlen);
-        if(bytes < 0)
+    {
+        std::lock_guard<std::mutex> lock(mLogMutex);
+        if(!mLogThreadRunning)
         {
-            char hbuf[NI_MAXHOST], sbuf[NI_MAXSERV];
-            getnameinfo((const sockaddr *)sockAddr, sizeof(*sockAddr),
-                        hbuf, sizeof(hbuf), sbuf, sizeof(sbuf),
-                        (NI_NUMERICHOST | NI_NUMERICSERV));
+            return;
+        }
 
-            std::cerr << "writeServiceLog() failed sendto() to " << hbuf << ":" <<
-                sbuf << ": " << strerror(errno) << std::endl;
+        mLogStats.bytes += str.length();
+        // text must stay contiguous in the log stream - queued text is
+        // dropped if it is not (or the queue is full), clients see the gap
+        if(!mLogPending.empty() &&
+           ((offset != (mLogOffset + mLogPending.length())) ||
+            ((mLogPending.length() + str.length()) > cLogQueueMax)))
+        {
+            mLogStats.dropped += mLogPending.length();
+            mLogPending.clear();
         }
-        if(bytes != (ssize_t)str.length())
+        // first text starts the coalescing period, full datagram ends it
+        wakeup = mLogPending.empty();
+        if(mLogPending.empty())
         {
-            std::cerr << "writeServiceLog() failed to send all bytes: " << bytes <<
-                " != " << str.length() << std::endl;
+            mLogOffset = offset;
         }
+        mLogPending.append(str);
+        wakeup |= (mLogPending.length() >= (size_t)rcci_msg_log_max_text);
+    }
+
+    if(wakeup)
+    {
+        mLogCond.notify_one();
     }
 }
 
+bool rcciServer::getLogStats(rcci_log_stats_t &stats)
+{
+    std::lock_guard<std::mutex> lock(mLogMutex);
+
+    stats = mLogStats;
+    return (mLogThread != NULL);
+}
+
 int rcciServer::setDriveDataCb(rccSysCtrl::driveFuncCb cbFunc)
 {
     mDriveCbFunc = cbFunc;
@@ -155,27 +297,124 @@ int rcciServer::setDriveDataCb(rccSysCtrl::driveFuncCb cbFunc)
     return 0;
 }
 
+bool rcciServer::getDriveStats(rcci_drive_stats_t &stats)
+{
+    std::lock_guard<std::mutex> lock(mDriveStatsMutex);
+
+    stats = mDriveStats;
+    return (mDriveThread != NULL);
+}
+
+int rcciServer::writeServiceVideo(const uint8_t *data, size_t size,
+                                  uint64_t captureUs, int64_t seq)
+{
+    int numClients;
+
+    if((size == 0) || (size > (size_t)rcci_msg_vframe2_max_frame))
+    {
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mVideoMutex);
+        mVideoStats.frames++;
+        if(mVideoClients.empty())
+        {
+            return 0;
+        }
+    }
+
+    // one copy shared by all clients - caller can reuse its buffer
+    std::shared_ptr<rcci_vframe_t> frame(new rcci_vframe_t);
+    frame->data.assign(data, data + size);
+    frame->captureUs = captureUs;
+
+    {
+        std::lock_guard<std::mutex> lock(mVideoMutex);
+        frame->seq = (seq < 0) ? mVideoSeq++ : (uint32_t)seq;
+        for(auto it = mVideoClients.begin(); it != mVideoClients.end(); ++it)
+        {
+            if((it->version < rcci_msg_video_v2) &&
+               (size > (size_t)rcci_msg_vframe_max_frame))
+            {
+                mVideoStats.dropped++;
+                continue;
+            }
+            // latest frame wins - slow client loses its oldest queued frame
+            if(it->queue.size() >= cVideoQueueDepth)
+            {
+                it->queue.pop_front();
+                mVideoStats.dropped++;
+            }
+            it->queue.push_back(frame);
+        }
+        numClients = mVideoClients.size();
+    }
+    mVideoCond.notify_one();
+
+    return numClients;
+}
+
+bool rcciServer::getVideoStats(rcci_video_stats_t &stats)
+{
+    std::lock_guard<std::mutex> lock(mVideoMutex);
+
+    stats = mVideoStats;
+    stats.clients = mVideoClients.size();
+    return (mVideoThread != NULL);
+}
+
 int rcciServer::closeServer(void)
 {
-    for(auto it = mServices.begin(); it != mServices.end(); ++it)
+    mLoopThreadRunning = false;
+    if(mLoopThread)
     {
-        closeServiceServer(*it);
+        wakeupEventLoop();
+        mLoopThread->join();
+        delete mLoopThread;
+        mLoopThread = NULL;
+    }
+
+    mDriveThreadRunning = false;
+    if(mDriveThread)
+    {
+        mDriveThread->join();
+        delete mDriveThread;
+        mDriveThread = NULL;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mVideoMutex);
+        mVideoThreadRunning = false;
+    }
+    if(mVideoThread)
+    {
+        mVideoCond.notify_all();
+        mVideoThread->join();
+        delete mVideoThread;
+        mVideoThread = NULL;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mVideoMutex);
+        mVideoClients.clear();
     }
 
-    mSelectThreadRunning = false;
-    if(mSelectThread)
+    // log thread sends what is still queued before quitting
     {
-        mSelectThread->join();
-        delete [] mSelectThread;
-        mSelectThread = NULL;
+        std::lock_guard<std::mutex> lock(mLogMutex);
+        mLogThreadRunning = false;
+    }
+    if(mLogThread)
+    {
+        mLogCond.notify_all();
+        mLogThread->join();
+        delete mLogThread;
+        mLogThread = NULL;
     }
 
-    mListenThreadRunning = false;
-    if(mListenThread)
+    for(auto it = mServices.begin(); it != mServices.end(); ++it)
     {
-        mListenThread->join();
-        delete [] mListenThread;
-        mListenThread = NULL;
+        closeServiceServer(*it);
     }
 
     for(auto it = mConnClients.begin(); it != mConnClients.end(); ++it)
@@ -190,6 +429,18 @@ int rcciServer::closeServer(void)
         mListenFd = -1;
     }
 
+    if(mEventFd > 0)
+    {
+        close(mEventFd);
+        mEventFd = -1;
+    }
+
+    if(mEpollFd > 0)
+    {
+        close(mEpollFd);
+        mEpollFd = -1;
+    }
+
     mPort = -1;
 
     return 0;
@@ -234,7 +485,10 @@ int rcciServer::startServiceServer(rcci_service_t &service)
 
     service.port = ntohs(sockAddr.sin_port);
 
-    service.clients.clear();
+    {
+        std::lock_guard<std::mutex> lock(mServicesMutex);
+        service.clients.clear();
+    }
 
     strStream.str(std::string());
     strStream << service.name << " service started at port: " << service.port <<
@@ -246,6 +500,8 @@ int rcciServer::startServiceServer(rcci_service_t &service)
 
 void rcciServer::closeServiceServer(rcci_service_t &service)
 {
+    std::lock_guard<std::mutex> lock(mServicesMutex);
+
     service.clients.clear();
     if(service.fd > 0)
     {
@@ -273,12 +529,20 @@ void rcciServer::addClient(rcci_client_info_t &cInfo)
         getLogger().error(strStream.str());
     }
 
-    // protect by mutex
-    mConnClients.push_back(cInfo);
+    // client socket is non-blocking (accept4()), a client that stops
+    // reading can not block the reactor - see flushReplies()
+    cInfo.rxBuf.assign(cRxBufSize, 0);
+    cInfo.rxLen = 0;
+    cInfo.txQueue.clear();
+    cInfo.txOff = 0;
+    cInfo.txArmed = false;
+    if(epollAdd(cInfo.fd, cClientEvents) < 0)
+    {
+        close(cInfo.fd);
+        return;
+    }
 
-    // inform listening thread to include it (must also be protected)
-    // use signals/slots - would be nice :)
-    mSelectThreadUpdate = true;
+    mConnClients.push_back(cInfo);
 
     strStream.str(std::string());
     strStream << "Client connected: " << hbuf << ":" << sbuf <<
@@ -295,19 +559,20 @@ void rcciServer::removeClient(rcci_client_info_t &cInfo)
     {
         if(it->fd == cInfo.fd)
         {
-            close(it->fd);
+            int fd = it->fd;
+
+            // video goes to UDP address, stop it with the control connection
+            removeVideoClients(fd);
+            removeServiceClients(*it);
 
-            // protect by mutex
+            // closing the fd also removes it from the epoll set
+            close(fd);
             mConnClients.erase(it);
 
-            strStream << "Removing client " << cInfo.fd <<
+            strStream << "Removing client " << fd <<
                 " (Num of clients: " << mConnClients.size() << ")" << std::endl;
             getLogger().debug(strStream.str());
 
-            // inform listening thread to include it (must also be protected)
-            // use signals/slots - would be nice :)
-            mSelectThreadUpdate = true;
-
             return;
         }
     }
@@ -315,287 +580,543 @@ void rcciServer::removeClient(rcci_client_info_t &cInfo)
     return;
 }
 
-void rcciServer::acceptThread(void)
+int rcciServer::epollAdd(int fd, uint32_t events)
 {
-    std::ostringstream strStream;
-    rcci_client_info_t cInfo;
-    socklen_t len(sizeof(cInfo.sockAddr));
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = events;
+    ev.data.fd = fd;
 
-    if(!isServerRunning())
+    if(epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
     {
-        strStream << "Server not started, can not listen!" << std::endl;
+        std::ostringstream strStream;
+        strStream << "epoll_ctl() failed for fd " << fd << ": " <<
+            strerror(errno) << std::endl;
         getLogger().error(strStream.str());
-        return;
+        return -1;
     }
-    strStream << "Starting server" << std::endl;
-    getLogger().debug(strStream.str());
-    // protect by mutex
-    mListenThreadRunning = true;
-    while(mListenThreadRunning)
+
+    return 0;
+}
+
+int rcciServer::epollMod(int fd, uint32_t events)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = events;
+    ev.data.fd = fd;
+
+    if(epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &ev) < 0)
     {
-        cInfo.fd = accept(mListenFd, (struct sockaddr *)&cInfo.sockAddr, &len);
+        std::ostringstream strStream;
+        strStream << "epoll_ctl() failed for fd " << fd << ": " <<
+            strerror(errno) << std::endl;
+        getLogger().error(strStream.str());
+        return -1;
+    }
 
-        if(cInfo.fd < 0)
+    return 0;
+}
+
+void rcciServer::wakeupEventLoop(void)
+{
+    uint64_t val = 1;
+
+    if(mEventFd > 0)
+    {
+        if(write(mEventFd, &val, sizeof(val)) != sizeof(val))
         {
-            strStream << "Error while client connecting" << std::endl;
-            getLogger().error(strStream.str());
+            std::cerr << "wakeupEventLoop() write failed: " <<
+                strerror(errno) << std::endl;
         }
-
-        addClient(cInfo);
     }
 }
 
-// TODO: Check if possible to use creation/killing of the thread instead of
-// timeouts for select() to detect if change is needed (maybe less CPU power)
-void rcciServer::selectThread(void)
+void rcciServer::eventLoopThread(void)
 {
     std::ostringstream strStream;
-    fd_set fullSet, readSet;
-    int maxFd, retVal;
-    struct timeval selTimeout; // make it programable?
+    struct epoll_event events[cMaxEpollEvents];
 
-    if(!isServerRunning())
+    // not isServerRunning() - mLoopThread may not be assigned yet
+    if((mPort <= 0) || (mListenFd <= 0) || (mEpollFd < 0))
     {
         strStream << "Server not started, can not listen!" << std::endl;
         getLogger().error(strStream.str());
         return;
     }
+    strStream << "Starting server" << std::endl;
+    getLogger().debug(strStream.str());
 
-    // protect by mutex mSelectThreadUpdate, mSelectThreadrunning & mConnClients
-
-    /* Always update FD_SET structures */
-    mSelectThreadUpdate = true;
-    mSelectThreadRunning = true;
-
-    while(mSelectThreadRunning)
+    while(mLoopThreadRunning)
     {
-        /* Update FD_SET structures - new request */
-        if(mSelectThreadUpdate)
+        // No timeout - every wakeup is either data or mEventFd
+        int numEvents = epoll_wait(mEpollFd, events, cMaxEpollEvents, -1);
+        if(numEvents < 0)
         {
-            maxFd = 0;
-            FD_ZERO(&fullSet);
-            for(auto it = mConnClients.begin(); it != mConnClients.end(); ++it)
+            if(errno == EINTR)
             {
-                FD_SET(it->fd, &fullSet);
-                maxFd = (maxFd > it->fd) ? maxFd : it->fd;
+                continue;
             }
-            mSelectThreadUpdate = false;
-        }
-
-        memcpy(&readSet, &fullSet, sizeof(fd_set));
-
-        selTimeout.tv_sec = 0;
-        selTimeout.tv_usec = cSelTimeoutMs*1e3;
-
-        retVal = select(maxFd + 1, &readSet, NULL, NULL, &selTimeout);
-        if(retVal < 0)
-        {
             strStream.str(std::string());
-            strStream << "select() failed: " << strerror(errno) << std::endl;
+            strStream << "epoll_wait() failed: " << strerror(errno) << std::endl;
             getLogger().error(strStream.str());
+            break;
         }
-        else
+
+        for(int i = 0; i < numEvents; i++)
         {
-            if(retVal == 0)
+            int fd = events[i].data.fd;
+
+            if(fd == mEventFd)
             {
-                continue;
+                uint64_t val;
+                while(read(mEventFd, &val, sizeof(val)) > 0) { /* drain */ }
             }
-
-            for(auto it = mConnClients.begin(); it != mConnClients.end(); ++it)
+            else if(fd == mListenFd)
             {
-                if(FD_ISSET(it->fd, &readSet))
-                {
-                    // TODO: Think if it would be better to serve data
-                    // in separate thread?
-
-                    processData(*it);
-                    // we break here and read next time around if something is
-                    // missing - mainly because processData() might have changed
-                    // mConnClients and we want to have it updated
-                    break;
-                }
+                acceptClients();
+            }
+            else if(fd == mServices[rcci_service_logging].fd)
+            {
+                drainServiceSocket(fd);
+            }
+            else if(fd == mServices[rcci_service_video].fd)
+            {
+                readVideoReports();
+            }
+            else
+            {
+                // also on EPOLLRDHUP - serve what is still buffered,
+                // serveClient() removes the client on end-of-file. EPOLLOUT
+                // (armed by flushReplies()) sends the queued rest.
+                serveClient(fd);
             }
         }
     }
 }
 
-int rcciServer::startDriveThread(void)
+void rcciServer::acceptClients(void)
 {
     std::ostringstream strStream;
+    rcci_client_info_t cInfo;
 
-    if(mDriveReadThread || mDriveReadThreadRunning)
+    // edge triggered - accept everything that is pending
+    while(true)
     {
-        strStream << "Drive data thread already running" << std::endl;
-        getLogger().error(strStream.str());
-        return -1;
-    }
+        socklen_t len(sizeof(cInfo.sockAddr));
+        cInfo.fd = accept4(mListenFd, (struct sockaddr *)&cInfo.sockAddr,
+                           &len, SOCK_NONBLOCK);
+
+        if(cInfo.fd < 0)
+        {
+            if((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+            {
+                strStream.str(std::string());
+                strStream << "Error while client connecting: " <<
+                    strerror(errno) << std::endl;
+                getLogger().error(strStream.str());
+            }
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
 
+        addClient(cInfo);
+    }
+}
 
-    if((mServices[rcci_service_drive].fd <= 0) ||
-       (mServices[rcci_service_drive].port <= 0))
+void rcciServer::serveClient(int fd)
+{
+    auto it = mConnClients.begin();
+    for(; it != mConnClients.end(); ++it)
     {
-        strStream << "Drive service seems not to be running."
-                  << " Not starting new thread." << std::endl;
-        getLogger().error(strStream.str());
-        return -1;
+        if(it->fd == fd)
+            break;
     }
-
-    mDriveReadThread = new std::thread(&rcciServer::driveReadThread, this);
-    if(!mDriveReadThread)
+    if(it == mConnClients.end())
     {
-        strStream << "Can not start drive reading thread" << std::endl;
-        getLogger().error(strStream.str());
-        return -1;
+        return;
     }
 
-    return 0;
-}
-
-int rcciServer::stopDriveThread(void)
-{
-// TODO: Re-enable the starting & stopping of drive thread from service registering!
+    rcci_client_info_t &cInfo = *it;
+    bool eof = false;
+    int retVal;
 
-    mThreadMutex.lock();
-    mDriveReadThreadRunning = false;
-    mThreadMutex.unlock();
+    // edge triggered - read until the socket is drained, every complete
+    // message is processed (also those received together with end-of-file)
+    do {
+        retVal = readClient(cInfo, eof);
+        if((retVal >= 0) && (parseMessages(cInfo) < 0))
+        {
+            retVal = -1;
+        }
+    } while(retVal > 0);
 
-    if(mDriveReadThread)
+    if(flushReplies(cInfo) < 0)
     {
-        mDriveReadThread->join();
-        delete mDriveReadThread;
-        mDriveReadThread = NULL;
+        retVal = -1;
     }
 
-    return 0;
+    if((retVal < 0) || eof)
+    {
+        removeClient(cInfo);
+    }
 }
 
-void rcciServer::driveReadThread(void)
+void rcciServer::driveThread(void)
 {
-    // TODO: Make it non-blocking with either select() - current implementation
-    // with DONTWAIT flag for recvfrom() or to send some bytes to the socket
-    // from stopDriveThread() function to unblock for this perticular situation
     std::ostringstream strStream;
-    fd_set readSet;
-    struct timeval selTimeout;
-
-    strStream.str(std::string());
-    strStream << "driveReadThread(): Listening for drive data" << std::endl;
-    getLogger().debug(strStream.str());
-    mThreadMutex.lock();
-    mDriveReadThreadRunning = true;
-    mThreadMutex.unlock();
-    while(true)
+    struct sched_param param;
+    struct pollfd pfd;
+    struct timespec lastWrite = { 0, 0 }, pendingRx = { 0, 0 };
+    rcci_msg_drv_ctrl_t pendingCmd;
+    bool pending = false;
+
+    param.sched_priority = cDriveThreadPrio;
+    if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
     {
-        // basically just listen and receive data and push it to callback
-        // function
-        mThreadMutex.lock();
-        if(mDriveReadThreadRunning == false)
-        {
-            mThreadMutex.unlock();
-            break;
-        }
-        mThreadMutex.unlock();
+        strStream << "Drive thread running without real-time priority"
+                  << std::endl;
+        getLogger().debug(strStream.str());
+    }
 
-        FD_ZERO(&readSet);
-        FD_SET(mServices[rcci_service_drive].fd, &readSet);
-        selTimeout.tv_sec = 0;
-        selTimeout.tv_usec = cSelTimeoutMs*1e3;
+    pfd.fd     = mServices[rcci_service_drive].fd;
+    pfd.events = POLLIN;
 
-        int retVal = select(mServices[rcci_service_drive].fd + 1,
-                            &readSet, NULL, NULL, &selTimeout);
-        if(retVal < 0)
-        {
-            strStream.str(std::string());
-            strStream << "driveReadThread() select() failed: " <<
-                strerror(errno) << std::endl;
-            continue;
-        }
-        if((retVal == 0) ||
-           !(FD_ISSET(mServices[rcci_service_drive].fd, &readSet)))
+    while(mDriveThreadRunning)
+    {
+        struct timespec now, timeout;
+        int64_t sinceWriteUs;
+
+        // sleep until data or until pending command may be written
+        timeout.tv_sec  = 0;
+        timeout.tv_nsec = (long)cDriveIdleTimeoutMs * 1000000;
+        if(pending)
         {
-            // timeout or false alarm
-            continue;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            sinceWriteUs = timespecDiffUs(now, lastWrite);
+            timeout.tv_nsec = (sinceWriteUs >= cDrivePeriodUs) ? 0 :
+                (cDrivePeriodUs - sinceWriteUs) * 1000;
         }
 
-        if(mServices[rcci_service_drive].fd <= 0)
+        pfd.revents = 0;
+        if((ppoll(&pfd, 1, &timeout, NULL) < 0) && (errno != EINTR))
         {
             strStream.str(std::string());
-            strStream << "Drive service fd not valid, "
-                      << "quitting driveReadThread()" << std::endl;
+            strStream << "Drive thread ppoll() failed: " << strerror(errno)
+                      << std::endl;
             getLogger().error(strStream.str());
-            mDriveReadThreadRunning = false;
             break;
         }
 
-        struct sockaddr_in sockAddr;
-        socklen_t   sockLen = sizeof(sockAddr);
-        rcci_msg_drv_ctrl_t drvData;
-
-        ssize_t bytes = recvfrom(mServices[rcci_service_drive].fd,
-                                 &drvData, sizeof(rcci_msg_drv_ctrl_t), 0,
-                                 (struct sockaddr *)&sockAddr, &sockLen);
-
-        if((bytes == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
-        {
-            // sleep for some time
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
-            continue;
-        }
-        if(mDriveCbFunc && (bytes == sizeof(rcci_msg_drv_ctrl_t)))
+        if(pfd.revents & POLLIN)
         {
-            // Check if data really commes from correct client
-            // (only first one is allowed)
-            if(memcmp(&sockAddr, &mServices[rcci_service_drive].clients[0],
-                      sizeof(struct sockaddr_in)) != 0)
+            rcci_msg_drv_ctrl_t newest;
+            struct timespec rxTime;
+            bool haveNew = false;
+
+            readDriveData(newest, haveNew, rxTime);
+            if(haveNew)
             {
-                strStream.str(std::string());
-                strStream << "Drive command comming from unknown source!"
-                          << " Ignored!" << std::endl;
-                getLogger().error(strStream.str());
-                continue;
+                if(pending)
+                {
+                    std::lock_guard<std::mutex> lock(mDriveStatsMutex);
+                    mDriveStats.coalesced++;
+                }
+                pendingCmd = newest;
+                pendingRx  = rxTime;
+                pending    = true;
             }
-            mDriveCbFunc(drvData);
         }
-        else
+
+        // extra writes within one PWM period have no effect on the output
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if(pending && (timespecDiffUs(now, lastWrite) >= cDrivePeriodUs))
         {
-            strStream.str(std::string());
-            strStream << "driveReadThread() wrong bytes read: " << bytes <<
-                      " != " << sizeof(rcci_msg_drv_ctrl_t);
-            getLogger().error(strStream.str());
+            applyDriveData(pendingCmd, pendingRx);
+            lastWrite = now;
+            pending   = false;
         }
     }
-
-    mThreadMutex.unlock();
-    return;
 }
 
-ssize_t rcciServer::processData(rcci_client_info_t &cInfo)
+// Drains the socket, returns newest valid command in 'newest'
+int rcciServer::readDriveData(rcci_msg_drv_ctrl_t &newest, bool &haveNew,
+                              struct timespec &rxTime)
 {
-    rcci_msg_header_t header;
-    ssize_t bytes;
-
     std::ostringstream strStream;
-
-    bytes = read(cInfo.fd, &header, sizeof(rcci_msg_header_t));
-    if(bytes < 0)
+    rcci_msg_drv_ctrl_t drvData[cDriveBatch];
+    struct sockaddr_in  sockAddr[cDriveBatch];
+    struct iovec        iov[cDriveBatch];
+    struct mmsghdr      msgs[cDriveBatch];
+    char                ctrl[cDriveBatch][CMSG_SPACE(sizeof(struct timespec))];
+    uint64_t received = 0, stale = 0, invalid = 0, coalesced = 0;
+    int total = 0;
+
+    if(mDriveSeqReset.exchange(false))
     {
-        strStream << "read() failed: " << strerror(errno) << std::endl;
-        getLogger().error(strStream.str());
-        return bytes;
+        mDriveSeqValid = false;
+        mDriveStaleRun = 0;
     }
-    else if(bytes == 0)
+
+    while(true)
     {
-        /* end-of-file connection closed */
-        removeClient(cInfo);
-        return 0;
+        struct sockaddr_in client;
+        bool haveClient;
+
+        for(int i = 0; i < cDriveBatch; i++)
+        {
+            iov[i].iov_base = &drvData[i];
+            iov[i].iov_len  = sizeof(rcci_msg_drv_ctrl_t);
+            memset(&msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+            msgs[i].msg_hdr.msg_name       = &sockAddr[i];
+            msgs[i].msg_hdr.msg_namelen    = sizeof(struct sockaddr_in);
+            msgs[i].msg_hdr.msg_iov        = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen     = 1;
+            msgs[i].msg_hdr.msg_control    = ctrl[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+        }
+
+        int num = recvmmsg(mServices[rcci_service_drive].fd, msgs, cDriveBatch,
+                           MSG_DONTWAIT, NULL);
+        if(num < 0)
+        {
+            if((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+            {
+                strStream.str(std::string());
+                strStream << "readDriveData() recvmmsg() failed: " <<
+                    strerror(errno) << std::endl;
+                getLogger().error(strStream.str());
+            }
+            break;
+        }
+
+        // Check if data really commes from correct client
+        // (only first one is allowed)
+        {
+            std::lock_guard<std::mutex> lock(mServicesMutex);
+            haveClient = !mServices[rcci_service_drive].clients.empty();
+            if(haveClient)
+            {
+                client = mServices[rcci_service_drive].clients[0];
+            }
+        }
+
+        for(int i = 0; i < num; i++)
+        {
+            if((msgs[i].msg_len != sizeof(rcci_msg_drv_ctrl_t)) ||
+               !rcciDrvCheckCrc(drvData[i]) || !haveClient ||
+               (memcmp(&sockAddr[i], &client, sizeof(struct sockaddr_in)) != 0))
+            {
+                invalid++;
+                continue;
+            }
+            received++;
+
+            // newest by 8-bit incremental count, resync if client restarted
+            int8_t diff = (int8_t)(drvData[i].count - mDriveLastSeq);
+            if(mDriveSeqValid && (diff <= 0) &&
+               (++mDriveStaleRun < cDriveSeqResync))
+            {
+                stale++;
+                continue;
+            }
+            mDriveSeqValid = true;
+            mDriveLastSeq  = drvData[i].count;
+            mDriveStaleRun = 0;
+
+            if(haveNew)
+            {
+                coalesced++;
+            }
+            newest  = drvData[i];
+            haveNew = true;
+
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+            rxTime.tv_sec = 0;
+            for(; cmsg != NULL; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg))
+            {
+                if((cmsg->cmsg_level == SOL_SOCKET) &&
+                   (cmsg->cmsg_type == SCM_TIMESTAMPNS))
+                {
+                    memcpy(&rxTime, CMSG_DATA(cmsg), sizeof(rxTime));
+                }
+            }
+            if(rxTime.tv_sec == 0)
+            {
+                clock_gettime(CLOCK_REALTIME, &rxTime);
+            }
+        }
+        total += num;
+
+        if(num < cDriveBatch)
+        {
+            break;
+        }
     }
 
-    if(bytes != sizeof(rcci_msg_header_t))
     {
-        // TODO: write back NACK message?
+        std::lock_guard<std::mutex> lock(mDriveStatsMutex);
+        mDriveStats.received  += received;
+        mDriveStats.stale     += stale;
+        mDriveStats.invalid   += invalid;
+        mDriveStats.coalesced += coalesced;
+    }
+
+    if(invalid > 0)
+    {
         strStream.str(std::string());
-        strStream << "Init header size wrong: " << bytes << " != " <<
-            sizeof(rcci_msg_header_t) << std::endl;
+        strStream << "Drive command comming from unknown source or with wrong"
+                  << " size/CRC! Ignored " << invalid << " command(s)!"
+                  << std::endl;
+        getLogger().error(strStream.str());
+    }
+
+    return total;
+}
+
+void rcciServer::applyDriveData(rcci_msg_drv_ctrl_t &cmd,
+                                struct timespec &rxTime)
+{
+    struct timespec done;
+    int64_t latUs;
+    int bucket = 0;
+
+    if(!mDriveCbFunc)
+    {
+        return;
+    }
+
+    mDriveCbFunc(cmd);
+
+    // kernel timestamp is CLOCK_REALTIME
+    clock_gettime(CLOCK_REALTIME, &done);
+    latUs = timespecDiffUs(done, rxTime);
+    if(latUs < 0)
+    {
+        latUs = 0;
+    }
+    while((bucket < (cDriveLatBuckets - 1)) &&
+          (latUs >= ((int64_t)cDriveLatBucketUs << bucket)))
+    {
+        bucket++;
+    }
+
+    std::lock_guard<std::mutex> lock(mDriveStatsMutex);
+    mDriveStats.applied++;
+    mDriveStats.latHist[bucket]++;
+    if(latUs > mDriveStats.latMaxUs)
+    {
+        mDriveStats.latMaxUs = latUs;
+    }
+}
+
+void rcciServer::drainServiceSocket(int fd)
+{
+    uint8_t buf[64];
+
+    // nothing is expected on send-only services - just drop it
+    while(recv(fd, buf, sizeof(buf), 0) >= 0) { /* drain */ }
+}
+
+int rcciServer::readClient(rcci_client_info_t &cInfo, bool &eof)
+{
+    std::ostringstream strStream;
+
+    while(cInfo.rxLen < cInfo.rxBuf.size())
+    {
+        ssize_t bytes = recv(cInfo.fd, &cInfo.rxBuf[cInfo.rxLen],
+                             cInfo.rxBuf.size() - cInfo.rxLen, MSG_DONTWAIT);
+        if(bytes > 0)
+        {
+            cInfo.rxLen += bytes;
+            continue;
+        }
+        else if(bytes == 0)
+        {
+            /* end-of-file connection closed */
+            eof = true;
+            return 0;
+        }
+
+        if(errno == EINTR)
+        {
+            continue;
+        }
+        if((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        {
+            /* socket drained - wait for next edge */
+            return 0;
+        }
+        strStream << "recv() failed: " << strerror(errno) << std::endl;
+        getLogger().error(strStream.str());
+        return -1;
+    }
+
+    // buffer full - parse and read again
+    return 1;
+}
+
+int rcciServer::parseMessages(rcci_client_info_t &cInfo)
+{
+    rcci_msg_header_t header;
+    size_t pos = 0;
+    int retVal = 0;
+
+    std::ostringstream strStream;
+
+    while((cInfo.rxLen - pos) >= sizeof(rcci_msg_header_t))
+    {
+        memcpy(&header, &cInfo.rxBuf[pos], sizeof(header));
+
+        if((header.size < sizeof(rcci_msg_header_t)) ||
+           (header.size > cMaxMsgSize))
+        {
+            // stream can not be re-synchronized
+            strStream << "Invalid message size " << header.size << " from: "
+                      << cInfo.fd << std::endl;
+            getLogger().error(strStream.str());
+            retVal = -1;
+            break;
+        }
+        if((cInfo.rxLen - pos) < header.size)
+        {
+            /* partial message - rest comes with next recv() */
+            break;
+        }
+
+        if(processMessage(cInfo, &cInfo.rxBuf[pos], header.size) < 0)
+        {
+            retVal = -1;
+            break;
+        }
+        pos += header.size;
+    }
+
+    if(pos > 0)
+    {
+        memmove(&cInfo.rxBuf[0], &cInfo.rxBuf[pos], cInfo.rxLen - pos);
+        cInfo.rxLen -= pos;
+    }
+
+    return retVal;
+}
+
+int rcciServer::processMessage(rcci_client_info_t &cInfo, const uint8_t *data,
+                               size_t len)
+{
+    const rcci_msg_header_t *header = (const rcci_msg_header_t *)data;
+
+    std::ostringstream strStream;
+
+    if(!rcciMsgCheckCrc(data, len))
+    {
+        strStream << "Message CRC mismatch (type: " << header->type <<
+            ") from: " << cInfo.fd << std::endl;
         getLogger().error(strStream.str());
         return -1;
     }
@@ -604,89 +1125,186 @@ ssize_t rcciServer::processData(rcci_client_info_t &cInfo)
     {
         // if init flag is not there only valid action is to initialize
         // the connection
-        return processMsgInit(cInfo, header);
+        return processMsgInit(cInfo, data, len);
     }
 
     /* else parse the messages */
-    switch(header.type)
+    switch(header->type)
     {
     case rcci_msg_init:
-        return processMsgInit(cInfo, header);
-        break;
+        return processMsgInit(cInfo, data, len);
     case rcci_msg_reg_service:
-        return processMsgRegService(cInfo, header);
+        return processMsgRegService(cInfo, data, len);
     case rcci_msg_unreg_service:
-        return processMsgUnregService(cInfo, header);
+        return processMsgUnregService(cInfo, data, len);
+    case rcci_msg_time_sync:
+        return processMsgTimeSync(cInfo, data, len);
+    case rcci_msg_log_read:
+        return processMsgLogRead(cInfo, data, len);
     default:
-        strStream.str(std::string());
-        strStream << "Unsupported header type: " << header.type << std::endl;
+        // framing is still valid - skip it
+        strStream << "Unsupported header type: " << header->type << std::endl;
+        getLogger().error(strStream.str());
+        return 0;
+    }
+
+    return 0;
+}
+
+void rcciServer::queueReply(rcci_client_info_t &cInfo, const void *data,
+                            size_t len)
+{
+    cInfo.txQueue.push_back(std::string((const char *)data, len));
+}
+
+// All replies of one wakeup go out with one sendmsg() (scatter-gather like
+// writev(), but with MSG_NOSIGNAL so a closed client does not raise SIGPIPE).
+// What the non-blocking socket does not take stays queued with EPOLLOUT
+// armed, the next wakeup continues from there.
+int rcciServer::flushReplies(rcci_client_info_t &cInfo)
+{
+    std::vector<std::string> &queue = cInfo.txQueue;
+    size_t idx = 0, off = cInfo.txOff, queued = 0;
+
+    std::ostringstream strStream;
+
+    while(idx < queue.size())
+    {
+        struct iovec iov[cMaxReplyIov];
+        struct msghdr msg;
+        int numIov = 0;
+
+        for(size_t i = idx; (i < queue.size()) && (numIov < cMaxReplyIov);
+            i++, numIov++)
+        {
+            size_t skip = (i == idx) ? off : 0;
+            iov[numIov].iov_base = (void *)(queue[i].data() + skip);
+            iov[numIov].iov_len  = queue[i].size() - skip;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = iov;
+        msg.msg_iovlen = numIov;
+
+        ssize_t bytes = sendmsg(cInfo.fd, &msg, MSG_NOSIGNAL);
+        if(bytes < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                break;
+            }
+            strStream << "Reply to " << cInfo.fd << " failed: "
+                      << strerror(errno) << std::endl;
+            getLogger().error(strStream.str());
+            queue.clear();
+            cInfo.txOff = 0;
+            return -1;
+        }
+
+        size_t sent = bytes;
+        while(sent > 0)
+        {
+            size_t rem = queue[idx].size() - off;
+            if(sent >= rem)
+            {
+                sent -= rem;
+                idx++;
+                off = 0;
+            }
+            else
+            {
+                off += sent;
+                sent = 0;
+            }
+        }
+    }
+
+    queue.erase(queue.begin(), queue.begin() + idx);
+    cInfo.txOff = off;
+
+    for(auto it = queue.begin(); it != queue.end(); ++it)
+    {
+        queued += it->size();
+    }
+    // one long reply (log history) may wait, more requests on top of it
+    // mean the client does not read
+    if((queued > cMaxTxQueueSize) && (queue.size() > 1))
+    {
+        strStream << "Client " << cInfo.fd << " does not read replies ("
+                  << queued << " B queued)" << std::endl;
+        getLogger().error(strStream.str());
         return -1;
     }
-    /* Otherwise finally call correct handler based on msg type */
+
+    // EPOLLOUT only while something is waiting, otherwise every ACK of
+    // the client would wake up the reactor
+    bool arm = !queue.empty();
+    if(arm != cInfo.txArmed)
+    {
+        if(epollMod(cInfo.fd, arm ? (cClientEvents | EPOLLOUT) :
+                    cClientEvents) < 0)
+        {
+            return -1;
+        }
+        cInfo.txArmed = arm;
+    }
 
     return 0;
 }
 
-int rcciServer::processMsgInit(rcci_client_info_t &cInfo,
-                               rcci_msg_header_t &header)
+int rcciServer::processMsgInit(rcci_client_info_t &cInfo, const uint8_t *data,
+                               size_t len)
 {
     rcci_msg_init_t init_msg;
-
-    ssize_t bytes;
-    ssize_t remBytes = sizeof(rcci_msg_init_t)-sizeof(rcci_msg_header_t);
+    size_t replyLen;
 
     std::ostringstream strStream;
 
-    if((header.type  != rcci_msg_init)       ||
-       (header.magic != rcci_msg_init_magic) ||
-       (header.ver   != rcci_msg_init_ver)   ||
-       (remBytes < 0))
+    memcpy(&init_msg.header, data, sizeof(rcci_msg_header_t));
+    if((init_msg.header.type  != rcci_msg_init)       ||
+       (init_msg.header.magic != rcci_msg_init_magic) ||
+       (init_msg.header.ver   != rcci_msg_init_ver))
     {
         // TODO: Send NACK message
         strStream << "processMsgInit() wrong message received, type: " <<
-            header.type << " expected: " << rcci_msg_init <<
+            init_msg.header.type << " expected: " << rcci_msg_init <<
             " from: " << cInfo.fd << std::endl;
         getLogger().error(strStream.str());
         return -1;
     }
 
-    /* Correct message - read other parts of the message */
-    bytes = read(cInfo.fd,
-                 ((uint8_t *)&init_msg + sizeof(rcci_msg_header_t)),
-                 remBytes);
-
-    if(bytes != remBytes)
+    if(len < rcci_msg_init_size_v1)
     {
         strStream << "processMsgInit() received size incorrect: " <<
-            bytes << " != " << remBytes << " from: " << cInfo.fd << std::endl;
+            len << " < " << rcci_msg_init_size_v1 << " from: " <<
+            cInfo.fd << std::endl;
         getLogger().error(strStream.str());
         // TODO: Send NACK message
         return -1;
     }
+    // clients without video service send and expect the shorter message
+    replyLen = (len < sizeof(rcci_msg_init_t)) ?
+        rcci_msg_init_size_v1 : sizeof(rcci_msg_init_t);
+    memset(&init_msg, 0, sizeof(init_msg));
+    memcpy(&init_msg, data, replyLen);
 
     // else parse the message and reply
     init_msg.header.magic = cServMagic;
     init_msg.header.ver   = cServVer;
     init_msg.header.type  = rcci_msg_init;
-    init_msg.header.size  = sizeof(rcci_msg_init_t);
-    init_msg.header.crc   = 0; // TODO: Ignored for now
+    init_msg.header.size  = replyLen;
     init_msg.status       = rcci_status_ack;
     init_msg.log_port     = mServices[rcci_service_logging].port;
     init_msg.drv_port     = mServices[rcci_service_drive].port;
+    init_msg.video_port   = mServices[rcci_service_video].port;
     // other fields remains the same
+    rcciMsgSetCrc(&init_msg, replyLen);
 
-    std::string serverLog;
-    getLogger().getLog(serverLog);
-
-    bytes = write(cInfo.fd, &init_msg, sizeof(rcci_msg_init_t));
-    if(bytes != sizeof(rcci_msg_init_t))
-    {
-        strStream << "processMsgInit() write 1 size incorrect: " <<
-            bytes << " != " << sizeof(rcci_msg_init_t) << " to: " <<
-            cInfo.fd << std::endl;
-        getLogger().error(strStream.str());
-        return -1;
-    }
+    queueReply(cInfo, &init_msg, replyLen);
 
     cInfo.flags |= rcci_client_flag_init;
 
@@ -694,40 +1312,34 @@ int rcciServer::processMsgInit(rcci_client_info_t &cInfo,
 }
 
 int rcciServer::processMsgRegService(rcci_client_info_t &cInfo,
-                                     rcci_msg_header_t &header)
+                                     const uint8_t *data, size_t len)
 {
     rcci_msg_reg_service_t msg;
 
-    ssize_t bytes;
-    ssize_t remBytes = sizeof(msg)-sizeof(rcci_msg_header_t);
-
     std::ostringstream strStream;
 
-    if((header.type  != rcci_msg_reg_service) ||
-       (header.magic != cServMagic)           ||
-       (header.ver   != cServVer)             ||
-       (remBytes < 0))
+    memcpy(&msg.header, data, sizeof(rcci_msg_header_t));
+    if((msg.header.type  != rcci_msg_reg_service) ||
+       (msg.header.magic != cServMagic)           ||
+       (msg.header.ver   != cServVer))
     {
         // TODO: Send NACK message
         strStream << "processMsgRegService() wrong message received, type: " <<
-            header.type << " expected: " << rcci_msg_reg_service <<
+            msg.header.type << " expected: " << rcci_msg_reg_service <<
             " from: " << cInfo.fd << std::endl;
         getLogger().error(strStream.str());
         return -1;
     }
 
-    /* Correct message - read other parts of the message */
-    bytes = read(cInfo.fd, ((uint8_t *)&msg + sizeof(rcci_msg_header_t)),
-                 remBytes);
-
-    if(bytes != remBytes)
+    if(len < sizeof(msg))
     {
         strStream << "processMsgRegClient() received size incorrect: " <<
-            bytes << " != " << remBytes << " from: " << cInfo.fd << std::endl;
+            len << " < " << sizeof(msg) << " from: " << cInfo.fd << std::endl;
         getLogger().error(strStream.str());
         // TODO: Send NACK message
         return -1;
     }
+    memcpy(&msg, data, sizeof(msg));
 
     // else parse the message and reply
     msg.header.magic = cServMagic;
@@ -738,47 +1350,39 @@ int rcciServer::processMsgRegService(rcci_client_info_t &cInfo,
     // other fields remains the same
 
     // now parse possible services - put it to separate methods, this is just ugly!
-    std::string serverLog;
-    getLogger().getLog(serverLog);
-
-    std::cerr << "Registering service added:" << msg.service << std::endl;
-    std::cerr << "DRV port:" << mServices[rcci_service_drive].port
-              << " fd: " << mServices[rcci_service_drive].fd << std::endl;
     // Logging service
     if((msg.service == rcci_client_flag_log) &&
        (mServices[rcci_service_logging].port > 0) &&
        (mServices[rcci_service_logging].fd > 0))
     {
-        // protect by mutex
+        std::lock_guard<std::mutex> lock(mServicesMutex);
         if(mServices[rcci_service_logging].canAddClient())
         {
             mServices[rcci_service_logging].clients.push_back(msg.sockaddr);
             cInfo.flags |= rcci_client_flag_log;
+            cInfo.regServices.push_back(std::make_pair(msg.service,
+                                                       msg.sockaddr));
         }
         else
         {
             msg.status = rcci_status_nack;
         }
-
-        if(msg.params != 0)
-        {
-            /* Full log is requested */
-            msg.header.size += serverLog.length();
-        }
+        // log history is read in chunks with rcci_msg_log_read
     }
     // Driving service
     else if((msg.service == rcci_client_flag_drive) &&
             (mServices[rcci_service_drive].port > 0) &&
             (mServices[rcci_service_drive].fd > 0))
     {
-        std::cerr << "DRV service added" << std::endl;
+        std::lock_guard<std::mutex> lock(mServicesMutex);
         if(mServices[rcci_service_drive].canAddClient())
         {
+            // drive socket is already served by the drive thread
             mServices[rcci_service_drive].clients.push_back(msg.sockaddr);
             cInfo.flags |= rcci_client_flag_drive;
-
-            // start the reading thread
-            // TODO: startDriveThread(); // start listening for DRV service
+            cInfo.regServices.push_back(std::make_pair(msg.service,
+                                                       msg.sockaddr));
+            mDriveSeqReset = true;
         }
         else
         {
@@ -786,77 +1390,62 @@ int rcciServer::processMsgRegService(rcci_client_info_t &cInfo,
             msg.status = rcci_status_nack;
         }
     }
-
-    // send reply
-    bytes = write(cInfo.fd, &msg, sizeof(rcci_msg_reg_service_t));
-    if(bytes != sizeof(rcci_msg_reg_service_t))
+    // Video service (unicast)
+    else if((msg.service == rcci_client_flag_video) &&
+            (mServices[rcci_service_video].port > 0) &&
+            (mServices[rcci_service_video].fd > 0))
     {
-        strStream << "processMsgRegClient() write 1 size incorrect: " <<
-            bytes << " != " << sizeof(rcci_msg_reg_service_t) << " to: " <<
-            cInfo.fd << std::endl;
-        getLogger().error(strStream.str());
-        return -1;
-    }
-
-    /* Exception if full log was requested, send also that one */
-    if((msg.service == rcci_client_flag_log) &&
-       (mServices[rcci_service_logging].port > 0) &&
-       (mServices[rcci_service_logging].fd > 0) &&
-       (msg.params != 0) && (serverLog.length() > 0) &&
-       (msg.status == rcci_status_ack))
-    {
-        // TODO: This is actually limited in size, should we make it better
-        // (it is for sure not critical)
-        bytes = write(cInfo.fd, serverLog.c_str(), serverLog.length());
-        if(bytes != (ssize_t)serverLog.length())
-        {
-            strStream << "processMsgRegClient() log write incorrect: " <<
-                bytes << " != " << serverLog.length() << " to: " <<
-                cInfo.fd << std::endl;
-            getLogger().error(strStream.str());
-            return -1;
+        std::lock_guard<std::mutex> lock(mServicesMutex);
+        if(mServices[rcci_service_video].canAddClient())
+        {
+            mServices[rcci_service_video].clients.push_back(msg.sockaddr);
+            cInfo.flags |= rcci_client_flag_video;
+            // params - highest fragment header version the client knows
+            addVideoClient(msg.sockaddr, cInfo.fd,
+                           (msg.params >= rcci_msg_video_v2) ?
+                           rcci_msg_video_v2 : rcci_msg_video_v1);
+        }
+        else
+        {
+            msg.status = rcci_status_nack;
         }
     }
 
+    rcciMsgSetCrc(&msg, sizeof(rcci_msg_reg_service_t));
+    queueReply(cInfo, &msg, sizeof(rcci_msg_reg_service_t));
+
     return 0;
 }
 
 int rcciServer::processMsgUnregService(rcci_client_info_t &cInfo,
-                                       rcci_msg_header_t &header)
+                                       const uint8_t *data, size_t len)
 {
     rcci_msg_reg_service_t msg;
 
-    ssize_t bytes;
-    ssize_t remBytes = sizeof(msg)-sizeof(rcci_msg_header_t);
-
     std::ostringstream strStream;
 
-    if((header.type  != rcci_msg_unreg_service) ||
-       (header.magic != cServMagic)             ||
-       (header.ver   != cServVer)               ||
-       (remBytes < 0))
+    memcpy(&msg.header, data, sizeof(rcci_msg_header_t));
+    if((msg.header.type  != rcci_msg_unreg_service) ||
+       (msg.header.magic != cServMagic)             ||
+       (msg.header.ver   != cServVer))
     {
         // TODO: Send NACK message
         strStream << "processMsgUnregService() wrong message received, type: " <<
-            header.type << " expected: " << rcci_msg_reg_service <<
+            msg.header.type << " expected: " << rcci_msg_reg_service <<
             " from: " << cInfo.fd << std::endl;
         getLogger().error(strStream.str());
         return -1;
     }
 
-    /* Correct message - read other parts of the message */
-    bytes = read(cInfo.fd, ((uint8_t *)&msg + sizeof(rcci_msg_header_t)),
-                 remBytes);
-
-    if(bytes != remBytes)
+    if(len < sizeof(msg))
     {
         strStream << "processMsgUnregClient() received size incorrect: " <<
-            bytes << " != " << remBytes << " from: " << cInfo.fd << std::endl;
+            len << " < " << sizeof(msg) << " from: " << cInfo.fd << std::endl;
         getLogger().error(strStream.str());
         // TODO: Send NACK message
         return -1;
     }
-
+    memcpy(&msg, data, sizeof(msg));
     // parse the message and reply
     msg.header.magic = cServMagic;
     msg.header.ver   = cServVer;
@@ -871,9 +1460,11 @@ int rcciServer::processMsgUnregService(rcci_client_info_t &cInfo,
         id = rcci_service_logging;
         break;
     case rcci_client_flag_drive:
-        // TODFO: stopDriveThread();
         id = rcci_service_drive;
         break;
+    case rcci_client_flag_video:
+        id = rcci_service_video;
+        break;
     default:
         id = rcci_service_nonexisting;
         break;
@@ -881,14 +1472,28 @@ int rcciServer::processMsgUnregService(rcci_client_info_t &cInfo,
 
     if(id < rcci_service_nonexisting)
     {
-        // protect by mutex
+        std::unique_lock<std::mutex> lock(mServicesMutex);
         for(auto it = mServices[id].clients.begin();
             it != mServices[id].clients.end(); ++it)
         {
             if(memcmp(&(*it), &msg.sockaddr, sizeof(msg.sockaddr)) == 0)
             {
                 /* Find a match - remove it */
+                if(id == rcci_service_video)
+                {
+                    removeVideoClient(msg.sockaddr);
+                }
                 mServices[id].clients.erase(it);
+                lock.unlock();
+                for(auto rIt = cInfo.regServices.begin();
+                    rIt != cInfo.regServices.end(); ++rIt)
+                {
+                    if(sameAddr(rIt->second, msg.sockaddr))
+                    {
+                        cInfo.regServices.erase(rIt);
+                        break;
+                    }
+                }
                 strStream << "Removing client for service " <<
                     mServices[id].name << std::endl;
                 getLogger().debug(strStream.str());
@@ -904,18 +1509,547 @@ int rcciServer::processMsgUnregService(rcci_client_info_t &cInfo,
         msg.status = rcci_status_nack;
     }
 
-    // send reply
-    bytes = write(cInfo.fd, &msg, sizeof(rcci_msg_reg_service_t));
-    if(bytes != sizeof(rcci_msg_reg_service_t))
+    rcciMsgSetCrc(&msg, sizeof(rcci_msg_reg_service_t));
+    queueReply(cInfo, &msg, sizeof(rcci_msg_reg_service_t));
+
+    return 0;
+}
+
+// Reply is queued right away - it goes out at the end of this wakeup, so
+// client sees the processing delay as part of the RTT only
+int rcciServer::processMsgTimeSync(rcci_client_info_t &cInfo,
+                                   const uint8_t *data, size_t len)
+{
+    rcci_msg_time_sync_t msg;
+    struct timespec ts;
+
+    std::ostringstream strStream;
+
+    if(len < sizeof(msg))
     {
-        strStream.str(std::string());
-        strStream << "processMsgRegClient() write 1 size incorrect: " <<
-            bytes << " != " << sizeof(rcci_msg_reg_service_t) << " to: " <<
-            cInfo.fd << std::endl;
+        strStream << "processMsgTimeSync() received size incorrect: " <<
+            len << " < " << sizeof(msg) << " from: " << cInfo.fd << std::endl;
         getLogger().error(strStream.str());
-        return -1;
+        return 0;
+    }
+    memcpy(&msg, data, sizeof(msg));
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    msg.header.magic = cServMagic;
+    msg.header.ver   = cServVer;
+    msg.header.size  = sizeof(rcci_msg_time_sync_t);
+    msg.server_us    = (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    rcciMsgSetCrc(&msg, sizeof(msg));
+
+    queueReply(cInfo, &msg, sizeof(msg));
+
+    return 0;
+}
+
+// Log text is copied from the logger straight to the reply buffer, one
+// bounded chunk per request - client asks for the next one
+int rcciServer::processMsgLogRead(rcci_client_info_t &cInfo,
+                                  const uint8_t *data, size_t len)
+{
+    rcci_msg_log_read_t msg;
+    std::string reply;
+    size_t textLen;
+
+    std::ostringstream strStream;
+
+    if(len < sizeof(msg))
+    {
+        strStream << "processMsgLogRead() received size incorrect: " <<
+            len << " < " << sizeof(msg) << " from: " << cInfo.fd << std::endl;
+        getLogger().error(strStream.str());
+        return 0;
     }
+    memcpy(&msg, data, sizeof(msg));
+
+    size_t maxSize = std::min(msg.max_size, rcci_msg_log_read_max);
+    reply.resize(sizeof(msg) + maxSize);
+    msg.offset = getLogger().readLog(msg.offset, &reply[sizeof(msg)], maxSize,
+                                     textLen, msg.end);
+    reply.resize(sizeof(msg) + textLen);
+
+    msg.header.magic = cServMagic;
+    msg.header.ver   = cServVer;
+    msg.header.size  = reply.length();
+    msg.size         = textLen;
+    msg.max_size     = maxSize;
+    rcciMsgSetCrc(&msg, sizeof(msg), &reply[sizeof(msg)], textLen);
+    memcpy(&reply[0], &msg, sizeof(msg));
+
+    cInfo.txQueue.push_back(std::move(reply));
 
     return 0;
 }
 
+void rcciServer::addVideoClient(const struct sockaddr_in &addr, int connFd,
+                                uint16_t version)
+{
+    rcci_video_client_t client;
+
+    client.addr     = addr;
+    client.connFd   = connFd;
+    client.version  = version;
+    client.fragSize = cVideoFragSize;
+    client.numFrags = 0;
+    client.nextFrag = 0;
+    client.rate     = cVideoRateStart;
+    client.tokens   = cVideoBurst;
+    client.refill   = rcciClock::now();
+
+    std::lock_guard<std::mutex> lock(mVideoMutex);
+    mVideoClients.push_back(client);
+}
+
+// called with mServicesMutex held
+void rcciServer::removeVideoClient(const struct sockaddr_in &addr)
+{
+    std::lock_guard<std::mutex> lock(mVideoMutex);
+
+    for(auto it = mVideoClients.begin(); it != mVideoClients.end(); ++it)
+    {
+        if(sameAddr(it->addr, addr))
+        {
+            mVideoClients.erase(it);
+            return;
+        }
+    }
+}
+
+// Log & drive destinations registered over the closed control connection
+void rcciServer::removeServiceClients(rcci_client_info_t &cInfo)
+{
+    std::lock_guard<std::mutex> lock(mServicesMutex);
+
+    for(auto rIt = cInfo.regServices.begin(); rIt != cInfo.regServices.end();
+        ++rIt)
+    {
+        rcci_service_id_t id = (rIt->first == rcci_client_flag_log) ?
+            rcci_service_logging : rcci_service_drive;
+        rcci_client_vect_t &clients = mServices[id].clients;
+
+        for(auto cIt = clients.begin(); cIt != clients.end(); ++cIt)
+        {
+            if(sameAddr(*cIt, rIt->second))
+            {
+                clients.erase(cIt);
+                break;
+            }
+        }
+    }
+    cInfo.regServices.clear();
+}
+
+void rcciServer::removeVideoClients(int connFd)
+{
+    std::lock_guard<std::mutex> lock(mServicesMutex);
+    std::lock_guard<std::mutex> videoLock(mVideoMutex);
+    rcci_client_vect_t &clients = mServices[rcci_service_video].clients;
+
+    for(auto it = mVideoClients.begin(); it != mVideoClients.end(); )
+    {
+        if(it->connFd != connFd)
+        {
+            ++it;
+            continue;
+        }
+
+        for(auto cIt = clients.begin(); cIt != clients.end(); ++cIt)
+        {
+            if(sameAddr(*cIt, it->addr))
+            {
+                clients.erase(cIt);
+                break;
+            }
+        }
+        it = mVideoClients.erase(it);
+    }
+}
+
+void rcciServer::videoThread(void)
+{
+    std::unique_lock<std::mutex> lock(mVideoMutex);
+
+    while(mVideoThreadRunning)
+    {
+        rcciClock::time_point now = rcciClock::now();
+        rcciClock::time_point wake = now + std::chrono::milliseconds(cVideoIdleMs);
+
+        // socket is non-blocking and token bucket limits one pass to a few
+        // fragments per client, so writeServiceVideo() never waits long
+        for(auto it = mVideoClients.begin(); it != mVideoClients.end(); ++it)
+        {
+            sendVideoFragments(*it, now);
+
+            if(it->cur || !it->queue.empty())
+            {
+                // wake up when there are tokens for the next fragment
+                double need = std::min(cVideoBurst, (double)(it->fragSize +
+                                       rcci_msg_vframe_payload_offset)) -
+                    it->tokens;
+                std::chrono::duration<double> wait(std::max(need, 0.0) / it->rate);
+                wake = std::min(wake, now +
+                    std::chrono::duration_cast<rcciClock::duration>(wait));
+            }
+        }
+
+        mVideoCond.wait_until(lock, wake);
+    }
+}
+
+// Called with mVideoMutex held, returns number of fragments sent
+int rcciServer::sendVideoFragments(rcci_video_client_t &client,
+                                   rcciClock::time_point now)
+{
+    rcci_msg_vframe_hdr_t hdrs[cVideoBatch];
+    rcci_msg_vframe2_hdr_t hdrs2[cVideoBatch];
+    struct iovec iov[2 * cVideoBatch];
+    struct mmsghdr msgs[cVideoBatch];
+    int sent = 0;
+
+    double dt = std::chrono::duration<double>(now - client.refill).count();
+    client.refill = now;
+    client.tokens = std::min(cVideoBurst, client.tokens + dt * client.rate);
+
+    while(client.tokens > 0)
+    {
+        if(!client.cur)
+        {
+            if(client.queue.empty())
+            {
+                break;
+            }
+            client.cur = client.queue.front();
+            client.queue.pop_front();
+
+            // v1 - max 255 fragments, bigger frames get bigger fragments
+            size_t size = client.cur->data.size();
+            client.fragSize = cVideoFragSize;
+            if(client.version < rcci_msg_video_v2)
+            {
+                client.fragSize = std::max(cVideoFragSize,
+                                           (size + rcci_msg_vframe_max_msgs - 1) /
+                                           rcci_msg_vframe_max_msgs);
+            }
+            client.numFrags = (size + client.fragSize - 1) / client.fragSize;
+            client.nextFrag = 0;
+        }
+
+        // batch never spans two frames - iovecs point into client.cur
+        const std::vector<uint8_t> &data = client.cur->data;
+        const bool v2 = (client.version >= rcci_msg_video_v2);
+        const size_t hdrSize = v2 ? rcci_msg_vframe2_payload_offset :
+            rcci_msg_vframe_payload_offset;
+        int num = 0;
+        while((num < cVideoBatch) && (client.nextFrag < client.numFrags))
+        {
+            size_t idx = client.nextFrag * client.fragSize;
+            size_t len = std::min(client.fragSize, data.size() - idx);
+            size_t bytes = hdrSize + len;
+
+            // fragment bigger than the bucket goes out when it is full
+            if(client.tokens < std::min((double)bytes, cVideoBurst))
+            {
+                break;
+            }
+            client.tokens -= bytes;
+
+            if(v2)
+            {
+                rcci_msg_vframe2_hdr_t &hdr = hdrs2[num];
+                memset(&hdr, 0, sizeof(hdr));
+                hdr.header.magic = rcci_msg_init_magic;
+                hdr.header.ver   = rcci_msg_video_v2;
+                hdr.header.type  = rcci_msg_video;
+                hdr.header.size  = bytes;
+                hdr.seq          = client.cur->seq;
+                hdr.frame_size   = data.size();
+                hdr.idx_frame    = idx;
+                hdr.all_msgs     = client.numFrags;
+                hdr.cur_msg      = client.nextFrag;
+                hdr.size_shard   = client.fragSize;
+                hdr.capture_us   = client.cur->captureUs;
+                hdr.flags        = client.cur->captureUs ?
+                    rcci_vframe_flag_capture : rcci_vframe_flag_none;
+                rcciMsgSetCrc(&hdr, hdrSize, &data[idx], len);
+                iov[2*num].iov_base = &hdr;
+            }
+            else
+            {
+                rcci_msg_vframe_hdr_t &hdr = hdrs[num];
+                memset(&hdr, 0, sizeof(hdr));
+                hdr.header.magic = rcci_msg_init_magic;
+                hdr.header.type  = rcci_msg_video;
+                hdr.header.size  = data.size();
+                hdr.size_frame   = len;
+                hdr.idx_frame    = idx;
+                hdr.cnt_frame    = client.cur->seq;
+                hdr.all_msgs     = client.numFrags;
+                hdr.cur_msg      = client.nextFrag;
+                rcciMsgSetCrc(&hdr, hdrSize, &data[idx], len);
+                iov[2*num].iov_base = &hdr;
+            }
+            iov[2*num].iov_len    = hdrSize;
+            iov[2*num+1].iov_base = (void *)&data[idx];
+            iov[2*num+1].iov_len  = len;
+
+            struct msghdr &msg = msgs[num].msg_hdr;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_name    = &client.addr;
+            msg.msg_namelen = sizeof(client.addr);
+            msg.msg_iov     = &iov[2*num];
+            msg.msg_iovlen  = 2;
+
+            num++;
+            client.nextFrag++;
+        }
+
+        // fragments which do not fit to socket buffer are lost, receiver
+        // drops the frame
+        int done = 0;
+        while(done < num)
+        {
+            int retVal = ::sendmmsg(mServices[rcci_service_video].fd,
+                                    &msgs[done], num - done, MSG_DONTWAIT);
+            if(retVal < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+            done += retVal;
+        }
+        sent += done;
+        mVideoStats.fragments += done;
+
+        if(client.nextFrag >= client.numFrags)
+        {
+            client.cur.reset();
+            mVideoStats.sent++;
+        }
+        else if(num < cVideoBatch)
+        {
+            break; // out of tokens
+        }
+    }
+
+    return sent;
+}
+
+// Receiver reports of video clients - per client AIMD of the pacing rate
+void rcciServer::readVideoReports(void)
+{
+    rcci_msg_vreport_t report;
+    struct sockaddr_in from;
+    socklen_t fromLen;
+    ssize_t len;
+
+    while(true)
+    {
+        fromLen = sizeof(from);
+        len = recvfrom(mServices[rcci_service_video].fd, &report,
+                       sizeof(report), MSG_DONTWAIT | MSG_TRUNC,
+                       (struct sockaddr *)&from, &fromLen);
+        if(len < 0)
+        {
+            break;
+        }
+        if((len != sizeof(report)) ||
+           (report.header.magic != rcci_msg_init_magic) ||
+           (report.header.type != rcci_msg_video_report) ||
+           !rcciMsgCheckCrc(&report, sizeof(report)))
+        {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mVideoMutex);
+        for(auto it = mVideoClients.begin(); it != mVideoClients.end(); ++it)
+        {
+            if(!sameAddr(it->addr, from))
+            {
+                continue;
+            }
+
+            mVideoStats.reports++;
+            if(report.loss_permille > cVideoLossHigh)
+            {
+                it->rate = std::max(cVideoRateMin, it->rate * 0.75);
+            }
+            else if(report.loss_permille <= cVideoLossLow)
+            {
+                it->rate = std::min(cVideoRateMax, it->rate + cVideoRateStep);
+            }
+            break;
+        }
+    }
+}
+
+void rcciServer::logThread(void)
+{
+    std::vector<rcci_log_client_t> clients;
+    std::string text;
+    uint64_t offset;
+    bool running = true;
+
+    while(running)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mLogMutex);
+            // first line starts the coalescing period, full datagram or
+            // closing down ends it early
+            mLogCond.wait(lock, [this]{ return !mLogPending.empty() ||
+                                        !mLogThreadRunning; });
+            mLogCond.wait_for(lock, std::chrono::milliseconds(cLogCoalesceMs),
+                              [this]{ return (mLogPending.length() >=
+                                              (size_t)rcci_msg_log_max_text) ||
+                                      !mLogThreadRunning; });
+
+            running = mLogThreadRunning;
+            text.swap(mLogPending);
+            mLogPending.clear();
+            offset = mLogOffset;
+            mLogOffset += text.length();
+        }
+
+        // own copy of the clients with their sequence numbers
+        {
+            std::lock_guard<std::mutex> lock(mServicesMutex);
+            const rcci_client_vect_t &reg = mServices[rcci_service_logging].clients;
+            std::vector<rcci_log_client_t> current;
+
+            for(auto it = reg.begin(); it != reg.end(); ++it)
+            {
+                rcci_log_client_t client = { *it, 0, false };
+                for(auto old = clients.begin(); old != clients.end(); ++old)
+                {
+                    if(sameAddr(old->addr, *it))
+                    {
+                        client = *old;
+                        break;
+                    }
+                }
+                current.push_back(client);
+            }
+            clients.swap(current);
+        }
+
+        if(!text.empty() && !clients.empty())
+        {
+            sendLogText(clients, text, offset);
+        }
+    }
+}
+
+// Text is cut to datagrams at line ends where possible, every datagram goes
+// to every client - one header per client & datagram, text is shared
+void rcciServer::sendLogText(std::vector<rcci_log_client_t> &clients,
+                             const std::string &text, uint64_t offset)
+{
+    std::vector<std::pair<size_t, size_t> > chunks; // text position, length
+    size_t pos = 0;
+
+    while(pos < text.length())
+    {
+        size_t len = std::min(text.length() - pos,
+                              (size_t)rcci_msg_log_max_text);
+        if((pos + len) < text.length())
+        {
+            size_t nl = text.rfind('\n', pos + len - 1);
+            if((nl != std::string::npos) && (nl >= pos))
+            {
+                len = nl - pos + 1;
+            }
+        }
+        chunks.push_back(std::make_pair(pos, len));
+        pos += len;
+    }
+
+    size_t total = chunks.size() * clients.size();
+    std::vector<rcci_msg_log_t> hdrs(total);
+    std::vector<struct iovec> iov(2 * total);
+    std::vector<struct mmsghdr> msgs(total);
+    std::vector<size_t> owner(total); // client index of the datagram
+
+    size_t n = 0;
+    for(size_t c = 0; c < clients.size(); c++)
+    {
+        for(size_t k = 0; k < chunks.size(); k++, n++)
+        {
+            const char *data = text.data() + chunks[k].first;
+            size_t len = chunks[k].second;
+            rcci_msg_log_t &hdr = hdrs[n];
+
+            hdr.header.magic = cServMagic;
+            hdr.header.ver   = cServVer;
+            hdr.header.type  = rcci_msg_log;
+            hdr.header.size  = sizeof(rcci_msg_log_t) + len;
+            hdr.seq          = clients[c].seq++;
+            hdr.reserved     = 0;
+            hdr.offset       = offset + chunks[k].first;
+            rcciMsgSetCrc(&hdr, sizeof(hdr), data, len);
+
+            iov[2 * n].iov_base     = &hdr;
+            iov[2 * n].iov_len      = sizeof(hdr);
+            iov[2 * n + 1].iov_base = (void *)data;
+            iov[2 * n + 1].iov_len  = len;
+
+            memset(&msgs[n], 0, sizeof(msgs[n]));
+            msgs[n].msg_hdr.msg_name    = &clients[c].addr;
+            msgs[n].msg_hdr.msg_namelen = sizeof(clients[c].addr);
+            msgs[n].msg_hdr.msg_iov     = &iov[2 * n];
+            msgs[n].msg_hdr.msg_iovlen  = 2;
+            owner[n] = c;
+        }
+    }
+
+    uint64_t batches = 0, errors = 0;
+    size_t done = 0;
+    while(done < total)
+    {
+        int num = std::min(total - done, (size_t)cLogBatch);
+        int retVal = ::sendmmsg(mServices[rcci_service_logging].fd,
+                                &msgs[done], num, MSG_DONTWAIT);
+        batches++;
+        if(retVal < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            // first datagram failed (full socket buffer, unreachable
+            // client) - skip it, report once per client until it recovers
+            rcci_log_client_t &client = clients[owner[done]];
+            if(!client.failed)
+            {
+                char host[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &client.addr.sin_addr, host, sizeof(host));
+                // not through the logger - it would feed this thread
+                std::cerr << "Log to " << host << ":" <<
+                    ntohs(client.addr.sin_port) << " failed: " <<
+                    strerror(errno) << std::endl;
+            }
+            client.failed = true;
+            errors++;
+            done++;
+            continue;
+        }
+
+        // error of a later datagram is returned by the next call
+        for(int i = 0; i < retVal; i++)
+        {
+            clients[owner[done + i]].failed = false;
+        }
+        done += retVal;
+    }
+
+    std::lock_guard<std::mutex> lock(mLogMutex);
+    mLogStats.datagrams += total - errors;
+    mLogStats.errors    += errors;
+    mLogStats.batches   += batches;
+}
@@ -3,7 +3,13 @@
 
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <string>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -22,6 +28,18 @@ private:
         struct sockaddr     sockAddr;
         int                 fd;
         uint32_t            flags; // collected from rcci_client_flags_t type
+        // incremental receive - partial message stays here until complete
+        std::vector<uint8_t>     rxBuf;
+        size_t                   rxLen;
+        // replies to all messages of one wakeup, sent with one writev(),
+        // what the socket did not take stays queued (txOff bytes of the
+        // first one sent) and EPOLLOUT is armed until it is drained
+        std::vector<std::string> txQueue;
+        size_t                   txOff;
+        bool                     txArmed;
+        // log & drive registrations (service flag, UDP address), removed
+        // with the connection so a reconnecting client is not denied
+        std::vector<std::pair<uint32_t, struct sockaddr_in> > regServices;
     } rcci_client_info_t;
 
     // service destinations
@@ -31,6 +49,7 @@ private:
     typedef enum rcci_service_id_e {
         rcci_service_logging = 0,
         rcci_service_drive,
+        rcci_service_video,
         rcci_service_nonexisting // must be last
     } rcci_service_id_t;
 
@@ -66,11 +85,77 @@ private:
 
     const rcci_service_t cServiceTable[rcci_service_nonexisting] = {
         { rcci_service_logging, "logging",  0, -1, -1, rcci_client_vect_t() },
-        {   rcci_service_drive,   "drive",  1, -1, -1, rcci_client_vect_t() }
+        {   rcci_service_drive,   "drive",  1, -1, -1, rcci_client_vect_t() },
+        {   rcci_service_video,   "video",  4, -1, -1, rcci_client_vect_t() }
     };
 
+    typedef std::chrono::steady_clock rcciClock;
+
+    // Encoded frame shared by queues of all video clients
+    typedef struct rcci_vframe_s {
+        std::vector<uint8_t> data;
+        uint32_t             seq;
+        uint64_t             captureUs; // 0 - not known
+    } rcci_vframe_t;
+    typedef std::shared_ptr<const rcci_vframe_t> rcci_vframe_ptr_t;
+
+    // Unicast video client - own frame queue and token bucket, so a slow
+    // client only drops its own frames
+    typedef struct rcci_video_client_s {
+        struct sockaddr_in            addr;
+        int                           connFd;   // control connection
+        uint16_t                      version;  // fragment header version
+        std::deque<rcci_vframe_ptr_t> queue;
+        rcci_vframe_ptr_t             cur;      // frame being sent
+        size_t                        fragSize;
+        int                           numFrags;
+        int                           nextFrag;
+        double                        rate;     // pacing [B/s]
+        double                        tokens;   // [B]
+        rcciClock::time_point         refill;
+    } rcci_video_client_t;
+
+    // Log client as seen by the log thread
+    typedef struct rcci_log_client_s {
+        struct sockaddr_in addr;
+        uint32_t           seq;    // next datagram sequence number
+        bool               failed; // last send failed (reported once)
+    } rcci_log_client_t;
+
 
 public:
+    // Drive command latency histogram - bucket i counts latencies below
+    // (cDriveLatBucketUs << i) [us], last bucket everything above
+    static const int cDriveLatBuckets  = 16;
+    static const int cDriveLatBucketUs = 16;
+
+    typedef struct rcci_drive_stats_s {
+        uint64_t received;  // commands from registered client
+        uint64_t applied;   // commands passed to drive callback
+        uint64_t stale;     // older/duplicate sequence numbers dropped
+        uint64_t coalesced; // replaced by newer one within same PWM period
+        uint64_t invalid;   // wrong size, CRC or unknown source
+        uint32_t latMaxUs;  // max receive -> drive callback done latency
+        uint64_t latHist[cDriveLatBuckets];
+    } rcci_drive_stats_t;
+
+    typedef struct rcci_video_stats_s {
+        uint64_t frames;    // frames given to writeServiceVideo()
+        uint64_t sent;      // frames sent completely (all clients)
+        uint64_t dropped;   // frames dropped from queues of slow clients
+        uint64_t fragments; // fragments sent
+        uint64_t reports;   // receiver reports from clients
+        uint32_t clients;
+    } rcci_video_stats_t;
+
+    typedef struct rcci_log_stats_s {
+        uint64_t bytes;     // log text given to writeServiceLog()
+        uint64_t dropped;   // text dropped before sending (queue full)
+        uint64_t datagrams; // sent (all clients)
+        uint64_t errors;    // datagrams not sent
+        uint64_t batches;   // sendmmsg() calls
+    } rcci_log_stats_t;
+
     rcciServer(void);
     ~rcciServer(void);
 
@@ -80,9 +165,20 @@ public:
     bool    isServerRunning();
 
     /* Service public interfaces */
-    /* Logging service write support */
-    void    writeServiceLog(std::string &str);
+    /* Logging service write support - text is queued and sent by the log
+       thread in datagrams of whole lines, offset - position of the text in
+       the log stream (rccLogger::getOffset()) */
+    void    writeServiceLog(std::string &str, uint64_t offset);
+    bool    getLogStats(rcci_log_stats_t &stats);
     int     setDriveDataCb(rccSysCtrl::driveFuncCb cbFunc);
+    bool    getDriveStats(rcci_drive_stats_t &stats);
+    /* Video service - encoded frame is queued to all registered clients
+       (never blocks), returns number of clients. captureUs - capture time
+       (CLOCK_MONOTONIC) for v2 clients, 0 - not known. seq - capture
+       sequence number, < 0 - frames are numbered by the service */
+    int     writeServiceVideo(const uint8_t *data, size_t size,
+                              uint64_t captureUs = 0, int64_t seq = -1);
+    bool    getVideoStats(rcci_video_stats_t &stats);
 
 private:
     // used for logging, drive & video streams - should be put
@@ -91,51 +187,111 @@ private:
     void    closeServiceServer(rcci_service_t &service);
 
     /* TCP server supporting methods */
-    int     listenServer(void); // generates acceptThread()
+    int     listenServer(void); // generates eventLoopThread()
+
+    // Single epoll reactor serving listen socket, TCP clients and UDP
+    // service sockets - woken up by mEventFd when closing down
+    void    eventLoopThread(void);
+    int     epollAdd(int fd, uint32_t events);
+    int     epollMod(int fd, uint32_t events);
+    void    wakeupEventLoop(void);
+    void    acceptClients(void);
+    void    serveClient(int fd);
+    void    drainServiceSocket(int fd);
+
+    // Real-time drive thread - drains drive socket with recvmmsg(), keeps
+    // only the newest command (by count) and applies at most one per PWM
+    // period
+    void    driveThread(void);
+    int     readDriveData(rcci_msg_drv_ctrl_t &newest, bool &haveNew,
+                          struct timespec &rxTime);
+    void    applyDriveData(rcci_msg_drv_ctrl_t &cmd, struct timespec &rxTime);
 
-    void    acceptThread(void);
-    void    selectThread(void);
+    // Video thread - fragments queued frames and sends them to every
+    // client paced by its token bucket
+    void    videoThread(void);
+    int     sendVideoFragments(rcci_video_client_t &client,
+                               rcciClock::time_point now);
+    void    readVideoReports(void);
+    void    addVideoClient(const struct sockaddr_in &addr, int connFd,
+                           uint16_t version);
+    void    removeVideoClient(const struct sockaddr_in &addr);
+    void    removeVideoClients(int connFd);
+    void    removeServiceClients(rcci_client_info_t &cInfo);
+
+    // Log thread - coalesces queued log text to datagrams and sends them
+    // to all log clients with sendmmsg()
+    void    logThread(void);
+    void    sendLogText(std::vector<rcci_log_client_t> &clients,
+                        const std::string &text, uint64_t offset);
 
     void    addClient(rcci_client_info_t &cInfo);
     void    removeClient(rcci_client_info_t &cInfo);
 
-    /* Internal service supporting methods */
-    /* Support for drive data polling*/
-    int     startDriveThread(void);
-    int     stopDriveThread(void);
-    void    driveReadThread(void);
-
-    /* TCP server message processing */
-    ssize_t processData(rcci_client_info_t &cInfo);
-    int     processMsgInit(rcci_client_info_t &cInfo,
-                           rcci_msg_header_t &header);
+    /* TCP server message processing - stream is framed by header.size,
+       all complete (pipelined) messages are processed per wakeup */
+    int     readClient(rcci_client_info_t &cInfo, bool &eof);
+    int     parseMessages(rcci_client_info_t &cInfo);
+    int     processMessage(rcci_client_info_t &cInfo, const uint8_t *data,
+                           size_t len);
+    void    queueReply(rcci_client_info_t &cInfo, const void *data,
+                       size_t len);
+    int     flushReplies(rcci_client_info_t &cInfo);
+    int     processMsgInit(rcci_client_info_t &cInfo, const uint8_t *data,
+                           size_t len);
     int     processMsgRegService(rcci_client_info_t &cInfo,
-                                 rcci_msg_header_t &header);
+                                 const uint8_t *data, size_t len);
+    int     processMsgTimeSync(rcci_client_info_t &cInfo,
+                               const uint8_t *data, size_t len);
+    int     processMsgLogRead(rcci_client_info_t &cInfo,
+                              const uint8_t *data, size_t len);
     int     processMsgUnregService(rcci_client_info_t &cInfo,
-                                   rcci_msg_header_t &header);
+                                   const uint8_t *data, size_t len);
 
     int                             mListenFd;
     int                             mPort;
-    std::thread                    *mListenThread;
-    bool                            mListenThreadRunning;
-    std::thread                    *mSelectThread;
-    bool                            mSelectThreadRunning;
+    int                             mEpollFd;
+    int                             mEventFd; // wakes up the event loop
+    std::thread                    *mLoopThread;
+    std::atomic<bool>               mLoopThreadRunning;
+    // only touched from the event loop thread
     std::vector<rcci_client_info_t> mConnClients;
-    bool                            mSelectThreadUpdate;
     uint16_t                        mMagic;
     uint16_t                        mProtVer;
     // mServices is initialized from mServiceTable in constructor
     rcci_service_vect_t             mServices;
+    // protects mServices[].clients - also read by drive & log threads
+    std::mutex                      mServicesMutex;
 
     // drive callback function member
     rccSysCtrl::driveFuncCb         mDriveCbFunc;
 
-    // Thread for supporting the drive readback (so we don't block other
-    // parts)
-    std::thread                    *mDriveReadThread;
-    bool                            mDriveReadThreadRunning;
-    std::mutex mThreadMutex;
+    std::thread                    *mDriveThread;
+    std::atomic<bool>               mDriveThreadRunning;
+    std::atomic<bool>               mDriveSeqReset; // new drive client
+    bool                            mDriveSeqValid;
+    uint8_t                         mDriveLastSeq;
+    int                             mDriveStaleRun;
+    std::mutex                      mDriveStatsMutex;
+    rcci_drive_stats_t              mDriveStats;
+
+    std::thread                    *mVideoThread;
+    std::atomic<bool>               mVideoThreadRunning;
+    // protects everything below, mVideoCond wakes up the video thread
+    std::mutex                      mVideoMutex;
+    std::condition_variable         mVideoCond;
+    std::vector<rcci_video_client_t> mVideoClients;
+    uint32_t                        mVideoSeq;
+    rcci_video_stats_t              mVideoStats;
 
+    std::thread                    *mLogThread;
+    bool                            mLogThreadRunning;
+    // protects everything below, mLogCond wakes up the log thread
+    std::mutex                      mLogMutex;
+    std::condition_variable         mLogCond;
+    std::string                     mLogPending;
+    uint64_t                        mLogOffset; // of mLogPending start
+    rcci_log_stats_t                mLogStats;
 };
 
 #endif // __RCCI_SERVER_H
@@ -0,0 +1,1093 @@
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+#include <time.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+
+#include "rcci_async_client.h"
+#include "rcci_video_rx.h"
+#include "rcci_crc.h"
+
+
+const int rcciAsyncClient::cDefaultTimeoutMs;
+const int rcciAsyncClient::cMinBackoffMs;
+const int rcciAsyncClient::cMaxBackoffMs;
+
+const int cMaxEvents(8);
+const int cLogBatch(64);         // datagrams read per event, level triggered
+const int cVideoRcvBuf(1 << 20); // room for a few frames sent in bursts
+// largest reply - log history chunk
+const size_t cMaxReply(sizeof(rcci_msg_log_read_t) + rcci_msg_log_read_max);
+
+static uint64_t monotonicUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+rcciAsyncClient::rcciAsyncClient(void)
+    : mEpollFd(-1), mState(rcci_async_closed),
+      mTimeout(std::chrono::milliseconds(cDefaultTimeoutMs)),
+      mSockFd(-1), mTcpConnecting(false),
+      mBackoff(std::chrono::milliseconds(cMinBackoffMs)),
+      mMagic(0), mVersion(0), mLogPort(-1), mDrvPort(-1), mVideoPort(-1),
+      mTxWait(false), mVideoRx(NULL), mLogFetching(false), mLogSynced(false),
+      mLogNextOffset(0), mLogSeqSynced(false), mLogSeq(0), mLogLost(0),
+      mLogMissing(0), mClockOffset(0)
+{
+    memset(&mServAddr, 0, sizeof(mServAddr));
+    memset(&mDrvMsg, 0, sizeof(mDrvMsg));
+    mLog.enabled = mDrv.enabled = mVideo.enabled = false;
+    mLog.registered = mDrv.registered = mVideo.registered = false;
+    mLog.fd = mDrv.fd = mVideo.fd = -1;
+    mLog.generation = mDrv.generation = mVideo.generation = 0;
+}
+
+rcciAsyncClient::~rcciAsyncClient(void)
+{
+    close();
+}
+
+int rcciAsyncClient::open(const std::string &hostname, int port)
+{
+    struct addrinfo hints, *res;
+
+    close();
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    int retVal = getaddrinfo(hostname.c_str(), NULL, &hints, &res);
+    if(retVal != 0)
+    {
+        std::cerr << "open() can not resolve " << hostname << ": " <<
+            gai_strerror(retVal) << std::endl;
+        return -1;
+    }
+    memcpy(&mServAddr, res->ai_addr, sizeof(mServAddr));
+    mServAddr.sin_port = htons(port);
+    freeaddrinfo(res);
+
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(mEpollFd < 0)
+    {
+        std::cerr << "epoll_create1() failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    mBackoff = std::chrono::milliseconds(cMinBackoffMs);
+    connectServer();
+
+    return 0;
+}
+
+void rcciAsyncClient::close(void)
+{
+    std::deque<rcci_async_req_t> requests;
+
+    if(mEpollFd < 0)
+    {
+        return;
+    }
+
+    // server drops registrations of the connection with it
+    mLog.enabled = mDrv.enabled = mVideo.enabled = false;
+    mLog.done = mDrv.done = mVideo.done = nullptr;
+    teardown();
+    mVideoRx = NULL;
+    requests.swap(mRequests);
+
+    ::close(mEpollFd);
+    mEpollFd = -1;
+    setState(rcci_async_closed);
+
+    for(auto it = requests.begin(); it != requests.end(); ++it)
+    {
+        it->reply(-ECONNRESET, std::string());
+    }
+}
+
+int rcciAsyncClient::run(int timeoutMs)
+{
+    struct epoll_event events[cMaxEvents];
+
+    if(mEpollFd < 0)
+    {
+        return -1;
+    }
+
+    checkDeadlines(asyncClock::now());
+    int numEvents = epoll_wait(mEpollFd, events, cMaxEvents,
+                               nextTimeoutMs(asyncClock::now(), timeoutMs));
+    if(numEvents < 0)
+    {
+        if(errno == EINTR)
+        {
+            return 0;
+        }
+        std::cerr << "epoll_wait() failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    // handlers tolerate events of a socket closed by an earlier one
+    for(int i = 0; (i < numEvents) && (mEpollFd >= 0); i++)
+    {
+        int fd = events[i].data.fd;
+        uint32_t ev = events[i].events;
+
+        if((fd == mSockFd) && mTcpConnecting)
+        {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+            {
+                err = errno;
+            }
+            if(err != 0)
+            {
+                std::cerr << "Error connecting to server: " << strerror(err) <<
+                    std::endl;
+                fail(-ECONNRESET);
+            }
+            else if(ev & EPOLLOUT)
+            {
+                connected();
+            }
+        }
+        else if(fd == mSockFd)
+        {
+            if(ev & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            {
+                readControl();
+            }
+            if((fd == mSockFd) && (ev & EPOLLOUT))
+            {
+                flushTx();
+            }
+        }
+        else if((fd == mLog.fd) && mLog.registered && !mLogFetching)
+        {
+            logReadDatagrams();
+        }
+        else if((fd == mVideo.fd) && mVideo.registered && mVideoRx)
+        {
+            mVideoRx->receive(0);
+        }
+    }
+
+    checkDeadlines(asyncClock::now());
+
+    return 0;
+}
+
+void rcciAsyncClient::connectServer(void)
+{
+    mSockFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(mSockFd < 0)
+    {
+        std::cerr << "Error creating socket: " << strerror(errno) << std::endl;
+        fail(-ECONNRESET);
+        return;
+    }
+
+    int one = 1;
+    setsockopt(mSockFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if((::connect(mSockFd, (struct sockaddr *)&mServAddr,
+                  sizeof(mServAddr)) < 0) && (errno != EINPROGRESS))
+    {
+        std::cerr << "Error connecting to server: " << strerror(errno) <<
+            std::endl;
+        fail(-ECONNRESET);
+        return;
+    }
+
+    // completion (or error) is reported as writable
+    mTcpConnecting   = true;
+    mConnectDeadline = asyncClock::now() + mTimeout;
+    if(epollSet(mSockFd, EPOLLIN | EPOLLOUT, true) < 0)
+    {
+        fail(-ECONNRESET);
+        return;
+    }
+    setState(rcci_async_connecting);
+}
+
+// TCP connected - initialization, then the services are registered again
+void rcciAsyncClient::connected(void)
+{
+    rcci_msg_init_t msg;
+
+    mTcpConnecting = false;
+    mTxWait        = false;
+    epollSet(mSockFd, EPOLLIN, false);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.header.type  = rcci_msg_init;
+    msg.header.magic = rcci_msg_init_magic;
+    msg.header.ver   = rcci_msg_init_ver;
+    msg.header.size  = sizeof(rcci_msg_init_t);
+    rcciMsgSetCrc(&msg, sizeof(msg));
+
+    sendRequest(&msg, sizeof(msg), rcci_msg_init,
+        [this](int status, const std::string &reply)
+        {
+            rcci_msg_init_t initMsg;
+
+            if(status < 0)
+            {
+                return;
+            }
+            memcpy(&initMsg, reply.data(),
+                   std::min(reply.size(), sizeof(initMsg)));
+            // servers without video service reply with the shorter message
+            if(((reply.size() != sizeof(initMsg)) &&
+                (reply.size() != rcci_msg_init_size_v1)) ||
+               (initMsg.status != rcci_status_ack))
+            {
+                std::cerr << "Initialization refused by server" << std::endl;
+                fail(-EPROTO);
+                return;
+            }
+
+            mMagic     = initMsg.header.magic;
+            mVersion   = initMsg.header.ver;
+            mLogPort   = initMsg.log_port;
+            mDrvPort   = initMsg.drv_port;
+            mVideoPort = (reply.size() == sizeof(initMsg)) ?
+                initMsg.video_port : -1;
+            mBackoff   = std::chrono::milliseconds(cMinBackoffMs);
+            setState(rcci_async_connected);
+
+            const rcci_client_flags_t flags[] = {
+                rcci_client_flag_log, rcci_client_flag_drive,
+                rcci_client_flag_video };
+            for(size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+            {
+                if(isConnected() && service(flags[i]).enabled)
+                {
+                    registerService(flags[i]);
+                }
+            }
+        });
+}
+
+// Closes the sockets, enabled services stay enabled
+void rcciAsyncClient::teardown(void)
+{
+    if(mSockFd >= 0)
+    {
+        // closing the fd also removes it from the epoll set
+        ::close(mSockFd);
+        mSockFd = -1;
+    }
+    mTcpConnecting = false;
+    mTxWait        = false;
+    mTxBuf.clear();
+    mRxBuf.clear();
+
+    closeService(mLog);
+    closeService(mDrv);
+    closeService(mVideo);
+    mLogFetching = false;
+}
+
+// Replies can not be matched to requests anymore - start over
+void rcciAsyncClient::fail(int status)
+{
+    std::deque<rcci_async_req_t> requests;
+
+    teardown();
+    requests.swap(mRequests);
+
+    mReconnectTime = asyncClock::now() + mBackoff;
+    mBackoff = std::min(mBackoff * 2,
+                        asyncClock::duration(
+                            std::chrono::milliseconds(cMaxBackoffMs)));
+    setState(rcci_async_backoff);
+
+    for(auto it = requests.begin(); it != requests.end(); ++it)
+    {
+        it->reply(status, std::string());
+    }
+}
+
+void rcciAsyncClient::setState(rcci_async_state_t state)
+{
+    if(state == mState)
+    {
+        return;
+    }
+    mState = state;
+    if(mStateCb)
+    {
+        mStateCb(state);
+    }
+}
+
+int rcciAsyncClient::epollSet(int fd, uint32_t events, bool add)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = events;
+    ev.data.fd = fd;
+    if(epoll_ctl(mEpollFd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev) < 0)
+    {
+        std::cerr << "epoll_ctl() failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+int rcciAsyncClient::sendRequest(const void *msg, size_t len,
+                                 rcci_msg_id_t reply, replyFuncCb cbFunc)
+{
+    rcci_async_req_t req;
+
+    if((mSockFd < 0) || mTcpConnecting)
+    {
+        return -1;
+    }
+
+    req.type     = reply;
+    req.deadline = asyncClock::now() + mTimeout;
+    req.reply    = cbFunc;
+    mRequests.push_back(req);
+
+    mTxBuf.append((const char *)msg, len);
+    flushTx();
+
+    return 0;
+}
+
+void rcciAsyncClient::flushTx(void)
+{
+    while(!mTxBuf.empty())
+    {
+        ssize_t bytes = send(mSockFd, mTxBuf.data(), mTxBuf.size(),
+                             MSG_NOSIGNAL);
+        if(bytes < 0)
+        {
+            if((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                if(!mTxWait && (epollSet(mSockFd, EPOLLIN | EPOLLOUT,
+                                         false) == 0))
+                {
+                    mTxWait = true;
+                }
+                return;
+            }
+            std::cerr << "send() failed: " << strerror(errno) << std::endl;
+            fail(-ECONNRESET);
+            return;
+        }
+        mTxBuf.erase(0, bytes);
+    }
+
+    if(mTxWait && (epollSet(mSockFd, EPOLLIN, false) == 0))
+    {
+        mTxWait = false;
+    }
+}
+
+void rcciAsyncClient::readControl(void)
+{
+    char buf[4096];
+
+    while(true)
+    {
+        ssize_t bytes = recv(mSockFd, buf, sizeof(buf), 0);
+        if(bytes > 0)
+        {
+            mRxBuf.append(buf, bytes);
+            continue;
+        }
+        if((bytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            break;
+        }
+        if(bytes < 0)
+        {
+            std::cerr << "recv() failed: " << strerror(errno) << std::endl;
+        }
+        else
+        {
+            std::cerr << "Connection closed by server" << std::endl;
+        }
+        fail(-ECONNRESET);
+        return;
+    }
+
+    while(mRxBuf.size() >= sizeof(rcci_msg_header_t))
+    {
+        rcci_msg_header_t header;
+
+        memcpy(&header, mRxBuf.data(), sizeof(header));
+        if((header.size < sizeof(header)) || (header.size > cMaxReply))
+        {
+            std::cerr << "Wrong reply size " << header.size << std::endl;
+            fail(-EPROTO);
+            return;
+        }
+        if(mRxBuf.size() < header.size)
+        {
+            break;
+        }
+
+        std::string msg = mRxBuf.substr(0, header.size);
+        mRxBuf.erase(0, header.size);
+        handleReply(msg);
+        if(mSockFd < 0)
+        {
+            // failed or closed by the reply callback
+            return;
+        }
+    }
+}
+
+void rcciAsyncClient::handleReply(const std::string &msg)
+{
+    rcci_msg_header_t header;
+
+    if(mRequests.empty())
+    {
+        std::cerr << "Unexpected reply from server" << std::endl;
+        fail(-EPROTO);
+        return;
+    }
+
+    rcci_async_req_t req = mRequests.front();
+    mRequests.pop_front();
+
+    memcpy(&header, msg.data(), sizeof(header));
+    if((header.type != req.type) || !rcciMsgCheckCrc(msg.data(), msg.size()))
+    {
+        std::cerr << "Wrong reply or CRC mismatch (type " << header.type <<
+            ", expected " << req.type << ")" << std::endl;
+        fail(-EPROTO);
+        req.reply(-EPROTO, std::string());
+        return;
+    }
+
+    req.reply(0, msg);
+}
+
+void rcciAsyncClient::checkDeadlines(asyncClock::time_point now)
+{
+    if(mState == rcci_async_backoff)
+    {
+        if(now >= mReconnectTime)
+        {
+            connectServer();
+        }
+        return;
+    }
+
+    if(mTcpConnecting && (now >= mConnectDeadline))
+    {
+        std::cerr << "Timeout connecting to server" << std::endl;
+        fail(-ETIMEDOUT);
+        return;
+    }
+
+    for(auto it = mRequests.begin(); it != mRequests.end(); ++it)
+    {
+        if(now >= it->deadline)
+        {
+            std::cerr << "No reply from server (type " << it->type << ")" <<
+                std::endl;
+            fail(-ETIMEDOUT);
+            return;
+        }
+    }
+}
+
+int rcciAsyncClient::nextTimeoutMs(asyncClock::time_point now, int timeoutMs)
+{
+    asyncClock::time_point next = asyncClock::time_point::max();
+
+    if(timeoutMs >= 0)
+    {
+        next = now + std::chrono::milliseconds(timeoutMs);
+    }
+    if(mState == rcci_async_backoff)
+    {
+        next = std::min(next, mReconnectTime);
+    }
+    if(mTcpConnecting)
+    {
+        next = std::min(next, mConnectDeadline);
+    }
+    for(auto it = mRequests.begin(); it != mRequests.end(); ++it)
+    {
+        next = std::min(next, it->deadline);
+    }
+
+    if(next == asyncClock::time_point::max())
+    {
+        return -1;
+    }
+    if(next <= now)
+    {
+        return 0;
+    }
+    // rounded up, not to wake up just before the deadline
+    return (std::chrono::duration_cast<std::chrono::microseconds>(
+                next - now).count() + 999) / 1000;
+}
+
+int rcciAsyncClient::openService(int port)
+{
+    struct sockaddr_in addr;
+
+    if(port <= 0)
+    {
+        std::cerr << "openService() service not provided by server" <<
+            std::endl;
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    IPPROTO_UDP);
+    if(fd < 0)
+    {
+        std::cerr << "Error creating socket: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    // the same server but different port
+    memcpy(&addr, &mServAddr, sizeof(addr));
+    addr.sin_port = htons(port);
+    if(::connect(fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        std::cerr << "Error connecting to service on port " << port <<
+            std::endl;
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void rcciAsyncClient::closeService(rcci_async_service_t &service)
+{
+    if(service.fd >= 0)
+    {
+        if((&service == &mVideo) && mVideoRx)
+        {
+            mVideoRx->closeSocket();
+        }
+        ::close(service.fd);
+        service.fd = -1;
+    }
+    service.registered = false;
+}
+
+rcciAsyncClient::rcci_async_service_t &
+rcciAsyncClient::service(rcci_client_flags_t flag)
+{
+    if(flag == rcci_client_flag_log)
+    {
+        return mLog;
+    }
+    else if(flag == rcci_client_flag_drive)
+    {
+        return mDrv;
+    }
+    return mVideo;
+}
+
+void rcciAsyncClient::serviceDone(rcci_async_service_t &service, int status)
+{
+    if(service.done)
+    {
+        doneFuncCb cbFunc;
+        cbFunc.swap(service.done);
+        cbFunc(status);
+    }
+}
+
+void rcciAsyncClient::registerService(rcci_client_flags_t flag)
+{
+    rcci_async_service_t &srv = service(flag);
+    rcci_msg_reg_service_t msg;
+    socklen_t sockLen = sizeof(msg.sockaddr);
+    int port = (flag == rcci_client_flag_log) ? mLogPort :
+        (flag == rcci_client_flag_drive) ? mDrvPort : mVideoPort;
+
+    closeService(srv);
+    srv.fd = openService(port);
+    if(srv.fd < 0)
+    {
+        // tried again after reconnect
+        serviceDone(srv, -EACCES);
+        return;
+    }
+    srv.generation++;
+
+    memset(&msg, 0, sizeof(msg));
+    if(getsockname(srv.fd, (struct sockaddr *)&msg.sockaddr, &sockLen) < 0)
+    {
+        std::cerr << "Error getting socket name: " << strerror(errno) <<
+            std::endl;
+        closeService(srv);
+        serviceDone(srv, -EACCES);
+        return;
+    }
+
+    if(flag == rcci_client_flag_video)
+    {
+        int rcvBuf = cVideoRcvBuf;
+        setsockopt(srv.fd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+        mVideoRx->attachSocket(srv.fd);
+        // params - highest video fragment version rcciVideoRx understands
+        msg.params = rcci_msg_video_v2;
+    }
+
+    msg.header.type  = rcci_msg_reg_service;
+    msg.header.magic = mMagic;
+    msg.header.ver   = mVersion;
+    msg.header.size  = sizeof(rcci_msg_reg_service_t);
+    msg.service      = flag;
+    rcciMsgSetCrc(&msg, sizeof(msg));
+
+    uint32_t generation = srv.generation;
+    sendRequest(&msg, sizeof(msg), rcci_msg_reg_service,
+        [this, flag, generation](int status, const std::string &reply)
+        {
+            rcci_async_service_t &srv = service(flag);
+            rcci_msg_reg_service_t regMsg;
+
+            if(!srv.enabled || (srv.generation != generation))
+            {
+                // disabled meanwhile, it was unregistered after this request
+                return;
+            }
+
+            if(status == 0)
+            {
+                memcpy(&regMsg, reply.data(),
+                       std::min(reply.size(), sizeof(regMsg)));
+                if((reply.size() != sizeof(regMsg)) ||
+                   (regMsg.status != rcci_status_ack))
+                {
+                    std::cerr << "Service registering denied by server!" <<
+                        std::endl;
+                    status = -EACCES;
+                }
+            }
+
+            if(status == -EACCES)
+            {
+                srv.enabled = false;
+                closeService(srv);
+            }
+            else if(status == 0)
+            {
+                srv.registered = true;
+                if(flag == rcci_client_flag_drive)
+                {
+                    // server restarts checking the count
+                    memset(&mDrvMsg, 0, sizeof(mDrvMsg));
+                }
+                else if((flag == rcci_client_flag_log) && mLogSynced)
+                {
+                    // text logged while disconnected, datagrams wait
+                    mLogFetching  = true;
+                    mLogSeqSynced = false;
+                    logFetchNext(mLogNextOffset);
+                }
+                else
+                {
+                    epollSet(srv.fd, EPOLLIN, true);
+                }
+            }
+            serviceDone(srv, status);
+        });
+}
+
+// Fire and forget - the reply is only matched
+void rcciAsyncClient::unregisterService(rcci_client_flags_t flag)
+{
+    rcci_async_service_t &srv = service(flag);
+    rcci_msg_reg_service_t msg;
+    socklen_t sockLen = sizeof(msg.sockaddr);
+
+    if(!isConnected() || (srv.fd < 0))
+    {
+        return;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    if(getsockname(srv.fd, (struct sockaddr *)&msg.sockaddr, &sockLen) < 0)
+    {
+        return;
+    }
+    msg.header.type  = rcci_msg_unreg_service;
+    msg.header.magic = mMagic;
+    msg.header.ver   = mVersion;
+    msg.header.size  = sizeof(rcci_msg_reg_service_t);
+    msg.service      = flag;
+    rcciMsgSetCrc(&msg, sizeof(msg));
+
+    // server replies with the registration message type
+    sendRequest(&msg, sizeof(msg), rcci_msg_reg_service,
+                [](int, const std::string &) {});
+}
+
+int rcciAsyncClient::logEnable(bool history, uint64_t offset, doneFuncCb done)
+{
+    if(mEpollFd < 0)
+    {
+        return -1;
+    }
+    if(mLog.enabled)
+    {
+        return 0;
+    }
+
+    mLog.enabled   = true;
+    mLog.done      = done;
+    mLogSynced     = history;
+    mLogNextOffset = offset;
+    mLogSeqSynced  = false;
+    if(isConnected())
+    {
+        registerService(rcci_client_flag_log);
+    }
+
+    return 0;
+}
+
+void rcciAsyncClient::logDisable(void)
+{
+    unregisterService(rcci_client_flag_log);
+    closeService(mLog);
+    mLog.enabled = false;
+    mLog.done    = nullptr;
+    mLogFetching = false;
+}
+
+int rcciAsyncClient::drvEnable(doneFuncCb done)
+{
+    if(mEpollFd < 0)
+    {
+        return -1;
+    }
+    if(mDrv.enabled)
+    {
+        return 0;
+    }
+
+    mDrv.enabled = true;
+    mDrv.done    = done;
+    if(isConnected())
+    {
+        registerService(rcci_client_flag_drive);
+    }
+
+    return 0;
+}
+
+void rcciAsyncClient::drvDisable(void)
+{
+    unregisterService(rcci_client_flag_drive);
+    closeService(mDrv);
+    mDrv.enabled = false;
+    mDrv.done    = nullptr;
+}
+
+int rcciAsyncClient::drvSendData(int32_t drive, int32_t steer)
+{
+    if(!mDrv.registered)
+    {
+        return -1;
+    }
+
+    mDrvMsg.count++;
+    mDrvMsg.drive = drive;
+    mDrvMsg.steer = steer;
+    rcciDrvSetCrc(mDrvMsg);
+
+    ssize_t bytes = send(mDrv.fd, &mDrvMsg, sizeof(mDrvMsg), MSG_DONTWAIT);
+    if((bytes < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+    {
+        std::cerr << "drvSendData() problems with send(): " <<
+            strerror(errno) << std::endl;
+    }
+
+    return bytes;
+}
+
+int rcciAsyncClient::videoEnable(rcciVideoRx &rx, doneFuncCb done)
+{
+    if(mEpollFd < 0)
+    {
+        return -1;
+    }
+    if(mVideo.enabled)
+    {
+        return 0;
+    }
+
+    mVideo.enabled = true;
+    mVideo.done    = done;
+    mVideoRx       = &rx;
+    if(isConnected())
+    {
+        registerService(rcci_client_flag_video);
+    }
+
+    return 0;
+}
+
+void rcciAsyncClient::videoDisable(void)
+{
+    unregisterService(rcci_client_flag_video);
+    closeService(mVideo);
+    mVideo.enabled = false;
+    mVideo.done    = nullptr;
+    mVideoRx       = NULL;
+}
+
+int rcciAsyncClient::logFetch(uint64_t offset, size_t maxBytes,
+                              logReadFuncCb done)
+{
+    rcci_msg_log_read_t msg;
+
+    if(!isConnected())
+    {
+        return -1;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.header.type  = rcci_msg_log_read;
+    msg.header.magic = mMagic;
+    msg.header.ver   = mVersion;
+    msg.header.size  = sizeof(rcci_msg_log_read_t);
+    msg.offset       = offset;
+    msg.max_size     = std::min(maxBytes, (size_t)rcci_msg_log_read_max);
+    rcciMsgSetCrc(&msg, sizeof(msg));
+
+    return sendRequest(&msg, sizeof(msg), rcci_msg_log_read,
+        [this, done](int status, const std::string &reply)
+        {
+            rcci_msg_log_read_t readMsg;
+
+            if(status < 0)
+            {
+                done(status, std::string(), 0, 0);
+                return;
+            }
+            memcpy(&readMsg, reply.data(),
+                   std::min(reply.size(), sizeof(readMsg)));
+            if((reply.size() < sizeof(readMsg)) ||
+               (reply.size() != (sizeof(readMsg) + readMsg.size)))
+            {
+                fail(-EPROTO);
+                done(-EPROTO, std::string(), 0, 0);
+                return;
+            }
+            done(0, reply.substr(sizeof(readMsg)), readMsg.offset,
+                 readMsg.end);
+        });
+}
+
+// History is read up to the end the server reports, meanwhile the
+// datagrams wait in the socket and the ones already read are skipped
+void rcciAsyncClient::logFetchNext(uint64_t offset)
+{
+    uint32_t generation = mLog.generation;
+
+    logFetch(offset, rcci_msg_log_read_max,
+        [this, offset, generation](int status, const std::string &text,
+                                   uint64_t start, uint64_t end)
+        {
+            if((status < 0) || !mLog.registered ||
+               (mLog.generation != generation))
+            {
+                return;
+            }
+
+            if((end < offset) && (offset > 0))
+            {
+                // log shorter than already read - daemon was restarted,
+                // its log is read from the start
+                logFetchNext(0);
+                return;
+            }
+            if(start > offset)
+            {
+                // not kept by the server anymore
+                mLogMissing += start - offset;
+            }
+            mLogNextOffset = start + text.length();
+            if(!text.empty() && mLogCb)
+            {
+                mLogCb(text, start);
+            }
+            if(!mLog.registered || (mLog.generation != generation))
+            {
+                // disabled by the callback
+                return;
+            }
+
+            if(!text.empty() && (mLogNextOffset < end))
+            {
+                logFetchNext(mLogNextOffset);
+                return;
+            }
+            mLogFetching = false;
+            if(epollSet(mLog.fd, EPOLLIN, true) == 0)
+            {
+                logReadDatagrams();
+            }
+        });
+}
+
+// Datagrams are checked by CRC, gaps in the offsets are counted (lost
+// datagrams or text dropped by the server), see rcciClient::logReadData()
+void rcciAsyncClient::logReadDatagrams(void)
+{
+    uint8_t buf[rcci_msg_log_max_size];
+    rcci_msg_log_t hdr;
+    uint32_t generation = mLog.generation;
+
+    for(int i = 0; (i < cLogBatch) && mLog.registered &&
+            (mLog.generation == generation); i++)
+    {
+        ssize_t bytes = recv(mLog.fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if(bytes < 0)
+        {
+            if((errno != EAGAIN) && (errno != EWOULDBLOCK))
+            {
+                std::cerr << "Log recv() failed: " << strerror(errno) <<
+                    std::endl;
+            }
+            return;
+        }
+
+        if((size_t)bytes < sizeof(hdr))
+        {
+            continue;
+        }
+        memcpy(&hdr, buf, sizeof(hdr));
+        if((hdr.header.type != rcci_msg_log) || (hdr.header.size != bytes) ||
+           !rcciMsgCheckCrc(buf, bytes))
+        {
+            std::cerr << "Invalid log datagram" << std::endl;
+            continue;
+        }
+
+        if(mLogSeqSynced && ((int32_t)(hdr.seq - mLogSeq) > 0))
+        {
+            mLogLost += hdr.seq - mLogSeq;
+        }
+        if(!mLogSeqSynced || ((int32_t)(hdr.seq - mLogSeq) >= 0))
+        {
+            mLogSeq       = hdr.seq + 1;
+            mLogSeqSynced = true;
+        }
+
+        size_t len = bytes - sizeof(hdr);
+        size_t skip = 0;
+        if(mLogSynced && (hdr.offset < mLogNextOffset))
+        {
+            // already read with the history
+            skip = std::min((uint64_t)len, mLogNextOffset - hdr.offset);
+            len -= skip;
+            hdr.offset += skip;
+        }
+        if(len == 0)
+        {
+            continue;
+        }
+
+        if(mLogSynced && (hdr.offset > mLogNextOffset))
+        {
+            mLogMissing += hdr.offset - mLogNextOffset;
+        }
+        mLogNextOffset = hdr.offset + len;
+        mLogSynced     = true;
+
+        if(mLogCb)
+        {
+            mLogCb(std::string((const char *)buf + sizeof(hdr) + skip, len),
+                   hdr.offset);
+        }
+    }
+}
+
+int rcciAsyncClient::syncClock(int samples, clockFuncCb done)
+{
+    if(!isConnected() || (samples <= 0))
+    {
+        return -1;
+    }
+
+    syncClockNext(samples, -1, done);
+
+    return 0;
+}
+
+// One exchange at a time, server time is assumed to be taken in the middle
+void rcciAsyncClient::syncClockNext(int samples, int bestRtt,
+                                    clockFuncCb done)
+{
+    rcci_msg_time_sync_t msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.header.type  = rcci_msg_time_sync;
+    msg.header.magic = mMagic;
+    msg.header.ver   = mVersion;
+    msg.header.size  = sizeof(rcci_msg_time_sync_t);
+    msg.client_us    = monotonicUs();
+    rcciMsgSetCrc(&msg, sizeof(msg));
+
+    int retVal = sendRequest(&msg, sizeof(msg), rcci_msg_time_sync,
+        [this, samples, bestRtt, done](int status, const std::string &reply)
+        {
+            rcci_msg_time_sync_t syncMsg;
+            uint64_t rxUs = monotonicUs();
+            int best = bestRtt;
+
+            if((status == 0) && (reply.size() != sizeof(syncMsg)))
+            {
+                status = -EPROTO;
+            }
+            if(status < 0)
+            {
+                done(status, -1);
+                return;
+            }
+
+            memcpy(&syncMsg, reply.data(), sizeof(syncMsg));
+            int rtt = rxUs - syncMsg.client_us;
+            if((best < 0) || (rtt < best))
+            {
+                best = rtt;
+                mClockOffset = (int64_t)syncMsg.server_us -
+                    (int64_t)((syncMsg.client_us + rxUs) / 2);
+            }
+
+            if(samples > 1)
+            {
+                syncClockNext(samples - 1, best, done);
+            }
+            else
+            {
+                done(0, best);
+            }
+        });
+    if(retVal < 0)
+    {
+        done(-ECONNRESET, bestRtt);
+    }
+}
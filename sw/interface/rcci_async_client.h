@@ -0,0 +1,203 @@
+#ifndef __RCCI_ASYNC_CLIENT_H
+#define __RCCI_ASYNC_CLIENT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <string>
+#include <deque>
+#include <functional>
+#include <chrono>
+
+extern "C" {
+#include "rcci_type.h"
+}
+
+class rcciVideoRx;
+
+/*! Event driven client of rcc_daemon - one epoll loop owns the control
+  connection and the log, drive and video service sockets, nothing in it
+  blocks. Control requests complete with callbacks and each has a deadline.
+  A missed deadline or a lost connection fails all pending requests and the
+  client reconnects with exponential backoff; enabled services are
+  registered again and the log continues from the last received offset
+  (from the start of the new log when the daemon was restarted - offsets
+  passed to the log callback go back then).
+  Call run() from one thread (or add fd() to another loop and call run(0)
+  when it is readable), all callbacks are called from run().
+  Not thread safe.
+*/
+class rcciAsyncClient {
+public:
+    typedef enum rcci_async_state_e {
+        rcci_async_closed = 0, // open() not called
+        rcci_async_connecting, // TCP connect & init in progress
+        rcci_async_connected,  // init done, services are being registered
+        rcci_async_backoff     // waiting to reconnect
+    } rcci_async_state_t;
+
+    /*! Request completion status: 0 - done, -ETIMEDOUT - deadline missed,
+      -ECONNRESET - connection lost, -EACCES - denied by the server,
+      -EPROTO - unexpected reply
+    */
+    typedef std::function<void(int)> doneFuncCb;
+    typedef std::function<void(rcci_async_state_t)> stateFuncCb;
+    // log text, offset of its first byte in the server log stream
+    typedef std::function<void(const std::string &, uint64_t)> logFuncCb;
+    // status, text, offset of the text, end of the server log
+    typedef std::function<void(int, const std::string &, uint64_t,
+                               uint64_t)> logReadFuncCb;
+    // status, best RTT [us]; offset from serverClockOffset()
+    typedef std::function<void(int, int)> clockFuncCb;
+
+    static const int cDefaultTimeoutMs = 1000;  // per request & TCP connect
+    static const int cMinBackoffMs = 250;
+    static const int cMaxBackoffMs = 8000;
+
+    rcciAsyncClient(void);
+    ~rcciAsyncClient(void);
+
+    /*! Resolves hostname (once, numeric addresses do not block) and starts
+      connecting, returns -1 if it can not be resolved
+    */
+    int  open(const std::string &hostname, int port);
+    //! Stops everything, services are disabled
+    void close(void);
+
+    //! epoll fd - readable when run() has something to do
+    int  fd(void) { return mEpollFd; };
+    /*! Waits up to timeoutMs (less when a deadline or reconnect is due)
+      and handles all events, returns -1 on error (not opened)
+    */
+    int  run(int timeoutMs);
+
+    rcci_async_state_t state(void) { return mState; };
+    bool isConnected(void) { return mState == rcci_async_connected; };
+
+    void setStateCb(stateFuncCb cbFunc) { mStateCb = cbFunc; };
+    void setLogCb(logFuncCb cbFunc) { mLogCb = cbFunc; };
+    void setRequestTimeout(int timeoutMs)
+    {
+        mTimeout = std::chrono::milliseconds(timeoutMs);
+    };
+
+    /*! Services stay enabled across reconnects until disabled, 'done' gets
+      the result of the first registration. Log text goes to the log
+      callback; with history everything kept by the server from 'offset'
+      comes first.
+    */
+    int  logEnable(bool history = true, uint64_t offset = 0,
+                   doneFuncCb done = nullptr);
+    void logDisable(void);
+    int  drvEnable(doneFuncCb done = nullptr);
+    void drvDisable(void);
+    //! Sends drive command without waiting, -1 when drive is not registered
+    int  drvSendData(int32_t drive, int32_t steer);
+    //! Frames are received by 'rx' (its frame callback), socket is attached
+    int  videoEnable(rcciVideoRx &rx, doneFuncCb done = nullptr);
+    void videoDisable(void);
+
+    // log bytes lost so far (gaps in offsets, not read again), datagrams
+    // lost in the network, offset of the next expected log byte
+    uint64_t logMissing(void) { return mLogMissing; };
+    uint64_t logLostDatagrams(void) { return mLogLost; };
+    uint64_t logOffset(void) { return mLogNextOffset; };
+
+    //! One chunk of the server log (see rcciClient::logFetch()), -1 if not connected
+    int  logFetch(uint64_t offset, size_t maxBytes, logReadFuncCb done);
+    //! Clock offset from the exchange with lowest RTT, -1 if not connected
+    int  syncClock(int samples, clockFuncCb done);
+    // server CLOCK_MONOTONIC = local CLOCK_MONOTONIC + offset [us]
+    int64_t serverClockOffset(void) { return mClockOffset; };
+
+private:
+    typedef std::chrono::steady_clock asyncClock;
+
+    // reply message (whole, CRC checked) or empty with error status
+    typedef std::function<void(int, const std::string &)> replyFuncCb;
+
+    typedef struct rcci_async_req_s {
+        rcci_msg_id_t          type;     // expected reply
+        asyncClock::time_point deadline;
+        replyFuncCb            reply;
+    } rcci_async_req_t;
+
+    typedef struct rcci_async_service_s {
+        bool                enabled;
+        bool                registered;
+        int                 fd;
+        uint32_t            generation; // of fd, replies to older are ignored
+        doneFuncCb          done;   // until the first registration result
+    } rcci_async_service_t;
+
+    void connectServer(void);
+    void connected(void);
+    void fail(int status);
+    void teardown(void);
+    void setState(rcci_async_state_t state);
+    int  epollSet(int fd, uint32_t events, bool add);
+
+    int  sendRequest(const void *msg, size_t len, rcci_msg_id_t reply,
+                     replyFuncCb cbFunc);
+    void flushTx(void);
+    void readControl(void);
+    void handleReply(const std::string &msg);
+    void checkDeadlines(asyncClock::time_point now);
+    int  nextTimeoutMs(asyncClock::time_point now, int timeoutMs);
+
+    int  openService(int port);
+    void closeService(rcci_async_service_t &service);
+    void registerService(rcci_client_flags_t flag);
+    void unregisterService(rcci_client_flags_t flag);
+    rcci_async_service_t &service(rcci_client_flags_t flag);
+    void serviceDone(rcci_async_service_t &service, int status);
+
+    void logFetchNext(uint64_t offset);
+    void logReadDatagrams(void);
+    void syncClockNext(int samples, int bestRtt, clockFuncCb done);
+
+    int                    mEpollFd;
+    rcci_async_state_t     mState;
+    stateFuncCb            mStateCb;
+    logFuncCb              mLogCb;
+    asyncClock::duration   mTimeout;
+
+    struct sockaddr_in     mServAddr;
+    int                    mSockFd;
+    bool                   mTcpConnecting;
+    asyncClock::time_point mConnectDeadline;
+    asyncClock::duration   mBackoff;
+    asyncClock::time_point mReconnectTime;
+
+    uint16_t               mMagic;
+    uint16_t               mVersion;
+    int                    mLogPort;
+    int                    mDrvPort;
+    int                    mVideoPort;
+
+    std::string            mTxBuf;   // not yet written requests
+    bool                   mTxWait;  // EPOLLOUT armed
+    std::string            mRxBuf;   // partial reply
+    std::deque<rcci_async_req_t> mRequests; // replies come in order
+
+    rcci_async_service_t   mLog;
+    rcci_async_service_t   mDrv;
+    rcci_async_service_t   mVideo;
+    rcciVideoRx           *mVideoRx;
+    rcci_msg_drv_ctrl_t    mDrvMsg;
+
+    bool                   mLogFetching;   // datagrams wait in the socket
+    bool                   mLogSynced;     // mLogNextOffset is known, it is
+                                           // read from on registration
+    uint64_t               mLogNextOffset;
+    bool                   mLogSeqSynced;
+    uint32_t               mLogSeq;
+    uint64_t               mLogLost;
+    uint64_t               mLogMissing;
+
+    int64_t                mClockOffset;
+};
+
+#endif // __RCCI_ASYNC_CLIENT_H
@@ -1,23 +1,33 @@
 #include <cstring>
 #include <cerrno>
 #include <iostream>
+#include <algorithm>
 #include <unistd.h>
+#include <time.h>
+#include <poll.h>
 
 #include "rcci_client.h"
+#include "rcci_crc.h"
 
 
-const int cLogMaxBufRead(1024);
+const int cVideoRcvBuf(1 << 20); // room for a few frames sent in bursts
+const int cReplyTimeoutMs(1000); // older servers do not reply to new messages
 
 rcciClient::rcciClient(void)
     : mPort(-1),mSockFd(-1),mServer(NULL),
-      mMagic(0), mVersion(0), mLogPort(-1), mLogFd(-1),
-      mDrvPort(-1), mDrvFd(-1)
+      mMagic(0), mVersion(0), mLogPort(-1), mLogFd(-1), mLogSynced(false),
+      mLogNextOffset(0), mLogSeqSynced(false), mLogSeq(0), mLogLost(0),
+      mLogMissing(0),
+      mLogGapFrom(0), mLogGapTo(0),
+      mDrvPort(-1), mDrvFd(-1), mVideoPort(-1), mVideoFd(-1),
+      mClockOffset(0)
 {
-
+    memset(&mDrvMsg, 0, sizeof(mDrvMsg));
 }
 
 rcciClient::~rcciClient(void)
 {
+    videoDisconnect();
     drvDisconnect();
     logDisconnect();
     disconnect();
@@ -115,6 +125,7 @@ int rcciClient::sendInitMsg(void)
     initMsg.header.magic = rcci_msg_init_magic;
     initMsg.header.ver   = rcci_msg_init_ver;
     initMsg.header.size  = sizeof(rcci_msg_init_t);
+    rcciMsgSetCrc(&initMsg, sizeof(initMsg));
 
     bytes = write(mSockFd, &initMsg, sizeof(rcci_msg_init_t));
     if(bytes < 0)
@@ -133,19 +144,27 @@ int rcciClient::sendInitMsg(void)
         return -1;
     }
 
+    // servers without video service reply with the shorter message
     if((initMsg.status != rcci_status_ack) ||
-       (bytes != sizeof(rcci_msg_init_t)))
+       ((bytes != sizeof(rcci_msg_init_t)) &&
+        (bytes != rcci_msg_init_size_v1)))
     {
         std::cerr << "read() failed (" << bytes << " != " <<
             sizeof(rcci_msg_init_t) << ") or wrong status: " <<
             initMsg.status << std::endl;
         return -1;
     }
+    if(!rcciMsgCheckCrc(&initMsg, bytes))
+    {
+        std::cerr << "sendInitMsg() reply CRC mismatch" << std::endl;
+        return -1;
+    }
 
     mMagic   = initMsg.header.magic;
     mVersion = initMsg.header.ver;
     mLogPort = initMsg.log_port;
     mDrvPort = initMsg.drv_port;
+    mVideoPort = (bytes == sizeof(rcci_msg_init_t)) ? initMsg.video_port : -1;
 
     return 0;
 }
@@ -186,19 +205,123 @@ int rcciClient::serviceConnect(int aServPort, int &aServFd,
 
 int rcciClient::logConnect(std::string &aStr, bool fullLog)
 {
+    return logStart(aStr, fullLog, 0);
+}
+
+int rcciClient::logResume(std::string &aStr, uint64_t offset)
+{
+    return logStart(aStr, true, offset);
+}
+
+// Registers first, then reads the history up to the end the server reports
+// - text logged meanwhile arrives in datagrams too, logReadData() skips it
+int rcciClient::logStart(std::string &aStr, bool history, uint64_t offset)
+{
+    aStr.clear();
     if(serviceConnect(mLogPort, mLogFd, mLogAddr) < 0)
     {
         return -1;
     }
+    mLogSynced    = false;
+    mLogSeqSynced = false;
 
-    if(registerLog(fullLog, aStr) < 0)
+    if(registerLog() < 0)
     {
         return -1;
     }
 
+    if(!history)
+    {
+        return mLogFd;
+    }
+
+    uint64_t end = offset + 1;
+    while(offset < end)
+    {
+        std::string chunk;
+        uint64_t start;
+
+        if(logFetch(offset, rcci_msg_log_read_max, chunk, start, end) < 0)
+        {
+            return -1;
+        }
+        if(start > offset)
+        {
+            // not kept by the server anymore
+            mLogMissing += start - offset;
+            mLogGapFrom  = offset;
+            mLogGapTo    = start;
+        }
+        aStr.append(chunk);
+        offset = start + chunk.length();
+        if(chunk.empty())
+        {
+            break;
+        }
+    }
+
+    mLogNextOffset = offset;
+    mLogSynced     = true;
+
     return mLogFd;
 }
 
+int rcciClient::logFetch(uint64_t offset, size_t maxBytes, std::string &aStr,
+                         uint64_t &start, uint64_t &end)
+{
+    rcci_msg_log_read_t msg;
+
+    if(!isConnected())
+    {
+        std::cerr << "logFetch() not connected to server" << std::endl;
+        return -1;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.header.type  = rcci_msg_log_read;
+    msg.header.magic = mMagic;
+    msg.header.ver   = mVersion;
+    msg.header.size  = sizeof(rcci_msg_log_read_t);
+    msg.offset       = offset;
+    msg.max_size     = std::min(maxBytes, (size_t)rcci_msg_log_read_max);
+    rcciMsgSetCrc(&msg, sizeof(msg));
+
+    if(write(mSockFd, &msg, sizeof(msg)) != sizeof(msg))
+    {
+        std::cerr << "logFetch() write() failed: " << strerror(errno) <<
+            std::endl;
+        return -1;
+    }
+
+    if(readReply(&msg, sizeof(msg)) < 0)
+    {
+        return -1;
+    }
+    if((msg.header.type != rcci_msg_log_read) ||
+       (msg.size > rcci_msg_log_read_max) ||
+       (msg.header.size != (sizeof(msg) + msg.size)))
+    {
+        std::cerr << "logFetch() wrong reply" << std::endl;
+        return -1;
+    }
+
+    aStr.resize(msg.size);
+    if((msg.size > 0) && (readReply(&aStr[0], msg.size) < 0))
+    {
+        return -1;
+    }
+    if(!rcciMsgCheckCrc(&msg, sizeof(msg), aStr.data(), aStr.length()))
+    {
+        std::cerr << "logFetch() reply CRC mismatch" << std::endl;
+        return -1;
+    }
+
+    start = msg.offset;
+    end   = msg.end;
+
+    return msg.size;
+}
+
 int rcciClient::logDisconnect(void)
 {
     if(mLogFd < 0)
@@ -213,33 +336,109 @@ int rcciClient::logDisconnect(void)
     return 0;
 }
 
-int rcciClient::logReadData(std::string &aStr)
+int rcciClient::logWaitData(int timeoutMs)
+{
+    if(mLogFd < 0)
+    {
+        return -1;
+    }
+
+    struct pollfd pfd = { mLogFd, POLLIN, 0 };
+    int retVal = poll(&pfd, 1, timeoutMs);
+    if(retVal < 0)
+    {
+        if(errno == EINTR)
+        {
+            return 0;
+        }
+        std::cerr << "logWaitData() poll() failed: " << strerror(errno) <<
+            std::endl;
+        return -1;
+    }
+    // pending socket error (POLLERR) is returned and cleared by recv()
+    if((retVal > 0) && (pfd.revents & POLLNVAL))
+    {
+        return -1;
+    }
+
+    return (retVal > 0) ? 1 : 0;
+}
+
+// Datagrams are checked by CRC, gaps in the offsets are counted (lost
+// datagrams or text dropped by the server) - the range can be read again
+// from the server log
+int rcciClient::logReadData(std::string &aStr, uint64_t *offset)
 {
     ssize_t bytes;
-    char buf[cLogMaxBufRead];
+    uint8_t buf[rcci_msg_log_max_size];
+    rcci_msg_log_t hdr;
 
+    aStr.clear();
     if(!isConnected())
     {
         std::cerr << "logReadData() client not connected" << std::endl;
         return -1;
     }
 
-    struct sockaddr_in sockAddr;
-    socklen_t sockLen;
-    memcpy(&sockAddr, &mLogAddr, sizeof(struct sockaddr_in));
-
-    bytes = recvfrom(mLogFd, &buf, cLogMaxBufRead, 0,
-                     (struct sockaddr *)&sockAddr, &sockLen);
+    bytes = recv(mLogFd, buf, sizeof(buf), 0);
     if(bytes < 0)
     {
-        std::cerr << "logReadData() recvfrom() failed: " <<
+        std::cerr << "logReadData() recv() failed: " <<
             strerror(errno) << std::endl;
         return -1;
     }
 
-    aStr = std::string(buf, bytes);
+    if((size_t)bytes < sizeof(hdr))
+    {
+        return 0;
+    }
+    memcpy(&hdr, buf, sizeof(hdr));
+    if((hdr.header.type != rcci_msg_log) || (hdr.header.size != bytes) ||
+       !rcciMsgCheckCrc(buf, bytes))
+    {
+        std::cerr << "logReadData() invalid datagram" << std::endl;
+        return 0;
+    }
 
-    return bytes;
+    if(mLogSeqSynced && ((int32_t)(hdr.seq - mLogSeq) > 0))
+    {
+        mLogLost += hdr.seq - mLogSeq;
+    }
+    if(!mLogSeqSynced || ((int32_t)(hdr.seq - mLogSeq) >= 0))
+    {
+        mLogSeq       = hdr.seq + 1;
+        mLogSeqSynced = true;
+    }
+
+    size_t len = bytes - sizeof(hdr);
+    size_t skip = 0;
+    if(mLogSynced && (hdr.offset < mLogNextOffset))
+    {
+        // already read (history read while registering, reordering)
+        skip = std::min((uint64_t)len, mLogNextOffset - hdr.offset);
+        len -= skip;
+        hdr.offset += skip;
+    }
+
+    if(!mLogSynced || (hdr.offset >= mLogNextOffset))
+    {
+        if(mLogSynced && (hdr.offset > mLogNextOffset))
+        {
+            mLogMissing += hdr.offset - mLogNextOffset;
+            mLogGapFrom  = mLogNextOffset;
+            mLogGapTo    = hdr.offset;
+        }
+        mLogNextOffset = hdr.offset + len;
+        mLogSynced     = true;
+    }
+
+    aStr.assign((const char *)buf + sizeof(hdr) + skip, len);
+    if(offset)
+    {
+        *offset = hdr.offset;
+    }
+
+    return len;
 }
 
 int rcciClient::drvConnect(void)
@@ -278,6 +477,7 @@ int rcciClient::drvSendData(int32_t drive, int32_t steer)
     mDrvMsg.count++;
     mDrvMsg.drive = drive;
     mDrvMsg.steer = steer;
+    rcciDrvSetCrc(mDrvMsg);
 
     ssize_t bytes = sendto(mDrvFd, &mDrvMsg, sizeof(mDrvMsg), 0,
                            (struct sockaddr *)&mDrvAddr, sizeof(mDrvAddr));
@@ -296,8 +496,140 @@ int rcciClient::drvSendData(int32_t drive, int32_t steer)
     return bytes;
 }
 
+int rcciClient::videoConnect(void)
+{
+    if(serviceConnect(mVideoPort, mVideoFd, mVideoAddr) < 0)
+    {
+        return -1;
+    }
+
+    int rcvBuf = cVideoRcvBuf;
+    if(setsockopt(mVideoFd, SOL_SOCKET, SO_RCVBUF, &rcvBuf,
+                  sizeof(rcvBuf)) < 0)
+    {
+        std::cerr << "videoConnect() can not set receive buffer: " <<
+            strerror(errno) << std::endl;
+    }
+
+    // params - highest video fragment version rcciVideoRx understands
+    if(registerService(rcci_client_flag_video, mVideoFd, rcci_msg_video_v2) < 0)
+    {
+        close(mVideoFd);
+        mVideoFd = -1;
+        return -1;
+    }
+
+    return mVideoFd;
+}
+
+int rcciClient::videoDisconnect(void)
+{
+    if(mVideoFd < 0)
+    {
+        return 0;
+    }
+
+    if(isConnected())
+    {
+        unregisterService(rcci_client_flag_video, mVideoFd);
+    }
+
+    close(mVideoFd);
+    mVideoFd = -1;
+    return 0;
+}
+
+int rcciClient::readReply(void *buf, size_t len)
+{
+    size_t got = 0;
+
+    while(got < len)
+    {
+        struct pollfd pfd = { mSockFd, POLLIN, 0 };
+        if(poll(&pfd, 1, cReplyTimeoutMs) <= 0)
+        {
+            std::cerr << "readReply() no reply from server" << std::endl;
+            return -1;
+        }
+
+        ssize_t bytes = read(mSockFd, (uint8_t *)buf + got, len - got);
+        if(bytes <= 0)
+        {
+            std::cerr << "readReply() read() failed, received " << got <<
+                " of " << len << std::endl;
+            return -1;
+        }
+        got += bytes;
+    }
+
+    return got;
+}
+
+static uint64_t monotonicUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// Server time is assumed to be taken in the middle of the exchange, error
+// of the offset is at most half of the RTT
+int rcciClient::syncClock(int samples)
+{
+    rcci_msg_time_sync_t msg;
+    int64_t bestRtt = -1;
+
+    if(!isConnected())
+    {
+        std::cerr << "syncClock() not connected to server" << std::endl;
+        return -1;
+    }
+
+    for(int i = 0; i < samples; i++)
+    {
+        memset(&msg, 0, sizeof(msg));
+        msg.header.type  = rcci_msg_time_sync;
+        msg.header.magic = mMagic;
+        msg.header.ver   = mVersion;
+        msg.header.size  = sizeof(rcci_msg_time_sync_t);
+        msg.client_us    = monotonicUs();
+        rcciMsgSetCrc(&msg, sizeof(msg));
+
+        if(write(mSockFd, &msg, sizeof(msg)) != sizeof(msg))
+        {
+            std::cerr << "syncClock() write() failed: " <<
+                strerror(errno) << std::endl;
+            return -1;
+        }
+
+        if(readReply(&msg, sizeof(msg)) < 0)
+        {
+            return -1;
+        }
+        uint64_t rxUs = monotonicUs();
+
+        if((msg.header.type != rcci_msg_time_sync) ||
+           (msg.header.size != sizeof(msg)) ||
+           !rcciMsgCheckCrc(&msg, sizeof(msg)))
+        {
+            std::cerr << "syncClock() wrong reply or CRC mismatch" << std::endl;
+            return -1;
+        }
+
+        int64_t rtt = rxUs - msg.client_us;
+        if((bestRtt < 0) || (rtt < bestRtt))
+        {
+            bestRtt = rtt;
+            mClockOffset = (int64_t)msg.server_us -
+                (int64_t)((msg.client_us + rxUs) / 2);
+        }
+    }
+
+    return (int)bestRtt;
+}
+
 int rcciClient::registerService(rcci_client_flags_t service, int srvFd,
-                                const int params)
+                                const int params, std::string *extra)
 {
     rcci_msg_reg_service_t msg;
     ssize_t bytes;
@@ -319,6 +651,7 @@ int rcciClient::registerService(rcci_client_flags_t service, int srvFd,
     msg.service      = service;
     memcpy(&msg.sockaddr, &sockAddr, sizeof(struct sockaddr_in));
     msg.params       = params;
+    rcciMsgSetCrc(&msg, sizeof(msg));
 
     bytes = write(mSockFd, &msg, sizeof(rcci_msg_reg_service_t));
     if(bytes < 0)
@@ -346,6 +679,7 @@ int rcciClient::registerService(rcci_client_flags_t service, int srvFd,
     if((msg.header.magic != mMagic)               ||
        (msg.header.ver   != mVersion)             ||
        (msg.header.type  != rcci_msg_reg_service) ||
+       (msg.header.size  < sizeof(rcci_msg_reg_service_t)) ||
        (bytes != sizeof(rcci_msg_reg_service_t)))
     {
         std::cerr << "read() failed (" << bytes << " != " <<
@@ -356,6 +690,31 @@ int rcciClient::registerService(rcci_client_flags_t service, int srvFd,
         return -1;
     }
 
+    // Readout also remaining stuff (full log) - CRC covers it as well
+    std::string rem(msg.header.size - sizeof(rcci_msg_reg_service_t), '\0');
+    size_t got = 0;
+    while(got < rem.size())
+    {
+        bytes = read(mSockFd, &rem[got], rem.size() - got);
+        if(bytes <= 0)
+        {
+            std::cerr << "read() failed, expected " << rem.size() <<
+                " received " << got << std::endl;
+            return -1;
+        }
+        got += bytes;
+    }
+
+    if(!rcciMsgCheckCrc(&msg, sizeof(msg), rem.data(), rem.size()))
+    {
+        std::cerr << "registerService() reply CRC mismatch" << std::endl;
+        return -1;
+    }
+    if(extra)
+    {
+        extra->swap(rem);
+    }
+
     return msg.header.size;
 }
 
@@ -381,6 +740,7 @@ int rcciClient::unregisterService(rcci_client_flags_t service, int srvFd)
     msg.service      = service;
     memcpy(&msg.sockaddr, &sockAddr, sizeof(struct sockaddr_in));
     msg.params       = 0;
+    rcciMsgSetCrc(&msg, sizeof(msg));
 
     bytes = write(mSockFd, &msg, sizeof(rcci_msg_reg_service_t));
     if(bytes < 0)
@@ -399,6 +759,14 @@ int rcciClient::unregisterService(rcci_client_flags_t service, int srvFd)
         return -1;
     }
 
+    if((bytes != sizeof(rcci_msg_reg_service_t)) ||
+       !rcciMsgCheckCrc(&msg, sizeof(msg)))
+    {
+        std::cerr << "unregisterService() wrong reply or CRC mismatch" <<
+            std::endl;
+        return -1;
+    }
+
     if(msg.status != rcci_status_ack)
     {
         std::cerr << "Service unregister denied by server!" << std::endl;
@@ -411,39 +779,13 @@ int rcciClient::unregisterService(rcci_client_flags_t service, int srvFd)
     return 0;
 }
 
-int rcciClient::registerLog(bool fullLog, std::string &aStr)
+int rcciClient::registerLog(void)
 {
-    int msg_size = -1;
-    ssize_t bytes;
-
-    msg_size = registerService(rcci_client_flag_log, mLogFd,
-                               (fullLog ? 1 : 0));
-    if(msg_size < 0)
+    if(registerService(rcci_client_flag_log, mLogFd, 0) < 0)
     {
         std::cerr << "registerService() for logging failed!" << std::endl;
         return -1;
     }
 
-    // Readout also remaining stuff - it is the log file
-    if(fullLog && ((msg_size - sizeof(rcci_msg_reg_service_t)) > 0))
-    {
-        char *log;
-        int remBytes = msg_size - sizeof(rcci_msg_reg_service_t);
-
-        log = new char [remBytes];
-
-        bytes = read(mSockFd, log, remBytes);
-        if(bytes != remBytes)
-        {
-            std::cerr << "read() failed, expected " << remBytes <<
-                " receiver " <<  bytes << std::endl;
-            return -1;
-        }
-
-        aStr = std::string(log); // clear
-
-        delete [] log;
-    }
-
     return 0;
 }
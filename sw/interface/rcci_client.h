@@ -23,26 +23,63 @@ public:
     // RCCI specific things
     int sendInitMsg(void);
 
-    // logging
+    // logging - aStr gets the log history kept by the server (full_log) or
+    // everything from 'offset' (logResume(), e.g. logOffset() of previous
+    // connection), live text is read with logReadData()
     int logConnect(std::string &aStr, bool full_log = true);
+    int logResume(std::string &aStr, uint64_t offset);
     int logDisconnect(void);
-    int logReadData(std::string &aStr);
+    // waits up to timeoutMs for a log datagram: 1 - readable, 0 - timeout,
+    // -1 - not connected or error
+    int logWaitData(int timeoutMs);
+    // text of one log datagram (empty if invalid), offset - its position
+    // in the server log stream
+    int logReadData(std::string &aStr, uint64_t *offset = NULL);
+    // log bytes lost so far (gaps in offsets) and the latest gap, datagrams
+    // lost in the network (gaps in sequence numbers)
+    uint64_t logMissing(void) { return mLogMissing; };
+    uint64_t logOffset(void) { return mLogNextOffset; };
+    uint64_t logLostDatagrams(void) { return mLogLost; };
+    bool     logLastGap(uint64_t &from, uint64_t &to)
+    {
+        from = mLogGapFrom;
+        to   = mLogGapTo;
+        return (mLogGapTo > mLogGapFrom);
+    };
+    // One chunk of the server log from 'offset' (over the control
+    // connection), start - offset of the returned text, end - end of the
+    // server log, returns text length or -1
+    int logFetch(uint64_t offset, size_t maxBytes, std::string &aStr,
+                 uint64_t &start, uint64_t &end);
 
     // Drive data
     int drvConnect(void);
     int drvDisconnect(void);
     int drvSendData(int32_t drive, int32_t steer);
 
+    // Unicast video - returns UDP socket the frames arrive to (rcciVideoRx)
+    int videoConnect(void);
+    int videoDisconnect(void);
+
+    // Clock synchronization with the server over the control connection,
+    // keeps the exchange with lowest RTT, returns its RTT [us] or -1
+    int     syncClock(int samples = 8);
+    // server CLOCK_MONOTONIC = local CLOCK_MONOTONIC + offset [us]
+    int64_t serverClockOffset(void) { return mClockOffset; };
+
 private:
     int serviceConnect(int mServPort, int &mServFd,
                        struct sockaddr_in &mServAddr);
 
+    // data following the reply (full log) is returned in 'extra'
     int registerService(rcci_client_flags_t service, int srvFd,
-                        const int param);
+                        const int param, std::string *extra = NULL);
     int unregisterService(rcci_client_flags_t service, int srvFd);
 
-    // Logging service is 'special' because of full log readback
-    int registerLog(bool fullLog, std::string &aStr);
+    int logStart(std::string &aStr, bool history, uint64_t offset);
+    int registerLog(void);
+    // reads exactly len bytes of a reply on the control connection
+    int readReply(void *buf, size_t len);
 
     int registerDrv(const struct sockaddr_in &sockAddr);
     int unregisterDrv(const struct sockaddr_in &sockAddr);
@@ -59,11 +96,24 @@ private:
     int                mLogPort;
     int                mLogFd;
     struct sockaddr_in mLogAddr;
+    bool               mLogSynced;     // mLogNextOffset is known
+    uint64_t           mLogNextOffset; // of the next expected text byte
+    bool               mLogSeqSynced;  // mLogSeq is known
+    uint32_t           mLogSeq;        // next expected datagram
+    uint64_t           mLogLost;
+    uint64_t           mLogMissing;
+    uint64_t           mLogGapFrom, mLogGapTo;
 
     int                 mDrvPort;
     int                 mDrvFd;
     rcci_msg_drv_ctrl_t mDrvMsg;
     struct sockaddr_in  mDrvAddr;
+
+    int                mVideoPort;
+    int                mVideoFd;
+    struct sockaddr_in mVideoAddr;
+
+    int64_t            mClockOffset;
 };
 
 #endif // __RCCI_CLIENT_H
@@ -0,0 +1,218 @@
+#include <cstring>
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#elif defined(__SSE4_2__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include "rcci_crc.h"
+
+const uint32_t cCrc32cPoly(0x82F63B78); // reflected Castagnoli polynomial
+
+// Slicing-by-8 tables: table[0] is the classic byte-wise table, table[k]
+// advances CRC of a byte followed by k zero bytes
+typedef struct rcci_crc32c_tables_s {
+    uint32_t table[8][256];
+
+    rcci_crc32c_tables_s(void)
+    {
+        for(uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = i;
+            for(int j = 0; j < 8; j++)
+            {
+                crc = (crc >> 1) ^ ((crc & 1) ? cCrc32cPoly : 0);
+            }
+            table[0][i] = crc;
+        }
+        for(uint32_t i = 0; i < 256; i++)
+        {
+            for(int k = 1; k < 8; k++)
+            {
+                table[k][i] = (table[k-1][i] >> 8) ^
+                    table[0][table[k-1][i] & 0xff];
+            }
+        }
+    };
+} rcci_crc32c_tables_t;
+
+static const rcci_crc32c_tables_t &crc32cTables(void)
+{
+    // built on first use, thread-safe static initialization
+    static const rcci_crc32c_tables_t tables;
+    return tables;
+}
+
+uint32_t rcciCrc32cSw(uint32_t crc, const void *data, size_t len)
+{
+    const uint32_t (*t)[256] = crc32cTables().table;
+    const uint8_t *p = (const uint8_t *)data;
+
+    crc = ~crc;
+
+#if !defined(__BYTE_ORDER__) || (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    while(len >= 8)
+    {
+        uint32_t lo, hi;
+
+        memcpy(&lo, p, sizeof(lo));
+        memcpy(&hi, p + 4, sizeof(hi));
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+            t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+            t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+            t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        p   += 8;
+        len -= 8;
+    }
+#endif
+
+    while(len--)
+    {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+    }
+
+    return ~crc;
+}
+
+#if defined(__ARM_FEATURE_CRC32)
+
+const char *rcciCrc32cHw(void)
+{
+    return "ARMv8 CRC32";
+}
+
+uint32_t rcciCrc32c(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    crc = ~crc;
+    while(len && ((uintptr_t)p & 7))
+    {
+        crc = __crc32cb(crc, *p++);
+        len--;
+    }
+    while(len >= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc = __crc32cd(crc, v);
+        p   += 8;
+        len -= 8;
+    }
+    while(len--)
+    {
+        crc = __crc32cb(crc, *p++);
+    }
+
+    return ~crc;
+}
+
+#elif defined(__SSE4_2__) && defined(__x86_64__)
+
+const char *rcciCrc32cHw(void)
+{
+    return "SSE4.2 CRC32";
+}
+
+uint32_t rcciCrc32c(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t crc64;
+
+    crc = ~crc;
+    while(len && ((uintptr_t)p & 7))
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+    crc64 = crc;
+    while(len >= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc64 = _mm_crc32_u64(crc64, v);
+        p   += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while(len--)
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+
+    return ~crc;
+}
+
+#else
+
+const char *rcciCrc32cHw(void)
+{
+    return NULL;
+}
+
+uint32_t rcciCrc32c(uint32_t crc, const void *data, size_t len)
+{
+    return rcciCrc32cSw(crc, data, len);
+}
+
+#endif
+
+uint32_t rcciMsgCrc(const void *msg, size_t len,
+                    const void *payload, size_t payloadLen)
+{
+    const size_t crcOff = offsetof(rcci_msg_header_t, crc);
+    const size_t crcEnd = crcOff + sizeof(uint32_t);
+    const uint8_t *p = (const uint8_t *)msg;
+    const uint32_t zero = 0;
+    uint32_t crc;
+
+    if(len < sizeof(rcci_msg_header_t))
+    {
+        return rcciCrc32c(0, msg, len);
+    }
+
+    crc = rcciCrc32c(0, p, crcOff);
+    crc = rcciCrc32c(crc, &zero, sizeof(zero));
+    crc = rcciCrc32c(crc, p + crcEnd, len - crcEnd);
+    if(payload && payloadLen)
+    {
+        crc = rcciCrc32c(crc, payload, payloadLen);
+    }
+
+    return crc;
+}
+
+void rcciMsgSetCrc(void *msg, size_t len,
+                   const void *payload, size_t payloadLen)
+{
+    uint32_t crc = rcciMsgCrc(msg, len, payload, payloadLen);
+
+    memcpy((uint8_t *)msg + offsetof(rcci_msg_header_t, crc), &crc, sizeof(crc));
+}
+
+bool rcciMsgCheckCrc(const void *msg, size_t len,
+                     const void *payload, size_t payloadLen)
+{
+    uint32_t crc;
+
+    if(len < sizeof(rcci_msg_header_t))
+    {
+        return false;
+    }
+    memcpy(&crc, (const uint8_t *)msg + offsetof(rcci_msg_header_t, crc),
+           sizeof(crc));
+
+    return (crc == rcciMsgCrc(msg, len, payload, payloadLen));
+}
+
+void rcciDrvSetCrc(rcci_msg_drv_ctrl_t &msg)
+{
+    msg.crc = rcciCrc32c(0, &msg, offsetof(rcci_msg_drv_ctrl_t, crc));
+}
+
+bool rcciDrvCheckCrc(const rcci_msg_drv_ctrl_t &msg)
+{
+    return (msg.crc == rcciCrc32c(0, &msg, offsetof(rcci_msg_drv_ctrl_t, crc)));
+}
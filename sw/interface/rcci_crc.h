@@ -0,0 +1,37 @@
+#ifndef __RCCI_CRC_H
+#define __RCCI_CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "rcci_type.h"
+
+/*! CRC-32C (Castagnoli, reflected 0x82F63B78) as used by iSCSI/ext4.
+  Start with crc = 0, result of one call can be passed as crc to the next
+  one to continue over more buffers. Uses CRC instructions when built for
+  them (ARMv8 CRC extension - __ARM_FEATURE_CRC32, x86-64 SSE4.2),
+  slicing-by-8 tables otherwise.
+*/
+uint32_t rcciCrc32c(uint32_t crc, const void *data, size_t len);
+//! Always the table implementation (self-check & benchmarks)
+uint32_t rcciCrc32cSw(uint32_t crc, const void *data, size_t len);
+//! Name of instructions used by rcciCrc32c() or NULL when tables are used
+const char *rcciCrc32cHw(void);
+
+/*! CRC of a message as it goes over the wire: 'len' bytes of 'msg' (starts
+  with rcci_msg_header_t) followed by optional 'payload' sent as separate
+  buffer (iovec, full log behind reg_service reply). header.crc is counted
+  as 0.
+*/
+uint32_t rcciMsgCrc(const void *msg, size_t len,
+                    const void *payload = NULL, size_t payloadLen = 0);
+void     rcciMsgSetCrc(void *msg, size_t len,
+                       const void *payload = NULL, size_t payloadLen = 0);
+bool     rcciMsgCheckCrc(const void *msg, size_t len,
+                         const void *payload = NULL, size_t payloadLen = 0);
+
+//! Drive message has no header - CRC covers all fields in front of crc
+void     rcciDrvSetCrc(rcci_msg_drv_ctrl_t &msg);
+bool     rcciDrvCheckCrc(const rcci_msg_drv_ctrl_t &msg);
+
+#endif // __RCCI_CRC_H
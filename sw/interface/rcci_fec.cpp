@@ -0,0 +1,328 @@
+#include <cstring>
+#include <vector>
+#include <utility>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RCCI_FEC_NEON
+#include <arm_neon.h>
+#endif
+
+#include "rcci_fec.h"
+
+const int cGfPoly(0x11d); // x^8 + x^4 + x^3 + x^2 + 1
+
+// GF(2^8) arithmetic tables. mul[c] is the table for multiplying by c,
+// mulLo/mulHi split it to nibbles for vector table lookups.
+typedef struct rcci_gf_tables_s {
+    uint8_t exp[512];
+    uint8_t log[256];
+    uint8_t mul[256][256];
+    uint8_t mulLo[256][16];
+    uint8_t mulHi[256][16];
+
+    rcci_gf_tables_s(void)
+    {
+        int x = 1;
+        for(int i = 0; i < 255; i++)
+        {
+            exp[i] = x;
+            exp[i + 255] = x;
+            log[x] = i;
+            x <<= 1;
+            if(x & 0x100)
+            {
+                x ^= cGfPoly;
+            }
+        }
+        exp[510] = exp[511] = 0;
+        log[0] = 0; // never used
+
+        for(int a = 0; a < 256; a++)
+        {
+            for(int b = 0; b < 256; b++)
+            {
+                mul[a][b] = (a && b) ? exp[log[a] + log[b]] : 0;
+            }
+            for(int n = 0; n < 16; n++)
+            {
+                mulLo[a][n] = mul[a][n];
+                mulHi[a][n] = mul[a][n << 4];
+            }
+        }
+    };
+} rcci_gf_tables_t;
+
+static const rcci_gf_tables_t &gfTables(void)
+{
+    // built on first use, thread-safe static initialization
+    static const rcci_gf_tables_t tables;
+    return tables;
+}
+
+static inline uint8_t gfInv(const rcci_gf_tables_t &gf, uint8_t a)
+{
+    return gf.exp[255 - gf.log[a]];
+}
+
+// Parity matrix: Cauchy 1 / (x_j + y_i) with x_j = numData + j, y_i = i,
+// columns scaled so parity row 0 is all ones. Scaling keeps every square
+// submatrix invertible, so any numParity erasures can be recovered.
+static inline uint8_t coef(const rcci_gf_tables_t &gf, int numData,
+                           int j, int i)
+{
+    if(j == 0)
+    {
+        return 1;
+    }
+    return gf.mul[numData ^ i][gfInv(gf, (numData + j) ^ i)];
+}
+
+// dst ^= c * src
+static void mulAdd(const rcci_gf_tables_t &gf, uint8_t *dst,
+                   const uint8_t *src, uint8_t c, size_t len)
+{
+    size_t i = 0;
+
+    if(c == 0)
+    {
+        return;
+    }
+    if(c == 1)
+    {
+        for(; (i + 8) <= len; i += 8)
+        {
+            uint64_t a, b;
+            memcpy(&a, dst + i, sizeof(a));
+            memcpy(&b, src + i, sizeof(b));
+            a ^= b;
+            memcpy(dst + i, &a, sizeof(a));
+        }
+    }
+    else
+    {
+#ifdef RCCI_FEC_NEON
+        uint8x8x2_t tLo, tHi;
+        const uint8x8_t mask = vdup_n_u8(0x0f);
+
+        tLo.val[0] = vld1_u8(&gf.mulLo[c][0]);
+        tLo.val[1] = vld1_u8(&gf.mulLo[c][8]);
+        tHi.val[0] = vld1_u8(&gf.mulHi[c][0]);
+        tHi.val[1] = vld1_u8(&gf.mulHi[c][8]);
+        for(; (i + 8) <= len; i += 8)
+        {
+            uint8x8_t s = vld1_u8(src + i);
+            uint8x8_t p = veor_u8(vtbl2_u8(tLo, vand_u8(s, mask)),
+                                  vtbl2_u8(tHi, vshr_n_u8(s, 4)));
+            vst1_u8(dst + i, veor_u8(vld1_u8(dst + i), p));
+        }
+#endif
+        const uint8_t *m = gf.mul[c];
+        for(; (i + 4) <= len; i += 4)
+        {
+            dst[i]     ^= m[src[i]];
+            dst[i + 1] ^= m[src[i + 1]];
+            dst[i + 2] ^= m[src[i + 2]];
+            dst[i + 3] ^= m[src[i + 3]];
+        }
+    }
+
+    for(; i < len; i++)
+    {
+        dst[i] ^= gf.mul[c][src[i]];
+    }
+}
+
+int rcciFecNumParity(int numData, int parityPercent)
+{
+    int numParity;
+
+    if((numData <= 0) || (parityPercent <= 0))
+    {
+        return 0;
+    }
+
+    numParity = (numData * parityPercent + 99) / 100;
+    if(numParity > (rcciFecMaxShards - numData))
+    {
+        numParity = rcciFecMaxShards - numData;
+    }
+
+    return (numParity > 0) ? numParity : 0;
+}
+
+bool rcciFecEncode(const uint8_t * const *data, const size_t *dataLen,
+                   int numData, uint8_t * const *parity, int numParity,
+                   size_t shardSize)
+{
+    const rcci_gf_tables_t &gf = gfTables();
+
+    if((numData <= 0) || (numParity < 0) ||
+       ((numData + numParity) > rcciFecMaxShards))
+    {
+        return false;
+    }
+
+    for(int j = 0; j < numParity; j++)
+    {
+        memset(parity[j], 0, shardSize);
+        for(int i = 0; i < numData; i++)
+        {
+            size_t len = (dataLen[i] < shardSize) ? dataLen[i] : shardSize;
+            mulAdd(gf, parity[j], data[i], coef(gf, numData, j, i), len);
+        }
+    }
+
+    return true;
+}
+
+// Gauss-Jordan inversion of n x n matrix (row major) in place
+static bool invertMatrix(const rcci_gf_tables_t &gf, std::vector<uint8_t> &a,
+                         int n)
+{
+    std::vector<uint8_t> inv(n * n, 0);
+
+    for(int i = 0; i < n; i++)
+    {
+        inv[i * n + i] = 1;
+    }
+
+    for(int col = 0; col < n; col++)
+    {
+        int pivot = col;
+        while((pivot < n) && (a[pivot * n + col] == 0))
+        {
+            pivot++;
+        }
+        if(pivot == n)
+        {
+            return false;
+        }
+        if(pivot != col)
+        {
+            for(int k = 0; k < n; k++)
+            {
+                std::swap(a[pivot * n + k], a[col * n + k]);
+                std::swap(inv[pivot * n + k], inv[col * n + k]);
+            }
+        }
+
+        uint8_t scale = gfInv(gf, a[col * n + col]);
+        for(int k = 0; k < n; k++)
+        {
+            a[col * n + k]   = gf.mul[scale][a[col * n + k]];
+            inv[col * n + k] = gf.mul[scale][inv[col * n + k]];
+        }
+
+        for(int row = 0; row < n; row++)
+        {
+            uint8_t f = a[row * n + col];
+            if((row == col) || (f == 0))
+            {
+                continue;
+            }
+            for(int k = 0; k < n; k++)
+            {
+                a[row * n + k]   ^= gf.mul[f][a[col * n + k]];
+                inv[row * n + k] ^= gf.mul[f][inv[col * n + k]];
+            }
+        }
+    }
+
+    a.swap(inv);
+    return true;
+}
+
+int rcciFecDecode(uint8_t * const *data, const size_t *dataLen,
+                  const bool *dataPresent, int numData,
+                  const uint8_t * const *parity, const bool *parityPresent,
+                  int numParity, size_t shardSize)
+{
+    const rcci_gf_tables_t &gf = gfTables();
+    std::vector<int> missing, rows;
+
+    if((numData <= 0) || (numParity < 0) ||
+       ((numData + numParity) > rcciFecMaxShards))
+    {
+        return -1;
+    }
+
+    for(int i = 0; i < numData; i++)
+    {
+        if(!dataPresent[i])
+        {
+            missing.push_back(i);
+        }
+    }
+    if(missing.empty())
+    {
+        return 0;
+    }
+    for(int j = 0; (j < numParity) && (rows.size() < missing.size()); j++)
+    {
+        if(parityPresent[j])
+        {
+            rows.push_back(j);
+        }
+    }
+    if(rows.size() < missing.size())
+    {
+        return -1;
+    }
+
+    int n = missing.size();
+    std::vector<uint8_t> a(n * n);
+    for(int k = 0; k < n; k++)
+    {
+        for(int l = 0; l < n; l++)
+        {
+            a[k * n + l] = coef(gf, numData, rows[k], missing[l]);
+        }
+    }
+    if(!invertMatrix(gf, a, n))
+    {
+        return -1;
+    }
+
+    // parity minus contribution of received data = A * missing data
+    std::vector<uint8_t> rhs(n * shardSize);
+    for(int k = 0; k < n; k++)
+    {
+        uint8_t *r = &rhs[k * shardSize];
+        memcpy(r, parity[rows[k]], shardSize);
+        for(int i = 0; i < numData; i++)
+        {
+            if(dataPresent[i])
+            {
+                size_t len = (dataLen[i] < shardSize) ? dataLen[i] : shardSize;
+                mulAdd(gf, r, data[i], coef(gf, numData, rows[k], i), len);
+            }
+        }
+    }
+
+    for(int l = 0; l < n; l++)
+    {
+        uint8_t *d = data[missing[l]];
+        size_t len = dataLen[missing[l]];
+        if(len > shardSize)
+        {
+            len = shardSize;
+        }
+
+        memset(d, 0, len);
+        for(int k = 0; k < n; k++)
+        {
+            mulAdd(gf, d, &rhs[k * shardSize], a[l * n + k], len);
+        }
+    }
+
+    return n;
+}
+
+bool rcciFecHasNeon(void)
+{
+#ifdef RCCI_FEC_NEON
+    return true;
+#else
+    return false;
+#endif
+}
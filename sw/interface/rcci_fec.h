@@ -0,0 +1,37 @@
+#ifndef __RCCI_FEC_H
+#define __RCCI_FEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*! Erasure code for video fragments: systematic Reed-Solomon over GF(2^8)
+  built from a Cauchy matrix. Any 'numParity' lost data shards of a frame
+  can be rebuilt from the same number of received parity shards. The first
+  parity shard is plain XOR of the data shards (cheap single loss case).
+  Data shards shorter than shardSize (last fragment) are zero padded.
+*/
+
+//! Data + parity shards of one frame (fragment index is uint8_t)
+const int rcciFecMaxShards = 255;
+
+//! Number of parity shards for given number of data shards & ratio in %
+int  rcciFecNumParity(int numData, int parityPercent);
+
+//! parity[j] (shardSize bytes each) from data[i] of dataLen[i] <= shardSize
+bool rcciFecEncode(const uint8_t * const *data, const size_t *dataLen,
+                   int numData, uint8_t * const *parity, int numParity,
+                   size_t shardSize);
+
+/*! Rebuilds data shards not marked in dataPresent (dataLen[i] bytes are
+  written to data[i]). Returns number of rebuilt shards, -1 when there is
+  not enough parity.
+*/
+int  rcciFecDecode(uint8_t * const *data, const size_t *dataLen,
+                   const bool *dataPresent, int numData,
+                   const uint8_t * const *parity, const bool *parityPresent,
+                   int numParity, size_t shardSize);
+
+//! True when GF(2^8) multiplication uses NEON
+bool rcciFecHasNeon(void);
+
+#endif // __RCCI_FEC_H
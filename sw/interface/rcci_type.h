@@ -2,6 +2,7 @@
 #define __RCCI_TYPE_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -18,6 +19,11 @@ typedef enum rcci_msg_id_e {
     rcci_msg_stat,          //!< RCC Status message ID
     rcci_msg_dr_ctrl,       //!< RCC Drive control message ID
     rcci_msg_video,         //!< RCC Video message ID
+    rcci_msg_video_fec,     //!< RCC Video FEC parity fragment ID
+    rcci_msg_video_report,  //!< RCC Video receiver report ID
+    rcci_msg_time_sync,     //!< RCC Clock synchronization ID
+    rcci_msg_log,           //!< RCC Log datagram ID
+    rcci_msg_log_read,      //!< RCC Log history read ID
     rcci_msg_nonexisting    //!< Must be last
 } rcci_msg_id_t;
 
@@ -34,7 +40,7 @@ typedef enum rcci_client_flags_s {
     rcci_client_flag_init  = 1,   // Initialized connection
     rcci_client_flag_log   = 2,   // Logging service
     rcci_client_flag_drive = 4,   // Drive control of the vehicle
-    rcci_client_flag_video = 5,   // Video streaming
+    rcci_client_flag_video = 8,   // Video streaming (unicast)
     rcci_client_flag_nonexisting  // Must be last
 } rcci_client_flags_t;
 
@@ -44,7 +50,7 @@ typedef struct rcci_msg_header_s {
     uint16_t      ver;       //!< Protocol version
     rcci_msg_id_t type;      //!< Message type id
     uint32_t      size;      //!< Size of message (includes header)
-    uint32_t      crc;       //!< Message CRC
+    uint32_t      crc;       //!< CRC-32C of the message with crc = 0 (rcci_crc.h)
 } rcci_msg_header_t;
 
 //! Initialization message
@@ -55,7 +61,10 @@ typedef struct rcci_msg_init_s {
     rcci_status_id_t    status;     //!< Reply status (ignored on server RX)
     int                 log_port;   //!< UDP port for logging datastream (ignored on server RC)
     int                 drv_port;   //!< UDP port for driving control
+    int                 video_port; //!< UDP port of unicast video service
 } rcci_msg_init_t;
+//! Init message size of peers without video service (ends before video_port)
+const uint32_t rcci_msg_init_size_v1 = offsetof(rcci_msg_init_t, video_port);
 
 //! Register & unregister services
 typedef struct rcci_msg_reg_service_s {
@@ -63,7 +72,7 @@ typedef struct rcci_msg_reg_service_s {
     rcci_client_flags_t service;
     rcci_status_id_t    status;
     struct sockaddr_in  sockaddr;
-    int                 params; // various parameters - in log it means 'dump full log' if params != 0
+    int                 params; // various parameters - video: highest fragment version
 } rcci_msg_reg_service_t;
 
 /*! Drive control message payload definition - it is used in UDP protocol so
@@ -74,6 +83,7 @@ typedef struct rcci_msg_drv_ctrl_s {
     uint8_t           count;  //!< Incremental number
     int32_t           drive;  //!< New drive value
     int32_t           steer;  //!< New stearing value
+    uint32_t          crc;    //!< CRC-32C of the fields above (rcciDrvSetCrc())
 } rcci_msg_drv_ctrl_t;
 
 const int32_t rcci_msg_vframe_max_packet_size = ((1<<16)-40);
@@ -94,4 +104,137 @@ typedef struct rcci_msg_vframe_s {
 const int32_t rcci_msg_vframe_header_size =
     sizeof(rcci_msg_vframe_s) - sizeof(uint8_t) * rcci_msg_vframe_max_frame_size;
 
+//! Fragment header only (must match the fields in front of rcci_msg_vframe_t::frame)
+typedef struct rcci_msg_vframe_hdr_s {
+    rcci_msg_header_t header;
+    uint32_t          size_frame;
+    uint32_t          idx_frame;
+    uint8_t           cnt_frame;
+    uint8_t           all_msgs;
+    uint8_t           cur_msg;
+} rcci_msg_vframe_hdr_t;
+
+//! Offset of payload in a fragment - this is header length on the wire
+const int32_t rcci_msg_vframe_payload_offset = offsetof(rcci_msg_vframe_t, frame);
+//! all_msgs & cur_msg are uint8_t so this limits number of fragments per frame
+const int32_t rcci_msg_vframe_max_msgs = 255;
+//! Maximum size of encoded frame
+const int32_t rcci_msg_vframe_max_frame =
+    rcci_msg_vframe_max_msgs * rcci_msg_vframe_max_frame_size;
+
+/*! Video fragment header versions (header.ver of video messages). v1 never
+  set header.ver, so it is 0. Receivers announce the highest version they
+  understand in header.ver of their reports and in 'params' of video service
+  registration, senders switch to v2 only when all receivers know it.
+*/
+const uint16_t rcci_msg_video_v1 = 0; //!< rcci_msg_vframe_hdr_t, rcci_msg_vfec_hdr_t
+const uint16_t rcci_msg_video_v2 = 2; //!< rcci_msg_vframe2_hdr_t
+
+//! Flags of v2 video fragments
+typedef enum rcci_vframe_flags_e {
+    rcci_vframe_flag_none    = 0,
+    rcci_vframe_flag_capture = 1, //!< capture_us holds capture timestamp
+    rcci_vframe_flag_scaled  = 2  //!< resolution lowered by adaptation
+} rcci_vframe_flags_t;
+
+/*! v2 fragment header, data (header.type == rcci_msg_video) and FEC parity
+  (rcci_msg_video_fec) fragments share it. header.size is the size of this
+  fragment on the wire (header + payload). Data fragment i starts at
+  i * size_shard of the frame and all but the last are size_shard long, parity
+  fragments are size_shard long (see rcci_fec.h).
+*/
+typedef struct rcci_msg_vframe2_hdr_s {
+    rcci_msg_header_t header;
+    uint32_t          seq;        //!< frame sequence number
+    uint32_t          frame_size; //!< size of the encoded frame
+    uint32_t          idx_frame;  //!< offset of payload in the frame (data)
+    uint16_t          all_msgs;   //!< number of data fragments of the frame
+    uint16_t          cur_msg;    //!< index of this data or parity fragment
+    uint16_t          num_parity; //!< number of parity fragments of the frame
+    uint16_t          flags;      //!< rcci_vframe_flags_t
+    uint32_t          size_shard; //!< payload size of all but last data fragment
+    uint64_t          capture_us; //!< capture time (CLOCK_MONOTONIC) [us]
+} rcci_msg_vframe2_hdr_t;
+
+const int32_t rcci_msg_vframe2_payload_offset = sizeof(rcci_msg_vframe2_hdr_t);
+const int32_t rcci_msg_vframe2_max_frag_size =
+    rcci_msg_vframe_max_packet_size - rcci_msg_vframe2_payload_offset;
+//! all_msgs & cur_msg are uint16_t - frames are not limited to 255 WiFi MTU
+//! sized fragments (~350 kB) as in v1
+const int32_t rcci_msg_vframe2_max_msgs = 65535;
+//! Maximum size of encoded frame in v2
+const int32_t rcci_msg_vframe2_max_frame = 1 << 24;
+
+/*! FEC parity fragment of a frame (header.type == rcci_msg_video_fec), same
+  layout and payload offset as rcci_msg_vframe_t. Data fragments of such
+  frame are all 'size_shard' long (except the last one) so fragment i starts
+  at i * size_shard, parity is computed over data fragments zero padded to
+  size_shard (see rcci_fec.h).
+*/
+typedef struct rcci_msg_vfec_hdr_s {
+    rcci_msg_header_t header;     //!< header.size - size of the whole frame
+    uint32_t          size_shard; //!< payload size (longest data fragment)
+    uint32_t          idx_parity; //!< index of this parity fragment
+    uint8_t           cnt_frame;  //!< frame counter (as in data fragments)
+    uint8_t           all_msgs;   //!< number of data fragments of the frame
+    uint8_t           num_parity; //!< number of parity fragments of the frame
+} rcci_msg_vfec_hdr_t;
+
+/*! Receiver report - sent periodically by every viewer as unicast UDP back
+  to the source address of the video fragments (the stream socket). Streamer
+  adapts JPEG quality, resolution and frame rate of the stream to it.
+  header.ver - highest video fragment version the viewer understands.
+*/
+typedef struct rcci_msg_vreport_s {
+    rcci_msg_header_t header;        //!< header.size - size of this message
+    uint32_t          interval_ms;   //!< period covered by the report
+    uint32_t          frames;        //!< frames completed in the period
+    uint32_t          fps_x100;      //!< completed frames per second * 100
+    uint32_t          jitter_us;     //!< jitter of frame completion intervals
+    uint16_t          loss_permille; //!< fragments lost (before FEC) in 1/1000
+    uint8_t           cnt_frame;     //!< counter (v2: low 8 bits of seq) of
+                                     //!< last completed frame
+} rcci_msg_vreport_t;
+
+/*! Clock synchronization (TCP) - client sends its time, server replies with
+  the same message and its CLOCK_MONOTONIC time (the clock of the capture
+  timestamps). Client estimates offset from the exchange with lowest RTT.
+*/
+typedef struct rcci_msg_time_sync_s {
+    rcci_msg_header_t header;
+    uint64_t          client_us; //!< client time when sent (echoed back)
+    uint64_t          server_us; //!< server time when replied [us]
+} rcci_msg_time_sync_t;
+
+/*! Log service datagram - log text (several whole lines when they fit)
+  follows the header, header.size includes it. seq counts datagrams sent to
+  the client, offset is position of the text in the log stream of the
+  server, so a gap in either shows lost text and the range to fetch again.
+*/
+typedef struct rcci_msg_log_s {
+    rcci_msg_header_t header;
+    uint32_t          seq;      //!< per client datagram counter
+    uint32_t          reserved; //!< 0
+    uint64_t          offset;   //!< log stream offset of the first text byte
+} rcci_msg_log_t;
+
+const int32_t rcci_msg_log_max_size = 1400; //!< whole datagram, fits WiFi MTU
+const int32_t rcci_msg_log_max_text =
+    rcci_msg_log_max_size - sizeof(rcci_msg_log_t);
+
+/*! Log history read (TCP) - request carries offset & max_size, reply the
+  offset of the first returned byte (later than requested when that part is
+  not kept anymore) and size bytes of log text following the message
+  (header.size includes it). end - current end of the server log stream.
+*/
+typedef struct rcci_msg_log_read_s {
+    rcci_msg_header_t header;
+    uint64_t          offset;   //!< log stream offset
+    uint64_t          end;      //!< reply: offset behind the newest byte
+    uint32_t          max_size; //!< request: max text bytes in reply
+    uint32_t          size;     //!< reply: text bytes following
+} rcci_msg_log_read_t;
+
+const uint32_t rcci_msg_log_read_max = 16 * 1024; //!< text per reply
+
 #endif // __RCCI__TYPE_H
@@ -0,0 +1,609 @@
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "rcci_video_rx.h"
+#include "rcci_crc.h"
+#include "rcci_fec.h"
+
+const int    rcciVideoRx::cDefaultSlots;
+const size_t rcciVideoRx::cDefaultMaxFrame;
+const int    rcciVideoRx::cDefaultTimeoutMs;
+const int    rcciVideoRx::cDefaultReportMs;
+
+const int cRxBatch(8); // datagrams per recvmmsg()
+
+rcciVideoRx::rcciVideoRx(int numSlots, size_t maxFrameSize, int timeoutMs)
+    : mMaxFrameSize(maxFrameSize),
+      mMaxFrags(std::min((size_t)rcci_msg_vframe2_max_msgs, maxFrameSize)),
+      mTimeout(std::chrono::milliseconds(timeoutMs)),
+      mFrameCb(nullptr), mSockFd(-1), mOwnSocket(false), mSenderKnown(false),
+      mReportInterval(std::chrono::milliseconds(cDefaultReportMs)),
+      mPeriodStart(rxClock::now()), mPeriodExpected(0), mPeriodReceived(0),
+      mPeriodFrames(0), mLastSeq(0), mHaveLast(false), mLastIntervalUs(-1),
+      mJitterUs(0)
+{
+    // v1 frame counter is 8-bit - slot index has to divide it evenly
+    if((numSlots <= 0) || (numSlots > 256) || (numSlots & (numSlots - 1)))
+    {
+        std::cerr << "rcciVideoRx: invalid number of slots " << numSlots
+                  << ", using " << cDefaultSlots << std::endl;
+        numSlots = cDefaultSlots;
+    }
+
+    mSlots.resize(numSlots);
+    for(size_t i = 0; i < mSlots.size(); i++)
+    {
+        mSlots[i].frame.resize(mMaxFrameSize);
+        mSlots[i].parity.resize(mMaxFrameSize);
+        mSlots[i].dataMap.assign(mMaxFrags, false);
+        mSlots[i].numData = 0;
+        resetSlot(mSlots[i]);
+    }
+    memset(&mStats, 0, sizeof(mStats));
+    memset(&mSender, 0, sizeof(mSender));
+}
+
+rcciVideoRx::~rcciVideoRx(void)
+{
+    closeSocket();
+}
+
+int rcciVideoRx::openSocket(int port, const char *group, const char *ifAddr)
+{
+    struct sockaddr_in addr;
+    struct ip_mreq mreq;
+    int yes = 1;
+
+    closeSocket();
+
+    mSockFd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(mSockFd < 0)
+    {
+        std::cerr << "socket() failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    mOwnSocket = true;
+
+    // allow several receivers on the same host
+    if(setsockopt(mSockFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) < 0)
+    {
+        std::cerr << "SO_REUSEADDR failed: " << strerror(errno) << std::endl;
+        closeSocket();
+        return -1;
+    }
+
+    // whole frame arrives as one burst, best effort (limited by rmem_max)
+    int rcvBuf = 2 * mMaxFrameSize;
+    if(setsockopt(mSockFd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf)) < 0)
+    {
+        std::cerr << "SO_RCVBUF failed: " << strerror(errno) << std::endl;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(port);
+    if(bind(mSockFd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        std::cerr << "bind() failed: " << strerror(errno) << std::endl;
+        closeSocket();
+        return -1;
+    }
+
+    mreq.imr_multiaddr.s_addr = inet_addr(group);
+    mreq.imr_interface.s_addr = ifAddr ? inet_addr(ifAddr) : htonl(INADDR_ANY);
+    if(setsockopt(mSockFd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+                  sizeof(mreq)) < 0)
+    {
+        std::cerr << "IP_ADD_MEMBERSHIP failed: " << strerror(errno)
+                  << std::endl;
+        closeSocket();
+        return -1;
+    }
+
+    mRxBuf.resize(cRxBatch * rcci_msg_vframe_max_packet_size);
+
+    return mSockFd;
+}
+
+int rcciVideoRx::attachSocket(int fd)
+{
+    closeSocket();
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    mSockFd    = fd;
+    mOwnSocket = false;
+    mRxBuf.resize(cRxBatch * rcci_msg_vframe_max_packet_size);
+
+    return mSockFd;
+}
+
+void rcciVideoRx::closeSocket(void)
+{
+    if((mSockFd >= 0) && mOwnSocket)
+    {
+        close(mSockFd);
+    }
+    mSockFd      = -1;
+    mOwnSocket   = false;
+    mSenderKnown = false;
+}
+
+int rcciVideoRx::receive(int timeoutMs)
+{
+    struct pollfd pfd;
+    int frames = 0;
+
+    if(mSockFd < 0)
+    {
+        return -1;
+    }
+
+    pfd.fd      = mSockFd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    int retVal = poll(&pfd, 1, timeoutMs);
+    if(retVal < 0)
+    {
+        if(errno == EINTR)
+        {
+            return 0;
+        }
+        std::cerr << "poll() failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    if(retVal == 0)
+    {
+        expire();
+        sendReport();
+        return 0;
+    }
+
+    while(true)
+    {
+        struct iovec       iov[cRxBatch];
+        struct mmsghdr     msgs[cRxBatch];
+        struct sockaddr_in from[cRxBatch];
+
+        for(int i = 0; i < cRxBatch; i++)
+        {
+            iov[i].iov_base = &mRxBuf[i * rcci_msg_vframe_max_packet_size];
+            iov[i].iov_len  = rcci_msg_vframe_max_packet_size;
+            memset(&msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+            msgs[i].msg_hdr.msg_iov    = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name    = &from[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+        }
+
+        int num = recvmmsg(mSockFd, msgs, cRxBatch, MSG_DONTWAIT, NULL);
+        if(num < 0)
+        {
+            if((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+            {
+                break;
+            }
+            std::cerr << "recvmmsg() failed: " << strerror(errno) << std::endl;
+            return -1;
+        }
+
+        for(int i = 0; i < num; i++)
+        {
+            int ret = processFragment((const uint8_t *)iov[i].iov_base,
+                                      msgs[i].msg_len);
+            if(ret > 0)
+            {
+                frames++;
+            }
+            if(ret >= 0)
+            {
+                mSender      = from[i];
+                mSenderKnown = true;
+            }
+        }
+
+        if(num < cRxBatch)
+        {
+            break;
+        }
+    }
+
+    sendReport();
+    return frames;
+}
+
+void rcciVideoRx::resetSlot(rcci_rx_slot_t &slot)
+{
+    // only bits of the last frame can be set
+    std::fill(slot.dataMap.begin(), slot.dataMap.begin() + slot.numData, false);
+    slot.parityMap.reset();
+
+    slot.active    = false;
+    slot.done      = false;
+    slot.seq       = 0;
+    slot.version   = rcci_msg_video_v1;
+    slot.flags     = rcci_vframe_flag_none;
+    slot.captureUs = 0;
+    slot.size      = 0;
+    slot.numData   = 0;
+    slot.numParity = 0;
+    slot.shardSize = 0;
+    slot.rxData    = 0;
+    slot.rxParity  = 0;
+    slot.rxLate    = 0;
+}
+
+void rcciVideoRx::expire(void)
+{
+    rxClock::time_point now = rxClock::now();
+
+    for(size_t i = 0; i < mSlots.size(); i++)
+    {
+        rcci_rx_slot_t &slot = mSlots[i];
+        if(slot.active && ((now - slot.firstRx) > mTimeout))
+        {
+            releaseSlot(slot);
+        }
+    }
+}
+
+// Frees slot of finished or abandoned frame, its fragments go to loss rate
+void rcciVideoRx::releaseSlot(rcci_rx_slot_t &slot)
+{
+    if(slot.active)
+    {
+        // parity fragments are not known when none of them arrived
+        int expected = slot.numData + slot.numParity;
+        int received = slot.rxData + slot.rxParity + slot.rxLate;
+
+        mPeriodExpected += expected;
+        mPeriodReceived += (received < expected) ? received : expected;
+        if(!slot.done)
+        {
+            mStats.dropped++;
+        }
+    }
+    resetSlot(slot);
+}
+
+// Slot of the fragment's frame, starts new frame if slot holds different
+// (older) one
+rcciVideoRx::rcci_rx_slot_t *rcciVideoRx::getSlot(const rcci_rx_frag_t &frag)
+{
+    rcci_rx_slot_t &slot = mSlots[frag.seq & (mSlots.size() - 1)];
+    rxClock::time_point now = rxClock::now();
+
+    if(slot.active &&
+       ((slot.seq != frag.seq) || (slot.version != frag.version) ||
+        (slot.size != frag.frameSize) || (slot.numData != frag.numData) ||
+        ((now - slot.firstRx) > mTimeout)))
+    {
+        releaseSlot(slot);
+    }
+
+    if(!slot.active)
+    {
+        slot.active  = true;
+        slot.seq     = frag.seq;
+        slot.version = frag.version;
+        slot.size    = frag.frameSize;
+        slot.numData = frag.numData;
+        slot.firstRx = now;
+    }
+
+    return &slot;
+}
+
+// Header of either version to rcci_rx_frag_t, checks what can be checked
+// without the slot
+bool rcciVideoRx::parseFragment(const uint8_t *data, size_t len,
+                                rcci_rx_frag_t &frag)
+{
+    rcci_msg_header_t header;
+
+    if(len < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if((header.magic != rcci_msg_init_magic) ||
+       ((header.type != rcci_msg_video) && (header.type != rcci_msg_video_fec)))
+    {
+        return false;
+    }
+    frag.parity  = (header.type == rcci_msg_video_fec);
+    frag.version = header.ver;
+
+    if(header.ver == rcci_msg_video_v2)
+    {
+        rcci_msg_vframe2_hdr_t hdr;
+
+        if((len < (size_t)rcci_msg_vframe2_payload_offset) ||
+           (header.size != len) ||
+           !rcciMsgCheckCrc(data, len))
+        {
+            return false;
+        }
+        memcpy(&hdr, data, sizeof(hdr));
+
+        frag.seq        = hdr.seq;
+        frag.frameSize  = hdr.frame_size;
+        frag.numData    = hdr.all_msgs;
+        frag.numParity  = hdr.num_parity;
+        frag.idx        = hdr.cur_msg;
+        frag.offset     = hdr.idx_frame;
+        frag.shardSize  = hdr.size_shard;
+        frag.flags      = hdr.flags;
+        frag.captureUs  = hdr.capture_us;
+        frag.payload    = data + rcci_msg_vframe2_payload_offset;
+        frag.payloadLen = len - rcci_msg_vframe2_payload_offset;
+
+        if((frag.numData == 0) || (frag.shardSize == 0) ||
+           (((uint64_t)(frag.numData - 1) * frag.shardSize) >= frag.frameSize))
+        {
+            return false;
+        }
+        if(frag.parity)
+        {
+            return (frag.payloadLen == frag.shardSize);
+        }
+
+        // fragment position follows from the shard size
+        size_t expected = (frag.idx < (size_t)(frag.numData - 1)) ?
+            frag.shardSize : (frag.frameSize - (frag.numData - 1) * frag.shardSize);
+        return (frag.offset == (uint64_t)frag.idx * frag.shardSize) &&
+            (frag.payloadLen == expected);
+    }
+
+    if((header.ver != rcci_msg_video_v1) ||
+       (len < (size_t)rcci_msg_vframe_payload_offset) ||
+       !rcciMsgCheckCrc(data, len))
+    {
+        return false;
+    }
+
+    // data and parity headers share the layout of the frame identification
+    rcci_msg_vframe_hdr_t hdr;
+    rcci_msg_vfec_hdr_t fecHdr;
+    memcpy(&hdr, data, sizeof(hdr));
+    memcpy(&fecHdr, data, sizeof(fecHdr));
+
+    frag.seq        = hdr.cnt_frame;
+    frag.frameSize  = hdr.header.size;
+    frag.numData    = hdr.all_msgs;
+    frag.flags      = rcci_vframe_flag_none;
+    frag.captureUs  = 0;
+    frag.payload    = data + rcci_msg_vframe_payload_offset;
+    frag.payloadLen = len - rcci_msg_vframe_payload_offset;
+    if(frag.parity)
+    {
+        frag.numParity = fecHdr.num_parity;
+        frag.idx       = fecHdr.idx_parity;
+        frag.offset    = 0;
+        frag.shardSize = fecHdr.size_shard;
+        return (frag.payloadLen == fecHdr.size_shard);
+    }
+
+    frag.numParity = 0;
+    frag.idx       = hdr.cur_msg;
+    frag.offset    = hdr.idx_frame;
+    // last fragment can be shorter - it does not tell the shard size
+    frag.shardSize = (frag.idx < (size_t)(frag.numData - 1)) ? hdr.size_frame : 0;
+    return (frag.numData > 0) && (frag.payloadLen == hdr.size_frame);
+}
+
+int rcciVideoRx::processFragment(const uint8_t *data, size_t len)
+{
+    rcci_rx_frag_t frag;
+
+    if(!parseFragment(data, len, frag) ||
+       (frag.frameSize == 0) || (frag.frameSize > mMaxFrameSize) ||
+       (frag.numData == 0) || (frag.numData > mMaxFrags))
+    {
+        mStats.invalid++;
+        return -1;
+    }
+
+    rcci_rx_slot_t &slot = *getSlot(frag);
+    if(slot.done)
+    {
+        slot.rxLate++;
+        mStats.late++;
+        return 0;
+    }
+
+    if(frag.shardSize && slot.shardSize && (slot.shardSize != frag.shardSize))
+    {
+        mStats.invalid++;
+        return -1;
+    }
+
+    if(frag.parity)
+    {
+        if((frag.idx >= (size_t)frag.numParity) ||
+           ((frag.numData + frag.numParity) > rcciFecMaxShards) ||
+           (((size_t)frag.numParity * frag.shardSize) > mMaxFrameSize))
+        {
+            mStats.invalid++;
+            return -1;
+        }
+        slot.numParity = frag.numParity;
+        slot.shardSize = frag.shardSize;
+        if(!slot.parityMap.test(frag.idx))
+        {
+            slot.parityMap.set(frag.idx);
+            slot.rxParity++;
+            memcpy(&slot.parity[frag.idx * slot.shardSize], frag.payload,
+                   frag.payloadLen);
+        }
+    }
+    else
+    {
+        if((frag.idx >= (size_t)frag.numData) ||
+           (((size_t)frag.offset + frag.payloadLen) > frag.frameSize))
+        {
+            mStats.invalid++;
+            return -1;
+        }
+        if(frag.shardSize)
+        {
+            slot.shardSize = frag.shardSize;
+        }
+        if(!slot.dataMap[frag.idx])
+        {
+            slot.dataMap[frag.idx] = true;
+            slot.rxData++;
+            memcpy(&slot.frame[frag.offset], frag.payload, frag.payloadLen);
+        }
+    }
+    if(frag.version == rcci_msg_video_v2)
+    {
+        slot.flags     = frag.flags;
+        slot.captureUs = frag.captureUs;
+    }
+    mStats.fragments++;
+
+    if(slot.rxData == slot.numData)
+    {
+        complete(slot, false);
+        return 1;
+    }
+    if(recover(slot))
+    {
+        complete(slot, true);
+        return 1;
+    }
+
+    return 0;
+}
+
+bool rcciVideoRx::recover(rcci_rx_slot_t &slot)
+{
+    const uint8_t *parity[rcciFecMaxShards];
+    uint8_t *data[rcciFecMaxShards];
+    size_t dataLen[rcciFecMaxShards];
+    bool dataPresent[rcciFecMaxShards], parityPresent[rcciFecMaxShards];
+    int numData = slot.numData;
+
+    if((slot.rxParity == 0) || (slot.shardSize == 0) ||
+       ((slot.rxData + slot.rxParity) < numData) ||
+       (((size_t)(numData - 1) * slot.shardSize) >= slot.size))
+    {
+        return false;
+    }
+
+    for(int i = 0; i < numData; i++)
+    {
+        data[i]        = &slot.frame[i * slot.shardSize];
+        dataLen[i]     = (i < (numData - 1)) ? slot.shardSize :
+            (slot.size - (numData - 1) * slot.shardSize);
+        dataPresent[i] = slot.dataMap[i];
+    }
+    for(int j = 0; j < slot.numParity; j++)
+    {
+        parity[j]        = &slot.parity[j * slot.shardSize];
+        parityPresent[j] = slot.parityMap.test(j);
+    }
+
+    return (rcciFecDecode(data, dataLen, dataPresent, numData, parity,
+                          parityPresent, slot.numParity, slot.shardSize) >= 0);
+}
+
+void rcciVideoRx::complete(rcci_rx_slot_t &slot, bool recovered)
+{
+    rxClock::time_point now = rxClock::now();
+
+    // RFC 3550 style jitter of intervals between completed frames
+    if(mHaveLast)
+    {
+        double intervalUs =
+            std::chrono::duration<double, std::micro>(now - mLastComplete).count();
+        if(mLastIntervalUs >= 0)
+        {
+            double d = intervalUs - mLastIntervalUs;
+            mJitterUs += (((d < 0) ? -d : d) - mJitterUs) / 16;
+        }
+        mLastIntervalUs = intervalUs;
+    }
+    mHaveLast     = true;
+    mLastComplete = now;
+    mLastSeq      = slot.seq;
+    mPeriodFrames++;
+
+    // slot stays reserved so late fragments are not taken as a new frame
+    slot.done = true;
+    mStats.frames++;
+    if(recovered)
+    {
+        mStats.recovered++;
+    }
+
+    if(mFrameCb)
+    {
+        rcci_video_frame_t info;
+        info.seq       = slot.seq;
+        info.version   = slot.version;
+        info.flags     = slot.flags;
+        info.captureUs = slot.captureUs;
+        mFrameCb(slot.frame.data(), slot.size, info);
+    }
+}
+
+void rcciVideoRx::makeReport(rcci_msg_vreport_t &report)
+{
+    rxClock::time_point now = rxClock::now();
+    uint32_t intervalMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now - mPeriodStart).count();
+
+    memset(&report, 0, sizeof(report));
+    report.header.magic   = rcci_msg_init_magic;
+    report.header.ver     = rcci_msg_video_v2;
+    report.header.type    = rcci_msg_video_report;
+    report.header.size    = sizeof(report);
+    report.interval_ms    = intervalMs;
+    report.frames         = mPeriodFrames;
+    report.fps_x100       = intervalMs ?
+        (uint32_t)(((uint64_t)mPeriodFrames * 100000) / intervalMs) : 0;
+    report.jitter_us      = (uint32_t)mJitterUs;
+    report.loss_permille  = mPeriodExpected ?
+        (uint16_t)(((mPeriodExpected - mPeriodReceived) * 1000) /
+                   mPeriodExpected) : 0;
+    report.cnt_frame      = (uint8_t)mLastSeq;
+    rcciMsgSetCrc(&report, sizeof(report));
+
+    mPeriodStart    = now;
+    mPeriodExpected = 0;
+    mPeriodReceived = 0;
+    mPeriodFrames   = 0;
+}
+
+void rcciVideoRx::sendReport(void)
+{
+    rcci_msg_vreport_t report;
+
+    if((mReportInterval.count() <= 0) || !mSenderKnown ||
+       ((rxClock::now() - mPeriodStart) < mReportInterval))
+    {
+        return;
+    }
+
+    makeReport(report);
+    // best effort, another report follows in one period
+    if(sendto(mSockFd, &report, sizeof(report), MSG_DONTWAIT,
+              (struct sockaddr *)&mSender, sizeof(mSender)) < 0)
+    {
+        std::cerr << "Sending receiver report failed: " << strerror(errno)
+                  << std::endl;
+    }
+}
@@ -0,0 +1,173 @@
+#ifndef __RCCI_VIDEO_RX_H
+#define __RCCI_VIDEO_RX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+#include <bitset>
+#include <functional>
+#include <chrono>
+
+#include <netinet/in.h>
+
+extern "C" {
+#include "rcci_type.h"
+}
+#include "rcci_fec.h"
+
+/*! Receiver of the multicast video stream (rcci_msg_vframe_t fragments and
+  rcci_msg_video_fec parity, v1 or v2 headers). Frames are reassembled in a
+  fixed pool of slots indexed by frame sequence number, so memory is bounded
+  and nothing is
+  allocated per frame. Fragments are placed directly to their offset,
+  lost ones are rebuilt from parity when possible. Completed frames are
+  handed to the callback (data valid only during the call), incomplete ones
+  are evicted when their slot is needed or after a timeout.
+  When receiving from the socket, receiver reports (rcci_msg_vreport_t) are
+  sent back to the stream source every report interval, they announce v2
+  support to the sender.
+  Not thread safe - use from one receiving thread.
+*/
+class rcciVideoRx {
+public:
+    typedef struct rcci_video_rx_stats_s {
+        uint64_t fragments;  // valid fragments (data & parity)
+        uint64_t frames;     // completed frames
+        uint64_t recovered;  // completed frames which needed parity
+        uint64_t dropped;    // incomplete frames evicted
+        uint64_t late;       // fragments of already completed frames
+        uint64_t invalid;    // wrong size, CRC or frame too big
+    } rcci_video_rx_stats_t;
+
+    // Completed frame as described by its fragment headers
+    typedef struct rcci_video_frame_s {
+        uint32_t seq;       // sequence number (v1: 8-bit frame counter)
+        uint16_t version;   // rcci_msg_video_v1 or rcci_msg_video_v2
+        uint16_t flags;     // rcci_vframe_flags_t (v2 only)
+        uint64_t captureUs; // valid with rcci_vframe_flag_capture
+    } rcci_video_frame_t;
+
+    // frame data, size, frame description
+    typedef std::function<void(const uint8_t *, size_t,
+                               const rcci_video_frame_t &)> frameFuncCb;
+
+    static const int    cDefaultSlots = 4;            // power of 2, <= 256
+    static const size_t cDefaultMaxFrame = 1 << 20;   // JPEG VGA ~50 kB, 720p ~200 kB
+    static const int    cDefaultTimeoutMs = 500;
+    static const int    cDefaultReportMs = 200;
+
+    rcciVideoRx(int numSlots = cDefaultSlots,
+                size_t maxFrameSize = cDefaultMaxFrame,
+                int timeoutMs = cDefaultTimeoutMs);
+    ~rcciVideoRx(void);
+
+    void setFrameCb(frameFuncCb cbFunc) { mFrameCb = cbFunc; };
+
+    /*! Joins multicast 'group' on 'port' (ifAddr NULL - default interface),
+      returns socket or -1
+    */
+    int  openSocket(int port, const char *group = "226.0.0.1",
+                    const char *ifAddr = NULL);
+    //! Receives from already opened (unicast) socket, it is not closed here
+    int  attachSocket(int fd);
+    void closeSocket(void);
+    int  socketFd(void) { return mSockFd; };
+
+    /*! Waits up to timeoutMs for fragments on the socket and processes
+      all queued ones, returns number of completed frames or -1 on error
+    */
+    int  receive(int timeoutMs);
+
+    //! One received datagram, returns 1 if it completed a frame, -1 invalid
+    int  processFragment(const uint8_t *data, size_t len);
+    //! Evicts timed out incomplete frames (also done by processFragment())
+    void expire(void);
+
+    void getStats(rcci_video_rx_stats_t &stats) { stats = mStats; };
+
+    //! Period of receiver reports sent by receive() (0 - do not send)
+    void setReportInterval(int intervalMs)
+    {
+        mReportInterval = std::chrono::milliseconds(intervalMs);
+    };
+    //! Fills report for the period since the previous one, starts new period
+    void makeReport(rcci_msg_vreport_t &report);
+
+private:
+    typedef std::chrono::steady_clock rxClock;
+
+    // Fragment header of any version
+    typedef struct rcci_rx_frag_s {
+        bool                              parity;
+        uint16_t                          version;
+        uint32_t                          seq;
+        uint32_t                          frameSize;
+        int                               numData;
+        int                               numParity; // 0 - not known (v1 data)
+        size_t                            idx;       // data or parity index
+        uint32_t                          offset;    // in frame (data)
+        uint32_t                          shardSize; // 0 - not known (v1 data)
+        uint16_t                          flags;
+        uint64_t                          captureUs;
+        const uint8_t                    *payload;
+        size_t                            payloadLen;
+    } rcci_rx_frag_t;
+
+    typedef struct rcci_rx_slot_s {
+        bool                              active;
+        bool                              done;
+        uint32_t                          seq;
+        uint16_t                          version;
+        uint16_t                          flags;
+        uint64_t                          captureUs;
+        uint32_t                          size;
+        int                               numData;
+        int                               numParity;
+        uint32_t                          shardSize; // 0 - not known yet
+        int                               rxData;
+        int                               rxParity;
+        int                               rxLate;    // after completion
+        std::vector<bool>                 dataMap;   // maxFrags
+        std::bitset<rcciFecMaxShards>     parityMap;
+        rxClock::time_point               firstRx;
+        std::vector<uint8_t>              frame;     // maxFrameSize
+        std::vector<uint8_t>              parity;    // maxFrameSize
+    } rcci_rx_slot_t;
+
+    bool            parseFragment(const uint8_t *data, size_t len,
+                                  rcci_rx_frag_t &frag);
+    rcci_rx_slot_t *getSlot(const rcci_rx_frag_t &frag);
+    void            resetSlot(rcci_rx_slot_t &slot);
+    void            releaseSlot(rcci_rx_slot_t &slot);
+    bool            recover(rcci_rx_slot_t &slot);
+    void            complete(rcci_rx_slot_t &slot, bool recovered);
+    void            sendReport(void);
+
+    std::vector<rcci_rx_slot_t> mSlots;
+    size_t                      mMaxFrameSize;
+    int                         mMaxFrags;
+    rxClock::duration           mTimeout;
+    frameFuncCb                 mFrameCb;
+    rcci_video_rx_stats_t       mStats;
+
+    int                         mSockFd;
+    bool                        mOwnSocket;
+    std::vector<uint8_t>        mRxBuf;   // batch of datagram buffers
+    struct sockaddr_in          mSender;  // source of last valid fragment
+    bool                        mSenderKnown;
+
+    // receiver report period
+    rxClock::duration           mReportInterval;
+    rxClock::time_point         mPeriodStart;
+    uint64_t                    mPeriodExpected; // fragments of closed slots
+    uint64_t                    mPeriodReceived;
+    uint32_t                    mPeriodFrames;
+    uint32_t                    mLastSeq;
+    bool                        mHaveLast;
+    rxClock::time_point         mLastComplete;
+    double                      mLastIntervalUs; // < 0 - not known yet
+    double                      mJitterUs;
+};
+
+#endif // __RCCI_VIDEO_RX_H
@@ -0,0 +1,57 @@
+#ifndef __RCC_CAM_WIDGET_H
+#define __RCC_CAM_WIDGET_H
+
+#include <QWidget>
+#include <QString>
+#include <QGridLayout>
+#include <QLabel>
+#include <QElapsedTimer>
+#include <QResizeEvent>
+
+#ifdef RCC_GUI_VIDEO
+#include "rccVideoThread.h"
+#endif
+
+QT_USE_NAMESPACE
+
+class rccCamWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    rccCamWidget(QWidget *parent = 0);
+    ~rccCamWidget();
+
+public slots:
+    // control connection of rccCtrlWidget, video has its own
+    void videoConnect(const QString &hostname, int port);
+    void videoDisconnect(void);
+
+    void frameReady(void);
+    void videoError(const QString &text);
+
+protected:
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    void resetStats(void);
+
+    QGridLayout      *mMainLayout;
+    QLabel           *mImageLabel;
+    QLabel           *mStatsLabel;
+
+#ifdef RCC_GUI_VIDEO
+    rccVideoThread   *mVideoThread;
+#endif
+
+    // counters of the current second
+    QElapsedTimer     mStatsTimer;
+    int               mFrames;
+    int               mSkipped;
+    int64_t           mLatSumUs;
+    int64_t           mLatMaxUs;
+    int               mLatCount;
+    int64_t           mDecodeSumUs;
+};
+
+#endif // __RCC_CAM_WIDGET_H
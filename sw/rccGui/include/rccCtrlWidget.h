@@ -7,6 +7,7 @@
 #include <QTimer>
 #include <QGroupBox>
 #include <QPlainTextEdit>
+#include <QLabel>
 #include <QSensor>
 #include <QSensorReading>
 
@@ -25,8 +26,9 @@ public:
     ~rccCtrlWidget();
 
 signals:
-    void addLogText(const QString &a_text);
     void driveRegistered(bool aDrvReg);
+    void rccConnected(const QString &hostname, int port);
+    void rccDisconnected(void);
 
 public slots:
     void connRequest(QString uri);
@@ -34,8 +36,12 @@ public slots:
     void driveDataUpdate(int32_t drive, int32_t steer);
 
 //    void timerTimeout(void);
+    void logTimerTimeout(void);
 
 private:
+    void appendLog(QString text, int dropped);
+    void stopLogReading(void);
+
     QGridLayout      *mMainLayout;
     QTimer           *mTimer;
 
@@ -45,6 +51,9 @@ private:
     bool              mDriveRegistered;
 
     QPlainTextEdit   *mLogText;
+    QLabel           *mLogDropped;
+    QTimer           *mLogTimer;     // batched log refresh
+    int               mLogDroppedTotal;
     rccLogReadThread *mLogReadThread;
 };
 
@@ -10,6 +10,9 @@
 #include <QSensor>
 #include <QSensorReading>
 #include <QCheckBox>
+#include <QSpinBox>
+#include <QLabel>
+#include <QElapsedTimer>
 
 QT_USE_NAMESPACE
 
@@ -28,21 +31,40 @@ signals:
 public slots:
     void driveRegistered(bool aDrvReg);
     void driveReadingChanged(void);
+    void sendTimerTimeout(void);
+    void sendPeriodsChanged(int periods);
 
     // GUI stuff slots
     void cbDriveEnableChanged(int state);
     void gbSensorEnableChanged(bool on);
 
 private:
+    void startSending(void);
+    void scheduleSend(void);
+
     // GUI things
     QGridLayout      *mMainLayout;
     QCheckBox        *mCbDriveEnable;
     QGroupBox        *mGbSensorGroup;
+    QSpinBox         *mSbSendPeriods;
 
     bool              mDriveRegistered;
 
     QSensor          *mDriveSensor;
     uint8_t           mDriveCount;
+
+    // send scheduler - filtered sensor values are sent every mSendPeriods
+    // PWM periods when they change, otherwise as heartbeats
+    QTimer           *mSendTimer;
+    QElapsedTimer     mClock;
+    int               mSendPeriods;
+    qint64            mNextSendUs;
+    qint64            mLastSendUs;
+    qint64            mLastReadingUs; // < 0 - no reading yet
+    double            mFiltDrive;
+    double            mFiltSteer;
+    int32_t           mSentDrive;
+    int32_t           mSentSteer;
 };
 
 #endif // __RCC_DRV_WIDGET_H
@@ -3,51 +3,107 @@
 
 #include <QWidget>
 #include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
 #include <QDebug>
 
+#include <atomic>
+
 #include "rcci_client.h"
 
 QT_USE_NAMESPACE
 
+/*! Reads log datagrams and keeps the text until the GUI takes it with
+  takeText() (from a timer, so the widget gets one insert per refresh
+  instead of one per datagram). When the GUI does not keep up, the oldest
+  text above maxLines is dropped and counted.
+*/
 class rccLogReadThread : public QThread
 {
     Q_OBJECT
 
 public:
-    rccLogReadThread(QWidget *parent, rcciClient *aRcciClient)
-        : QThread(parent)
+    static const int cWaitMs = 100;     // mRunning is checked this often
+    static const int cErrorWaitMs = 500;
+
+    rccLogReadThread(QWidget *parent, rcciClient *aRcciClient,
+                     int maxLines = 5000)
+        : QThread(parent), mRunning(true), mRcciClient(aRcciClient),
+          mMaxLines(maxLines), mPendingLines(0), mDropped(0)
     {
-        mRcciClient = aRcciClient;
     }
 
+    //! thread exits within cWaitMs, wait() for it
     void setRunningFalse() { mRunning = false; };
 
-signals:
-    void newLogText(const QString &a_text);
+    //! Pending text (whole datagrams) and lines dropped since the last call
+    bool takeText(QString &text, int &dropped)
+    {
+        QMutexLocker lock(&mMutex);
+
+        text     = mPending.join(QString());
+        dropped  = mDropped;
+        mPending.clear();
+        mPendingLines = 0;
+        mDropped      = 0;
+
+        return !text.isEmpty() || (dropped > 0);
+    };
 
 private:
-    // TODO: Protect mRunning with mutexes
+    void addText(const QString &text)
+    {
+        QMutexLocker lock(&mMutex);
+
+        mPending.append(text);
+        mPendingLines += text.count('\n');
+        while((mPendingLines > mMaxLines) && (mPending.size() > 1))
+        {
+            int lines = mPending.first().count('\n');
+            mPendingLines -= lines;
+            mDropped      += lines;
+            mPending.removeFirst();
+        }
+    };
+
     void run() override
     {
         if(!mRcciClient)
             return;
 
-        mRunning = true;
         while(mRunning)
         {
             std::string logStr;
-            if(mRcciClient->logReadData(logStr) > 0)
+
+            int retVal = mRcciClient->logWaitData(cWaitMs);
+            if(retVal > 0)
             {
-                // TODO: Remove the stupid new-line after each message for QPlainTextEdit
-                emit newLogText(QString::fromStdString(logStr));
+                retVal = mRcciClient->logReadData(logStr);
+            }
+            if(retVal < 0)
+            {
+                // not registered anymore or socket error, do not spin
+                msleep(cErrorWaitMs);
+                continue;
+            }
+            if(!logStr.empty())
+            {
+                addText(QString::fromStdString(logStr));
             }
         }
     };
 
 
 private:
-    bool        mRunning;
-    rcciClient *mRcciClient;
+    std::atomic<bool> mRunning;
+    rcciClient       *mRcciClient;
+    int               mMaxLines;
+
+    QMutex            mMutex;        // protects the fields below
+    QStringList       mPending;
+    int               mPendingLines;
+    int               mDropped;
 };
 
 #endif // __RCC_LOG_READ_WIDGET_H
@@ -0,0 +1,222 @@
+#ifndef __RCC_VIDEO_THREAD_H
+#define __RCC_VIDEO_THREAD_H
+
+#include <QWidget>
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QImage>
+#include <QImageReader>
+#include <QBuffer>
+#include <QByteArray>
+#include <QSize>
+#include <QString>
+
+#include <time.h>
+#include <atomic>
+#include <vector>
+
+#include "rcci_client.h"
+#include "rcci_video_rx.h"
+
+QT_USE_NAMESPACE
+
+/*! Receives the unicast video of rcc_daemon (own control connection) and
+  decodes JPEG frames off the GUI thread. Only the newest frame completed
+  in one receive pass is decoded, downscaled while decoding (libjpeg DCT
+  scaling through QImageReader) to the size of the view. Only the newest
+  decoded image is kept for the GUI - frameReady() is emitted when there
+  was none waiting, takeFrame() gets it.
+*/
+class rccVideoThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    typedef struct rcc_video_info_s {
+        uint32_t seq;
+        bool     hasCapture;  // captureUs valid (v2 stream)
+        uint64_t captureUs;   // car CLOCK_MONOTONIC [us]
+        int      decodeUs;
+        int      skipped;     // frames not shown since the previous one
+    } rcc_video_info_t;
+
+    static const int cWaitMs = 100;   // mRunning is checked this often
+
+    rccVideoThread(QWidget *parent, const QString &hostname, int port)
+        : QThread(parent), mRunning(true), mHostname(hostname), mPort(port),
+          mClockSynced(false), mClockOffset(0), mFramePosted(false)
+    {
+    }
+
+    //! thread exits within cWaitMs, wait() for it
+    void setRunningFalse() { mRunning = false; };
+
+    //! Decoded frames are scaled down to fit (invalid size - not scaled)
+    void setTargetSize(const QSize &size)
+    {
+        QMutexLocker lock(&mMutex);
+        mTargetSize = size;
+    };
+
+    bool takeFrame(QImage &image, rcc_video_info_t &info)
+    {
+        QMutexLocker lock(&mMutex);
+
+        mFramePosted = false;
+        if(mFrame.isNull())
+        {
+            return false;
+        }
+        image = mFrame;
+        info  = mFrameInfo;
+        mFrame = QImage();
+
+        return true;
+    };
+
+    // server CLOCK_MONOTONIC = local + offset [us], false if not known
+    bool clockOffset(int64_t &offset)
+    {
+        offset = mClockOffset;
+        return mClockSynced;
+    };
+
+    static uint64_t monotonicUs(void)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    };
+
+signals:
+    void frameReady(void);
+    void videoError(const QString &text);
+
+private:
+    void run() override
+    {
+        rcciClient  client;
+        rcciVideoRx videoRx;
+        std::vector<uint8_t> jpeg;
+        rcciVideoRx::rcci_video_frame_t jpegInfo;
+        int received = 0;
+        int skipped  = 0;
+
+        if((client.connect(mHostname.toStdString(), mPort) < 0) ||
+           (videoRx.attachSocket(client.videoConnect()) < 0))
+        {
+            emit videoError(QString("Can not connect to video service of "
+                                    "%1:%2").arg(mHostname).arg(mPort));
+            return;
+        }
+        if(client.syncClock() >= 0)
+        {
+            mClockOffset = client.serverClockOffset();
+            mClockSynced = true;
+        }
+
+        // latest frame wins - older ones of the same pass are not decoded
+        videoRx.setFrameCb(
+            [&](const uint8_t *data, size_t size,
+                const rcciVideoRx::rcci_video_frame_t &info)
+            {
+                jpeg.assign(data, data + size);
+                jpegInfo = info;
+                received++;
+            });
+
+        while(mRunning)
+        {
+            if(videoRx.receive(cWaitMs) < 0)
+            {
+                emit videoError(QString("Video receiving failed"));
+                break;
+            }
+            if(received > 0)
+            {
+                skipped += received - 1;
+                received = 0;
+                decode(jpeg, jpegInfo, skipped);
+            }
+        }
+
+        client.videoDisconnect();
+        client.disconnect();
+    };
+
+    // skipped - frames not decoded so far, handed over with the image
+    void decode(const std::vector<uint8_t> &jpeg,
+                const rcciVideoRx::rcci_video_frame_t &frameInfo, int &skipped)
+    {
+        rcc_video_info_t info;
+        QSize target;
+        uint64_t startUs = monotonicUs();
+
+        {
+            QMutexLocker lock(&mMutex);
+            target = mTargetSize;
+        }
+
+        QByteArray bytes = QByteArray::fromRawData((const char *)jpeg.data(),
+                                                   jpeg.size());
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader reader(&buffer, "jpeg");
+
+        // JPEG handler scales by 1/2, 1/4, 1/8 in DCT, less to decode
+        QSize size = reader.size();
+        if(size.isValid() && target.isValid() &&
+           ((size.width() > target.width()) ||
+            (size.height() > target.height())))
+        {
+            reader.setScaledSize(size.scaled(target, Qt::KeepAspectRatio));
+        }
+
+        QImage image = reader.read();
+        if(image.isNull())
+        {
+            skipped++;
+            return;
+        }
+
+        info.seq        = frameInfo.seq;
+        info.hasCapture = (frameInfo.flags & rcci_vframe_flag_capture) != 0;
+        info.captureUs  = frameInfo.captureUs;
+        info.decodeUs   = monotonicUs() - startUs;
+
+        {
+            QMutexLocker lock(&mMutex);
+            if(!mFrame.isNull())
+            {
+                // GUI did not take the previous one
+                skipped += mFrameInfo.skipped + 1;
+            }
+            info.skipped = skipped;
+            skipped      = 0;
+            mFrame       = image;
+            mFrameInfo   = info;
+            if(mFramePosted)
+            {
+                return;
+            }
+            mFramePosted = true;
+        }
+        emit frameReady();
+    };
+
+private:
+    std::atomic<bool>    mRunning;
+    QString              mHostname;
+    int                  mPort;
+    std::atomic<bool>    mClockSynced;
+    std::atomic<int64_t> mClockOffset;
+
+    QMutex               mMutex;        // protects the fields below
+    QSize                mTargetSize;
+    bool                 mFramePosted;  // frameReady() not handled yet
+    QImage               mFrame;
+    rcc_video_info_t     mFrameInfo;
+};
+
+#endif // __RCC_VIDEO_THREAD_H
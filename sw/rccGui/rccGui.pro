@@ -94,9 +94,18 @@ OBJECTS_DIR = $${DESTDIR}/obj/
 RESOURCES = rccGui.qrc
 
 # Application
-SOURCES += src/main.cpp src/mainwindow.cpp src/rccCtrlWidget.cpp src/rccConnWidget.cpp ../interface/rcci_client.cpp src/rccDrvWidget.cpp src/rccCamWidget.cpp
+SOURCES += src/main.cpp src/mainwindow.cpp src/rccCtrlWidget.cpp src/rccConnWidget.cpp ../interface/rcci_client.cpp ../interface/rcci_crc.cpp src/rccDrvWidget.cpp src/rccCamWidget.cpp
 
-HEADERS += include/mainwindow.h include/rccConnWidget.h include/rccCtrlWidget.h ../interface/rcci_client.h ../interface/rcci_type.h include/rccLogReadThread.h include/rccDrvWidget.h include/rccCamWidget.h
+HEADERS += include/mainwindow.h include/rccConnWidget.h include/rccCtrlWidget.h ../interface/rcci_client.h ../interface/rcci_type.h ../interface/rcci_crc.h include/rccLogReadThread.h include/rccDrvWidget.h include/rccCamWidget.h
+
+# Camera view - the video receiver uses recvmmsg() & poll(), other builds
+# get an empty camera tab
+linux|android {
+   DEFINES += RCC_GUI_VIDEO
+
+   SOURCES += ../interface/rcci_fec.cpp ../interface/rcci_video_rx.cpp
+   HEADERS += ../interface/rcci_fec.h ../interface/rcci_video_rx.h include/rccVideoThread.h
+}
 
 FORMS   += ui/mainwindow.ui
 
@@ -30,6 +30,11 @@ MainWindow::MainWindow(QWidget *parent) :
     // mCtrlWidget->mDrvWidget
     connect(mCtrlWidget, SIGNAL(driveRegistered(bool)),
             mDrvWidget, SLOT(driveRegistered(bool)));
+    // mCtrlWidget->mCamWidget
+    connect(mCtrlWidget, SIGNAL(rccConnected(QString, int)),
+            mCamWidget, SLOT(videoConnect(QString, int)));
+    connect(mCtrlWidget, SIGNAL(rccDisconnected()),
+            mCamWidget, SLOT(videoDisconnect()));
 
     mTabWidget->addTab(mCtrlWidget, tr("Ctrl"));
     mTabWidget->addTab(mDrvWidget, tr("Drv"));
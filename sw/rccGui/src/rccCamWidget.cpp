@@ -0,0 +1,165 @@
+#include <QWidget>
+#include <QPixmap>
+
+#include <algorithm>
+
+#include "rccCamWidget.h"
+#include "helperMacros.h"
+
+// fps & latency are shown for this period
+static const int cStatsPeriodMs(1000);
+
+rccCamWidget::rccCamWidget(QWidget *parent)
+    : QWidget(parent), mMainLayout(NULL), mImageLabel(NULL),
+      mStatsLabel(NULL)
+#ifdef RCC_GUI_VIDEO
+    , mVideoThread(NULL)
+#endif
+{
+    mMainLayout = new QGridLayout;
+    setLayout(mMainLayout);
+
+    mImageLabel = new QLabel();
+    mImageLabel->setAlignment(Qt::AlignCenter);
+    mImageLabel->setMinimumSize(160, 120);
+    // size follows the window, not the frames
+    mImageLabel->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
+#ifdef RCC_GUI_VIDEO
+    mImageLabel->setText(tr("Not connected"));
+#else
+    mImageLabel->setText(tr("Camera view is available in Linux and "
+                            "Android builds only"));
+#endif
+
+    mStatsLabel = new QLabel();
+
+    mMainLayout->addWidget(mImageLabel, 0, 0, 5, 4);
+    mMainLayout->addWidget(mStatsLabel, 5, 0, 1, 4);
+
+    resetStats();
+}
+
+rccCamWidget::~rccCamWidget()
+{
+    videoDisconnect();
+    DEL_WIDGET(mStatsLabel);
+    DEL_WIDGET(mImageLabel);
+}
+
+#ifdef RCC_GUI_VIDEO
+void rccCamWidget::videoConnect(const QString &hostname, int port)
+{
+    videoDisconnect();
+
+    mImageLabel->setText(tr("Waiting for video..."));
+    resetStats();
+
+    mVideoThread = new rccVideoThread(this, hostname, port);
+    mVideoThread->setTargetSize(mImageLabel->size());
+    // queued - emitted from the video thread
+    connect(mVideoThread, SIGNAL(frameReady()), this, SLOT(frameReady()),
+            Qt::QueuedConnection);
+    connect(mVideoThread, SIGNAL(videoError(QString)),
+            this, SLOT(videoError(QString)), Qt::QueuedConnection);
+    mVideoThread->start();
+}
+
+void rccCamWidget::videoDisconnect(void)
+{
+    if(mVideoThread)
+    {
+        mVideoThread->setRunningFalse();
+        mVideoThread->wait();
+        DEL_WIDGET(mVideoThread);
+    }
+    mImageLabel->clear();
+    mImageLabel->setText(tr("Not connected"));
+    mStatsLabel->clear();
+}
+
+void rccCamWidget::frameReady(void)
+{
+    QImage image;
+    rccVideoThread::rcc_video_info_t info;
+    int64_t offset;
+
+    if(!mVideoThread || !mVideoThread->takeFrame(image, info))
+    {
+        return;
+    }
+
+    mImageLabel->setPixmap(QPixmap::fromImage(image));
+
+    mFrames++;
+    mSkipped     += info.skipped;
+    mDecodeSumUs += info.decodeUs;
+    if(info.hasCapture && mVideoThread->clockOffset(offset))
+    {
+        // capture on the car to shown here, both on the car clock
+        int64_t lat = (int64_t)rccVideoThread::monotonicUs() + offset -
+            (int64_t)info.captureUs;
+        mLatSumUs += lat;
+        mLatMaxUs  = std::max(mLatMaxUs, lat);
+        mLatCount++;
+    }
+
+    qint64 elapsed = mStatsTimer.elapsed();
+    if(elapsed < cStatsPeriodMs)
+    {
+        return;
+    }
+
+    QString stats = QString("%1 fps, decode %2 ms")
+        .arg(mFrames * 1000.0 / elapsed, 0, 'f', 1)
+        .arg(mDecodeSumUs / 1000.0 / mFrames, 0, 'f', 1);
+    if(mLatCount > 0)
+    {
+        stats += QString(", latency %1 ms (max %2 ms)")
+            .arg(mLatSumUs / 1000.0 / mLatCount, 0, 'f', 1)
+            .arg(mLatMaxUs / 1000.0, 0, 'f', 1);
+    }
+    if(mSkipped > 0)
+    {
+        stats += QString(", %1 frames skipped").arg(mSkipped);
+    }
+    mStatsLabel->setText(stats);
+
+    resetStats();
+}
+
+void rccCamWidget::videoError(const QString &text)
+{
+    mImageLabel->clear();
+    mImageLabel->setText(text);
+}
+
+void rccCamWidget::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    if(mVideoThread)
+    {
+        mVideoThread->setTargetSize(mImageLabel->size());
+    }
+}
+#else
+// No video receiver in this build - the tab only shows the note
+void rccCamWidget::videoConnect(const QString &, int) {}
+void rccCamWidget::videoDisconnect(void) {}
+void rccCamWidget::frameReady(void) {}
+void rccCamWidget::videoError(const QString &) {}
+void rccCamWidget::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+}
+#endif
+
+void rccCamWidget::resetStats(void)
+{
+    mStatsTimer.start();
+    mFrames      = 0;
+    mSkipped     = 0;
+    mLatSumUs    = 0;
+    mLatMaxUs    = 0;
+    mLatCount    = 0;
+    mDecodeSumUs = 0;
+}
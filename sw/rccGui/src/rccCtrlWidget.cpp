@@ -6,9 +6,15 @@
 #include "rccCtrlWidget.h"
 #include "helperMacros.h"
 
+// lines kept in the log view, older ones are removed by the widget
+static const int cLogMaxBlocks(5000);
+// log view refresh period (~30 per second), text is inserted in one go
+static const int cLogRefreshMs(33);
+
 rccCtrlWidget::rccCtrlWidget(QWidget *parent)
     : QWidget(parent), mTimer(NULL), mRcciClient(NULL), mDriveRegistered(false),
-      mLogText(NULL), mLogReadThread(NULL)
+      mLogText(NULL), mLogDropped(NULL), mLogTimer(NULL), mLogDroppedTotal(0),
+      mLogReadThread(NULL)
 {
     mMainLayout = new QGridLayout;
     setLayout(mMainLayout);
@@ -17,14 +23,21 @@ rccCtrlWidget::rccCtrlWidget(QWidget *parent)
 
     mLogText = new QPlainTextEdit();
     mLogText->setReadOnly(true);
+    mLogText->setMaximumBlockCount(cLogMaxBlocks);
+
+    mLogDropped = new QLabel();
+    mLogDropped->hide();
 
     mMainLayout->addWidget(mRccConnWidget, 0, 0, 1, 4);
     mMainLayout->addWidget(mLogText, 1, 0, 5, 4);
+    mMainLayout->addWidget(mLogDropped, 6, 0, 1, 4);
+
+    mLogTimer = new QTimer(this);
+    mLogTimer->setInterval(cLogRefreshMs);
 
     connect(mRccConnWidget, SIGNAL(rccConnect(QString)),
             this, SLOT(connRequest(QString)));
-    connect(this, SIGNAL(addLogText(QString)),
-            mLogText, SLOT(appendPlainText(QString)));
+    connect(mLogTimer, SIGNAL(timeout()), this, SLOT(logTimerTimeout()));
 
     mRcciClient = new rcciClient();
 }
@@ -33,13 +46,7 @@ rccCtrlWidget::~rccCtrlWidget()
 {
     emit driveRegistered(false);
     mDriveRegistered = false;
-    if(mLogReadThread)
-    {
-        mLogReadThread->setRunningFalse();
-        mLogReadThread->terminate();
-        mLogReadThread->wait();
-        DEL_WIDGET(mLogReadThread);
-    }
+    stopLogReading();
     if(mRcciClient)
     {
         mRcciClient->drvDisconnect();
@@ -49,6 +56,8 @@ rccCtrlWidget::~rccCtrlWidget()
     }
     DEL_WIDGET(mRccConnWidget);
     DEL_WIDGET(mTimer);
+    DEL_WIDGET(mLogTimer);
+    DEL_WIDGET(mLogDropped);
     DEL_WIDGET(mLogText);
 }
 
@@ -58,16 +67,15 @@ void rccCtrlWidget::connRequest(QString uri)
     {
         // TODO: Add this also to the destructor (separate file to cleanup)?
         // we assume we want to disconnect?
-        mRcciClient->drvDisconnect();
-        mRcciClient->logDisconnect();
         qDebug() << QString("Disconnecting from %1").arg(uri);
 
-        mLogReadThread->setRunningFalse();
-        mLogReadThread->terminate();
-        mLogReadThread->wait();
-        DEL_WIDGET(mLogReadThread);
+        // reading thread uses the log socket
+        stopLogReading();
+        mRcciClient->drvDisconnect();
+        mRcciClient->logDisconnect();
         mRcciClient->disconnect();
         mRccConnWidget->connected(false);
+        emit rccDisconnected();
         return;
     }
     QStringList uriList = uri.split(":");
@@ -98,22 +106,23 @@ void rccCtrlWidget::connRequest(QString uri)
     }
 
     mLogText->clear();
+    mLogDroppedTotal = 0;
+    mLogDropped->hide();
 
-    // start reading thread and push strings to text fields
-    emit addLogText(QString::fromStdString(logStr));
+    // log history first, then new entries collected by the reading thread
+    appendLog(QString::fromStdString(logStr), 0);
 
-    // start new thread class to read new log entries and connect them
-    // to our log text widget
     if(!mLogReadThread)
     {
-        mLogReadThread = new rccLogReadThread(this, mRcciClient);
-        connect(mLogReadThread, SIGNAL(newLogText(const QString &)),
-                mLogText, SLOT(appendPlainText(QString)));
+        mLogReadThread = new rccLogReadThread(this, mRcciClient,
+                                              cLogMaxBlocks);
         mLogReadThread->start();
     }
+    mLogTimer->start();
 
     qDebug() << QString("Connected to %1").arg(uri);
     mRccConnWidget->connected(true);
+    emit rccConnected(hostname, std::atoi(port.toStdString().c_str()));
 }
 
 void rccCtrlWidget::driveRegister(bool aDrvReg)
@@ -156,3 +165,51 @@ void rccCtrlWidget::driveDataUpdate(int32_t drive, int32_t steer)
     }
 }
 
+void rccCtrlWidget::logTimerTimeout(void)
+{
+    QString text;
+    int dropped;
+
+    if(mLogReadThread && mLogReadThread->takeText(text, dropped))
+    {
+        appendLog(text, dropped);
+    }
+}
+
+// One insert for all text collected since the last refresh
+void rccCtrlWidget::appendLog(QString text, int dropped)
+{
+    if(dropped > 0)
+    {
+        // GUI did not keep up, the oldest lines were not shown
+        mLogDroppedTotal += dropped;
+        text.prepend(QString("<=== %1 log lines dropped ===>\n").arg(dropped));
+        mLogDropped->setText(QString("Log lines dropped: %1")
+                             .arg(mLogDroppedTotal));
+        mLogDropped->show();
+    }
+
+    // every log message ends with new line, appendPlainText() adds one
+    if(text.endsWith('\n'))
+    {
+        text.chop(1);
+    }
+    if(!text.isEmpty())
+    {
+        mLogText->appendPlainText(text);
+    }
+}
+
+void rccCtrlWidget::stopLogReading(void)
+{
+    if(mLogTimer)
+    {
+        mLogTimer->stop();
+    }
+    if(mLogReadThread)
+    {
+        mLogReadThread->setRunningFalse();
+        mLogReadThread->wait();
+        DEL_WIDGET(mLogReadThread);
+    }
+}
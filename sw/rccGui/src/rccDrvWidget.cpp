@@ -7,8 +7,25 @@
 #include "helperMacros.h"
 #include "rcci_type.h"
 
+#include <cmath>
+#include <algorithm>
+
+// commands are sent on multiples of the PWM period of the car (see
+// rccSysCtrl), more often has no effect on the output
+static const int cPwmPeriodUs(16600);
+static const int cDefaultSendPeriods(2);  // ~30 commands/s
+static const int cMaxSendPeriods(12);
+// unchanged command is repeated this often, well within the drive
+// watchdog timeout of rcc_daemon (250 ms)
+static const int cHeartbeatUs(100000);
+// time constant of the sensor low-pass filter
+static const double cFilterTauUs(50000.0);
+
 rccDrvWidget::rccDrvWidget(QWidget *parent)
-    : QWidget(parent), mDriveRegistered(false), mDriveSensor(NULL)
+    : QWidget(parent), mDriveRegistered(false), mDriveSensor(NULL),
+      mSendTimer(NULL), mSendPeriods(cDefaultSendPeriods), mNextSendUs(0),
+      mLastSendUs(0), mLastReadingUs(-1), mFiltDrive(0), mFiltSteer(0),
+      mSentDrive(0), mSentSteer(0)
 {
     mMainLayout = new QGridLayout;
     setLayout(mMainLayout);
@@ -26,8 +43,8 @@ rccDrvWidget::rccDrvWidget(QWidget *parent)
             this, SLOT(cbDriveEnableChanged(int)));
 
     mGbSensorGroup = new QGroupBox(this);
-//    connect(mGbSensorGroup, SIGNAL(toggled(bool)),
-//            this, SLOT(gbSensorEnableChanged(bool)));
+    connect(mGbSensorGroup, SIGNAL(toggled(bool)),
+            this, SLOT(gbSensorEnableChanged(bool)));
 
     if(mDriveSensor && mDriveSensor->connectToBackend())
     {
@@ -42,8 +59,23 @@ rccDrvWidget::rccDrvWidget(QWidget *parent)
     mGbSensorGroup->setChecked(false);
     mGbSensorGroup->setEnabled(false);
 
+    mSbSendPeriods = new QSpinBox(this);
+    mSbSendPeriods->setRange(1, cMaxSendPeriods);
+    mSbSendPeriods->setValue(cDefaultSendPeriods);
+    mSbSendPeriods->setPrefix(tr("Send every "));
+    mSbSendPeriods->setSuffix(tr(" PWM period(s) (16.6 ms)"));
+    connect(mSbSendPeriods, SIGNAL(valueChanged(int)),
+            this, SLOT(sendPeriodsChanged(int)));
+
     mMainLayout->addWidget(mCbDriveEnable);
     mMainLayout->addWidget(mGbSensorGroup);
+    mMainLayout->addWidget(mSbSendPeriods);
+
+    mSendTimer = new QTimer(this);
+    mSendTimer->setSingleShot(true);
+    mSendTimer->setTimerType(Qt::PreciseTimer);
+    connect(mSendTimer, SIGNAL(timeout()), this, SLOT(sendTimerTimeout()));
+    mClock.start();
 
     // this only requests drive control - the controller responds
     // with another signal that shows if it's indeed registered or
@@ -56,8 +88,10 @@ rccDrvWidget::~rccDrvWidget()
     emit driveRegister(false);
     mDriveSensor->stop();
     mDriveRegistered = false;
+    DEL_WIDGET(mSendTimer);
     DEL_WIDGET(mDriveSensor);
 
+    DEL_WIDGET(mSbSendPeriods);
     DEL_WIDGET(mGbSensorGroup);
     DEL_WIDGET(mCbDriveEnable);
 }
@@ -67,16 +101,91 @@ void rccDrvWidget::driveReadingChanged(void)
     if(mDriveSensor)
     {
         const qreal maxValue = 10.0; // TODO: Check, make it programable?
-        qreal x = mDriveSensor->reading()->value(0).value<qreal>();
         qreal y = mDriveSensor->reading()->value(1).value<qreal>();
         qreal z = mDriveSensor->reading()->value(2).value<qreal>();
 
-        qDebug() << "Sensor reading x=" << x << " y=" << y << " z=" << z;
         // If horizontal we take 'y' and 'z' and normalize it to int32
-        int32_t drive = static_cast<int32_t>((z * rcci_msg_drv_max_param) / maxValue);
-        int32_t steer = static_cast<int32_t>((y * rcci_msg_drv_max_param) / maxValue);
+        double drive = (z * rcci_msg_drv_max_param) / maxValue;
+        double steer = (y * rcci_msg_drv_max_param) / maxValue;
+
+        // readings come in bursts or stall - first order low-pass by the
+        // real time between them, sent by sendTimerTimeout()
+        qint64 nowUs = mClock.nsecsElapsed() / 1000;
+        if(mLastReadingUs < 0)
+        {
+            mFiltDrive = drive;
+            mFiltSteer = steer;
+        }
+        else
+        {
+            double alpha = 1.0 - std::exp(-(nowUs - mLastReadingUs) /
+                                          cFilterTauUs);
+            mFiltDrive += alpha * (drive - mFiltDrive);
+            mFiltSteer += alpha * (steer - mFiltSteer);
+        }
+        mLastReadingUs = nowUs;
+    }
+}
+
+// Changed command goes out on the next send slot, unchanged one only as
+// a heartbeat - drvSendData() increments the count of every packet
+void rccDrvWidget::sendTimerTimeout(void)
+{
+    if(!mDriveRegistered)
+    {
+        return;
+    }
+
+    const double maxParam = rcci_msg_drv_max_param;
+    int32_t drive = static_cast<int32_t>(
+        std::lround(std::max(-maxParam, std::min(maxParam, mFiltDrive))));
+    int32_t steer = static_cast<int32_t>(
+        std::lround(std::max(-maxParam, std::min(maxParam, mFiltSteer))));
+    qint64 nowUs = mClock.nsecsElapsed() / 1000;
+
+    // heartbeat on the send slot closest to its due time
+    if((drive != mSentDrive) || (steer != mSentSteer) ||
+       ((nowUs - mLastSendUs) >=
+        (cHeartbeatUs - (mSendPeriods * cPwmPeriodUs) / 2)))
+    {
         emit driveDataUpdated(drive, steer);
+        mSentDrive  = drive;
+        mSentSteer  = steer;
+        mLastSendUs = nowUs;
+    }
+
+    scheduleSend();
+}
+
+void rccDrvWidget::sendPeriodsChanged(int periods)
+{
+    // applies from the next send slot
+    mSendPeriods = periods;
+}
+
+void rccDrvWidget::startSending(void)
+{
+    mNextSendUs = mClock.nsecsElapsed() / 1000;
+    // neutral command right away, the car knows the client is alive
+    mSentDrive  = 0;
+    mSentSteer  = 0;
+    mLastSendUs = mNextSendUs - cHeartbeatUs;
+    sendTimerTimeout();
+}
+
+// Absolute schedule, so timer rounding to ms does not accumulate
+void rccDrvWidget::scheduleSend(void)
+{
+    qint64 periodUs = (qint64)mSendPeriods * cPwmPeriodUs;
+    qint64 nowUs = mClock.nsecsElapsed() / 1000;
+
+    mNextSendUs += periodUs;
+    if(mNextSendUs <= nowUs)
+    {
+        // GUI thread stalled - skip missed slots, do not send a burst
+        mNextSendUs = nowUs + periodUs;
     }
+    mSendTimer->start((int)((mNextSendUs - nowUs + 500) / 1000));
 }
 
 void rccDrvWidget::driveRegistered(bool aDrvReg)
@@ -87,6 +196,10 @@ void rccDrvWidget::driveRegistered(bool aDrvReg)
     mDriveRegistered = aDrvReg;
     if(aDrvReg)
     {
+        if(!mSendTimer->isActive())
+        {
+            startSending();
+        }
         // enable all possible buttons/boxes/..
         mCbDriveEnable->setChecked(Qt::Checked);
         if(mDriveSensor && mDriveSensor->connectToBackend())
@@ -96,6 +209,7 @@ void rccDrvWidget::driveRegistered(bool aDrvReg)
     }
     else
     {
+        mSendTimer->stop();
         mCbDriveEnable->setCheckState(Qt::Unchecked);
         mGbSensorGroup->setEnabled(false);
     }
@@ -128,5 +242,9 @@ void rccDrvWidget::gbSensorEnableChanged(bool on)
     else
     {
         mDriveSensor->stop();
+        // no input anymore - heartbeats keep the car stopped
+        mFiltDrive     = 0;
+        mFiltSteer     = 0;
+        mLastReadingUs = -1;
     }
 }